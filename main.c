@@ -13,8 +13,12 @@
 #include <stdbool.h>
 #include <string.h>
 #include "platform/blink_settings.h"
+#include "platform/pio.h"
 
 #include "platform.h"
+#include "vm.h"
+#include "modbus.h"
+#include "memsvc.h"
 
 /////////////////////////////////////////////////////////////////////////////
 
@@ -28,6 +32,31 @@
  */
 #define HOME_KEY 0x1B    // ASCII for Home key
 #define CTRL_E 0x05     // ASCII for CTRL+E
+#define CTRL_U 0x15     // ASCII for CTRL+U; starts a behaviour program upload
+#define CTRL_P 0x10     // ASCII for CTRL+P (DLE); starts a memory-access session
+#define CTRL_T 0x14     // ASCII for CTRL+T; runs the USART loopback self-test
+
+// If non-zero, run the USART loopback self-test once at boot.
+#if !defined(PROG_BIST_AT_BOOT)
+#define PROG_BIST_AT_BOOT 0
+#endif
+
+/*
+ * Modbus RTU slave address
+ * 
+ * If non-zero, the USART speaks Modbus RTU instead of driving the VT100
+ * console. The data model is:
+ * 
+ * -- Coils 0-4:            Blink setting, one-hot (write 1 to select)
+ * -- Discrete input 0:     On-board button pressed
+ * -- Holding register 0:   Blink setting (0 = OFF ... 4 = ON)
+ * -- Input register 0:     On-board button pressed
+ * -- Input registers 1-5:  Frames, CRC errors, exceptions, frames for this
+ *                          slave, broadcasts
+ */
+#if !defined(PROG_MODBUS_ADDR)
+#define PROG_MODBUS_ADDR 0
+#endif
 
 static const char banner_msg[] =
         "\033[1;1H"
@@ -64,6 +93,10 @@ typedef struct prog_state_type {
     // Flags for this program
 #define PROG_FLAG_BANNER_PENDING	0x0001	// Waiting to transmit the banner
 #define PROG_FLAG_UPDATE_PENDING	0x0002	// Waiting to transmit updates
+#define PROG_FLAG_VM_UPLOAD		0x0004	// Receiving a behaviour program
+#define PROG_FLAG_MEMSVC		0x0008	// In a memory-access session
+#define PROG_FLAG_MEMSVC_RSP		0x0010	// Memory-access response waiting to be sent
+#define PROG_FLAG_BIST			0x0020	// USART self-test requested
 #define PROG_FLAG_GEN_COMPLETE		0x8000	// Message generation has been done, but transmission has not occurred; 32768; 2**15
 
     uint16_t flags;
@@ -81,23 +114,83 @@ typedef struct prog_state_type {
     platform_usart_rx_async_desc_t rx_desc; // Buffer, length, type of completion; if applicable, completion info
     uint16_t rx_desc_blen;
     char rx_desc_buf[16];
+
+    // Screen regions that need redrawing; always drawn from the latest state
+#define PROG_REDRAW_BUTTON		0x0001	// "On-board button" line
+#define PROG_REDRAW_BLINK		0x0002	// "Blink Setting" line
+    uint16_t redraw;
+    bool pb_pressed; // Latest known button state
+    platform_timespec_t ts_redraw; // When the last redraw was sent
+
+    // Redraw statistics
+    uint32_t nr_redraws; // Number of redraw transmissions
+    uint32_t nr_redraw_merged; // Region updates merged into a pending redraw
+    uint32_t nr_redraw_bytes; // Bytes sent for redraws
+
+    // State last drawn on the display; -1 until first drawn
+    int8_t disp_blink;
+    int8_t disp_pb;
+
+    // Behaviour program interpreter
+    vm_t vm;
+    const char *vm_reply; // Upload result message, waiting to be sent
+    /*
+     * Upload frame: 2-byte little-endian length, followed by the image
+     * (see tools/vmasm.py).
+     */
+    uint8_t vm_upload_buf[VM_PROG_MAX + 2];
+
+    // Modbus RTU slave (only if PROG_MODBUS_ADDR is non-zero)
+    modbus_slave_t mb;
+
+    // Memory/register access service
+    memsvc_t memsvc;
+
+    // USART self-test report; one line per rate
+#define PROG_BIST_LINE_MAX	(35 + 10 + 5 + 5 + 10) // Fixed text, then the numbers at their widest
+    char bist_report[2 + PLATFORM_USART_BIST_NR_RATES * PROG_BIST_LINE_MAX];
 } prog_state_t;
 
+/*
+ * Maximum number of status redraws per second
+ * 
+ * Holding down a key produces auto-repeat events much faster than the
+ * terminal needs to be refreshed; updates arriving in between are merged.
+ */
+#define PROG_REDRAW_MAX_HZ	20
+
 /*
  * Initialize the main program state
  * 
  * This style might be familiar to those accustomed to he programming
  * conventions employed by the Arduino platform.
  */
+static void prog_vm_setup(prog_state_t *ps);
+#if PROG_MODBUS_ADDR != 0
+static void prog_modbus_setup(prog_state_t *ps);
+#endif
+
 static void prog_setup(prog_state_t *ps) {
     memset(ps, 0, sizeof (*ps));
+    ps->disp_blink = -1;
+    ps->disp_pb = -1;
 
     platform_init();
 
     ps->rx_desc.buf = ps->rx_desc_buf;
     ps->rx_desc.max_len = sizeof (ps->rx_desc_buf);
 
+#if PROG_BIST_AT_BOOT != 0
+    // The receiver is armed once the self-test is done.
+    ps->flags |= PROG_FLAG_BIST;
+#else
     platform_usart_cdc_rx_async(&ps->rx_desc);
+#endif
+
+    prog_vm_setup(ps);
+#if PROG_MODBUS_ADDR != 0
+    prog_modbus_setup(ps);
+#endif
     return;
 }
 
@@ -114,26 +207,312 @@ const char *blinkSettingStrings[NUM_SETTINGS] = {
 
 static const char CHANGE_MODE[] = "\033[12;1H\033[0K";
 
+static void setBlinkSetting(prog_state_t *ps, BlinkSetting setting) {
+    currentSetting = setting;
+
+    // The line itself is redrawn later, with whatever the setting is then.
+    if ((ps->redraw & PROG_REDRAW_BLINK) != 0)
+        ++ps->nr_redraw_merged;
+    ps->redraw |= PROG_REDRAW_BLINK;
+
+    if (currentSetting == OFF) {
+        pio_clr(0, (1 << 15)); // Turn off LED
+    } else if (currentSetting == ON) {
+        pio_set(0, (1 << 15));
+    } else {
+        platform_blink_modify(); // Start blinking with new setting
+    }
+}
+
 static void updateBlinkSetting(prog_state_t *ps, bool increase) {
     if (increase && currentSetting < ON) {
-        currentSetting++;
+        setBlinkSetting(ps, currentSetting + 1);
     } else if (!increase && currentSetting > OFF) {
-        currentSetting--;
+        setBlinkSetting(ps, currentSetting - 1);
+    } else {
+        setBlinkSetting(ps, currentSetting);
     }
+}
+
+//////////////////////////////////////////////////////////////////////////////
 
-    ps->tx_desc[0].buf = CHANGE_MODE;
-    ps->tx_desc[0].len = sizeof (CHANGE_MODE) - 1;
-    ps->tx_desc[1].buf = blinkSettingStrings[currentSetting];
-    ps->tx_desc[1].len = strlen(blinkSettingStrings[currentSetting]);
+// Hooks for the behaviour program and the Modbus data model
 
-    platform_usart_cdc_tx_async(ps->tx_desc, 2);
+static void prog_hook_set_blink(void *ctx, int16_t val) {
+    prog_state_t *ps = ctx;
 
-    if (currentSetting == OFF) {
-        PORT_SEC_REGS->GROUP[0].PORT_OUTCLR |= (1 << 15); // Turn off LED
-    } else if (currentSetting == ON) {
-        PORT_SEC_REGS->GROUP[0].PORT_OUTSET |= (1 << 15);
-    } else {
-        platform_blink_modify(); // Start blinking with new setting
+    if (val < OFF)
+        val = OFF;
+    else if (val > ON)
+        val = ON;
+    if ((BlinkSetting) val == currentSetting)
+        return;
+
+    // Restart the blink period, as with the arrow keys
+    platform_blink_restart();
+    setBlinkSetting(ps, (BlinkSetting) val);
+}
+
+static int16_t prog_hook_get_blink(void *ctx) {
+    (void) ctx;
+    return currentSetting;
+}
+
+static void prog_vm_setup(prog_state_t *ps) {
+    ps->vm.ops.ctx = ps;
+    ps->vm.ops.set_blink = prog_hook_set_blink;
+    ps->vm.ops.get_blink = prog_hook_get_blink;
+    ps->vm.key = -1;
+
+    // Start whatever program was uploaded last, if any.
+    vm_load_stored(&ps->vm);
+}
+
+static const char VM_MSG_WAIT[] = "\033[14;1H\033[0KProgram: [Waiting]\r\n";
+static const char VM_MSG_OK[] = "\033[14;1H\033[0KProgram: [Loaded]\r\n";
+static const char VM_MSG_ERR[] = "\033[14;1H\033[0KProgram: [Rejected]\r\n";
+
+/*
+ * Switch the receiver over to take a program image
+ * 
+ * NOTE: The idle timeout still applies, so the image must be sent without
+ *       gaps; a truncated image fails its checksum and is rejected.
+ */
+
+static void prog_vm_upload_start(prog_state_t *ps) {
+    ps->rx_desc.buf = (char *) ps->vm_upload_buf;
+    ps->rx_desc.max_len = sizeof (ps->vm_upload_buf);
+    ps->rx_desc.mode = PLATFORM_USART_RX_MODE_LENPFX;
+    ps->rx_desc.len = 2;
+    ps->flags |= PROG_FLAG_VM_UPLOAD;
+    ps->vm_reply = VM_MSG_WAIT;
+}
+
+// Store a received program image, then go back to taking keystrokes
+
+static void prog_vm_upload_done(prog_state_t *ps) {
+    uint16_t len = ps->rx_desc.compl_info.data_len;
+    bool ok = false;
+
+    if ((ps->rx_desc.compl_flags & PLATFORM_USART_RX_FLAG_LEN) != 0 && len > 2)
+        ok = vm_store(&ps->vm, &ps->vm_upload_buf[2], len - 2);
+    ps->vm_reply = ok ? VM_MSG_OK : VM_MSG_ERR;
+
+    ps->rx_desc.buf = ps->rx_desc_buf;
+    ps->rx_desc.max_len = sizeof (ps->rx_desc_buf);
+    ps->rx_desc.mode = PLATFORM_USART_RX_MODE_IDLE;
+    ps->flags &= ~PROG_FLAG_VM_UPLOAD;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+// Modbus RTU data model; see PROG_MODBUS_ADDR
+
+#if PROG_MODBUS_ADDR != 0
+
+static uint8_t prog_modbus_read(void *ctx, uint8_t table, uint16_t addr, uint16_t *val) {
+    prog_state_t *ps = ctx;
+
+    switch (table) {
+        case MODBUS_TABLE_COIL:
+            if (addr > ON)
+                return MODBUS_EX_ILLEGAL_ADDRESS;
+            *val = (currentSetting == addr);
+            return MODBUS_EX_NONE;
+        case MODBUS_TABLE_DISCRETE:
+            if (addr != 0)
+                return MODBUS_EX_ILLEGAL_ADDRESS;
+            *val = ps->pb_pressed;
+            return MODBUS_EX_NONE;
+        case MODBUS_TABLE_HOLDING:
+            if (addr != 0)
+                return MODBUS_EX_ILLEGAL_ADDRESS;
+            *val = currentSetting;
+            return MODBUS_EX_NONE;
+        case MODBUS_TABLE_INPUT:
+            switch (addr) {
+                case 0: *val = ps->pb_pressed; break;
+                case 1: *val = ps->mb.stats.nr_frames; break;
+                case 2: *val = ps->mb.stats.nr_crc_err; break;
+                case 3: *val = ps->mb.stats.nr_exceptions; break;
+                case 4: *val = ps->mb.stats.nr_slave_msgs; break;
+                case 5: *val = ps->mb.stats.nr_no_resp; break;
+                default: return MODBUS_EX_ILLEGAL_ADDRESS;
+            }
+            return MODBUS_EX_NONE;
+        default:
+            return MODBUS_EX_ILLEGAL_ADDRESS;
+    }
+}
+
+static uint8_t prog_modbus_write(void *ctx, uint8_t table, uint16_t addr, uint16_t val) {
+    switch (table) {
+        case MODBUS_TABLE_COIL:
+            if (addr > ON)
+                return MODBUS_EX_ILLEGAL_ADDRESS;
+            // Writing 0 to a coil does not select anything else.
+            if (val)
+                prog_hook_set_blink(ctx, addr);
+            return MODBUS_EX_NONE;
+        case MODBUS_TABLE_HOLDING:
+            if (addr != 0)
+                return MODBUS_EX_ILLEGAL_ADDRESS;
+            if (val > ON)
+                return MODBUS_EX_ILLEGAL_VALUE;
+            prog_hook_set_blink(ctx, val);
+            return MODBUS_EX_NONE;
+        default:
+            return MODBUS_EX_ILLEGAL_ADDRESS;
+    }
+}
+
+static void prog_modbus_setup(prog_state_t *ps) {
+    modbus_map_t map = {ps, prog_modbus_read, prog_modbus_write};
+
+    modbus_init(&ps->mb, PROG_MODBUS_ADDR, &map);
+}
+#endif
+
+//////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Memory-access sessions
+ * 
+ * After CTRL+P, every reception is a length-prefixed memsvc request, served
+ * from the main loop between its other duties; a request with a zero length
+ * ends the session. Console output is held back for the duration so that it
+ * does not get mixed into the responses.
+ */
+
+static void prog_memsvc_start(prog_state_t *ps) {
+    ps->rx_desc.buf = (char *) ps->memsvc.req;
+    ps->rx_desc.max_len = sizeof (ps->memsvc.req);
+    ps->rx_desc.mode = PLATFORM_USART_RX_MODE_LENPFX;
+    ps->rx_desc.len = 2;
+    ps->flags |= PROG_FLAG_MEMSVC;
+
+    // Acknowledge with an empty response.
+    memsvc_handle(&ps->memsvc, 0);
+    ps->flags |= PROG_FLAG_MEMSVC_RSP;
+}
+
+static void prog_memsvc_done(prog_state_t *ps) {
+    uint16_t len = ps->rx_desc.compl_info.data_len;
+
+    if ((ps->rx_desc.compl_flags & PLATFORM_USART_RX_FLAG_LEN) == 0) {
+        // Truncated or oversized request; drop it.
+        return;
+    } else if (len == 2) {
+        // End of session
+        ps->rx_desc.buf = ps->rx_desc_buf;
+        ps->rx_desc.max_len = sizeof (ps->rx_desc_buf);
+        ps->rx_desc.mode = PLATFORM_USART_RX_MODE_IDLE;
+        ps->flags &= ~PROG_FLAG_MEMSVC;
+        return;
+    }
+
+    memsvc_handle(&ps->memsvc, len - 2);
+    ps->flags |= PROG_FLAG_MEMSVC_RSP;
+}
+
+static void prog_memsvc_output(prog_state_t *ps) {
+    if ((ps->flags & PROG_FLAG_MEMSVC_RSP) == 0 || platform_usart_cdc_tx_busy())
+        return;
+
+    ps->tx_desc[0].buf = (const char *) ps->memsvc.rsp;
+    ps->tx_desc[0].len = ps->memsvc.rsp_len;
+    if (platform_usart_cdc_tx_async(&ps->tx_desc[0], 1))
+        ps->flags &= ~PROG_FLAG_MEMSVC_RSP;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+// Append the decimal representation of a number; return the new end.
+
+static char *prog_fmt_u32(char *p, uint32_t val) {
+    char tmp[10];
+    unsigned int n = 0;
+
+    do {
+        tmp[n++] = '0' + (val % 10);
+        val /= 10;
+    } while (val != 0);
+    while (n > 0)
+        *p++ = tmp[--n];
+    return p;
+}
+
+static char *prog_fmt_str(char *p, const char *s) {
+    while (*s != '\0')
+        *p++ = *s++;
+    return p;
+}
+
+/*
+ * Run the USART self-test and report, e.g.
+ * 
+ *   BIST 57600: 64 bytes back, 0 errors, 5236 B/s
+ * 
+ * This waits for the link to be idle, as the test takes over the USART;
+ * the receiver is re-armed afterwards.
+ */
+static void prog_bist_run(prog_state_t *ps) {
+    platform_usart_bist_result_t res[PLATFORM_USART_BIST_NR_RATES];
+    unsigned int n, x;
+    char *p = ps->bist_report;
+
+    if ((ps->flags & PROG_FLAG_BIST) == 0 || platform_usart_cdc_tx_busy())
+        return;
+
+    _Static_assert(sizeof ("BIST " ": " " bytes back, " " errors, " " B/s\r\n") - 1 == 35,
+            "PROG_BIST_LINE_MAX must cover the fixed text of a line");
+
+    n = platform_usart_cdc_bist(res, sizeof (res) / sizeof (res[0]));
+    p = prog_fmt_str(p, "\r\n");
+    for (x = 0; x < n; ++x) {
+        p = prog_fmt_str(p, "BIST ");
+        p = prog_fmt_u32(p, res[x].baud);
+        p = prog_fmt_str(p, ": ");
+        p = prog_fmt_u32(p, res[x].nr_bytes);
+        p = prog_fmt_str(p, " bytes back, ");
+        p = prog_fmt_u32(p, res[x].nr_err);
+        p = prog_fmt_str(p, " errors, ");
+        p = prog_fmt_u32(p, res[x].bytes_per_sec);
+        p = prog_fmt_str(p, " B/s\r\n");
+    }
+
+    ps->tx_desc[0].buf = ps->bist_report;
+    ps->tx_desc[0].len = p - ps->bist_report;
+    platform_usart_cdc_tx_async(&ps->tx_desc[0], 1);
+    ps->flags &= ~PROG_FLAG_BIST;
+
+    ps->rx_desc.compl_type = PLATFORM_USART_RX_COMPL_NONE;
+    platform_usart_cdc_rx_async(&ps->rx_desc);
+}
+
+/*
+ * Send the upload result or program output, if any
+ * 
+ * Status redraws take precedence; this only uses an otherwise-idle link.
+ */
+static void prog_vm_output(prog_state_t *ps) {
+    if (ps->redraw != 0 || platform_usart_cdc_tx_busy() ||
+            (ps->flags & PROG_FLAG_MEMSVC) != 0)
+        return;
+
+    if (ps->vm_reply != NULL) {
+        ps->tx_desc[0].buf = ps->vm_reply;
+        ps->tx_desc[0].len = strlen(ps->vm_reply);
+        if (platform_usart_cdc_tx_async(&ps->tx_desc[0], 1))
+            ps->vm_reply = NULL;
+    } else if (ps->vm.nr_out > 0) {
+        // Copy out, so that the program can keep writing while this is sent.
+        memcpy(ps->tx_buf, ps->vm.out, ps->vm.nr_out);
+        ps->tx_blen = ps->vm.nr_out;
+        ps->tx_desc[0].buf = ps->tx_buf;
+        ps->tx_desc[0].len = ps->tx_blen;
+        if (platform_usart_cdc_tx_async(&ps->tx_desc[0], 1))
+            ps->vm.nr_out = 0;
     }
 }
 
@@ -150,12 +529,103 @@ static const char BUTTON_PRESSED[] = "On-board button: [Pressed] ";
 static const char BUTTON_RELEASED[] = "On-board button: [Released]";
 static char current_banner[sizeof (banner_msg)];
 
+/*
+ * Send one transmission covering all regions pending redraw
+ * 
+ * This is only done once the link is idle and, to bound the refresh rate,
+ * no sooner than 1/PROG_REDRAW_MAX_HZ after the previous redraw.
+ */
+static void prog_redraw(prog_state_t *ps) {
+    platform_timespec_t now, delta;
+    static const platform_timespec_t ts_min = {0, 1000000000 / PROG_REDRAW_MAX_HZ};
+    unsigned int n = 0, x;
+
+    if (ps->redraw == 0 || platform_usart_cdc_tx_busy() ||
+            (ps->flags & PROG_FLAG_MEMSVC) != 0)
+        return;
+
+    platform_tick_count(&now);
+    platform_tick_delta(&delta, &now, &ps->ts_redraw);
+    if (ps->nr_redraws > 0 && platform_timespec_compare(&delta, &ts_min) < 0)
+        return;
+
+    if ((ps->redraw & PROG_REDRAW_BUTTON) != 0) {
+        ps->tx_desc[n].buf = ESC_SEQ_BUTTON_POS;
+        ps->tx_desc[n++].len = sizeof (ESC_SEQ_BUTTON_POS) - 1;
+        if (ps->pb_pressed) {
+            ps->tx_desc[n].buf = BUTTON_PRESSED;
+            ps->tx_desc[n++].len = sizeof (BUTTON_PRESSED) - 1;
+        } else {
+            ps->tx_desc[n].buf = BUTTON_RELEASED;
+            ps->tx_desc[n++].len = sizeof (BUTTON_RELEASED) - 1;
+        }
+    }
+    if ((ps->redraw & PROG_REDRAW_BLINK) != 0) {
+        ps->tx_desc[n].buf = CHANGE_MODE;
+        ps->tx_desc[n++].len = sizeof (CHANGE_MODE) - 1;
+        ps->tx_desc[n].buf = blinkSettingStrings[currentSetting];
+        ps->tx_desc[n++].len = strlen(blinkSettingStrings[currentSetting]);
+    }
+
+    if (platform_usart_cdc_tx_async(&ps->tx_desc[0], n)) {
+        for (x = 0; x < n; ++x)
+            ps->nr_redraw_bytes += ps->tx_desc[x].len;
+        ++ps->nr_redraws;
+        ps->redraw = 0;
+        ps->ts_redraw = now;
+    }
+    return;
+}
+
+/*
+ * Show the blink setting and button state on the display
+ * 
+ * Only the framebuffer is drawn into here; the display driver sends the
+ * changed cells to the panel on its own.
+ */
+static const char *const dispBlinkNames[NUM_SETTINGS] = {
+    "OFF   ", "SLOW  ", "MEDIUM", "FAST  ", "ON    "
+};
+
+static void prog_disp(prog_state_t *ps) {
+    unsigned int x;
+
+    if (ps->disp_blink != (int8_t) currentSetting) {
+        if (ps->disp_blink < 0)
+            platform_disp_text(0, 0, "EEE 158", PLATFORM_DISP_WHITE, PLATFORM_DISP_BLACK);
+        x = platform_disp_text(0, 16, "Blink:  ", PLATFORM_DISP_WHITE, PLATFORM_DISP_BLACK);
+        platform_disp_text(x, 16, dispBlinkNames[currentSetting],
+                PLATFORM_DISP_WHITE, PLATFORM_DISP_BLACK);
+        ps->disp_blink = (int8_t) currentSetting;
+    }
+    if (ps->disp_pb != (int8_t) ps->pb_pressed) {
+        x = platform_disp_text(0, 24, "Button: ", PLATFORM_DISP_WHITE, PLATFORM_DISP_BLACK);
+        platform_disp_text(x, 24, ps->pb_pressed ? "Pressed " : "Released",
+                PLATFORM_DISP_WHITE, PLATFORM_DISP_BLACK);
+        ps->disp_pb = (int8_t) ps->pb_pressed;
+    }
+}
+
 static void prog_loop_one(prog_state_t *ps) {
     uint16_t a = 0, b = 0, c = 0;
 
     // Do one iteration of the platform event loop first.
     platform_do_loop_one();
     platform_blink_modify();
+    prog_disp(ps);
+
+#if PROG_MODBUS_ADDR != 0
+    // The USART belongs to the Modbus slave; there is no console.
+    if ((a = platform_pb_get_event()) != 0) {
+        if ((a & PLATFORM_PB_ONBOARD_PRESS) != 0)
+            ps->pb_pressed = true;
+        else if ((a & PLATFORM_PB_ONBOARD_RELEASE) != 0)
+            ps->pb_pressed = false;
+    }
+    modbus_poll(&ps->mb);
+    return;
+#endif
+
     // Print out the banner
     if (init == 0) {
         ps->tx_desc[0].buf = init_banner_msg;
@@ -165,29 +635,57 @@ static void prog_loop_one(prog_state_t *ps) {
     }
     // Something happened to the pushbutton?
     if ((a = platform_pb_get_event()) != 0) {
+        ps->vm.pb_events |= a;
+        if ((ps->redraw & PROG_REDRAW_BUTTON) != 0)
+            ++ps->nr_redraw_merged;
         if ((a & PLATFORM_PB_ONBOARD_PRESS) != 0) {
-            ps->tx_desc[0].buf = ESC_SEQ_BUTTON_POS;
-            ps->tx_desc[0].len = sizeof (ESC_SEQ_BUTTON_POS) - 1;
-            ps->tx_desc[1].buf = BUTTON_PRESSED;
-            ps->tx_desc[1].len = sizeof (BUTTON_PRESSED) - 1;
-            platform_usart_cdc_tx_async(&ps->tx_desc[0], 2);
+            ps->pb_pressed = true;
+            ps->redraw |= PROG_REDRAW_BUTTON;
         } else if ((a & PLATFORM_PB_ONBOARD_RELEASE) != 0) {
-            ps->tx_desc[0].buf = ESC_SEQ_BUTTON_POS;
-            ps->tx_desc[0].len = sizeof (ESC_SEQ_BUTTON_POS) - 1;
-            ps->tx_desc[1].buf = BUTTON_RELEASED;
-            ps->tx_desc[1].len = sizeof (BUTTON_RELEASED) - 1;
-            platform_usart_cdc_tx_async(&ps->tx_desc[0], 2);
+            ps->pb_pressed = false;
+            ps->redraw |= PROG_REDRAW_BUTTON;
         }
     }
 
     // Something from the UART?
-    if (ps->rx_desc.compl_type == PLATFORM_USART_RX_COMPL_DATA) {
+    if (ps->rx_desc.compl_type == PLATFORM_USART_RX_COMPL_DATA &&
+            (ps->flags & PROG_FLAG_MEMSVC) != 0) {
+        // The previous response must be out before its buffer is reused.
+        if ((ps->flags & PROG_FLAG_MEMSVC_RSP) == 0) {
+            prog_memsvc_done(ps);
+            ps->rx_desc.compl_type = PLATFORM_USART_RX_COMPL_NONE;
+            platform_usart_cdc_rx_async(&ps->rx_desc);
+        }
+    } else if (ps->rx_desc.compl_type == PLATFORM_USART_RX_COMPL_DATA &&
+            (ps->flags & PROG_FLAG_VM_UPLOAD) != 0) {
+        prog_vm_upload_done(ps);
+        ps->rx_desc.compl_type = PLATFORM_USART_RX_COMPL_NONE;
+        platform_usart_cdc_rx_async(&ps->rx_desc);
+    } else if (ps->rx_desc.compl_type == PLATFORM_USART_RX_COMPL_DATA) {
         char received_char = ps->rx_desc_buf[0];
 
-        if (received_char == CTRL_E || (received_char == 0x1B && ps -> rx_desc_buf[2] == 0x48)) {
+        if (received_char == CTRL_U) {
+            prog_vm_upload_start(ps);
+            ps->rx_desc.compl_type = PLATFORM_USART_RX_COMPL_NONE;
+            platform_usart_cdc_rx_async(&ps->rx_desc);
+        } else if (received_char == CTRL_P) {
+            prog_memsvc_start(ps);
+            ps->rx_desc.compl_type = PLATFORM_USART_RX_COMPL_NONE;
+            platform_usart_cdc_rx_async(&ps->rx_desc);
+        } else if (received_char == CTRL_T) {
+            // The receiver stays idle until the self-test has run.
+            ps->flags |= PROG_FLAG_BIST;
+            ps->rx_desc.compl_type = PLATFORM_USART_RX_COMPL_NONE;
+        } else if (received_char == CTRL_E || (received_char == 0x1B && ps -> rx_desc_buf[2] == 0x48)) {
             ps->flags |= PROG_FLAG_BANNER_PENDING;
         } else {
             ps->flags |= PROG_FLAG_UPDATE_PENDING;
+
+            // Arrow keys etc. are passed on as 0x100 + final byte.
+            if (received_char == 0x1B && ps->rx_desc.compl_info.data_len >= 3)
+                ps->vm.key = 0x100 | (uint8_t) ps->rx_desc_buf[2];
+            else
+                ps->vm.key = (uint8_t) received_char;
         }
         ps->rx_desc_blen = ps->rx_desc.compl_info.data_len;
     }
@@ -216,6 +714,7 @@ static void prog_loop_one(prog_state_t *ps) {
 
         if (platform_usart_cdc_tx_async(&ps->tx_desc[0], 1)) {
             ps->flags &= ~(PROG_FLAG_BANNER_PENDING | PROG_FLAG_GEN_COMPLETE);
+            ps->redraw |= PROG_REDRAW_BUTTON | PROG_REDRAW_BLINK;
         }
     } while (0);
 
@@ -224,62 +723,52 @@ static void prog_loop_one(prog_state_t *ps) {
         if ((ps->flags & PROG_FLAG_UPDATE_PENDING) == 0)
             break;
 
-        if (platform_usart_cdc_tx_busy())
-            break;
-
-        if ((ps->flags & PROG_FLAG_GEN_COMPLETE) == 0) {
-            // Message has not been generated.
-
-            // Echo back the received packet as a hex dump.
-            char received_char = ps->rx_desc_buf[0];
-            if (received_char == '\033') {
-                // Escape sequence detected, could be an arrow key
-                if (ps->rx_desc_buf[1] == '[') {
-                    switch (ps->rx_desc_buf[2]) {
-                        case 'D': // Left arrow
-                            TC0_REGS -> COUNT16.TC_COUNT = 0;
-                            updateBlinkSetting(ps, false);
-                            break;
-                        case 'C': // Right arrow
-                            TC0_REGS -> COUNT16.TC_COUNT = 0;
-                            updateBlinkSetting(ps, true);
-                            break;
-                    }
+        /*
+         * Keystrokes are acted on right away, even while the link is busy;
+         * only the redraw is deferred (see prog_redraw()).
+         */
+        char received_char = ps->rx_desc_buf[0];
+        if (received_char == '\033') {
+            // Escape sequence detected, could be an arrow key
+            if (ps->rx_desc_buf[1] == '[') {
+                switch (ps->rx_desc_buf[2]) {
+                    case 'D': // Left arrow
+                        platform_blink_restart();
+                        updateBlinkSetting(ps, false);
+                        break;
+                    case 'C': // Right arrow
+                        platform_blink_restart();
+                        updateBlinkSetting(ps, true);
+                        break;
                 }
-            } else if (received_char == 0x61 || received_char == 0x41) {
-                TC0_REGS -> COUNT16.TC_COUNT = 0;
-                while (TC0_REGS -> COUNT16.TC_SYNCBUSY & (1 << 4));
-                updateBlinkSetting(ps, false);
-            } else if (received_char == 'D' || received_char == 'd') {
-                TC0_REGS -> COUNT16.TC_COUNT = 0;
-                while (TC0_REGS -> COUNT16.TC_SYNCBUSY & (1 << 4));
-                updateBlinkSetting(ps, true);
-            } else {
-                // Handle other inputs as before
-                ps->flags |= PROG_FLAG_UPDATE_PENDING;
-                ps->rx_desc_blen = ps->rx_desc.compl_info.data_len;
-            }
-
-            // Reset receive buffer and wait for completion
-            while (platform_usart_cdc_tx_busy()) {
-                platform_do_loop_one();
             }
+        } else if (received_char == 0x61 || received_char == 0x41) {
+            platform_blink_restart();
+            updateBlinkSetting(ps, false);
+        } else if (received_char == 'D' || received_char == 'd') {
+            platform_blink_restart();
+            updateBlinkSetting(ps, true);
+        }
 
-            ps->rx_desc.compl_type = PLATFORM_USART_RX_COMPL_NONE;
-            platform_usart_cdc_rx_async(&ps->rx_desc);
+        // Re-arm the receiver
+        ps->rx_desc.compl_type = PLATFORM_USART_RX_COMPL_NONE;
+        platform_usart_cdc_rx_async(&ps->rx_desc);
+        ps->rx_desc_blen = 0;
+        ps->flags &= ~PROG_FLAG_UPDATE_PENDING;
+    } while (0);
 
-            ps->flags |= PROG_FLAG_GEN_COMPLETE;
-            ps->rx_desc_blen = 0;
-        }
+    // Self-test, once the link is idle
+    prog_bist_run(ps);
 
-        if (platform_usart_cdc_tx_async(&ps->tx_desc[0], 3)) {
-            ps->rx_desc.compl_type = PLATFORM_USART_RX_COMPL_NONE;
-            platform_usart_cdc_rx_async(&ps->rx_desc);
-            ps->flags &= ~(PROG_FLAG_UPDATE_PENDING | PROG_FLAG_GEN_COMPLETE);
-        }
+    // Redraw any status lines that changed
+    prog_redraw(ps);
 
+    // Memory-access responses; console output is held back meanwhile.
+    prog_memsvc_output(ps);
 
-    } while (0);
+    // Give the behaviour program its slice, then send what it printed.
+    vm_run(&ps->vm, VM_BUDGET);
+    prog_vm_output(ps);
 
     // Done
     return;
@@ -0,0 +1,179 @@
+/**
+ * @file memsvc.c
+ * @brief Memory/register access service
+ */
+
+// Common include for the XC32 compiler
+#include <xc.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "memsvc.h"
+#include "platform.h"
+
+/////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Allow-list
+ * 
+ * Peripheral ranges are limited to those whose registers have no read side
+ * effects worth worrying about; in particular, SERCOM is absent, since
+ * reading DATA would steal received characters from the driver.
+ */
+typedef struct memsvc_range_type {
+    uintptr_t base;
+    uint32_t size;
+    uint8_t flags;
+#define MEMSVC_RANGE_R	0x01
+#define MEMSVC_RANGE_W	0x02
+} memsvc_range_t;
+
+static const memsvc_range_t memsvc_ranges[] = {
+    {HSRAM_ADDR, HSRAM_SIZE, MEMSVC_RANGE_R | MEMSVC_RANGE_W},
+    {FLASH_ADDR, FLASH_SIZE, MEMSVC_RANGE_R},
+    {DATAFLASH_ADDR, DATAFLASH_SIZE, MEMSVC_RANGE_R},
+};
+
+// Return true if [addr, addr + len) lies entirely within one allowed range
+
+static bool memsvc_allowed(uint32_t addr, uint16_t len, uint8_t flags) {
+    const memsvc_range_t *r;
+    unsigned int x;
+
+    for (x = 0; x < sizeof (memsvc_ranges) / sizeof (memsvc_ranges[0]); ++x) {
+        r = &memsvc_ranges[x];
+        if ((r->flags & flags) != flags)
+            continue;
+        if (addr >= r->base && (addr - r->base) + len <= r->size)
+            return true;
+    }
+
+    // A few peripherals, read-only
+    if (flags == MEMSVC_RANGE_R) {
+#define PERIPH_OK(regs) \
+        (addr >= (uintptr_t) (regs) && \
+         (addr - (uintptr_t) (regs)) + len <= sizeof (*(regs)))
+        // TC0's registers are inaccessible while its clocks are gated.
+        if (PERIPH_OK(TC0_REGS))
+            return platform_pclk_is_on(PLATFORM_PCLK_TC0);
+        if (PERIPH_OK(PORT_SEC_REGS) ||
+                PERIPH_OK(GCLK_REGS) || PERIPH_OK(OSCCTRL_REGS) ||
+                PERIPH_OK(EIC_SEC_REGS))
+            return true;
+#undef PERIPH_OK
+    }
+    return false;
+}
+
+/*
+ * Copy with the widest access that the target's alignment allows
+ * 
+ * Peripheral registers must be accessed with their natural width; a plain
+ * memcpy() may split or merge accesses. The width follows the memory/
+ * register side only: the packet side is at arbitrary offsets, so each
+ * access goes through an aligned local.
+ */
+static void memsvc_read(uint8_t *dst, uintptr_t src, uint16_t len) {
+    uint32_t w;
+    uint16_t h;
+
+    while (len > 0) {
+        if (len >= 4 && (src & 3) == 0) {
+            w = *(const volatile uint32_t *) src;
+            memcpy(dst, &w, 4);
+            dst += 4;
+            src += 4;
+            len -= 4;
+        } else if (len >= 2 && (src & 1) == 0) {
+            h = *(const volatile uint16_t *) src;
+            memcpy(dst, &h, 2);
+            dst += 2;
+            src += 2;
+            len -= 2;
+        } else {
+            *(dst++) = *(const volatile uint8_t *) (src++);
+            --len;
+        }
+    }
+}
+
+static void memsvc_write(uintptr_t dst, const uint8_t *src, uint16_t len) {
+    uint32_t w;
+    uint16_t h;
+
+    while (len > 0) {
+        if (len >= 4 && (dst & 3) == 0) {
+            memcpy(&w, src, 4);
+            *(volatile uint32_t *) dst = w;
+            dst += 4;
+            src += 4;
+            len -= 4;
+        } else if (len >= 2 && (dst & 1) == 0) {
+            memcpy(&h, src, 2);
+            *(volatile uint16_t *) dst = h;
+            dst += 2;
+            src += 2;
+            len -= 2;
+        } else {
+            *(volatile uint8_t *) (dst++) = *(src++);
+            --len;
+        }
+    }
+}
+
+static uint32_t memsvc_rd32(const uint8_t *p) {
+    return (uint32_t) p[0] | ((uint32_t) p[1] << 8) |
+            ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+void memsvc_handle(memsvc_t *svc, uint16_t len) {
+    const uint8_t *req = &svc->req[2];
+    uint8_t *rsp = &svc->rsp[3];
+    uint16_t i = 1, o = 1, n;
+    uint32_t addr;
+    uint8_t op;
+
+    rsp[0] = (len > 0) ? req[0] : 0;
+    while (i < len) {
+        if (o >= MEMSVC_RSP_MAX)
+            break;
+        op = req[i];
+        if (len - i < 7 || (op != MEMSVC_OP_READ && op != MEMSVC_OP_WRITE)) {
+            rsp[o++] = MEMSVC_ST_BAD_OP;
+            break;
+        }
+        addr = memsvc_rd32(&req[i + 1]);
+        n = (uint16_t) req[i + 5] | ((uint16_t) req[i + 6] << 8);
+        i += 7;
+
+        if (op == MEMSVC_OP_READ) {
+            if (!memsvc_allowed(addr, n, MEMSVC_RANGE_R)) {
+                rsp[o++] = MEMSVC_ST_DENIED;
+            } else if (o + 1 + n > MEMSVC_RSP_MAX) {
+                rsp[o++] = MEMSVC_ST_TOO_BIG;
+            } else {
+                rsp[o++] = MEMSVC_ST_OK;
+                memsvc_read(&rsp[o], (uintptr_t) addr, n);
+                o += n;
+            }
+        } else {
+            if (len - i < n) {
+                rsp[o++] = MEMSVC_ST_BAD_OP;
+                break;
+            }
+            if (!memsvc_allowed(addr, n, MEMSVC_RANGE_W)) {
+                rsp[o++] = MEMSVC_ST_DENIED;
+            } else {
+                memsvc_write((uintptr_t) addr, &req[i], n);
+                rsp[o++] = MEMSVC_ST_OK;
+            }
+            i += n;
+        }
+    }
+
+    svc->rsp[0] = MEMSVC_RSP_SYNC;
+    svc->rsp[1] = (uint8_t) o;
+    svc->rsp[2] = (uint8_t) (o >> 8);
+    svc->rsp_len = 3 + o;
+    ++svc->nr_requests;
+}
@@ -0,0 +1,75 @@
+/**
+ * @file  memsvc.h
+ * @brief Declarations for the memory/register access service
+ *
+ * The service executes batches of reads and writes on behalf of a host,
+ * restricted to an allow-list of address ranges. Requests and responses are
+ * carried over the CDC USART; see tools/memclient.py for the host side.
+ * 
+ * Request payload:
+ * 
+ *     seq:u8 { op:u8 addr:u32 len:u16 [data:len if op == 'W'] }...
+ * 
+ * Response payload:
+ * 
+ *     seq:u8 { status:u8 [data:len if op == 'R' and status == 0] }...
+ * 
+ * All multi-byte fields are little-endian.
+ */
+
+#if !defined(EEE158_MEMSVC_H_)
+#define EEE158_MEMSVC_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /// Maximum request payload size, in bytes
+#define MEMSVC_REQ_MAX	256
+
+    /// Maximum response payload size, in bytes
+#define MEMSVC_RSP_MAX	512
+
+    /// Operations
+#define MEMSVC_OP_READ	'R'
+#define MEMSVC_OP_WRITE	'W'
+
+    /// Per-operation status codes
+#define MEMSVC_ST_OK		0x00
+#define MEMSVC_ST_DENIED	0x01	// Range not (fully) in the allow-list
+#define MEMSVC_ST_TOO_BIG	0x02	// Response would not fit
+#define MEMSVC_ST_BAD_OP	0x03	// Unknown or truncated operation
+
+    /// Response frame marker (ASCII DLE), followed by a 16-bit length
+#define MEMSVC_RSP_SYNC		0x10
+
+    /// Service state
+
+    typedef struct memsvc_type {
+        /// Request frame: 16-bit length prefix + payload
+        uint8_t req[2 + MEMSVC_REQ_MAX];
+
+        /// Response frame: sync + 16-bit length + payload
+        uint8_t rsp[3 + MEMSVC_RSP_MAX];
+
+        /// Size of the response frame in @c rsp
+        uint16_t rsp_len;
+
+        /// Number of requests served
+        uint32_t nr_requests;
+    } memsvc_t;
+
+    /**
+     * Execute the request in @c svc->req, whose payload is @c len bytes long
+     * 
+     * The response frame is left in @c svc->rsp and @c svc->rsp_len.
+     */
+    void memsvc_handle(memsvc_t *svc, uint16_t len);
+
+#ifdef __cplusplus
+}
+#endif	// __cplusplus
+#endif	// !defined(EEE158_MEMSVC_H_)
@@ -0,0 +1,287 @@
+/**
+ * @file modbus.c
+ * @brief Modbus RTU slave
+ *
+ * Supported functions: 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x0F and 0x10.
+ */
+
+// Common include for the XC32 compiler
+#include <xc.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "modbus.h"
+
+/////////////////////////////////////////////////////////////////////////////
+
+/*
+ * CRC-16/MODBUS (reflected 0x8005, initial value 0xFFFF), byte-at-a-time
+ * 
+ * The table costs 512 bytes of flash, but keeps the CRC of a full-size
+ * frame well under one character time at 24 MHz.
+ */
+static const uint16_t modbus_crc_table[256] = {
+    0x0000, 0xC0C1, 0xC181, 0x0140, 0xC301, 0x03C0, 0x0280, 0xC241,
+    0xC601, 0x06C0, 0x0780, 0xC741, 0x0500, 0xC5C1, 0xC481, 0x0440,
+    0xCC01, 0x0CC0, 0x0D80, 0xCD41, 0x0F00, 0xCFC1, 0xCE81, 0x0E40,
+    0x0A00, 0xCAC1, 0xCB81, 0x0B40, 0xC901, 0x09C0, 0x0880, 0xC841,
+    0xD801, 0x18C0, 0x1980, 0xD941, 0x1B00, 0xDBC1, 0xDA81, 0x1A40,
+    0x1E00, 0xDEC1, 0xDF81, 0x1F40, 0xDD01, 0x1DC0, 0x1C80, 0xDC41,
+    0x1400, 0xD4C1, 0xD581, 0x1540, 0xD701, 0x17C0, 0x1680, 0xD641,
+    0xD201, 0x12C0, 0x1380, 0xD341, 0x1100, 0xD1C1, 0xD081, 0x1040,
+    0xF001, 0x30C0, 0x3180, 0xF141, 0x3300, 0xF3C1, 0xF281, 0x3240,
+    0x3600, 0xF6C1, 0xF781, 0x3740, 0xF501, 0x35C0, 0x3480, 0xF441,
+    0x3C00, 0xFCC1, 0xFD81, 0x3D40, 0xFF01, 0x3FC0, 0x3E80, 0xFE41,
+    0xFA01, 0x3AC0, 0x3B80, 0xFB41, 0x3900, 0xF9C1, 0xF881, 0x3840,
+    0x2800, 0xE8C1, 0xE981, 0x2940, 0xEB01, 0x2BC0, 0x2A80, 0xEA41,
+    0xEE01, 0x2EC0, 0x2F80, 0xEF41, 0x2D00, 0xEDC1, 0xEC81, 0x2C40,
+    0xE401, 0x24C0, 0x2580, 0xE541, 0x2700, 0xE7C1, 0xE681, 0x2640,
+    0x2200, 0xE2C1, 0xE381, 0x2340, 0xE101, 0x21C0, 0x2080, 0xE041,
+    0xA001, 0x60C0, 0x6180, 0xA141, 0x6300, 0xA3C1, 0xA281, 0x6240,
+    0x6600, 0xA6C1, 0xA781, 0x6740, 0xA501, 0x65C0, 0x6480, 0xA441,
+    0x6C00, 0xACC1, 0xAD81, 0x6D40, 0xAF01, 0x6FC0, 0x6E80, 0xAE41,
+    0xAA01, 0x6AC0, 0x6B80, 0xAB41, 0x6900, 0xA9C1, 0xA881, 0x6840,
+    0x7800, 0xB8C1, 0xB981, 0x7940, 0xBB01, 0x7BC0, 0x7A80, 0xBA41,
+    0xBE01, 0x7EC0, 0x7F80, 0xBF41, 0x7D00, 0xBDC1, 0xBC81, 0x7C40,
+    0xB401, 0x74C0, 0x7580, 0xB541, 0x7700, 0xB7C1, 0xB681, 0x7640,
+    0x7200, 0xB2C1, 0xB381, 0x7340, 0xB101, 0x71C0, 0x7080, 0xB041,
+    0x5000, 0x90C1, 0x9181, 0x5140, 0x9301, 0x53C0, 0x5280, 0x9241,
+    0x9601, 0x56C0, 0x5780, 0x9741, 0x5500, 0x95C1, 0x9481, 0x5440,
+    0x9C01, 0x5CC0, 0x5D80, 0x9D41, 0x5F00, 0x9FC1, 0x9E81, 0x5E40,
+    0x5A00, 0x9AC1, 0x9B81, 0x5B40, 0x9901, 0x59C0, 0x5880, 0x9841,
+    0x8801, 0x48C0, 0x4980, 0x8941, 0x4B00, 0x8BC1, 0x8A81, 0x4A40,
+    0x4E00, 0x8EC1, 0x8F81, 0x4F40, 0x8D01, 0x4DC0, 0x4C80, 0x8C41,
+    0x4400, 0x84C1, 0x8581, 0x4540, 0x8701, 0x47C0, 0x4680, 0x8641,
+    0x8201, 0x42C0, 0x4380, 0x8341, 0x4100, 0x81C1, 0x8081, 0x4040
+};
+
+uint16_t modbus_crc16(const uint8_t *buf, uint16_t len) {
+    uint16_t crc = 0xFFFF;
+
+    while (len-- > 0)
+        crc = (crc >> 8) ^ modbus_crc_table[(crc ^ *(buf++)) & 0xFF];
+    return crc;
+}
+
+static uint16_t mb_rd16(const uint8_t *p) {
+    return ((uint16_t) p[0] << 8) | p[1];
+}
+
+static void mb_wr16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t) (v >> 8);
+    p[1] = (uint8_t) v;
+}
+
+// (Re-)arm the receiver for the next request
+
+static void mb_rx_arm(modbus_slave_t *mb) {
+    mb->rx_desc.buf = (char *) mb->rx_buf;
+    mb->rx_desc.max_len = sizeof (mb->rx_buf);
+    mb->rx_desc.mode = PLATFORM_USART_RX_MODE_IDLE;
+    platform_usart_cdc_rx_async(&mb->rx_desc);
+}
+
+/*
+ * Set t3.5/t1.5 for the rate the link runs at now
+ * 
+ * The driver keeps them in bit times across rate changes, which is wrong
+ * across 19200 bps, where the specification switches to fixed values.
+ */
+static void mb_set_timing(modbus_slave_t *mb) {
+    platform_timespec_t t35 = {0, 0}, t15 = {0, 0};
+
+    mb->baud = platform_usart_cdc_get_baud();
+    t35.nr_nsec = MODBUS_T35_NS(mb->baud);
+    t15.nr_nsec = MODBUS_T15_NS(mb->baud);
+    platform_usart_cdc_set_timing(&t35, &t15);
+}
+
+void modbus_init(modbus_slave_t *mb, uint8_t addr, const modbus_map_t *map) {
+    memset(mb, 0, sizeof (*mb));
+    mb->addr = addr;
+    mb->map = *map;
+
+    platform_usart_cdc_rx_abort();
+    mb_set_timing(mb);
+    mb_rx_arm(mb);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+// Request handling
+
+/*
+ * Process the PDU in @c req (function code first) of length @c len
+ * 
+ * The response PDU is written to @c rsp; its length is returned via
+ * @c rsp_len. Return an exception code.
+ */
+static uint8_t mb_handle(modbus_slave_t *mb, const uint8_t *req, uint16_t len,
+        uint8_t *rsp, uint16_t *rsp_len) {
+    uint16_t start, qty, val, x;
+    uint8_t table, ex;
+
+    if (len < 5) {
+        if ((req[0] >= 0x01 && req[0] <= 0x06) || req[0] == 0x0F || req[0] == 0x10)
+            return MODBUS_EX_ILLEGAL_VALUE;
+        return MODBUS_EX_ILLEGAL_FUNCTION;
+    }
+    start = mb_rd16(&req[1]);
+    qty = mb_rd16(&req[3]);
+    rsp[0] = req[0];
+
+    switch (req[0]) {
+        case 0x01: // Read Coils
+        case 0x02: // Read Discrete Inputs
+            table = (req[0] == 0x01) ? MODBUS_TABLE_COIL : MODBUS_TABLE_DISCRETE;
+            if (qty == 0 || qty > 2000)
+                return MODBUS_EX_ILLEGAL_VALUE;
+            if ((uint32_t) start + qty > 0x10000)
+                return MODBUS_EX_ILLEGAL_ADDRESS;
+            rsp[1] = (uint8_t) ((qty + 7) / 8);
+            memset(&rsp[2], 0, rsp[1]);
+            for (x = 0; x < qty; ++x) {
+                if ((ex = mb->map.read(mb->map.ctx, table, start + x, &val)) != MODBUS_EX_NONE)
+                    return ex;
+                if (val)
+                    rsp[2 + (x / 8)] |= (1 << (x % 8));
+            }
+            *rsp_len = 2 + rsp[1];
+            return MODBUS_EX_NONE;
+
+        case 0x03: // Read Holding Registers
+        case 0x04: // Read Input Registers
+            table = (req[0] == 0x03) ? MODBUS_TABLE_HOLDING : MODBUS_TABLE_INPUT;
+            if (qty == 0 || qty > 125)
+                return MODBUS_EX_ILLEGAL_VALUE;
+            if ((uint32_t) start + qty > 0x10000)
+                return MODBUS_EX_ILLEGAL_ADDRESS;
+            rsp[1] = (uint8_t) (qty * 2);
+            for (x = 0; x < qty; ++x) {
+                if ((ex = mb->map.read(mb->map.ctx, table, start + x, &val)) != MODBUS_EX_NONE)
+                    return ex;
+                mb_wr16(&rsp[2 + (x * 2)], val);
+            }
+            *rsp_len = 2 + rsp[1];
+            return MODBUS_EX_NONE;
+
+        case 0x05: // Write Single Coil; "qty" is the value here
+            if (qty != 0xFF00 && qty != 0x0000)
+                return MODBUS_EX_ILLEGAL_VALUE;
+            if ((ex = mb->map.write(mb->map.ctx, MODBUS_TABLE_COIL, start, qty != 0)) != MODBUS_EX_NONE)
+                return ex;
+            memcpy(rsp, req, 5);
+            *rsp_len = 5;
+            return MODBUS_EX_NONE;
+
+        case 0x06: // Write Single Register; "qty" is the value here
+            if ((ex = mb->map.write(mb->map.ctx, MODBUS_TABLE_HOLDING, start, qty)) != MODBUS_EX_NONE)
+                return ex;
+            memcpy(rsp, req, 5);
+            *rsp_len = 5;
+            return MODBUS_EX_NONE;
+
+        case 0x0F: // Write Multiple Coils
+            if (qty == 0 || qty > 1968 || len < 6 || req[5] != (qty + 7) / 8 ||
+                    len < 6 + req[5])
+                return MODBUS_EX_ILLEGAL_VALUE;
+            if ((uint32_t) start + qty > 0x10000)
+                return MODBUS_EX_ILLEGAL_ADDRESS;
+            for (x = 0; x < qty; ++x) {
+                val = (req[6 + (x / 8)] >> (x % 8)) & 0x01;
+                if ((ex = mb->map.write(mb->map.ctx, MODBUS_TABLE_COIL, start + x, val)) != MODBUS_EX_NONE)
+                    return ex;
+            }
+            memcpy(rsp, req, 5);
+            *rsp_len = 5;
+            return MODBUS_EX_NONE;
+
+        case 0x10: // Write Multiple Registers
+            if (qty == 0 || qty > 123 || len < 6 || req[5] != qty * 2 ||
+                    len < 6 + req[5])
+                return MODBUS_EX_ILLEGAL_VALUE;
+            if ((uint32_t) start + qty > 0x10000)
+                return MODBUS_EX_ILLEGAL_ADDRESS;
+            for (x = 0; x < qty; ++x) {
+                val = mb_rd16(&req[6 + (x * 2)]);
+                if ((ex = mb->map.write(mb->map.ctx, MODBUS_TABLE_HOLDING, start + x, val)) != MODBUS_EX_NONE)
+                    return ex;
+            }
+            memcpy(rsp, req, 5);
+            *rsp_len = 5;
+            return MODBUS_EX_NONE;
+
+        default:
+            return MODBUS_EX_ILLEGAL_FUNCTION;
+    }
+}
+
+void modbus_poll(modbus_slave_t *mb) {
+    uint16_t len, rsp_len = 0, crc;
+    uint8_t ex;
+
+    if (platform_usart_cdc_get_baud() != mb->baud)
+        mb_set_timing(mb);
+    if (mb->rx_desc.compl_type != PLATFORM_USART_RX_COMPL_DATA)
+        return;
+
+    /*
+     * The previous response must be out before this one can be built in
+     * the same buffer; a well-behaved master never gets here, as it waits
+     * for the response before sending the next request.
+     */
+    if (platform_usart_cdc_tx_busy())
+        return;
+
+    len = mb->rx_desc.compl_info.data_len;
+    ++mb->stats.nr_frames;
+
+    // Frames with a t1.5 violation, or a bad CRC, are silently dropped.
+    if (len < 4 || (mb->rx_desc.compl_flags & PLATFORM_USART_RX_FLAG_GAP) != 0 ||
+            (mb->rx_desc.compl_flags & PLATFORM_USART_RX_FLAG_FULL) != 0) {
+        ++mb->stats.nr_crc_err;
+        mb_rx_arm(mb);
+        return;
+    }
+    crc = modbus_crc16(mb->rx_buf, len - 2);
+    if (mb->rx_buf[len - 2] != (crc & 0xFF) || mb->rx_buf[len - 1] != (crc >> 8)) {
+        ++mb->stats.nr_crc_err;
+        mb_rx_arm(mb);
+        return;
+    }
+
+    if (mb->rx_buf[0] != mb->addr && mb->rx_buf[0] != 0) {
+        // Not for us
+        mb_rx_arm(mb);
+        return;
+    }
+    ++mb->stats.nr_slave_msgs;
+
+    ex = mb_handle(mb, &mb->rx_buf[1], len - 3, &mb->tx_buf[1], &rsp_len);
+    if (mb->rx_buf[0] == 0) {
+        // Broadcasts are never responded to.
+        ++mb->stats.nr_no_resp;
+        mb_rx_arm(mb);
+        return;
+    }
+
+    mb->tx_buf[0] = mb->addr;
+    if (ex != MODBUS_EX_NONE) {
+        mb->tx_buf[1] = mb->rx_buf[1] | 0x80;
+        mb->tx_buf[2] = ex;
+        rsp_len = 2;
+        ++mb->stats.nr_exceptions;
+    }
+    crc = modbus_crc16(mb->tx_buf, rsp_len + 1);
+    mb->tx_buf[rsp_len + 1] = (uint8_t) crc;
+    mb->tx_buf[rsp_len + 2] = (uint8_t) (crc >> 8);
+
+    /*
+     * The request has been followed by t3.5 of silence by the time the
+     * driver completes reception, so the response may go out right away.
+     */
+    mb->tx_desc.buf = (const char *) mb->tx_buf;
+    mb->tx_desc.len = rsp_len + 3;
+    platform_usart_cdc_tx_async(&mb->tx_desc, 1);
+    mb_rx_arm(mb);
+}
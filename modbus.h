@@ -0,0 +1,124 @@
+/**
+ * @file  modbus.h
+ * @brief Declarations for the Modbus RTU slave
+ *
+ * The slave runs on top of the asynchronous USART API: a request frame is
+ * delimited by the t3.5 idle time (via the driver's idle timeout), and
+ * frames with an inter-character gap longer than t1.5 are discarded.
+ *
+ * Both times are measured between the main-loop passes that pick the bytes
+ * up, not between their arrivals on the line, so they are only as good as
+ * one pass: a gap can be misjudged by up to the longest pass time. Keep the
+ * main loop well under t0.5 (250 us above 19200 bps) for the t1.5 check to
+ * mean anything.
+ */
+
+#if !defined(EEE158_MODBUS_H_)
+#define EEE158_MODBUS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /// Maximum size of an RTU frame (address + PDU + CRC), in bytes
+#define MODBUS_ADU_MAX	256
+
+    /**
+     * Character time, t1.5 and t3.5, in nanoseconds
+     * 
+     * @note
+     * Per the Modbus serial-line specification, fixed values of 750 us and
+     * 1.75 ms are used above 19200 bps.
+     */
+#define MODBUS_TCHAR_NS(baud)	((PLATFORM_USART_CDC_CHAR_BITS * 1000000000UL) / (baud))
+#define MODBUS_T15_NS(baud)	((baud) > 19200 ? 750000UL : (MODBUS_TCHAR_NS(baud) * 3) / 2)
+#define MODBUS_T35_NS(baud)	((baud) > 19200 ? 1750000UL : (MODBUS_TCHAR_NS(baud) * 7) / 2)
+
+    /// Data tables, named after their conventional address prefixes
+#define MODBUS_TABLE_COIL	0	// 0xxxx; 1 bit, read-write
+#define MODBUS_TABLE_DISCRETE	1	// 1xxxx; 1 bit, read-only
+#define MODBUS_TABLE_INPUT	3	// 3xxxx; 16 bits, read-only
+#define MODBUS_TABLE_HOLDING	4	// 4xxxx; 16 bits, read-write
+
+    /// Exception codes; zero means success
+#define MODBUS_EX_NONE			0x00
+#define MODBUS_EX_ILLEGAL_FUNCTION	0x01
+#define MODBUS_EX_ILLEGAL_ADDRESS	0x02
+#define MODBUS_EX_ILLEGAL_VALUE		0x03
+#define MODBUS_EX_DEVICE_FAILURE	0x04
+
+    /// Application data model
+
+    typedef struct modbus_map_type {
+        /// Opaque pointer passed to every hook
+        void *ctx;
+
+        /**
+         * Read one item; bits are returned as 0 or 1
+         * 
+         * @return	@c MODBUS_EX_NONE or an exception code
+         */
+        uint8_t (*read)(void *ctx, uint8_t table, uint16_t addr, uint16_t *val);
+
+        /**
+         * Write one item (coils and holding registers only)
+         * 
+         * @return	@c MODBUS_EX_NONE or an exception code
+         */
+        uint8_t (*write)(void *ctx, uint8_t table, uint16_t addr, uint16_t val);
+    } modbus_map_t;
+
+    /// Slave state
+
+    typedef struct modbus_slave_type {
+        /// Own address, 1 to 247
+        uint8_t addr;
+
+        /// Baud rate the receive timing was last set for
+        uint32_t baud;
+
+        /// Application data model
+        modbus_map_t map;
+
+        /// Receive side
+        platform_usart_rx_async_desc_t rx_desc;
+        uint8_t rx_buf[MODBUS_ADU_MAX];
+
+        /// Transmit side
+        platform_usart_tx_bufdesc_t tx_desc;
+        uint8_t tx_buf[MODBUS_ADU_MAX];
+
+        /// Counters, as in the Modbus diagnostics function
+        struct {
+            uint16_t nr_frames;	// Frames seen on the bus
+            uint16_t nr_crc_err;	// Frames with a bad CRC or bad timing
+            uint16_t nr_exceptions;	// Exception responses sent
+            uint16_t nr_slave_msgs;	// Frames addressed to this slave
+            uint16_t nr_no_resp;	// Frames not responded to (broadcasts)
+        } stats;
+    } modbus_slave_t;
+
+    /**
+     * Set up the slave and take over the CDC USART
+     * 
+     * @note
+     * The receive timing of the USART driver is changed to t3.5/t1.5, for
+     * the rate the link runs at; modbus_poll() follows later changes.
+     */
+    void modbus_init(modbus_slave_t *mb, uint8_t addr, const modbus_map_t *map);
+
+    /// Handle any received request; call once per main-loop iteration
+    void modbus_poll(modbus_slave_t *mb);
+
+    /// Compute the Modbus CRC-16 of a buffer
+    uint16_t modbus_crc16(const uint8_t *buf, uint16_t len);
+
+#ifdef __cplusplus
+}
+#endif	// __cplusplus
+#endif	// !defined(EEE158_MODBUS_H_)
@@ -51,17 +51,17 @@ OBJECTDIR=build/${CND_CONF}/${IMAGE_TYPE}
 DISTDIR=dist/${CND_CONF}/${IMAGE_TYPE}
 
 # Source Files Quoted if spaced
-SOURCEFILES_QUOTED_IF_SPACED=platform/gpio.c platform/systick.c platform/usart.c main.c
+SOURCEFILES_QUOTED_IF_SPACED=platform/gpio.c platform/systick.c platform/usart.c platform/sync.c vm.c modbus.c memsvc.c platform/pclk.c platform/onewire.c platform/dma.c platform/display.c platform/ws2812.c main.c
 
 # Object Files Quoted if spaced
-OBJECTFILES_QUOTED_IF_SPACED=${OBJECTDIR}/platform/gpio.o ${OBJECTDIR}/platform/systick.o ${OBJECTDIR}/platform/usart.o ${OBJECTDIR}/main.o
-POSSIBLE_DEPFILES=${OBJECTDIR}/platform/gpio.o.d ${OBJECTDIR}/platform/systick.o.d ${OBJECTDIR}/platform/usart.o.d ${OBJECTDIR}/main.o.d
+OBJECTFILES_QUOTED_IF_SPACED=${OBJECTDIR}/platform/gpio.o ${OBJECTDIR}/platform/systick.o ${OBJECTDIR}/platform/usart.o ${OBJECTDIR}/platform/sync.o ${OBJECTDIR}/vm.o ${OBJECTDIR}/modbus.o ${OBJECTDIR}/memsvc.o ${OBJECTDIR}/platform/pclk.o ${OBJECTDIR}/platform/onewire.o ${OBJECTDIR}/platform/dma.o ${OBJECTDIR}/platform/display.o ${OBJECTDIR}/platform/ws2812.o ${OBJECTDIR}/main.o
+POSSIBLE_DEPFILES=${OBJECTDIR}/platform/gpio.o.d ${OBJECTDIR}/platform/systick.o.d ${OBJECTDIR}/platform/usart.o.d ${OBJECTDIR}/platform/sync.o.d ${OBJECTDIR}/vm.o.d ${OBJECTDIR}/modbus.o.d ${OBJECTDIR}/memsvc.o.d ${OBJECTDIR}/platform/pclk.o.d ${OBJECTDIR}/platform/onewire.o.d ${OBJECTDIR}/platform/dma.o.d ${OBJECTDIR}/platform/display.o.d ${OBJECTDIR}/platform/ws2812.o.d ${OBJECTDIR}/main.o.d
 
 # Object Files
-OBJECTFILES=${OBJECTDIR}/platform/gpio.o ${OBJECTDIR}/platform/systick.o ${OBJECTDIR}/platform/usart.o ${OBJECTDIR}/main.o
+OBJECTFILES=${OBJECTDIR}/platform/gpio.o ${OBJECTDIR}/platform/systick.o ${OBJECTDIR}/platform/usart.o ${OBJECTDIR}/platform/sync.o ${OBJECTDIR}/vm.o ${OBJECTDIR}/modbus.o ${OBJECTDIR}/memsvc.o ${OBJECTDIR}/platform/pclk.o ${OBJECTDIR}/platform/onewire.o ${OBJECTDIR}/platform/dma.o ${OBJECTDIR}/platform/display.o ${OBJECTDIR}/platform/ws2812.o ${OBJECTDIR}/main.o
 
 # Source Files
-SOURCEFILES=platform/gpio.c platform/systick.c platform/usart.c main.c
+SOURCEFILES=platform/gpio.c platform/systick.c platform/usart.c platform/sync.c vm.c modbus.c memsvc.c platform/pclk.c platform/onewire.c platform/dma.c platform/display.c platform/ws2812.c main.c
 
 # Pack Options 
 PACK_COMMON_OPTIONS=-I "${CMSIS_DIR}/CMSIS/Core/Include"
@@ -122,6 +122,60 @@ ${OBJECTDIR}/platform/usart.o: platform/usart.c  .generated_files/flags/default/
 	@${RM} ${OBJECTDIR}/platform/usart.o 
 	${MP_CC}  $(MP_EXTRA_CC_PRE) -g -D__DEBUG   -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/platform/usart.o.d" -o ${OBJECTDIR}/platform/usart.o platform/usart.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}/PIC32CM-LS00" ${PACK_COMMON_OPTIONS} 
 	
+${OBJECTDIR}/platform/sync.o: platform/sync.c  .generated_files/flags/default/69fde42d21fdcb64a34162a833165f0ca177a805 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}/platform" 
+	@${RM} ${OBJECTDIR}/platform/sync.o.d 
+	@${RM} ${OBJECTDIR}/platform/sync.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE) -g -D__DEBUG   -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/platform/sync.o.d" -o ${OBJECTDIR}/platform/sync.o platform/sync.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}/PIC32CM-LS00" ${PACK_COMMON_OPTIONS} 
+	
+${OBJECTDIR}/vm.o: vm.c  .generated_files/flags/default/7cc85476571e47093c581f3cb5b7b1a41553fb6a .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/vm.o.d 
+	@${RM} ${OBJECTDIR}/vm.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE) -g -D__DEBUG   -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/vm.o.d" -o ${OBJECTDIR}/vm.o vm.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}/PIC32CM-LS00" ${PACK_COMMON_OPTIONS} 
+	
+${OBJECTDIR}/modbus.o: modbus.c  .generated_files/flags/default/59288ca2833433b61c065cfe635d0fa7d924f053 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/modbus.o.d 
+	@${RM} ${OBJECTDIR}/modbus.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE) -g -D__DEBUG   -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/modbus.o.d" -o ${OBJECTDIR}/modbus.o modbus.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}/PIC32CM-LS00" ${PACK_COMMON_OPTIONS} 
+	
+${OBJECTDIR}/memsvc.o: memsvc.c  .generated_files/flags/default/479a11f309e01d84e969db14a0e252088551359c .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/memsvc.o.d 
+	@${RM} ${OBJECTDIR}/memsvc.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE) -g -D__DEBUG   -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/memsvc.o.d" -o ${OBJECTDIR}/memsvc.o memsvc.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}/PIC32CM-LS00" ${PACK_COMMON_OPTIONS} 
+	
+${OBJECTDIR}/platform/pclk.o: platform/pclk.c  .generated_files/flags/default/8583cc341c4396dcf57bc3bf21dff6217006dbec .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}/platform" 
+	@${RM} ${OBJECTDIR}/platform/pclk.o.d 
+	@${RM} ${OBJECTDIR}/platform/pclk.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE) -g -D__DEBUG   -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/platform/pclk.o.d" -o ${OBJECTDIR}/platform/pclk.o platform/pclk.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}/PIC32CM-LS00" ${PACK_COMMON_OPTIONS} 
+	
+${OBJECTDIR}/platform/onewire.o: platform/onewire.c  .generated_files/flags/default/3b9a97ac0e4e7ced27238d7f4dfafe04ffc04b3d .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}/platform" 
+	@${RM} ${OBJECTDIR}/platform/onewire.o.d 
+	@${RM} ${OBJECTDIR}/platform/onewire.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE) -g -D__DEBUG   -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/platform/onewire.o.d" -o ${OBJECTDIR}/platform/onewire.o platform/onewire.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}/PIC32CM-LS00" ${PACK_COMMON_OPTIONS} 
+	
+${OBJECTDIR}/platform/dma.o: platform/dma.c  .generated_files/flags/default/4b65bd89c0fecdfd8ba169d84c90a619262b928e .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}/platform" 
+	@${RM} ${OBJECTDIR}/platform/dma.o.d 
+	@${RM} ${OBJECTDIR}/platform/dma.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE) -g -D__DEBUG   -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/platform/dma.o.d" -o ${OBJECTDIR}/platform/dma.o platform/dma.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}/PIC32CM-LS00" ${PACK_COMMON_OPTIONS} 
+	
+${OBJECTDIR}/platform/display.o: platform/display.c  .generated_files/flags/default/677891b9f00577339d3286dc2b6b2dddf924538f .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}/platform" 
+	@${RM} ${OBJECTDIR}/platform/display.o.d 
+	@${RM} ${OBJECTDIR}/platform/display.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE) -g -D__DEBUG   -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/platform/display.o.d" -o ${OBJECTDIR}/platform/display.o platform/display.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}/PIC32CM-LS00" ${PACK_COMMON_OPTIONS} 
+	
+${OBJECTDIR}/platform/ws2812.o: platform/ws2812.c  .generated_files/flags/default/43f4e8e6393958b964e9c005798bfcab3f719bd3 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}/platform" 
+	@${RM} ${OBJECTDIR}/platform/ws2812.o.d 
+	@${RM} ${OBJECTDIR}/platform/ws2812.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE) -g -D__DEBUG   -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/platform/ws2812.o.d" -o ${OBJECTDIR}/platform/ws2812.o platform/ws2812.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}/PIC32CM-LS00" ${PACK_COMMON_OPTIONS} 
+	
 ${OBJECTDIR}/main.o: main.c  .generated_files/flags/default/9dfd425f674e26d2d116019e80852f576d9458d1 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
 	@${MKDIR} "${OBJECTDIR}" 
 	@${RM} ${OBJECTDIR}/main.o.d 
@@ -147,6 +201,60 @@ ${OBJECTDIR}/platform/usart.o: platform/usart.c  .generated_files/flags/default/
 	@${RM} ${OBJECTDIR}/platform/usart.o 
 	${MP_CC}  $(MP_EXTRA_CC_PRE)  -g -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/platform/usart.o.d" -o ${OBJECTDIR}/platform/usart.o platform/usart.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}/PIC32CM-LS00" ${PACK_COMMON_OPTIONS} 
 	
+${OBJECTDIR}/platform/sync.o: platform/sync.c  .generated_files/flags/default/176f000d5a52a249032fa46701cb62133111b56f .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}/platform" 
+	@${RM} ${OBJECTDIR}/platform/sync.o.d 
+	@${RM} ${OBJECTDIR}/platform/sync.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)  -g -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/platform/sync.o.d" -o ${OBJECTDIR}/platform/sync.o platform/sync.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}/PIC32CM-LS00" ${PACK_COMMON_OPTIONS} 
+	
+${OBJECTDIR}/vm.o: vm.c  .generated_files/flags/default/c59cebae511c64f608a07e1af8c736aac44c95c7 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/vm.o.d 
+	@${RM} ${OBJECTDIR}/vm.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)  -g -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/vm.o.d" -o ${OBJECTDIR}/vm.o vm.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}/PIC32CM-LS00" ${PACK_COMMON_OPTIONS} 
+	
+${OBJECTDIR}/modbus.o: modbus.c  .generated_files/flags/default/6454a0c5ccc596c9373b25acb553285813f17ec8 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/modbus.o.d 
+	@${RM} ${OBJECTDIR}/modbus.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)  -g -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/modbus.o.d" -o ${OBJECTDIR}/modbus.o modbus.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}/PIC32CM-LS00" ${PACK_COMMON_OPTIONS} 
+	
+${OBJECTDIR}/memsvc.o: memsvc.c  .generated_files/flags/default/9297c0bcde986c42287632e0bd902a7c02f5e4a2 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/memsvc.o.d 
+	@${RM} ${OBJECTDIR}/memsvc.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)  -g -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/memsvc.o.d" -o ${OBJECTDIR}/memsvc.o memsvc.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}/PIC32CM-LS00" ${PACK_COMMON_OPTIONS} 
+	
+${OBJECTDIR}/platform/pclk.o: platform/pclk.c  .generated_files/flags/default/13ed268c0a9ec83abbe70b4824dbf889dce55d62 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}/platform" 
+	@${RM} ${OBJECTDIR}/platform/pclk.o.d 
+	@${RM} ${OBJECTDIR}/platform/pclk.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)  -g -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/platform/pclk.o.d" -o ${OBJECTDIR}/platform/pclk.o platform/pclk.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}/PIC32CM-LS00" ${PACK_COMMON_OPTIONS} 
+	
+${OBJECTDIR}/platform/onewire.o: platform/onewire.c  .generated_files/flags/default/417551ceac482b82b28e02d7c279bd79f01342cf .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}/platform" 
+	@${RM} ${OBJECTDIR}/platform/onewire.o.d 
+	@${RM} ${OBJECTDIR}/platform/onewire.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)  -g -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/platform/onewire.o.d" -o ${OBJECTDIR}/platform/onewire.o platform/onewire.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}/PIC32CM-LS00" ${PACK_COMMON_OPTIONS} 
+	
+${OBJECTDIR}/platform/dma.o: platform/dma.c  .generated_files/flags/default/7d7756a4aea6ef8118be315be1dc182df1be8903 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}/platform" 
+	@${RM} ${OBJECTDIR}/platform/dma.o.d 
+	@${RM} ${OBJECTDIR}/platform/dma.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)  -g -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/platform/dma.o.d" -o ${OBJECTDIR}/platform/dma.o platform/dma.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}/PIC32CM-LS00" ${PACK_COMMON_OPTIONS} 
+	
+${OBJECTDIR}/platform/display.o: platform/display.c  .generated_files/flags/default/dfb42719c9293ae737d0445a0da3a84a750078ef .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}/platform" 
+	@${RM} ${OBJECTDIR}/platform/display.o.d 
+	@${RM} ${OBJECTDIR}/platform/display.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)  -g -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/platform/display.o.d" -o ${OBJECTDIR}/platform/display.o platform/display.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}/PIC32CM-LS00" ${PACK_COMMON_OPTIONS} 
+	
+${OBJECTDIR}/platform/ws2812.o: platform/ws2812.c  .generated_files/flags/default/58876bfa3aa2217cea5f16b88583f1c6bfaa95a5 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}/platform" 
+	@${RM} ${OBJECTDIR}/platform/ws2812.o.d 
+	@${RM} ${OBJECTDIR}/platform/ws2812.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)  -g -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/platform/ws2812.o.d" -o ${OBJECTDIR}/platform/ws2812.o platform/ws2812.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}/PIC32CM-LS00" ${PACK_COMMON_OPTIONS} 
+	
 ${OBJECTDIR}/main.o: main.c  .generated_files/flags/default/5d75296ee1bcd74f674e7ad57ea4286ba58c1120 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
 	@${MKDIR} "${OBJECTDIR}" 
 	@${RM} ${OBJECTDIR}/main.o.d 
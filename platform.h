@@ -32,6 +32,28 @@ extern "C" {
 
     //////////////////////////////////////////////////////////////////////////////
 
+    /**
+     * Check whether the 48-MHz DFLL is locked to the 32-kHz crystal
+     * 
+     * @note
+     * This can only be @c true if the platform was built with
+     * @c PLATFORM_CLK_DFLL_CLOSED_LOOP set, and the crystal is present.
+     */
+    bool platform_clk_dfll_closed_loop(void);
+
+    /**
+     * Measure the frequency error of the 48-MHz DFLL
+     * 
+     * @param[out]	ppm	Frequency error relative to 48 MHz, in parts per
+     *			million; positive if the DFLL runs fast
+     * 
+     * @return	@c true if a measurement is available, @c false otherwise
+     *		(e.g. the DFLL is in open-loop mode)
+     */
+    bool platform_clk_dfll_error_ppm(int32_t *ppm);
+
+    //////////////////////////////////////////////////////////////////////////////
+
     /// Pushbutton event mask for pressing the on-board button
 #define PLATFORM_PB_ONBOARD_PRESS	0x0001
 
@@ -74,6 +96,9 @@ extern "C" {
      */
     void platform_blink_modify();
 
+    /// Restart the current blink period (e.g. upon a setting change)
+    void platform_blink_restart(void);
+
     //////////////////////////////////////////////////////////////////////////////
 
     /**
@@ -152,6 +177,63 @@ extern "C" {
         /// Maximum number of bytes for @c buf
         uint16_t max_len;
 
+        /**
+         * Additional completion criterion, evaluated as each byte arrives
+         * 
+         * @note
+         * Reception always completes once @c buf is full or the line has
+         * been idle long enough, regardless of this setting.
+         */
+        uint16_t mode;
+
+        /// Complete only when full or idle (default)
+#define PLATFORM_USART_RX_MODE_IDLE	0x0000
+
+        /// Complete upon receiving any byte in @c term
+#define PLATFORM_USART_RX_MODE_TERM	0x0001
+
+        /// Complete after exactly @c len bytes
+#define PLATFORM_USART_RX_MODE_LEN	0x0002
+
+        /**
+         * The first @c len bytes (1 or 2, little-endian) give the number of
+         * bytes that follow; complete once those have been received
+         */
+#define PLATFORM_USART_RX_MODE_LENPFX	0x0003
+
+        /**
+         * Cooked (line) mode: the driver echoes printable characters,
+         * handles backspace/DEL and CTRL+U (line kill), and completes with
+         * @c PLATFORM_USART_RX_FLAG_TERM on CR or LF (CR LF counts once)
+         * 
+         * @note
+         * The line terminator is not stored, control characters are
+         * dropped, and neither the idle timeout nor a full buffer completes
+         * reception in this mode.
+         */
+#define PLATFORM_USART_RX_MODE_LINE	0x0004
+
+        /// Set of terminator bytes (@c PLATFORM_USART_RX_MODE_TERM only)
+        const char *term;
+
+        /// Number of bytes in @c term
+        uint16_t nr_term;
+
+        /// Length parameter for @c PLATFORM_USART_RX_MODE_LEN and @c PLATFORM_USART_RX_MODE_LENPFX
+        uint16_t len;
+
+        /**
+         * Optional per-byte arrival times, one per element of @c buf; @c NULL
+         * if not needed
+         * 
+         * Each is the time from @c ts_start to the main-loop pass that
+         * picked up the byte, in microseconds.
+         */
+        uint32_t *ts;
+
+        /// When reception was enqueued; set by the driver
+        platform_timespec_t ts_start;
+
         /// Type of completion that has occurred
         volatile uint16_t compl_type;
 
@@ -169,6 +251,48 @@ extern "C" {
          */
 #define PLATFORM_USART_RX_COMPL_BREAK	0x0002
 
+        /// What caused the completion, if @c compl_type is not NONE
+        volatile uint16_t compl_flags;
+
+        /// The buffer was filled
+#define PLATFORM_USART_RX_FLAG_FULL	0x0001
+
+        /// The line went idle
+#define PLATFORM_USART_RX_FLAG_IDLE	0x0002
+
+        /// A terminator byte was received; it is the last byte in @c buf
+#define PLATFORM_USART_RX_FLAG_TERM	0x0004
+
+        /// The requested (or length-prefixed) number of bytes was received
+#define PLATFORM_USART_RX_FLAG_LEN	0x0008
+
+        /// Reception was aborted via @c platform_usart_cdc_rx_abort()
+#define PLATFORM_USART_RX_FLAG_ABORT	0x0010
+
+        /**
+         * Two bytes were separated by more than the inter-character gap
+         * limit (see @c platform_usart_cdc_set_timing())
+         * 
+         * @note
+         * This does not complete reception by itself.
+         */
+#define PLATFORM_USART_RX_FLAG_GAP	0x0020
+
+        /**
+         * Characters were lost because the receiver overflowed; see
+         * @c ovf_idx
+         * 
+         * @note
+         * This does not complete reception by itself.
+         */
+#define PLATFORM_USART_RX_FLAG_OVF	0x0040
+
+        /**
+         * Index in @c buf of the first byte received after the first
+         * overflow; valid only if @c PLATFORM_USART_RX_FLAG_OVF is set
+         */
+        volatile uint16_t ovf_idx;
+
         /// Extra information about a completion event, if applicable
 
         volatile union {
@@ -182,6 +306,12 @@ extern "C" {
         } compl_info;
     } platform_usart_rx_async_desc_t;
 
+    /// Baud rate of the CDC (debugger) USART link
+#define PLATFORM_USART_CDC_BAUD	57600
+
+    /// Number of bits per character on the CDC link (start, 8 data, parity, stop)
+#define PLATFORM_USART_CDC_CHAR_BITS	11
+
     /// Descriptor for a transmission fragment
 
     typedef struct platform_usart_tx_desc_type {
@@ -234,6 +364,638 @@ extern "C" {
     /// Check whether a reception is on-going
     bool platform_usart_cdc_rx_busy(void);
 
+    /**
+     * Detect the host's baud rate and switch to it
+     * 
+     * The host must send the character 'U' (0x55) within @c timeout_ms.
+     * The measured rate is snapped to the nearest of 9600, 19200, 38400,
+     * 57600, 115200 and 230400 bps.
+     * 
+     * @note
+     * This blocks until 'U' is seen or the timeout expires, and must be
+     * called while no transfer is on-going. The idle timeout is rescaled
+     * for the new rate. Not available in synchronous mode.
+     * 
+     * @return	The detected rate, or zero if detection failed, in which case
+     *		@c PLATFORM_USART_CDC_BAUD is used (or, in synchronous mode,
+     *		nothing is changed)
+     */
+    uint32_t platform_usart_cdc_autobaud(uint32_t timeout_ms);
+
+    /// Get the current baud rate of the CDC link
+    uint32_t platform_usart_cdc_get_baud(void);
+
+    /// Number of rates the loopback self-test runs at
+#define PLATFORM_USART_BIST_NR_RATES	6
+
+    /// Result of the loopback self-test at one baud rate
+
+    typedef struct platform_usart_bist_result_type {
+        /// Baud rate tested
+        uint32_t baud;
+
+        /// Number of bytes received back
+        uint16_t nr_bytes;
+
+        /// Number of bytes lost or corrupted
+        uint16_t nr_err;
+
+        /// Measured throughput, in bytes per second
+        uint32_t bytes_per_sec;
+    } platform_usart_bist_result_t;
+
+    /**
+     * Run the USART loopback self-test
+     * 
+     * A pseudo-random pattern is sent through the regular transmit and
+     * receive paths in internal loopback, once for each supported rate
+     * (see @c platform_usart_cdc_autobaud()). The original rate is restored
+     * afterwards.
+     * 
+     * @note
+     * This blocks, and requires no transfer to be on-going. The test
+     * pattern is also visible on the TX line.
+     * 
+     * @p	res	Array receiving the per-rate results
+     * @p	nr_res	Number of elements in @c res
+     * 
+     * @return	Number of rates tested; zero if the USART was busy
+     */
+    unsigned int platform_usart_cdc_bist(platform_usart_bist_result_t *res,
+            unsigned int nr_res);
+
+    /// A request/response exchange with an attached device
+
+    typedef struct platform_usart_xact_type {
+        /// Request fragments (see @c platform_usart_cdc_tx_async())
+        const platform_usart_tx_bufdesc_t *tx;
+
+        /// Number of request fragments
+        unsigned int nr_tx;
+
+        /**
+         * Reply buffer and completion criterion
+         * 
+         * Set up @c buf, @c max_len, @c mode and its parameters as for
+         * @c platform_usart_cdc_rx_async(); the completion fields report
+         * on the accepted reply.
+         */
+        platform_usart_rx_async_desc_t rx;
+
+        /**
+         * Optional check of a completed reply
+         * 
+         * If this returns @c false, the reply is discarded (e.g. an
+         * unsolicited message) and reception restarts. @c NULL accepts
+         * any reply.
+         */
+        bool (*match)(const char *buf, uint16_t len, void *arg);
+
+        /// Passed to @c match
+        void *arg;
+
+        /// Time allowed from sending the request to an accepted reply
+        uint32_t timeout_ms;
+
+        /// Progress of this transaction
+        volatile uint16_t state;
+
+        /// Waiting for earlier transactions
+#define PLATFORM_USART_XACT_QUEUED	0x0000
+
+        /// Request sent or being sent; awaiting the reply
+#define PLATFORM_USART_XACT_ACTIVE	0x0001
+
+        /// A matching reply was received
+#define PLATFORM_USART_XACT_DONE	0x0002
+
+        /// No matching reply within @c timeout_ms
+#define PLATFORM_USART_XACT_TIMEOUT	0x0003
+
+        /// The request or reply descriptor was rejected
+#define PLATFORM_USART_XACT_FAILED	0x0004
+
+        /// Driver-private
+        struct platform_usart_xact_type *next;
+        platform_timespec_t ts_start;
+    } platform_usart_xact_t;
+
+    /**
+     * Queue a transaction
+     * 
+     * Transactions run one after another, in submission order, from the
+     * main loop: each request is sent as soon as the previous transaction
+     * finishes, without waiting for the application.
+     * 
+     * @note
+     * The transaction, and all buffers it refers to, must remain valid
+     * until @c state is DONE, TIMEOUT or FAILED. A transaction waits while
+     * the link is in use through @c platform_usart_cdc_tx_async() or
+     * @c platform_usart_cdc_rx_async().
+     * 
+     * @p	xact	Transaction
+     * 
+     * @return	@c true if queued, @c false if @c xact is invalid, asks for
+     *		@c PLATFORM_USART_RX_MODE_LINE, or is already queued
+     */
+    bool platform_usart_cdc_xact_submit(platform_usart_xact_t *xact);
+
+    /// Check whether any transaction is queued or active
+    bool platform_usart_cdc_xact_busy(void);
+
+    /// RS-485 half-duplex settings
+
+    typedef struct platform_usart_rs485_cfg_type {
+        /// Time from DE assertion to the first start bit, in bit times
+        uint8_t pre_guard_bits;
+
+        /// Time from the last stop bit to DE release, in bit times (43 ms max)
+        uint8_t post_guard_bits;
+
+        /// Drop whatever is received while DE is asserted
+        bool suppress_echo;
+    } platform_usart_rs485_cfg_t;
+
+    /**
+     * Switch the CDC USART to (or from) RS-485 half-duplex operation
+     * 
+     * In this mode, a driver-enable pin (PB10 by default) is asserted ahead
+     * of each transmission and released after the last stop bit plus the
+     * post-guard, as timed by TC1. Transmission is reported busy until DE
+     * is released.
+     * 
+     * @note
+     * Guard times are kept in bit times, and follow later baud rate changes
+     * (including autobaud).
+     * 
+     * @p	cfg	Settings, or @c NULL to return to full-duplex operation
+     * 
+     * @return	@c false if a transmission is on-going, or if the post-guard
+     *		does not fit TC1 at the current rate; @c true otherwise
+     */
+    bool platform_usart_cdc_set_rs485(const platform_usart_rs485_cfg_t *cfg);
+
+    /// Synchronous-mode settings
+
+    typedef struct platform_usart_sync_cfg_type {
+        /// Drive the bit clock (XCK) from this end
+        bool master;
+
+        /**
+         * Bit rate; as master, rounded to the nearest rate of the form
+         * 12 MHz / n. As slave, only used to scale the idle timeout.
+         */
+        uint32_t rate;
+    } platform_usart_sync_cfg_t;
+
+    /**
+     * Switch the CDC USART to (or from) synchronous operation
+     * 
+     * The bit clock is carried on PB08 (the asynchronous RX pin), and
+     * reception moves to PB11. Framing becomes 8N1. The transmit/receive
+     * API is unchanged; transmit fragments go out by DMA.
+     * 
+     * @note
+     * Not available in RS-485 mode, nor during the loopback self-test.
+     * 
+     * @p	cfg	Settings, or @c NULL to return to the asynchronous link,
+     *			at the rate in use before synchronous mode
+     * 
+     * @return	@c false if a transfer is on-going or the rate is out of
+     *		range, @c true otherwise; the resulting rate is reported by
+     *		@c platform_usart_cdc_get_baud()
+     */
+    bool platform_usart_cdc_set_sync(const platform_usart_sync_cfg_t *cfg);
+
+    /// Receive error counters of the CDC USART, since startup
+
+    typedef struct platform_usart_stats_type {
+        /// Number of receiver overflows (one or more characters lost each)
+        uint32_t nr_ovf;
+
+        /// Number of characters dropped for a parity error
+        uint32_t nr_perr;
+
+        /// Number of characters dropped for a framing error
+        uint32_t nr_ferr;
+    } platform_usart_stats_t;
+
+    /**
+     * Get a snapshot of the receive error counters
+     * 
+     * @param[out]	stats	Where to store the snapshot
+     */
+    void platform_usart_cdc_get_stats(platform_usart_stats_t *stats);
+
+    /**
+     * Send a byte to the peer whenever the receiver overflows
+     * 
+     * The byte (e.g. XOFF or a protocol NAK) is sent ahead of any queued
+     * transmission.
+     * 
+     * @p	notify	Byte to send, or a negative value to send nothing (default)
+     */
+    void platform_usart_cdc_set_ovf_notify(int notify);
+
+    /// XON/XOFF flow-control settings
+
+    typedef struct platform_usart_flow_cfg_type {
+        /**
+         * Send XOFF once this many bytes or fewer are left in the receive
+         * buffer; this should cover the peer's reaction time
+         */
+        uint16_t xoff_room;
+
+        /// Send XON once at least this many bytes are free again
+        uint16_t xon_room;
+    } platform_usart_flow_cfg_t;
+
+    /**
+     * Enable (or disable) XON/XOFF flow control on the CDC USART
+     * 
+     * XON (0x11) and XOFF (0x13) from the peer pause and resume
+     * transmission, and are not delivered as data. XOFF/XON are sent to
+     * the peer as room in the active receive buffer crosses the given
+     * levels.
+     * 
+     * @note
+     * Binary data containing 0x11 or 0x13 cannot be received in this mode.
+     * Not available in RS-485 mode, nor during the loopback self-test.
+     * 
+     * @p	cfg	Settings, or @c NULL to disable (default)
+     * 
+     * @return	@c false if the settings are invalid, @c true otherwise
+     */
+    bool platform_usart_cdc_set_xonxoff(const platform_usart_flow_cfg_t *cfg);
+
+    /**
+     * Change the receive timing parameters
+     * 
+     * @p	idle	Line-idle time after which reception completes
+     * @p	gap	Maximum gap between two bytes before
+     *		@c PLATFORM_USART_RX_FLAG_GAP is raised; zero disables the check
+     * 
+     * @note
+     * Either pointer may be @c NULL to leave that parameter unchanged.
+     * Once set, both are kept in bit times across later baud rate changes,
+     * instead of the idle timeout going back to its default.
+     */
+    void platform_usart_cdc_set_timing(const platform_timespec_t *idle,
+            const platform_timespec_t *gap);
+
+    //////////////////////////////////////////////////////////////////////////////
+
+    /// Counters for posted writes to synchronized peripheral registers
+
+    typedef struct platform_sync_stats_type {
+        /// Number of writes posted without waiting for synchronization
+        uint32_t nr_posted;
+
+        /// Number of dependent accesses that still had to wait
+        uint32_t nr_stalls;
+
+        /// Number of dependent accesses that found synchronization done
+        uint32_t nr_elided;
+
+        /**
+         * Estimated number of CPU cycles that would otherwise have been
+         * spent polling SYNCBUSY
+         */
+        uint32_t cycles_saved;
+    } platform_sync_stats_t;
+
+    /**
+     * Get a snapshot of the posted-write counters
+     * 
+     * @param[out]	stats	Where to store the snapshot
+     */
+    void platform_sync_get_stats(platform_sync_stats_t *stats);
+
+    //////////////////////////////////////////////////////////////////////////////
+
+    /// Peripheral clock ID for SERCOM3 (the CDC USART)
+#define PLATFORM_PCLK_SERCOM3	0
+
+    /// Peripheral clock ID for TC0 (the LED blinker)
+#define PLATFORM_PCLK_TC0	1
+
+    /// Peripheral clock ID for TC2 (1-Wire slot timing)
+#define PLATFORM_PCLK_TC2	2
+
+    /// Peripheral clock ID for SERCOM0 (the display's SPI)
+#define PLATFORM_PCLK_SERCOM0	3
+
+    /// Peripheral clock ID for SERCOM2 (the WS2812 strip)
+#define PLATFORM_PCLK_SERCOM2	4
+
+    /// Peripheral clock ID for TC1 (RS-485 DE release timing)
+#define PLATFORM_PCLK_TC1	5
+
+    /// Number of peripheral clock ID's
+#define PLATFORM_PCLK_NR	6
+
+    /// Peripheral clock-gating state
+
+    typedef struct platform_pclk_stats_type {
+        /// Bitmask of @c PLATFORM_PCLK_* whose clocks are currently on
+        uint32_t mask_on;
+
+        /// Number of times a peripheral's clocks were gated
+        uint32_t nr_gated;
+
+        /**
+         * Estimated active current currently saved by gating, in uA
+         * 
+         * @note
+         * This is based on typical datasheet figures, not a measurement.
+         */
+        uint32_t ua_reclaimed;
+    } platform_pclk_stats_t;
+
+    /**
+     * Check whether a peripheral is currently clocked
+     * 
+     * @note
+     * The registers of a gated peripheral must not be accessed.
+     */
+    bool platform_pclk_is_on(unsigned int id);
+
+    /**
+     * Get a snapshot of the clock-gating state
+     * 
+     * @param[out]	stats	Where to store the snapshot
+     */
+    void platform_pclk_get_stats(platform_pclk_stats_t *stats);
+
+    //////////////////////////////////////////////////////////////////////////////
+
+    /// A 1-Wire transfer: reset, write, then a ROM search pass or a read
+
+    typedef struct platform_ow_xfer_type {
+        /// Start with a reset pulse, and fail if no device answers it
+        bool reset;
+
+        /// Bytes to write, LSB first
+        const uint8_t *tx;
+        uint16_t nr_tx;
+
+        /// Buffer for the bytes to read after writing
+        uint8_t *rx;
+        uint16_t nr_rx;
+
+        /**
+         * If not @c NULL, run one ROM search pass after writing (@c tx
+         * must end with SEARCH ROM, 0xF0), instead of reading
+         * 
+         * On entry, this holds the ROM found by the previous pass; on
+         * return, the next ROM.
+         */
+        uint8_t *search_rom;
+
+        /**
+         * ROM search state: zero before the first pass; afterwards, zero
+         * if @c search_rom holds the last device
+         */
+        uint8_t search_last;
+
+        /// Progress of this transfer
+        volatile uint16_t state;
+
+        /// The transfer is on-going
+#define PLATFORM_OW_XFER_BUSY		0x0001
+
+        /// The transfer completed
+#define PLATFORM_OW_XFER_DONE		0x0002
+
+        /// No device answered the reset pulse (or the ROM search)
+#define PLATFORM_OW_XFER_NO_PRESENCE	0x0003
+    } platform_ow_xfer_t;
+
+    /**
+     * Start a 1-Wire transfer
+     * 
+     * Bits are sequenced from a timer interrupt; the main loop is not held
+     * up. Completion is reported via @c xfer->state.
+     * 
+     * @note
+     * The transfer and its buffers must remain valid until it completes.
+     * 
+     * @return	@c false if another transfer is on-going or @c xfer is
+     *		invalid, @c true otherwise
+     */
+    bool platform_ow_xfer_async(platform_ow_xfer_t *xfer);
+
+    /// Check whether a 1-Wire transfer is on-going
+    bool platform_ow_busy(void);
+
+    /// Compute the 1-Wire (Dallas/Maxim) CRC-8 of a buffer
+    uint8_t platform_ow_crc8(const uint8_t *buf, unsigned int len);
+
+    /// A DS18B20 temperature sensor
+
+    typedef struct platform_ow_temp_type {
+        /// ROM code, e.g. from a ROM search
+        uint8_t rom[8];
+
+        /// Last reading, in 1/16 degrees Celsius
+        volatile int16_t raw;
+
+        /// Whether @c raw is valid (the last read passed its CRC check)
+        volatile bool valid;
+    } platform_ow_temp_t;
+
+    /**
+     * Read a set of DS18B20 sensors periodically, in the background
+     * 
+     * All sensors are told to convert at once; each is read once the
+     * conversion time has passed, without blocking the main loop.
+     * 
+     * @note
+     * @c devs must remain valid until @c platform_ow_temp_stop().
+     * Application transfers may be interleaved.
+     * 
+     * @p	devs		Sensors
+     * @p	nr_devs		Number of sensors
+     * @p	period_ms	Time between rounds (at least the 750-ms
+     *			conversion time)
+     * 
+     * @return	@c false if the arguments are invalid or a previous round is
+     *		still winding down, @c true otherwise
+     */
+    bool platform_ow_temp_start(platform_ow_temp_t *devs, unsigned int nr_devs,
+            uint32_t period_ms);
+
+    /// Stop reading sensors
+    void platform_ow_temp_stop(void);
+
+    //////////////////////////////////////////////////////////////////////////////
+
+    /// Pin-toggle rates through either view of PORT
+
+    typedef struct platform_pio_bench_type {
+        /// Toggles per second through the APB view
+        uint32_t apb_per_sec;
+
+        /// Toggles per second through the IOBUS alias (what the pin HAL uses)
+        uint32_t iobus_per_sec;
+    } platform_pio_bench_t;
+
+    /**
+     * Measure pin-toggle rates through the APB and IOBUS views of PORT
+     * 
+     * The LED pin is toggled an even number of times each way, with
+     * interrupts disabled, so it ends in the state it started in.
+     * 
+     * @param[out]	res	Where to store the results
+     */
+    void platform_pio_bench(platform_pio_bench_t *res);
+
+    //////////////////////////////////////////////////////////////////////////////
+
+    /*
+     * Display pixel format: 1 for a monochrome SSD1306 (128x64), 16 for an
+     * RGB565 ST7735S (160x80)
+     */
+#if !defined(PLATFORM_DISP_BPP)
+#define PLATFORM_DISP_BPP	1
+#endif
+
+#if PLATFORM_DISP_BPP == 1
+#define PLATFORM_DISP_WIDTH	128
+#define PLATFORM_DISP_HEIGHT	64
+#else
+#define PLATFORM_DISP_WIDTH	160
+#define PLATFORM_DISP_HEIGHT	80
+#endif
+
+    /// Colors; on a monochrome panel, any non-zero color is a lit pixel
+#define PLATFORM_DISP_BLACK	0x0000
+#define PLATFORM_DISP_WHITE	0xFFFF
+
+    /// Size of a text character cell, in pixels
+#define PLATFORM_DISP_CHAR_W	6
+#define PLATFORM_DISP_CHAR_H	8
+
+    /// Display update counters
+
+    typedef struct platform_disp_stats_type {
+        /// Number of times the panel was brought up to date with the framebuffer
+        uint32_t nr_frames;
+
+        /// Number of rectangles sent
+        uint32_t nr_rects;
+
+        /// Number of pixel bytes sent (commands excluded)
+        uint32_t nr_bytes;
+
+        /// Pixel bytes sent for the last frame
+        uint32_t last_frame_bytes;
+
+        /**
+         * Time taken by the last frame, in us, from the first rectangle
+         * being started until the last one was done
+         */
+        uint32_t last_frame_us;
+    } platform_disp_stats_t;
+
+    /**
+     * Fill the whole framebuffer with one color
+     * 
+     * @note
+     * Drawing only changes the framebuffer; changed regions are sent to the
+     * panel by DMA in the background, from the main loop.
+     */
+    void platform_disp_clear(uint16_t color);
+
+    /// Set one pixel; coordinates off the panel are ignored
+    void platform_disp_pixel(unsigned int x, unsigned int y, uint16_t color);
+
+    /// Fill a rectangle, clipped to the panel
+    void platform_disp_fill_rect(unsigned int x, unsigned int y,
+            unsigned int w, unsigned int h, uint16_t color);
+
+    /**
+     * Draw a string in the built-in 5x7 font
+     * 
+     * Each character fills a whole @c PLATFORM_DISP_CHAR_W by
+     * @c PLATFORM_DISP_CHAR_H cell, background included; characters outside
+     * printable ASCII are drawn as '?'. Text running off the right edge is
+     * clipped, not wrapped.
+     * 
+     * @return	X-coordinate just past the last character drawn
+     */
+    unsigned int platform_disp_text(unsigned int x, unsigned int y,
+            const char *s, uint16_t fg, uint16_t bg);
+
+    /// Check whether framebuffer changes are still waiting to reach the panel
+    bool platform_disp_busy(void);
+
+    /**
+     * Get a snapshot of the display update counters
+     * 
+     * @param[out]	stats	Where to store the snapshot
+     */
+    void platform_disp_get_stats(platform_disp_stats_t *stats);
+
+    //////////////////////////////////////////////////////////////////////////////
+
+    /// Number of LEDs on the WS2812 strip
+#if !defined(PLATFORM_WS2812_NR)
+#define PLATFORM_WS2812_NR	16
+#endif
+
+    /// WS2812 strip counters
+
+    typedef struct platform_ws2812_stats_type {
+        /// Number of frames sent
+        uint32_t nr_frames;
+
+        /// Number of frames replaced by a newer one before being sent
+        uint32_t nr_replaced;
+
+        /// Time taken to encode the last frame, in us
+        uint32_t encode_us;
+    } platform_ws2812_stats_t;
+
+    /**
+     * Set the color of one LED for the next frame
+     * 
+     * Colors are scaled by the global brightness when the frame is shown.
+     * Indices past the strip are ignored.
+     */
+    void platform_ws2812_set(unsigned int idx, uint8_t r, uint8_t g, uint8_t b);
+
+    /**
+     * Queue the colors set so far as the next frame
+     * 
+     * The frame is encoded right away, into whichever buffer is not being
+     * sent; it goes out by DMA once the strip has latched the previous
+     * one. A frame still waiting to go out is replaced.
+     */
+    void platform_ws2812_show(void);
+
+    /**
+     * Select who drives the strip
+     * 
+     * By default, the strip follows the blink setting, with the on-board
+     * LED's period and duty cycle; with @c false, it shows only what the
+     * application sets.
+     */
+    void platform_ws2812_set_auto(bool on);
+
+    /// Set the global brightness (0 ... 255)
+    void platform_ws2812_set_brightness(uint8_t val);
+
+    /// Check whether a frame is being sent or waiting to be
+    bool platform_ws2812_busy(void);
+
+    /**
+     * Get a snapshot of the strip counters
+     * 
+     * @param[out]	stats	Where to store the snapshot
+     */
+    void platform_ws2812_get_stats(platform_ws2812_stats_t *stats);
+
     //////////////////////////////////////////////////////////////////////////////
 
 #ifdef __cplusplus
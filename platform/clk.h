@@ -1,6 +1,169 @@
 #ifndef CLK_H
 #define CLK_H
 
+/*
+ * DFLL48M operating mode
+ * 
+ * When non-zero, the DFLL48M is run in closed-loop mode, referenced to the
+ * 32.768 kHz crystal (XOSC32K) via GCLK_GEN1. If the crystal fails to start
+ * (e.g. it is not populated on the board) or the DFLL fails to lock, the
+ * DFLL is left in open-loop mode with the factory calibration, as before.
+ * 
+ * NOTE: Open-loop is good to about +/-1% across temperature; closed-loop
+ *       tracks the crystal (typically +/-20 ppm).
+ */
+#if !defined(PLATFORM_CLK_DFLL_CLOSED_LOOP)
+#define PLATFORM_CLK_DFLL_CLOSED_LOOP 0
+#endif
+
+/// NVM Software Calibration Area word holding the DFLL48M COARSE value
+#if !defined(DFLL_CALIB_ADDR)
+#define DFLL_CALIB_ADDR	0x00806020UL
+#endif
+
+/// Frequency of the DFLL48M reference clock, in Hz
+#define DFLL_REF_HZ	32768UL
+
+/// Target DFLL48M output frequency, in Hz
+#define DFLL_TARGET_HZ	48000000UL
+
+/// DFLLMUL.MUL, rounded to the nearest integer
+#define DFLL_MUL	((DFLL_TARGET_HZ + (DFLL_REF_HZ / 2)) / DFLL_REF_HZ)
+
+/*
+ * DFLLMUL.CSTEP and DFLLMUL.FSTEP
+ * 
+ * The datasheet recommends using at most 50% of the maximum step size to
+ * avoid overshoot while still locking quickly. COARSE is 6 bits wide and
+ * FINE is 10 bits wide; so go with a quarter of each.
+ */
+#define DFLL_CSTEP	((0x3F + 1) / 4)
+#define DFLL_FSTEP	((0x3FF + 1) / 4)
+
+/// Quantization error of DFLL_MUL, in ppm (about +107 ppm for 48 MHz)
+#define DFLL_MUL_ERR_PPM \
+	((((int32_t) (DFLL_MUL * DFLL_REF_HZ) - (int32_t) DFLL_TARGET_HZ) * 1000L) / \
+	(int32_t) (DFLL_TARGET_HZ / 1000UL))
+
+// Sanity checks for the values above; these fail at build time.
+_Static_assert(DFLL_MUL > 0 && DFLL_MUL <= 0xFFFF, "DFLLMUL.MUL out of range");
+_Static_assert(DFLL_CSTEP > 0 && DFLL_CSTEP <= 0x3F, "DFLLMUL.CSTEP out of range");
+_Static_assert(DFLL_FSTEP > 0 && DFLL_FSTEP <= 0x3FF, "DFLLMUL.FSTEP out of range");
+_Static_assert(DFLL_MUL_ERR_PPM > -250 && DFLL_MUL_ERR_PPM < 250,
+		"DFLLMUL.MUL quantization error too large");
+
+/*
+ * Number of polling iterations before giving up on XOSC32K or the DFLL lock.
+ * 
+ * At 4 MHz and several cycles per iteration, this is a bit over one second;
+ * this comfortably covers the crystal's worst-case startup time.
+ */
+#define DFLL_LOCK_TIMEOUT_LOOPS	(500000UL)
+
+/// Non-zero if the DFLL48M is locked to XOSC32K
+static bool dfll_closed_loop = false;
+
+/*
+ * Start up XOSC32K and route it to the DFLL48M reference via GCLK_GEN1
+ * 
+ * Return true if the crystal came up within the timeout.
+ */
+static bool dfll_ref_init(void) {
+    uint32_t n = 0;
+
+    /*
+     * Crystal mode, 32 kHz output enabled, 62.5-ms startup time.
+     * 
+     * NOTE: ONDEMAND must be cleared, otherwise the oscillator only runs
+     *       when a peripheral (or GCLK) requests it.
+     */
+    OSC32KCTRL_REGS->OSC32KCTRL_XOSC32K = (0x0 << 8) | (1 << 3) | (1 << 2);
+    OSC32KCTRL_REGS->OSC32KCTRL_XOSC32K |= (1 << 1);
+    while ((OSC32KCTRL_REGS->OSC32KCTRL_STATUS & (1 << 0)) == 0) {
+        if (++n >= DFLL_LOCK_TIMEOUT_LOOPS) {
+            // No crystal; turn it back off.
+            OSC32KCTRL_REGS->OSC32KCTRL_XOSC32K = 0;
+            return false;
+        }
+        asm("nop");
+    }
+
+    // GCLK_GEN1 <- XOSC32K, no division
+    GCLK_REGS->GCLK_GENCTRL[1] = 0x00000104;
+    while ((GCLK_REGS->GCLK_SYNCBUSY & (1 << 3)) != 0)
+        asm("nop");
+
+    // GCLK_DFLL48M_REF is at index 0; use Generator 1.
+    GCLK_REGS->GCLK_PCHCTRL[0] = 0x00000041;
+    while ((GCLK_REGS->GCLK_PCHCTRL[0] & 0x00000040) == 0)
+        asm("nop");
+    return true;
+}
+
+/*
+ * Undo dfll_ref_init(): nothing else uses GCLK_GEN1 or XOSC32K, so there is
+ * no point in keeping them running once the DFLL is back in open-loop mode.
+ */
+static void dfll_ref_release(void) {
+    GCLK_REGS->GCLK_PCHCTRL[0] = 0;
+    while ((GCLK_REGS->GCLK_PCHCTRL[0] & 0x00000040) != 0)
+        asm("nop");
+
+    GCLK_REGS->GCLK_GENCTRL[1] = 0;
+    while ((GCLK_REGS->GCLK_SYNCBUSY & (1 << 3)) != 0)
+        asm("nop");
+
+    OSC32KCTRL_REGS->OSC32KCTRL_XOSC32K = 0;
+}
+
+/*
+ * Switch an already-enabled DFLL48M into closed-loop mode
+ * 
+ * Return true if both coarse and fine lock were achieved; otherwise, the DFLL
+ * is reverted to open-loop mode.
+ */
+static bool dfll_closed_loop_enable(void) {
+    uint32_t n = 0;
+
+    OSCCTRL_REGS->OSCCTRL_DFLLMUL = ((uint32_t) DFLL_CSTEP << 26) |
+            ((uint32_t) DFLL_FSTEP << 16) | (DFLL_MUL << 0);
+    while ((OSCCTRL_REGS->OSCCTRL_STATUS & (1 << 24)) == 0)
+        asm("nop");
+
+    // MODE = 1 (closed-loop)
+    OSCCTRL_REGS->OSCCTRL_DFLLCTRL |= (1 << 2);
+    while ((OSCCTRL_REGS->OSCCTRL_STATUS & (1 << 24)) == 0)
+        asm("nop");
+
+    // Wait for DFLLLCKC and DFLLLCKF
+    while ((OSCCTRL_REGS->OSCCTRL_STATUS & (0x3 << 26)) != (0x3 << 26)) {
+        if (++n >= DFLL_LOCK_TIMEOUT_LOOPS) {
+            // Fall back to open-loop; DFLLVAL still holds the calibration.
+            OSCCTRL_REGS->OSCCTRL_DFLLCTRL &= ~(1 << 2);
+            while ((OSCCTRL_REGS->OSCCTRL_STATUS & (1 << 24)) == 0)
+                asm("nop");
+            return false;
+        }
+        asm("nop");
+    }
+    return true;
+}
+
+/*
+ * Lock the DFLL48M to XOSC32K
+ * 
+ * Return true if locked; otherwise, the DFLL is left in open-loop mode and
+ * the reference path is shut down again.
+ */
+static bool dfll_lock(void) {
+    if (!dfll_ref_init())
+        return false;
+    if (dfll_closed_loop_enable())
+        return true;
+    dfll_ref_release();
+    return false;
+}
+
 // Enable higher frequencies for higher performance
 
 void raise_perf_level(void) {
@@ -43,7 +206,7 @@ void raise_perf_level(void) {
      * ... then writing the calibration values (which MUST be done as a
      * single write, hence the use of a temporary variable)...
      */
-    tmp_reg = *((uint32_t*) 0x00806020);
+    tmp_reg = *((uint32_t*) DFLL_CALIB_ADDR);
     tmp_reg &= ((uint32_t) (0b111111) << 25);
     tmp_reg >>= 15;
     tmp_reg |= ((512 << 0) & 0x000003ff);
@@ -61,41 +224,88 @@ void raise_perf_level(void) {
     //	while ((OSCCTRL_REGS->OSCCTRL_STATUS & (1 << 24)) == 0)
     //		asm("nop");
 
+    /*
+     * Optionally lock the DFLL to the 32 kHz crystal. This is done while
+     * GCLK_GEN0 is still on OSC16M, so that lock-in transients do not
+     * reach the CPU.
+     */
+#if PLATFORM_CLK_DFLL_CLOSED_LOOP
+    dfll_closed_loop = dfll_lock();
+#endif
+
     /*
      * Configure GCLK_GEN2 as described; this one will become the main
      * clock for slow/medium-speed peripherals, as GCLK_GEN0 will be
      * stepped up for 24 MHz operation.
      */
     GCLK_REGS->GCLK_GENCTRL[2] = 0x00000105;
-    while ((GCLK_REGS->GCLK_SYNCBUSY & (1 << 4)) != 0)
-        asm("nop");
+    sync_post(&GCLK_REGS->GCLK_SYNCBUSY, (1 << 4));
 
     // Switch over GCLK_GEN0 to DFLL48M, with DIV=2 to get 24 MHz.
     GCLK_REGS->GCLK_GENCTRL[0] = 0x00020107;
-    while ((GCLK_REGS->GCLK_SYNCBUSY & (1 << 2)) != 0)
-        asm("nop");
+    sync_post(&GCLK_REGS->GCLK_SYNCBUSY, (1 << 2));
 
     // Done. We're now at 24 MHz.
     return;
 }
 
+// Check whether the DFLL48M is running in closed-loop mode
+
+bool platform_clk_dfll_closed_loop(void) {
+    return dfll_closed_loop;
+}
+
+// Measure the current frequency error of the DFLL48M
+
+bool platform_clk_dfll_error_ppm(int32_t *ppm) {
+    int32_t diff = 0;
+
+    if (!dfll_closed_loop || !ppm)
+        return false;
+
+    /*
+     * In closed-loop mode, DFLLVAL.DIFF holds (MUL - measured ratio) for
+     * the last reference period. A read request is required to get a
+     * coherent value.
+     */
+    OSCCTRL_REGS->OSCCTRL_DFLLSYNC = (1 << 7);
+    while ((OSCCTRL_REGS->OSCCTRL_STATUS & (1 << 24)) == 0)
+        asm("nop");
+    diff = (int16_t) (OSCCTRL_REGS->OSCCTRL_DFLLVAL >> 16);
+
+    /*
+     * Positive DIFF means the DFLL is running slow. Add the quantization
+     * error of MUL itself, relative to the nominal 48 MHz.
+     */
+    *ppm = (int32_t) ((-(int64_t) diff * 1000000) / (int32_t) DFLL_MUL) +
+            DFLL_MUL_ERR_PPM;
+    return true;
+}
+
 void TC0_Init(void) {
-    // Enable the TC0 Bus Clock
-    GCLK_REGS -> GCLK_PCHCTRL[23] = (1 << 6); // Bit 6 Enable
-    while ((GCLK_REGS -> GCLK_PCHCTRL [23] * (1 << 6)) == 0);
+    // Enable the TC0 bus and GCLK clocks; released while not blinking
+    pclk_get(PLATFORM_PCLK_TC0);
 
     // Setting up the TC 0 -> CTRLA Register
     TC0_REGS -> COUNT16.TC_CTRLA = (1); // Software Reset; Bit 0
-    while (TC0_REGS -> COUNT16.TC_SYNCBUSY & (1));
+    sync_post(&TC0_REGS -> COUNT16.TC_SYNCBUSY, (1 << 0));
+    sync_wait(&TC0_REGS -> COUNT16.TC_SYNCBUSY, (1 << 0));
 
-    TC0_REGS -> COUNT16.TC_CTRLA = (0x0 << 2); // Set to 16 bit mode; Bit[3:2].
-    TC0_REGS -> COUNT16.TC_CTRLA = (0x1 << 4); // Reset counter on next prescaler clock Bit[5:4]]
-    TC0_REGS -> COUNT16.TC_CTRLA = (0x7 << 8); // Prescaler Factor: 1024 Bit[10:8]]
+    /*
+     * 16-bit mode, reset the counter on the next prescaler clock, and
+     * prescale by 1024; all in one store.
+     */
+    TC0_REGS -> COUNT16.TC_CTRLA = RF_VALUE(RF_REG_TC_CTRLA,
+            RF(RF_TC_CTRLA_MODE, 0x0),
+            RF(RF_TC_CTRLA_PRESCSYNC, 0x1),
+            RF(RF_TC_CTRLA_PRESCALER, 0x7));
 
-    // Setting up the WAVE Register
-    TC0_REGS -> COUNT16.TC_WAVE = (0x1 << 0); // Use MFRQ Bit [1:0]
+    // Setting up the WAVE Register: MFRQ
+    TC0_REGS -> COUNT16.TC_WAVE = RF_VALUE(RF_REG_TC_WAVE,
+            RF(RF_TC_WAVE_WAVEGEN, 0x1));
 
-    TC0_REGS -> COUNT16.TC_CTRLA |= (1 << 1); // Enable TC0 Peripheral Bit 1
+    TC0_REGS -> COUNT16.TC_CTRLA |= RF_MASK(RF_TC_CTRLA_ENABLE);
+    sync_post(&TC0_REGS -> COUNT16.TC_SYNCBUSY, (1 << 1));
 }
 
-#endif CLK_H
\ No newline at end of file
+#endif // CLK_H
@@ -0,0 +1,648 @@
+/**
+ * @file platform/display.c
+ * @brief Platform-support routines, SPI display with a RAM framebuffer
+ */
+
+/*
+ * HW configuration:
+ * -- SPI: SERCOM0 host, GCLK_GEN0 (24 MHz); MOSI on PA04 (PAD0) and SCK on
+ *    PA05 (PAD1), peripheral function D. There is no MISO.
+ * -- D/C, CS and RST: plain outputs, PA06, PA07 and PA08 by default (see
+ *    PLATFORM_DISP_*_PIN). RST may be left undefined if the module resets
+ *    itself at power-up.
+ * -- Panel: SSD1306 (1bpp) or ST7735S (16bpp), per PLATFORM_DISP_BPP
+ *
+ * Drawing only touches the framebuffer. The framebuffer is split into
+ * bands, each as many pixel rows as share one byte in the panel's memory
+ * (eight for the SSD1306's pages, one for RGB565), and each band keeps the
+ * column span changed since it was last sent. From the main loop, runs of
+ * bands with the same span are sent as one rectangle: the panel's address
+ * window is set by polled writes, and the pixel data follows by DMA, one
+ * band at a time, or in one go if the span is the full width (the bands
+ * then lie back to back in RAM).
+ *
+ * A band drawn into while it is being sent is simply marked again, and
+ * goes out once more with the next rectangle.
+ */
+
+// Common include for the XC32 compiler
+#include <xc.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "sync.h"
+#include "pclk.h"
+#include "regfield.h"
+#include "pio.h"
+#include "dma.h"
+#include "../platform.h"
+
+// Functions "exported" by this file
+void platform_disp_init(void);
+void platform_disp_tick_handler(const platform_timespec_t *tick);
+
+/////////////////////////////////////////////////////////////////////////////
+
+#define DISP_SPI_REGS	(&SERCOM0_REGS->SPIM)
+
+#if !defined(PLATFORM_DISP_GROUP)
+#define PLATFORM_DISP_GROUP	0
+#endif
+#if !defined(PLATFORM_DISP_DC_PIN)
+#define PLATFORM_DISP_DC_PIN	6
+#endif
+#if !defined(PLATFORM_DISP_CS_PIN)
+#define PLATFORM_DISP_CS_PIN	7
+#endif
+#if !defined(PLATFORM_DISP_RST_PIN) && !defined(PLATFORM_DISP_NO_RST)
+#define PLATFORM_DISP_RST_PIN	8
+#endif
+
+#if defined(PLATFORM_DISP_RST_PIN)
+#define DISP_RST_MSK	(1 << PLATFORM_DISP_RST_PIN)
+#else
+#define DISP_RST_MSK	0
+#endif
+
+/// SCK rate; the SERCOM divides GCLK_GEN0 by an even number, rounded down
+#if !defined(PLATFORM_DISP_SPI_HZ)
+#if PLATFORM_DISP_BPP == 1
+#define PLATFORM_DISP_SPI_HZ	6000000
+#else
+#define PLATFORM_DISP_SPI_HZ	12000000
+#endif
+#endif
+#define DISP_SPI_BAUD	((24000000 + 2 * PLATFORM_DISP_SPI_HZ - 1) / (2 * PLATFORM_DISP_SPI_HZ) - 1)
+
+/// DMAC trigger for "SERCOM0 DATA empty", from the device header
+#define DISP_DMA_TRIG	SERCOM0_DMAC_ID_TX
+
+#if PLATFORM_DISP_BPP == 1
+#define DISP_BAND_ROWS	8
+#define DISP_COL_BYTES	1
+#else
+#define DISP_BAND_ROWS	1
+#define DISP_COL_BYTES	2
+#endif
+#define DISP_NR_BANDS	(PLATFORM_DISP_HEIGHT / DISP_BAND_ROWS)
+#define DISP_BAND_BYTES	(PLATFORM_DISP_WIDTH * DISP_COL_BYTES)
+
+_Static_assert(PLATFORM_DISP_WIDTH <= 255, "Dirty spans are kept as bytes");
+_Static_assert(DISP_NR_BANDS * DISP_BAND_BYTES <= 65535, "A full frame must fit one DMA block");
+
+/// Delays around the hardware reset, in ms
+#define DISP_T_RESET_MS		1
+#define DISP_T_BOOT_MS		10
+
+/*
+ * Panel bring-up: command, argument count, arguments, and if the count has
+ * DISP_DELAY set, a delay in ms to observe afterwards
+ */
+#define DISP_DELAY	0x80
+
+#if PLATFORM_DISP_BPP == 1
+
+/// SSD1306 takes its arguments as commands too (D/C low)
+#define DISP_ARGS_ARE_DATA	0
+
+static const uint8_t disp_init_seq[] = {
+    0xAE, 0,			// Display off
+    0xD5, 1, 0x80,		// Clock divide, oscillator
+    0xA8, 1, 0x3F,		// 64 rows
+    0xD3, 1, 0x00,		// No vertical offset
+    0x40, 0,			// Start line 0
+    0x8D, 1, 0x14,		// Charge pump on
+    0x20, 1, 0x00,		// Horizontal addressing
+    0xA1, 0,			// Column 127 is SEG0
+    0xC8, 0,			// Scan COM63 to COM0
+    0xDA, 1, 0x12,		// Alternative COM pins
+    0x81, 1, 0xCF,		// Contrast
+    0xD9, 1, 0xF1,		// Pre-charge
+    0xDB, 1, 0x40,		// VCOMH
+    0xA4, 0,			// Show RAM contents
+    0xA6, 0,			// Not inverted
+    0xAF, DISP_DELAY, 100,	// Display on
+};
+
+#else
+
+/// ST7735S takes its arguments as data (D/C high)
+#define DISP_ARGS_ARE_DATA	1
+
+/*
+ * Window offsets into the controller's 132x162 memory; these are for the
+ * common 0.96" 160x80 IPS modules, in landscape
+ */
+#if !defined(PLATFORM_DISP_XOFS)
+#define PLATFORM_DISP_XOFS	1
+#endif
+#if !defined(PLATFORM_DISP_YOFS)
+#define PLATFORM_DISP_YOFS	26
+#endif
+
+static const uint8_t disp_init_seq[] = {
+    0x01, DISP_DELAY, 150,	// SWRESET
+    0x11, DISP_DELAY, 120,	// SLPOUT
+    0x3A, 1, 0x05,		// RGB565
+    0x36, 1, 0x68,		// MX, MV, BGR: landscape
+    0x21, 0,			// Inverted (IPS panel)
+    0x13, 0,			// Normal display mode
+    0x29, DISP_DELAY, 20,	// Display on
+};
+
+#endif
+
+/// Driver state
+#define DISP_ST_BOOT	0	// Waiting for the first tick
+#define DISP_ST_RESET	1	// RST held low
+#define DISP_ST_INIT	2	// Sending disp_init_seq
+#define DISP_ST_IDLE	3	// Up to date, or waiting for a change
+#define DISP_ST_STREAM	4	// Sending a rectangle
+
+typedef struct ctx_disp_type {
+    uint8_t fb[DISP_NR_BANDS * DISP_BAND_BYTES];
+
+    /// Changed columns per band; clean if x0 > x1
+    uint8_t dirty_x0[DISP_NR_BANDS];
+    uint8_t dirty_x1[DISP_NR_BANDS];
+
+    uint8_t state;
+
+    /// Next byte of disp_init_seq, and the delay in force
+    uint8_t init_idx;
+    uint8_t wait_ms;
+    platform_timespec_t ts_wait;
+
+    /// Rectangle being sent: next band, end band, and columns
+    uint8_t band;
+    uint8_t band_end;
+    uint8_t x0;
+    uint8_t x1;
+
+    /// A frame is on-going since ts_frame
+    bool in_frame;
+    platform_timespec_t ts_frame;
+    uint32_t frame_bytes;
+
+    platform_disp_stats_t stats;
+} ctx_disp_t;
+static ctx_disp_t ctx_disp;
+
+//////////////////////////////////////////////////////////////////////////////
+
+/*
+ * 5x7 font, printable ASCII; one byte per column, top row in bit 0
+ */
+static const uint8_t disp_font[][5] = {
+    {0x00, 0x00, 0x00, 0x00, 0x00}, {0x00, 0x00, 0x5F, 0x00, 0x00},	// ' ' !
+    {0x00, 0x07, 0x00, 0x07, 0x00}, {0x14, 0x7F, 0x14, 0x7F, 0x14},	// " #
+    {0x24, 0x2A, 0x7F, 0x2A, 0x12}, {0x23, 0x13, 0x08, 0x64, 0x62},	// $ %
+    {0x36, 0x49, 0x55, 0x22, 0x50}, {0x00, 0x05, 0x03, 0x00, 0x00},	// & '
+    {0x00, 0x1C, 0x22, 0x41, 0x00}, {0x00, 0x41, 0x22, 0x1C, 0x00},	// ( )
+    {0x08, 0x2A, 0x1C, 0x2A, 0x08}, {0x08, 0x08, 0x3E, 0x08, 0x08},	// * +
+    {0x00, 0x50, 0x30, 0x00, 0x00}, {0x08, 0x08, 0x08, 0x08, 0x08},	// , -
+    {0x00, 0x60, 0x60, 0x00, 0x00}, {0x20, 0x10, 0x08, 0x04, 0x02},	// . /
+    {0x3E, 0x51, 0x49, 0x45, 0x3E}, {0x00, 0x42, 0x7F, 0x40, 0x00},	// 0 1
+    {0x42, 0x61, 0x51, 0x49, 0x46}, {0x21, 0x41, 0x45, 0x4B, 0x31},	// 2 3
+    {0x18, 0x14, 0x12, 0x7F, 0x10}, {0x27, 0x45, 0x45, 0x45, 0x39},	// 4 5
+    {0x3C, 0x4A, 0x49, 0x49, 0x30}, {0x01, 0x71, 0x09, 0x05, 0x03},	// 6 7
+    {0x36, 0x49, 0x49, 0x49, 0x36}, {0x06, 0x49, 0x49, 0x29, 0x1E},	// 8 9
+    {0x00, 0x36, 0x36, 0x00, 0x00}, {0x00, 0x56, 0x36, 0x00, 0x00},	// : ;
+    {0x08, 0x14, 0x22, 0x41, 0x00}, {0x14, 0x14, 0x14, 0x14, 0x14},	// < =
+    {0x00, 0x41, 0x22, 0x14, 0x08}, {0x02, 0x01, 0x51, 0x09, 0x06},	// > ?
+    {0x32, 0x49, 0x79, 0x41, 0x3E}, {0x7E, 0x11, 0x11, 0x11, 0x7E},	// @ A
+    {0x7F, 0x49, 0x49, 0x49, 0x36}, {0x3E, 0x41, 0x41, 0x41, 0x22},	// B C
+    {0x7F, 0x41, 0x41, 0x22, 0x1C}, {0x7F, 0x49, 0x49, 0x49, 0x41},	// D E
+    {0x7F, 0x09, 0x09, 0x09, 0x01}, {0x3E, 0x41, 0x49, 0x49, 0x7A},	// F G
+    {0x7F, 0x08, 0x08, 0x08, 0x7F}, {0x00, 0x41, 0x7F, 0x41, 0x00},	// H I
+    {0x20, 0x40, 0x41, 0x3F, 0x01}, {0x7F, 0x08, 0x14, 0x22, 0x41},	// J K
+    {0x7F, 0x40, 0x40, 0x40, 0x40}, {0x7F, 0x02, 0x0C, 0x02, 0x7F},	// L M
+    {0x7F, 0x04, 0x08, 0x10, 0x7F}, {0x3E, 0x41, 0x41, 0x41, 0x3E},	// N O
+    {0x7F, 0x09, 0x09, 0x09, 0x06}, {0x3E, 0x41, 0x51, 0x21, 0x5E},	// P Q
+    {0x7F, 0x09, 0x19, 0x29, 0x46}, {0x46, 0x49, 0x49, 0x49, 0x31},	// R S
+    {0x01, 0x01, 0x7F, 0x01, 0x01}, {0x3F, 0x40, 0x40, 0x40, 0x3F},	// T U
+    {0x1F, 0x20, 0x40, 0x20, 0x1F}, {0x3F, 0x40, 0x38, 0x40, 0x3F},	// V W
+    {0x63, 0x14, 0x08, 0x14, 0x63}, {0x07, 0x08, 0x70, 0x08, 0x07},	// X Y
+    {0x61, 0x51, 0x49, 0x45, 0x43}, {0x00, 0x7F, 0x41, 0x41, 0x00},	// Z [
+    {0x02, 0x04, 0x08, 0x10, 0x20}, {0x00, 0x41, 0x41, 0x7F, 0x00},	// \ ]
+    {0x04, 0x02, 0x01, 0x02, 0x04}, {0x40, 0x40, 0x40, 0x40, 0x40},	// ^ _
+    {0x00, 0x01, 0x02, 0x04, 0x00}, {0x20, 0x54, 0x54, 0x54, 0x78},	// ` a
+    {0x7F, 0x48, 0x44, 0x44, 0x38}, {0x38, 0x44, 0x44, 0x44, 0x20},	// b c
+    {0x38, 0x44, 0x44, 0x48, 0x7F}, {0x38, 0x54, 0x54, 0x54, 0x18},	// d e
+    {0x08, 0x7E, 0x09, 0x01, 0x02}, {0x0C, 0x52, 0x52, 0x52, 0x3E},	// f g
+    {0x7F, 0x08, 0x04, 0x04, 0x78}, {0x00, 0x44, 0x7D, 0x40, 0x00},	// h i
+    {0x20, 0x40, 0x44, 0x3D, 0x00}, {0x7F, 0x10, 0x28, 0x44, 0x00},	// j k
+    {0x00, 0x41, 0x7F, 0x40, 0x00}, {0x7C, 0x04, 0x18, 0x04, 0x78},	// l m
+    {0x7C, 0x08, 0x04, 0x04, 0x78}, {0x38, 0x44, 0x44, 0x44, 0x38},	// n o
+    {0x7C, 0x14, 0x14, 0x14, 0x08}, {0x08, 0x14, 0x14, 0x18, 0x7C},	// p q
+    {0x7C, 0x08, 0x04, 0x04, 0x08}, {0x48, 0x54, 0x54, 0x54, 0x20},	// r s
+    {0x04, 0x3F, 0x44, 0x40, 0x20}, {0x3C, 0x40, 0x40, 0x20, 0x7C},	// t u
+    {0x1C, 0x20, 0x40, 0x20, 0x1C}, {0x3C, 0x40, 0x30, 0x40, 0x3C},	// v w
+    {0x44, 0x28, 0x10, 0x28, 0x44}, {0x0C, 0x50, 0x50, 0x50, 0x3C},	// x y
+    {0x44, 0x64, 0x54, 0x4C, 0x44}, {0x00, 0x08, 0x36, 0x41, 0x00},	// z {
+    {0x00, 0x00, 0x7F, 0x00, 0x00}, {0x00, 0x41, 0x36, 0x08, 0x00},	// | }
+    {0x08, 0x04, 0x08, 0x10, 0x08},					// ~
+};
+
+_Static_assert(sizeof (disp_font) / sizeof (disp_font[0]) == 0x7F - 0x20,
+        "One glyph per printable ASCII character");
+
+//////////////////////////////////////////////////////////////////////////////
+
+// Framebuffer access; no clipping, no dirty marking
+
+static inline void disp_put(unsigned int x, unsigned int y, uint16_t color) {
+#if PLATFORM_DISP_BPP == 1
+    uint8_t *p = &ctx_disp.fb[(y >> 3) * DISP_BAND_BYTES + x];
+
+    if (color != 0)
+        *p |= (1 << (y & 7));
+    else
+        *p &= ~(1 << (y & 7));
+#else
+    uint8_t *p = &ctx_disp.fb[y * DISP_BAND_BYTES + x * 2];
+
+    // The panel takes RGB565 MSB first, so store it that way.
+    p[0] = (uint8_t) (color >> 8);
+    p[1] = (uint8_t) color;
+#endif
+}
+
+// Widen the dirty spans of the bands covering rows y0 ... y1 to x0 ... x1
+
+static void disp_mark(unsigned int x0, unsigned int x1, unsigned int y0, unsigned int y1) {
+    unsigned int b;
+
+    // A clean band has x0 = 0xFF and x1 = 0, so min/max just works.
+    for (b = y0 / DISP_BAND_ROWS; b <= y1 / DISP_BAND_ROWS; ++b) {
+        if (ctx_disp.dirty_x0[b] > x0)
+            ctx_disp.dirty_x0[b] = (uint8_t) x0;
+        if (ctx_disp.dirty_x1[b] < x1)
+            ctx_disp.dirty_x1[b] = (uint8_t) x1;
+    }
+}
+
+static inline void disp_set_clean(unsigned int b) {
+    ctx_disp.dirty_x0[b] = 0xFF;
+    ctx_disp.dirty_x1[b] = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+// Pin and SPI helpers
+
+static inline void disp_dc(bool data) {
+    if (data)
+        pio_set(PLATFORM_DISP_GROUP, (1 << PLATFORM_DISP_DC_PIN));
+    else
+        pio_clr(PLATFORM_DISP_GROUP, (1 << PLATFORM_DISP_DC_PIN));
+}
+
+static inline void disp_select(bool sel) {
+    if (sel)
+        pio_clr(PLATFORM_DISP_GROUP, (1 << PLATFORM_DISP_CS_PIN));
+    else
+        pio_set(PLATFORM_DISP_GROUP, (1 << PLATFORM_DISP_CS_PIN));
+}
+
+static void disp_spi_put(uint8_t b) {
+    while ((DISP_SPI_REGS->SERCOM_INTFLAG & (1 << 0)) == 0) // DRE
+        asm("nop");
+    DISP_SPI_REGS->SERCOM_DATA = b;
+}
+
+/*
+ * Wait for the last byte to have left the shift register, as D/C and CS may
+ * only change in between bytes
+ *
+ * NOTE: TXC is only cleared by new data, so this must follow a write.
+ */
+static void disp_spi_drain(void) {
+    while ((DISP_SPI_REGS->SERCOM_INTFLAG & (1 << 1)) == 0) // TXC
+        asm("nop");
+}
+
+// Send one command and its arguments, by polling
+
+static void disp_cmd(uint8_t cmd, const uint8_t *args, unsigned int nr_args) {
+    disp_dc(false);
+    disp_spi_put(cmd);
+    if (nr_args > 0 && DISP_ARGS_ARE_DATA) {
+        disp_spi_drain();
+        disp_dc(true);
+    }
+    while (nr_args-- > 0)
+        disp_spi_put(*(args++));
+    disp_spi_drain();
+}
+
+/*
+ * Point the panel's write window at columns x0 ... x1 of bands b0 ... b1
+ * (SSD1306 pages, or ST7735S rows)
+ */
+
+static void disp_window(unsigned int x0, unsigned int x1, unsigned int b0, unsigned int b1) {
+#if PLATFORM_DISP_BPP == 1
+    uint8_t a[2];
+
+    a[0] = (uint8_t) x0;
+    a[1] = (uint8_t) x1;
+    disp_cmd(0x21, a, 2); // Column range
+    a[0] = (uint8_t) b0;
+    a[1] = (uint8_t) b1;
+    disp_cmd(0x22, a, 2); // Page range
+#else
+    uint8_t a[4];
+
+    x0 += PLATFORM_DISP_XOFS;
+    x1 += PLATFORM_DISP_XOFS;
+    a[0] = (uint8_t) (x0 >> 8);
+    a[1] = (uint8_t) x0;
+    a[2] = (uint8_t) (x1 >> 8);
+    a[3] = (uint8_t) x1;
+    disp_cmd(0x2A, a, 4); // CASET
+    b0 += PLATFORM_DISP_YOFS;
+    b1 += PLATFORM_DISP_YOFS;
+    a[0] = (uint8_t) (b0 >> 8);
+    a[1] = (uint8_t) b0;
+    a[2] = (uint8_t) (b1 >> 8);
+    a[3] = (uint8_t) b1;
+    disp_cmd(0x2B, a, 4); // RASET
+    disp_cmd(0x2C, NULL, 0); // RAMWR
+#endif
+    disp_dc(true);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+// Time elapsed since @c since, in ms
+
+static uint32_t disp_elapsed_ms(const platform_timespec_t *tick, const platform_timespec_t *since) {
+    platform_timespec_t ts_delta;
+
+    platform_tick_delta(&ts_delta, tick, since);
+    return ts_delta.nr_sec * 1000 + ts_delta.nr_nsec / 1000000;
+}
+
+static void disp_wait(ctx_disp_t *ctx, const platform_timespec_t *tick, uint8_t ms) {
+    ctx->ts_wait = *tick;
+    ctx->wait_ms = ms;
+}
+
+// Send the next entry of disp_init_seq; return false once there is none
+
+static bool disp_init_step(ctx_disp_t *ctx, const platform_timespec_t *tick) {
+    const uint8_t *e = &disp_init_seq[ctx->init_idx];
+    unsigned int n;
+
+    if (ctx->init_idx >= sizeof (disp_init_seq))
+        return false;
+
+    n = e[1] & ~DISP_DELAY;
+    disp_select(true);
+    disp_cmd(e[0], &e[2], n);
+    disp_select(false);
+    ctx->init_idx += 2 + n;
+    if ((e[1] & DISP_DELAY) != 0)
+        disp_wait(ctx, tick, disp_init_seq[ctx->init_idx++]);
+    return true;
+}
+
+// Start sending the next run of bands with the same dirty span, if any
+
+static bool disp_rect_start(ctx_disp_t *ctx) {
+    unsigned int b, e;
+
+    for (b = 0; b < DISP_NR_BANDS; ++b) {
+        if (ctx->dirty_x0[b] <= ctx->dirty_x1[b])
+            break;
+    }
+    if (b >= DISP_NR_BANDS)
+        return false;
+
+    ctx->x0 = ctx->dirty_x0[b];
+    ctx->x1 = ctx->dirty_x1[b];
+    for (e = b; e < DISP_NR_BANDS; ++e) {
+        if (ctx->dirty_x0[e] != ctx->x0 || ctx->dirty_x1[e] != ctx->x1)
+            break;
+        disp_set_clean(e);
+    }
+    ctx->band = (uint8_t) b;
+    ctx->band_end = (uint8_t) e;
+
+    disp_select(true);
+    disp_window(ctx->x0, ctx->x1, b, e - 1);
+    ++ctx->stats.nr_rects;
+    return true;
+}
+
+// Hand the next band (or all of them, if back to back) to DMA
+
+static void disp_rect_next(ctx_disp_t *ctx) {
+    unsigned int len = (ctx->x1 - ctx->x0 + 1) * DISP_COL_BYTES;
+    const uint8_t *src = &ctx->fb[ctx->band * DISP_BAND_BYTES + ctx->x0 * DISP_COL_BYTES];
+
+    if (len == DISP_BAND_BYTES) {
+        len *= ctx->band_end - ctx->band;
+        ctx->band = ctx->band_end;
+    } else {
+        ++ctx->band;
+    }
+    dma_start(DMA_CH_DISP, src, &DISP_SPI_REGS->SERCOM_DATA, (uint16_t) len, DISP_DMA_TRIG);
+    ctx->frame_bytes += len;
+    ctx->stats.nr_bytes += len;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+void platform_disp_tick_handler(const platform_timespec_t *tick) {
+    ctx_disp_t *ctx = &ctx_disp;
+    platform_timespec_t ts_delta;
+
+    if (ctx->wait_ms > 0) {
+        if (disp_elapsed_ms(tick, &ctx->ts_wait) < ctx->wait_ms)
+            return;
+        ctx->wait_ms = 0;
+    }
+
+    switch (ctx->state) {
+        case DISP_ST_BOOT:
+            pio_clr(PLATFORM_DISP_GROUP, DISP_RST_MSK);
+            disp_wait(ctx, tick, DISP_T_RESET_MS);
+            ctx->state = DISP_ST_RESET;
+            return;
+
+        case DISP_ST_RESET:
+            pio_set(PLATFORM_DISP_GROUP, DISP_RST_MSK);
+            disp_wait(ctx, tick, DISP_T_BOOT_MS);
+            ctx->state = DISP_ST_INIT;
+            return;
+
+        case DISP_ST_INIT:
+            // One command per call, so as not to hold up the main loop
+            if (!disp_init_step(ctx, tick))
+                ctx->state = DISP_ST_IDLE;
+            return;
+
+        case DISP_ST_IDLE:
+            if (!disp_rect_start(ctx))
+                return;
+            if (!ctx->in_frame) {
+                ctx->in_frame = true;
+                ctx->ts_frame = *tick;
+                ctx->frame_bytes = 0;
+            }
+            ctx->state = DISP_ST_STREAM;
+            disp_rect_next(ctx);
+            return;
+
+        case DISP_ST_STREAM:
+            if (dma_busy(DMA_CH_DISP))
+                return;
+            if (ctx->band < ctx->band_end) {
+                disp_rect_next(ctx);
+                return;
+            }
+            disp_spi_drain();
+            disp_select(false);
+            ctx->state = DISP_ST_IDLE;
+
+            // Start the next rectangle right away; the frame ends with the last.
+            if (disp_rect_start(ctx)) {
+                ctx->state = DISP_ST_STREAM;
+                disp_rect_next(ctx);
+                return;
+            }
+            platform_tick_delta(&ts_delta, tick, &ctx->ts_frame);
+            ctx->stats.last_frame_us = ts_delta.nr_sec * 1000000 + ts_delta.nr_nsec / 1000;
+            ctx->stats.last_frame_bytes = ctx->frame_bytes;
+            ++ctx->stats.nr_frames;
+            ctx->in_frame = false;
+            return;
+
+        default:
+            return;
+    }
+}
+
+void platform_disp_init(void) {
+    unsigned int b;
+
+    memset(&ctx_disp, 0, sizeof (ctx_disp));
+    for (b = 0; b < DISP_NR_BANDS; ++b)
+        disp_set_clean(b);
+
+    // Control lines: deselected, command mode, and in reset until the first tick
+    PORT_SEC_REGS->GROUP[PLATFORM_DISP_GROUP].PORT_OUTSET = (1 << PLATFORM_DISP_CS_PIN);
+    PORT_SEC_REGS->GROUP[PLATFORM_DISP_GROUP].PORT_OUTCLR =
+            (1 << PLATFORM_DISP_DC_PIN) | DISP_RST_MSK;
+    PORT_SEC_REGS->GROUP[PLATFORM_DISP_GROUP].PORT_DIRSET =
+            (1 << PLATFORM_DISP_CS_PIN) | (1 << PLATFORM_DISP_DC_PIN) | DISP_RST_MSK;
+
+    pclk_get(PLATFORM_PCLK_SERCOM0);
+    DISP_SPI_REGS->SERCOM_CTRLA = RF_VALUE(RF_REG_SPI_CTRLA,
+            RF(RF_SPI_CTRLA_SWRST, 0x1));
+    sync_post(&DISP_SPI_REGS->SERCOM_SYNCBUSY, (1 << 0));
+    sync_wait(&DISP_SPI_REGS->SERCOM_SYNCBUSY, (1 << 0));
+
+    // Host, mode 0, MSB first; DO on PAD0 and SCK on PAD1
+    DISP_SPI_REGS->SERCOM_CTRLA = RF_VALUE(RF_REG_SPI_CTRLA,
+            RF(RF_SPI_CTRLA_MODE, 0x3),
+            RF(RF_SPI_CTRLA_DOPO, 0x0),
+            RF(RF_SPI_CTRLA_DIPO, 0x3),
+            RF(RF_SPI_CTRLA_FORM, 0x0),
+            RF(RF_SPI_CTRLA_CPHA, 0x0),
+            RF(RF_SPI_CTRLA_CPOL, 0x0),
+            RF(RF_SPI_CTRLA_DORD, 0x0));
+    DISP_SPI_REGS->SERCOM_CTRLB = RF_VALUE(RF_REG_SPI_CTRLB,
+            RF(RF_SPI_CTRLB_CHSIZE, 0x0),
+            RF(RF_SPI_CTRLB_MSSEN, 0x0),
+            RF(RF_SPI_CTRLB_RXEN, 0x0));
+    sync_post(&DISP_SPI_REGS->SERCOM_SYNCBUSY, (1 << 2));
+    DISP_SPI_REGS->SERCOM_BAUD = DISP_SPI_BAUD;
+
+    // PA04 (MOSI) and PA05 (SCK): peripheral function D
+    PORT_SEC_REGS->GROUP[0].PORT_PINCFG[4] |= (1 << 0);
+    PORT_SEC_REGS->GROUP[0].PORT_PINCFG[5] |= (1 << 0);
+    PORT_SEC_REGS->GROUP[0].PORT_PMUX[2] = (MUX_PA05D_SERCOM0_PAD1 << 4) |
+            (MUX_PA04D_SERCOM0_PAD0 << 0);
+
+    sync_wait(&DISP_SPI_REGS->SERCOM_SYNCBUSY, (1 << 2));
+    DISP_SPI_REGS->SERCOM_CTRLA |= (1 << 1);
+    sync_post(&DISP_SPI_REGS->SERCOM_SYNCBUSY, (1 << 1));
+
+    // The first frame is the whole (blank) framebuffer.
+    disp_mark(0, PLATFORM_DISP_WIDTH - 1, 0, PLATFORM_DISP_HEIGHT - 1);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+void platform_disp_pixel(unsigned int x, unsigned int y, uint16_t color) {
+    if (x >= PLATFORM_DISP_WIDTH || y >= PLATFORM_DISP_HEIGHT)
+        return;
+    disp_put(x, y, color);
+    disp_mark(x, x, y, y);
+}
+
+void platform_disp_fill_rect(unsigned int x, unsigned int y,
+        unsigned int w, unsigned int h, uint16_t color) {
+    unsigned int xe, ye, i, j;
+
+    if (x >= PLATFORM_DISP_WIDTH || y >= PLATFORM_DISP_HEIGHT || w == 0 || h == 0)
+        return;
+    xe = (w > PLATFORM_DISP_WIDTH - x) ? PLATFORM_DISP_WIDTH : x + w;
+    ye = (h > PLATFORM_DISP_HEIGHT - y) ? PLATFORM_DISP_HEIGHT : y + h;
+
+    for (j = y; j < ye; ++j) {
+        for (i = x; i < xe; ++i)
+            disp_put(i, j, color);
+    }
+    disp_mark(x, xe - 1, y, ye - 1);
+}
+
+void platform_disp_clear(uint16_t color) {
+    platform_disp_fill_rect(0, 0, PLATFORM_DISP_WIDTH, PLATFORM_DISP_HEIGHT, color);
+}
+
+unsigned int platform_disp_text(unsigned int x, unsigned int y,
+        const char *s, uint16_t fg, uint16_t bg) {
+    const uint8_t *g;
+    unsigned int x0 = x, i, j, col;
+    char c;
+
+    if (s == NULL || y >= PLATFORM_DISP_HEIGHT)
+        return x;
+
+    for (; (c = *s) != '\0' && x < PLATFORM_DISP_WIDTH; ++s) {
+        g = disp_font[((c < 0x20 || c > 0x7E) ? '?' : c) - 0x20];
+        for (i = 0; i < PLATFORM_DISP_CHAR_W && x + i < PLATFORM_DISP_WIDTH; ++i) {
+            col = (i < 5) ? g[i] : 0;
+            for (j = 0; j < PLATFORM_DISP_CHAR_H && y + j < PLATFORM_DISP_HEIGHT; ++j)
+                disp_put(x + i, y + j, ((col >> j) & 1) ? fg : bg);
+        }
+        x += PLATFORM_DISP_CHAR_W;
+    }
+    if (x > x0) {
+        disp_mark(x0, ((x < PLATFORM_DISP_WIDTH) ? x : PLATFORM_DISP_WIDTH) - 1, y,
+                ((y + PLATFORM_DISP_CHAR_H < PLATFORM_DISP_HEIGHT) ?
+                y + PLATFORM_DISP_CHAR_H : PLATFORM_DISP_HEIGHT) - 1);
+    }
+    return x;
+}
+
+bool platform_disp_busy(void) {
+    unsigned int b;
+
+    if (ctx_disp.state != DISP_ST_IDLE)
+        return true;
+    for (b = 0; b < DISP_NR_BANDS; ++b) {
+        if (ctx_disp.dirty_x0[b] <= ctx_disp.dirty_x1[b])
+            return true;
+    }
+    return false;
+}
+
+void platform_disp_get_stats(platform_disp_stats_t *stats) {
+    if (stats)
+        *stats = ctx_disp.stats;
+}
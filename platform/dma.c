@@ -0,0 +1,80 @@
+/**
+ * @file platform/dma.c
+ * @brief Platform-support routines, memory-to-peripheral DMA
+ */
+
+/*
+ * DMAC keeps each channel's transfer descriptor in RAM, at BASEADDR plus
+ * 16 bytes per channel; the descriptor of a running transfer is written
+ * back at WRBADDR. Only single-block transfers are used, so DESCADDR is
+ * always zero and the channel disables itself once the block is done.
+ *
+ * DMAC sits on the AHB, whose clock is on out of reset; it has no GCLK
+ * channel, and is not part of the pclk table.
+ */
+
+// Common include for the XC32 compiler
+#include <xc.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "dma.h"
+#include "../platform.h"
+
+// Functions "exported" by this file
+void platform_dma_init(void);
+
+/////////////////////////////////////////////////////////////////////////////
+
+static dmac_descriptor_registers_t dma_desc[DMA_NR_CH] __attribute__((aligned(16)));
+static dmac_descriptor_registers_t dma_wrb[DMA_NR_CH] __attribute__((aligned(16)));
+
+void platform_dma_init(void) {
+    memset(dma_desc, 0, sizeof (dma_desc));
+    memset(dma_wrb, 0, sizeof (dma_wrb));
+
+    DMAC_SEC_REGS->DMAC_CTRL = (1 << 0); // SWRST
+    while ((DMAC_SEC_REGS->DMAC_CTRL & (1 << 0)) != 0)
+        asm("nop");
+
+    DMAC_SEC_REGS->DMAC_BASEADDR = (uintptr_t) dma_desc;
+    DMAC_SEC_REGS->DMAC_WRBADDR = (uintptr_t) dma_wrb;
+
+    // All four priority levels, then DMAENABLE
+    DMAC_SEC_REGS->DMAC_CTRL = (0xF << 8) | (1 << 1);
+}
+
+bool dma_busy(unsigned int ch) {
+    DMAC_SEC_REGS->DMAC_CHID = ch;
+    return (DMAC_SEC_REGS->DMAC_CHCTRLA & (1 << 1)) != 0;
+}
+
+void dma_abort(unsigned int ch) {
+    DMAC_SEC_REGS->DMAC_CHID = ch;
+    DMAC_SEC_REGS->DMAC_CHCTRLA &= ~(1 << 1);
+    while ((DMAC_SEC_REGS->DMAC_CHCTRLA & (1 << 1)) != 0)
+        asm("nop");
+}
+
+bool dma_start(unsigned int ch, const void *src, volatile void *dst,
+        uint16_t len, uint8_t trig) {
+    dmac_descriptor_registers_t *d;
+
+    if (ch >= DMA_NR_CH || len == 0 || dma_busy(ch))
+        return false;
+    d = &dma_desc[ch];
+
+    // Byte beats; with SRCINC, SRCADDR is the end of the block (25.6.2.7)
+    d->DMAC_BTCNT = len;
+    d->DMAC_SRCADDR = (uintptr_t) src + len;
+    d->DMAC_DSTADDR = (uintptr_t) dst;
+    d->DMAC_DESCADDR = 0;
+    d->DMAC_BTCTRL = (1 << 10) | (0x0 << 8) | (1 << 0); // SRCINC, BYTE, VALID
+
+    // One beat per trigger; the descriptor must be in RAM before ENABLE.
+    __DMB();
+    DMAC_SEC_REGS->DMAC_CHCTRLB = (0x2 << 22) | ((uint32_t) trig << 8);
+    DMAC_SEC_REGS->DMAC_CHINTFLAG = 0x7;
+    DMAC_SEC_REGS->DMAC_CHCTRLA = (1 << 1);
+    return true;
+}
@@ -0,0 +1,48 @@
+#ifndef DMA_H
+#define DMA_H
+
+/*
+ * Memory-to-peripheral DMA
+ *
+ * A minimal front-end to DMAC: each channel moves one block of bytes from
+ * RAM to a peripheral register, one byte per trigger, and is then idle
+ * again. Channels are fixed per driver; there is no allocator.
+ *
+ * NOTE: These are meant to be called from the main loop only; CHCTRLA and
+ *       the like are reached through CHID, which an interrupt handler
+ *       could change underneath.
+ */
+
+/// DMAC channel used by the display driver
+#define DMA_CH_DISP	0
+
+/// DMAC channel used by the WS2812 strip driver
+#define DMA_CH_WS2812	1
+
+/// DMAC channel used by the CDC USART (synchronous mode only)
+#define DMA_CH_USART	2
+
+/// Number of DMAC channels in use (descriptor memory is reserved for these)
+#define DMA_NR_CH	3
+
+/**
+ * Start a transfer on a channel
+ *
+ * @param[in]	ch	Channel (@c DMA_CH_*)
+ * @param[in]	src	First byte to send; must remain valid until done
+ * @param[in]	dst	Peripheral register written once per beat
+ * @param[in]	len	Number of bytes (1 ... 65535)
+ * @param[in]	trig	Peripheral trigger (DMAC CHCTRLB.TRIGSRC)
+ *
+ * @return	@c false if the channel is still busy, @c true otherwise
+ */
+bool dma_start(unsigned int ch, const void *src, volatile void *dst,
+        uint16_t len, uint8_t trig);
+
+/// Check whether a channel still has a transfer on-going
+bool dma_busy(unsigned int ch);
+
+/// Stop a channel; whatever of its block has not been sent is dropped
+void dma_abort(unsigned int ch);
+
+#endif // DMA_H
@@ -28,15 +28,36 @@
 #include <stdbool.h>
 #include <string.h>
 #include "blink_settings.h"
+#include "sync.h"
+#include "pclk.h"
+#include "regfield.h"
+#include "pio.h"
 
-#include "clk.h"
 #include "../platform.h"
+#include "clk.h"
 
 int top = 23438;
+
+/*
+ * If non-zero, wait this long (in ms) at boot for the host to send 'U' and
+ * detect its baud rate; see platform_usart_cdc_autobaud().
+ */
+#if !defined(PLATFORM_USART_AUTOBAUD_MS)
+#define PLATFORM_USART_AUTOBAUD_MS 0
+#endif
+
 // Initializers defined in other platform_*.c files
+extern void platform_pclk_init(void);
 extern void platform_systick_init(void);
 extern void platform_usart_init(void);
 extern void platform_usart_tick_handler(const platform_timespec_t *tick);
+extern void platform_ow_init(void);
+extern void platform_ow_tick_handler(const platform_timespec_t *tick);
+extern void platform_dma_init(void);
+extern void platform_disp_init(void);
+extern void platform_disp_tick_handler(const platform_timespec_t *tick);
+extern void platform_ws2812_init(void);
+extern void platform_ws2812_tick_handler(const platform_timespec_t *tick);
 /////////////////////////////////////////////////////////////////////////////
 
 
@@ -75,14 +96,16 @@ static void EIC_init_early(void) {
 
     // Reset, and wait for said operation to complete.
     EIC_SEC_REGS->EIC_CTRLA = 0x01;
-    while ((EIC_SEC_REGS->EIC_SYNCBUSY & 0x01) != 0)
-        asm("nop");
+    sync_post(&EIC_SEC_REGS->EIC_SYNCBUSY, 0x01);
 
     /*
      * Just set the debounce prescaler for now, and leave the EIC disabled.
      * This is because most settings are not editable while the peripheral
      * is enabled.
+     * 
+     * NOTE: Registers cannot be written until the reset has completed.
      */
+    sync_wait(&EIC_SEC_REGS->EIC_SYNCBUSY, 0x01);
     EIC_SEC_REGS->EIC_DPRESCALER = (0b0 << 16) | (0b0000 << 4) |
             (0b1111 << 0);
     return;
@@ -96,8 +119,7 @@ static void EIC_init_late(void) {
      * impossible.
      */
     EIC_SEC_REGS->EIC_CTRLA |= 0x02;
-    while ((EIC_SEC_REGS->EIC_SYNCBUSY & 0x02) != 0)
-        asm("nop");
+    sync_post(&EIC_SEC_REGS->EIC_SYNCBUSY, 0x02);
     return;
 }
 
@@ -145,54 +167,88 @@ static void blink_init(void) {
 int read_count() {
     // Allow read access of COUNT register
     // Return back the counter value
+    sync_wait(&TC0_REGS -> COUNT16.TC_SYNCBUSY, (1 << 2));
     TC0_REGS -> COUNT16.TC_CTRLBSET = (0x4 << 5);
-    while (TC0_REGS -> COUNT16.TC_SYNCBUSY & (1 << 2));
+    sync_post(&TC0_REGS -> COUNT16.TC_SYNCBUSY, (1 << 2));
+
+    // COUNT is only valid once the read request has been synchronized.
+    sync_wait(&TC0_REGS -> COUNT16.TC_SYNCBUSY, (1 << 2));
     return TC0_REGS -> COUNT16.TC_COUNT; // 39.8.13
 
 }
 
+/*
+ * Program the blink period (TC0 CC0) without waiting for synchronization
+ * 
+ * Only the previous CC0 write must have been synchronized before CC0 can be
+ * written again; that has almost always happened by the next main-loop
+ * iteration.
+ */
+static void blink_set_top(uint16_t val) {
+    sync_wait(&TC0_REGS -> COUNT16.TC_SYNCBUSY, (1 << 6));
+    TC0_REGS -> COUNT16.TC_CC[0] = val;
+    sync_post(&TC0_REGS -> COUNT16.TC_SYNCBUSY, (1 << 6));
+}
+
+/// Whether the blinker holds a reference to TC0's clocks (taken by TC0_Init())
+static bool blink_clk_held = true;
+
+void platform_blink_restart(void) {
+    // While gated, TC0 is restarted once it is clocked again anyway.
+    if (!blink_clk_held)
+        return;
+
+    sync_wait(&TC0_REGS -> COUNT16.TC_SYNCBUSY, (1 << 4));
+    TC0_REGS -> COUNT16.TC_COUNT = 0;
+    sync_post(&TC0_REGS -> COUNT16.TC_SYNCBUSY, (1 << 4));
+}
+
 void platform_blink_modify(void) {
-    // Start the timer if it's not running
-    /*if (!(TC0_REGS->COUNT16.TC_STATUS & TC_STATUS_STOP_Msk)) {
-        TC0_REGS->COUNT16.TC_CTRLA |= TC_CTRLA_ENABLE_Msk;
-    }*/
-    
+    bool blinking = (currentSetting != OFF && currentSetting != ON);
+
+    // TC0 only needs to run while the LED actually blinks.
+    if (blinking && !blink_clk_held) {
+        pclk_get(PLATFORM_PCLK_TC0);
+        blink_clk_held = true;
+        platform_blink_restart();
+    } else if (!blinking && blink_clk_held) {
+        pclk_put(PLATFORM_PCLK_TC0);
+        blink_clk_held = false;
+    }
+
     switch (currentSetting) {
         case OFF:
-            PORT_SEC_REGS -> GROUP[0].PORT_OUTCLR = (1 << 15);
+            pio_clr(0, (1 << 15));
             break;
         case SLOW:
-            TC0_REGS -> COUNT16.TC_CC[0] = 23438;
-            while (TC0_REGS -> COUNT16.TC_SYNCBUSY & (1 << 6));
-            if (read_count() < TC0_REGS -> COUNT16.TC_CC[0]*0.9) {
-                PORT_SEC_REGS -> GROUP[0].PORT_OUTCLR = (1 << 15);
+            blink_set_top(23438);
+            if (read_count() < 23438*0.9) {
+                pio_clr(0, (1 << 15));
             }
-            if (read_count() > TC0_REGS -> COUNT16.TC_CC[0]*0.9) {
-                PORT_SEC_REGS -> GROUP[0].PORT_OUTSET = (1 << 15);
+            if (read_count() > 23438*0.9) {
+                pio_set(0, (1 << 15));
             }
             break;
         case MEDIUM:
-            TC0_REGS -> COUNT16.TC_CC[0] = 11719;
-            while (TC0_REGS -> COUNT16.TC_SYNCBUSY & (1 << 6));
-            if (read_count() < TC0_REGS -> COUNT16.TC_CC[0]*0.8) {
-                PORT_SEC_REGS -> GROUP[0].PORT_OUTCLR = (1 << 15);
+            blink_set_top(11719);
+            if (read_count() < 11719*0.8) {
+                pio_clr(0, (1 << 15));
             }
-            if (read_count() > TC0_REGS -> COUNT16.TC_CC[0]*0.8) {
-                PORT_SEC_REGS -> GROUP[0].PORT_OUTSET = (1 << 15);
+            if (read_count() > 11719*0.8) {
+                pio_set(0, (1 << 15));
             }
             break;
         case FAST:
-            TC0_REGS -> COUNT16.TC_CC[0] = 7032;
-            while (TC0_REGS -> COUNT16.TC_SYNCBUSY & (1 << 6));
-            if (read_count() < TC0_REGS -> COUNT16.TC_CC[0]*0.5) {
-                PORT_SEC_REGS -> GROUP[0].PORT_OUTCLR = (1 << 15);
+            blink_set_top(7032);
+            if (read_count() < 7032*0.5) {
+                pio_clr(0, (1 << 15));
             }
-            if (read_count() > TC0_REGS -> COUNT16.TC_CC[0]*0.5) {
-                PORT_SEC_REGS -> GROUP[0].PORT_OUTSET = (1 << 15);
+            if (read_count() > 7032*0.5) {
+                pio_set(0, (1 << 15));
             }
             break;
         case ON:
-            PORT_SEC_REGS -> GROUP[0].PORT_OUTSET = (1 << 15);
+            pio_set(0, (1 << 15));
             break;
     }
 
@@ -271,6 +327,102 @@ uint16_t platform_pb_get_event(void) {
 
 //////////////////////////////////////////////////////////////////////////////
 
+/// Number of toggles per measurement in platform_pio_bench(); must be even
+#define PIO_BENCH_NR	256
+
+// SysTick counts spent toggling PA15 through the given view of PORT
+
+static uint32_t pio_bench_one(port_registers_t *regs) {
+    uint32_t t0, t1;
+    unsigned int x;
+
+    t0 = SysTick->VAL;
+    for (x = 0; x < PIO_BENCH_NR; ++x)
+        regs->GROUP[0].PORT_OUTTGL = (1 << 15);
+    t1 = SysTick->VAL;
+
+    // SysTick counts down; account for at most one wrap.
+    return (t0 >= t1) ? (t0 - t1) : (t0 + (SysTick->LOAD + 1 - t1));
+}
+
+void platform_pio_bench(platform_pio_bench_t *res) {
+    uint64_t per_sec = (uint64_t) PIO_BENCH_NR *
+            ((SysTick->LOAD + 1) / PLATFORM_TICK_PERIOD_US) * 1000000UL;
+    uint32_t apb, iobus;
+
+    __disable_irq();
+    apb = pio_bench_one(PORT_SEC_REGS);
+    iobus = pio_bench_one(PIO_REGS);
+    __enable_irq();
+
+    res->apb_per_sec = (uint32_t) (per_sec / (apb ? apb : 1));
+    res->iobus_per_sec = (uint32_t) (per_sec / (iobus ? iobus : 1));
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Interrupt priority plan
+ * 
+ * The Cortex-M23 implements two priority bits and no sub-priorities, so a
+ * vector preempts another exactly when its level is numerically lower.
+ * Levels are assigned by intent:
+ * 
+ * -- EMERGENCY:  Safety shutdown; must preempt everything else
+ * -- TIMEBASE:   SysTick and 1-Wire slot timing; preempts communication
+ *                and input handlers so that timestamps and bit timing
+ *                taken there stay consistent
+ * -- COMM:       USART/DMA completion
+ * -- INPUT:      Pushbuttons and other human-paced events
+ * 
+ * Vectors on the same level never preempt one another.
+ */
+#define NVIC_PRIO_EMERGENCY	0
+#define NVIC_PRIO_TIMEBASE	1
+#define NVIC_PRIO_COMM		2
+#define NVIC_PRIO_INPUT		3
+
+/*
+ * One line per vector: X(IRQn, level)
+ * 
+ * NOTE: Listing a vector twice is a build error (duplicate enumerator in
+ *       nvic_plan_slot_t below).
+ */
+#define NVIC_PLAN(X) \
+    X(SysTick_IRQn,		NVIC_PRIO_TIMEBASE) \
+    X(TC2_IRQn,			NVIC_PRIO_TIMEBASE) \
+    X(SERCOM3_1_IRQn,		NVIC_PRIO_COMM) \
+    X(TC1_IRQn,			NVIC_PRIO_COMM) \
+    X(EIC_EXTINT_2_IRQn,	NVIC_PRIO_INPUT)
+
+// Build-time checks of the plan
+#define NVIC_PLAN_SLOT(irqn, prio) NVIC_PLAN_SLOT_##irqn,
+typedef enum { NVIC_PLAN(NVIC_PLAN_SLOT) NVIC_PLAN_NR } nvic_plan_slot_t;
+#undef NVIC_PLAN_SLOT
+
+#define NVIC_PLAN_CHECK(irqn, prio) \
+    _Static_assert((prio) < (1 << __NVIC_PRIO_BITS), #irqn ": priority out of range");
+NVIC_PLAN(NVIC_PLAN_CHECK)
+#undef NVIC_PLAN_CHECK
+
+_Static_assert(NVIC_PRIO_EMERGENCY < NVIC_PRIO_TIMEBASE &&
+        NVIC_PRIO_TIMEBASE < NVIC_PRIO_COMM &&
+        NVIC_PRIO_COMM < NVIC_PRIO_INPUT,
+        "NVIC levels must be ordered by preemption intent");
+_Static_assert(NVIC_PRIO_INPUT < (1 << __NVIC_PRIO_BITS),
+        "NVIC levels exceed the implemented priority bits");
+
+typedef struct nvic_plan_entry_type {
+    IRQn_Type irqn;
+    uint8_t prio;
+} nvic_plan_entry_t;
+
+#define NVIC_PLAN_ENTRY(irqn, prio) {irqn, prio},
+static const nvic_plan_entry_t nvic_plan[NVIC_PLAN_NR] = {
+    NVIC_PLAN(NVIC_PLAN_ENTRY)
+};
+#undef NVIC_PLAN_ENTRY
+
 /*
  * Configure the NVIC
  * 
@@ -278,16 +430,25 @@ uint16_t platform_pb_get_event(void) {
  * execution returns from this function.
  */
 static void NVIC_init(void) {
+    unsigned int x;
+
     /*
      * Unlike AHB/APB peripherals, the NVIC is part of the Arm v8-M
      * architecture core proper. Hence, it is always enabled.
+     * 
+     * All priorities are applied with interrupts masked, so that no
+     * handler ever runs under a partially-applied plan.
      */
+    __disable_irq();
+    for (x = 0; x < NVIC_PLAN_NR; ++x)
+        NVIC_SetPriority(nvic_plan[x].irqn, nvic_plan[x].prio);
+    for (x = 0; x < NVIC_PLAN_NR; ++x) {
+        // Only device interrupts have NVIC enable bits.
+        if (nvic_plan[x].irqn >= 0)
+            NVIC_EnableIRQ(nvic_plan[x].irqn);
+    }
     __DMB();
     __enable_irq();
-    NVIC_SetPriority(EIC_EXTINT_2_IRQn, 3);
-    NVIC_SetPriority(SysTick_IRQn, 3);
-    NVIC_EnableIRQ(EIC_EXTINT_2_IRQn);
-    NVIC_EnableIRQ(SysTick_IRQn);
     return;
 }
 
@@ -321,15 +482,24 @@ void platform_init(void) {
     EIC_init_early();
 
     // Regular initialization
+    platform_pclk_init();
     TC0_Init();
     PB_init();
     Emergency_Pins_Init();
     blink_init();
     platform_usart_init();
+    platform_ow_init();
+    platform_dma_init();
+    platform_disp_init();
+    platform_ws2812_init();
 
     // Late initialization
     EIC_init_late();
     platform_systick_init();
+#if PLATFORM_USART_AUTOBAUD_MS > 0
+    // Needs SysTick running, but should finish before interrupts arrive.
+    platform_usart_cdc_autobaud(PLATFORM_USART_AUTOBAUD_MS);
+#endif
     NVIC_init();
     return;
 }
@@ -347,4 +517,7 @@ void platform_do_loop_one(void) {
      */
     platform_tick_hrcount(&tick);
     platform_usart_tick_handler(&tick);
+    platform_ow_tick_handler(&tick);
+    platform_disp_tick_handler(&tick);
+    platform_ws2812_tick_handler(&tick);
 }
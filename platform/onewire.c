@@ -0,0 +1,571 @@
+/**
+ * @file platform/onewire.c
+ * @brief Platform-support routines, 1-Wire master
+ */
+
+/*
+ * HW configuration:
+ * -- 1-Wire data: PA16 by default (see PLATFORM_OW_GROUP/PLATFORM_OW_PIN),
+ *    open drain with an external 4.7k pull-up to VDD
+ * -- Slot timing: TC2, 16-bit MFRQ mode, GCLK_GEN0 (24 MHz) / 8
+ *
+ * The line is never driven high: OUT stays at zero, and the pin is switched
+ * between output (pulled low) and input (released) via DIR.
+ *
+ * Each time slot is split into phases, and TC2 is reprogrammed at each
+ * phase boundary from its overflow interrupt. Since the counter restarts
+ * by itself at the overflow, phase lengths are measured from that instant
+ * rather than from when the handler gets to run; interrupt latency thus
+ * shifts, but does not stretch, the slots. The short low pulse that opens
+ * a write-1 or read slot is timed inline instead, as 2 us is shorter than
+ * the latency itself.
+ */
+
+// Common include for the XC32 compiler
+#include <xc.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "sync.h"
+#include "pclk.h"
+#include "regfield.h"
+#include "pio.h"
+#include "../platform.h"
+
+// Functions "exported" by this file
+void platform_ow_init(void);
+void platform_ow_tick_handler(const platform_timespec_t *tick);
+
+/////////////////////////////////////////////////////////////////////////////
+
+#if !defined(PLATFORM_OW_GROUP)
+#define PLATFORM_OW_GROUP	0
+#endif
+#if !defined(PLATFORM_OW_PIN)
+#define PLATFORM_OW_PIN		16
+#endif
+
+/// TC2 counts per microsecond (24 MHz / 8)
+#define OW_COUNTS_PER_US	3
+
+/*
+ * Standard-speed timing, in microseconds (Maxim AN126, "standard" column)
+ *
+ * Write-1 and read slots open with an inline OW_T_SHORT_LOW pulse; the
+ * other figures are timer phases.
+ *
+ * The read sample must land within 15 us of the slot's falling edge. TC2
+ * shares its priority level with SysTick, whose handler can hold off the
+ * sampling by its own run time (a few us), so the sample point is kept
+ * early enough to absorb that.
+ */
+#define OW_T_RESET_LOW		480
+#define OW_T_RESET_SAMPLE	70
+#define OW_T_RESET_REST		410
+#define OW_T_W0_LOW		60
+#define OW_T_W0_REC		10
+#define OW_T_W1_REST		64
+#define OW_T_READ_SAMPLE	10
+#define OW_T_READ_REST		55
+#define OW_T_SHORT_LOW		2
+
+/// Slack left for a SysTick handler run before the read sample, in us
+#define OW_T_READ_SLACK		5
+
+_Static_assert(OW_T_READ_SAMPLE + OW_T_READ_SLACK <= 15,
+        "1-Wire read sample too late to absorb SysTick");
+
+/// Slot kinds
+#define OW_SLOT_NONE	0
+#define OW_SLOT_RESET	1
+#define OW_SLOT_W0	2
+#define OW_SLOT_W1	3
+#define OW_SLOT_READ	4
+
+/// What to do at the next timer overflow
+#define OW_PHASE_LOW	0	// Release the line (end of a long low)
+#define OW_PHASE_SAMPLE	1	// Sample the line
+#define OW_PHASE_END	2	// Slot over; start the next one
+
+/// Where in the active transfer the engine is
+#define OW_STAGE_RESET	0
+#define OW_STAGE_TX	1
+#define OW_STAGE_SEARCH	2
+#define OW_STAGE_RX	3
+
+/// 1-Wire engine state; shared with the TC2 handler
+typedef struct ctx_ow_type {
+    /// Transfer in progress; NULL if idle
+    platform_ow_xfer_t * volatile xfer;
+
+    volatile uint8_t stage;
+    volatile uint8_t phase;
+    volatile uint8_t slot;
+
+    /// Line level sampled during the current slot
+    volatile uint8_t sample;
+
+    /// Bit index within the current stage
+    volatile uint16_t bit;
+
+    /// ROM search: step within the bit (id, complement, direction), id bit
+    volatile uint8_t search_step;
+    volatile uint8_t search_id;
+
+    /// ROM search: last bit position (1-based) where 0 was taken on a conflict
+    volatile uint8_t search_zero;
+
+    /// Whether TC2's clocks are held
+    bool clk_held;
+} ctx_ow_t;
+static ctx_ow_t ctx_ow;
+
+//////////////////////////////////////////////////////////////////////////////
+
+// Line control
+
+static inline void ow_drive_low(void) {
+    pio_dirset(PLATFORM_OW_GROUP, (1 << PLATFORM_OW_PIN));
+}
+
+static inline void ow_release(void) {
+    pio_dirclr(PLATFORM_OW_GROUP, (1 << PLATFORM_OW_PIN));
+}
+
+static inline uint8_t ow_read_line(void) {
+    return (pio_in(PLATFORM_OW_GROUP) >> PLATFORM_OW_PIN) & 1;
+}
+
+// Busy-wait for a few microseconds, against SysTick
+
+static void ow_delay_us(uint32_t us) {
+    uint32_t cycles = us * ((SysTick->LOAD + 1) / PLATFORM_TICK_PERIOD_US);
+    uint32_t start = SysTick->VAL, now, d;
+
+    do {
+        now = SysTick->VAL;
+        d = (start >= now) ? (start - now) : (start + (SysTick->LOAD + 1 - now));
+    } while (d < cycles);
+}
+
+/*
+ * Set the length of the phase now running
+ *
+ * NOTE: This runs from the TC2 handler as well, so SYNCBUSY is polled
+ *       directly instead of via sync_wait().
+ */
+static void ow_arm(uint32_t us) {
+    while ((TC2_REGS->COUNT16.TC_SYNCBUSY & (1 << 6)) != 0)
+        asm("nop");
+    TC2_REGS->COUNT16.TC_CC[0] = (uint16_t) (us * OW_COUNTS_PER_US - 1);
+}
+
+static void ow_timer_cmd(uint8_t cmd) {
+    while ((TC2_REGS->COUNT16.TC_SYNCBUSY & (1 << 2)) != 0)
+        asm("nop");
+    TC2_REGS->COUNT16.TC_CTRLBSET = (cmd << 5);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+// Finish the active transfer with the given state
+
+static uint8_t ow_finish(ctx_ow_t *ctx, uint16_t state) {
+    ctx->xfer->state = state;
+    ctx->xfer = NULL;
+    return OW_SLOT_NONE;
+}
+
+/*
+ * Account for the slot just completed, and pick the next one
+ *
+ * Called with the result of the previous slot in ctx->sample; the very first
+ * call of a transfer is made with ctx->slot == OW_SLOT_NONE.
+ */
+static uint8_t ow_advance(ctx_ow_t *ctx) {
+    platform_ow_xfer_t *x = ctx->xfer;
+    uint16_t n = ctx->bit;
+    uint8_t r, dir;
+
+    switch (ctx->stage) {
+        case OW_STAGE_RESET:
+            if (ctx->slot == OW_SLOT_NONE && x->reset)
+                return OW_SLOT_RESET;
+            if (ctx->slot == OW_SLOT_RESET && ctx->sample != 0)
+                // Nobody pulled the line low after the reset pulse
+                return ow_finish(ctx, PLATFORM_OW_XFER_NO_PRESENCE);
+            ctx->stage = OW_STAGE_TX;
+            ctx->bit = n = 0;
+            // fall through
+
+        case OW_STAGE_TX:
+            if (n < x->nr_tx * 8) {
+                ctx->bit = n + 1;
+                return ((x->tx[n >> 3] >> (n & 7)) & 1) ? OW_SLOT_W1 : OW_SLOT_W0;
+            }
+            ctx->bit = n = 0;
+            if (x->search_rom != NULL) {
+                ctx->stage = OW_STAGE_SEARCH;
+                ctx->search_step = 0;
+                ctx->search_zero = 0;
+                return OW_SLOT_READ;
+            }
+            ctx->stage = OW_STAGE_RX;
+            if (x->nr_rx > 0)
+                return OW_SLOT_READ;
+            return ow_finish(ctx, PLATFORM_OW_XFER_DONE);
+
+        case OW_STAGE_SEARCH:
+            /*
+             * Per ROM bit: read the bit, read its complement, then write the
+             * direction taken; devices not matching it drop out (AN187).
+             */
+            if (ctx->search_step == 0) {
+                ctx->search_id = ctx->sample;
+                ctx->search_step = 1;
+                return OW_SLOT_READ;
+            }
+            if (ctx->search_step == 1) {
+                if (ctx->search_id != 0 && ctx->sample != 0)
+                    // No device answered
+                    return ow_finish(ctx, PLATFORM_OW_XFER_NO_PRESENCE);
+                r = (x->search_rom[n >> 3] >> (n & 7)) & 1;
+                if (ctx->search_id != ctx->sample) {
+                    dir = ctx->search_id;
+                } else {
+                    // Conflict: retrace the previous path up to the last fork
+                    if (n + 1 < x->search_last)
+                        dir = r;
+                    else
+                        dir = (n + 1 == x->search_last);
+                    if (dir == 0)
+                        ctx->search_zero = n + 1;
+                }
+                if (dir)
+                    x->search_rom[n >> 3] |= (1 << (n & 7));
+                else
+                    x->search_rom[n >> 3] &= ~(1 << (n & 7));
+                ctx->search_step = 2;
+                return dir ? OW_SLOT_W1 : OW_SLOT_W0;
+            }
+            ctx->bit = ++n;
+            if (n < 64) {
+                ctx->search_step = 0;
+                return OW_SLOT_READ;
+            }
+            x->search_last = ctx->search_zero;
+            return ow_finish(ctx, PLATFORM_OW_XFER_DONE);
+
+        case OW_STAGE_RX:
+        default:
+            if (ctx->sample)
+                x->rx[n >> 3] |= (1 << (n & 7));
+            else
+                x->rx[n >> 3] &= ~(1 << (n & 7));
+            ctx->bit = ++n;
+            if (n < x->nr_rx * 8)
+                return OW_SLOT_READ;
+            return ow_finish(ctx, PLATFORM_OW_XFER_DONE);
+    }
+}
+
+// Open a slot; the timer has just wrapped to zero, or is restarted right after
+
+static void ow_slot_begin(ctx_ow_t *ctx, uint8_t slot) {
+    ctx->slot = slot;
+    switch (slot) {
+        case OW_SLOT_RESET:
+            ow_drive_low();
+            ow_arm(OW_T_RESET_LOW);
+            ctx->phase = OW_PHASE_LOW;
+            break;
+        case OW_SLOT_W0:
+            ow_drive_low();
+            ow_arm(OW_T_W0_LOW);
+            ctx->phase = OW_PHASE_LOW;
+            break;
+        case OW_SLOT_W1:
+            ow_drive_low();
+            ow_delay_us(OW_T_SHORT_LOW);
+            ow_release();
+            ow_arm(OW_T_W1_REST);
+            ctx->phase = OW_PHASE_END;
+            break;
+        case OW_SLOT_READ:
+            ow_drive_low();
+            ow_delay_us(OW_T_SHORT_LOW);
+            ow_release();
+            ow_arm(OW_T_READ_SAMPLE);
+            ctx->phase = OW_PHASE_SAMPLE;
+            break;
+        default:
+            ow_timer_cmd(0x2); // STOP
+            break;
+    }
+}
+
+/*
+ * TC2 overflow: one phase boundary
+ *
+ * NOTE: This is on the TIMEBASE priority level (see NVIC_PLAN), so that
+ *       only the emergency handler can preempt it; SysTick, on the same
+ *       level, can still delay it (see OW_T_READ_SLACK).
+ */
+void __attribute__((used, interrupt())) TC2_Handler(void) {
+    ctx_ow_t *ctx = &ctx_ow;
+
+    TC2_REGS->COUNT16.TC_INTFLAG = (1 << 0);
+    switch (ctx->phase) {
+        case OW_PHASE_LOW:
+            ow_release();
+            if (ctx->slot == OW_SLOT_RESET) {
+                ow_arm(OW_T_RESET_SAMPLE);
+                ctx->phase = OW_PHASE_SAMPLE;
+            } else {
+                ow_arm(OW_T_W0_REC);
+                ctx->phase = OW_PHASE_END;
+            }
+            break;
+
+        case OW_PHASE_SAMPLE:
+            ctx->sample = ow_read_line();
+            ow_arm((ctx->slot == OW_SLOT_RESET) ? OW_T_RESET_REST : OW_T_READ_REST);
+            ctx->phase = OW_PHASE_END;
+            break;
+
+        case OW_PHASE_END:
+        default:
+            ow_slot_begin(ctx, ow_advance(ctx));
+            break;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+void platform_ow_init(void) {
+    memset(&ctx_ow, 0, sizeof (ctx_ow));
+
+    // Released, and never driven high
+    PORT_SEC_REGS->GROUP[PLATFORM_OW_GROUP].PORT_DIRCLR = (1 << PLATFORM_OW_PIN);
+    PORT_SEC_REGS->GROUP[PLATFORM_OW_GROUP].PORT_OUTCLR = (1 << PLATFORM_OW_PIN);
+    PORT_SEC_REGS->GROUP[PLATFORM_OW_GROUP].PORT_PINCFG[PLATFORM_OW_PIN] = (1 << 1); // INEN
+
+    pclk_get(PLATFORM_PCLK_TC2);
+    TC2_REGS->COUNT16.TC_CTRLA = RF_VALUE(RF_REG_TC_CTRLA,
+            RF(RF_TC_CTRLA_SWRST, 0x1));
+    sync_post(&TC2_REGS->COUNT16.TC_SYNCBUSY, (1 << 0));
+    sync_wait(&TC2_REGS->COUNT16.TC_SYNCBUSY, (1 << 0));
+
+    // 16-bit, GCLK/8, MFRQ (CC0 is the period), overflow interrupt
+    TC2_REGS->COUNT16.TC_CTRLA = RF_VALUE(RF_REG_TC_CTRLA,
+            RF(RF_TC_CTRLA_MODE, 0x0),
+            RF(RF_TC_CTRLA_PRESCSYNC, 0x1),
+            RF(RF_TC_CTRLA_PRESCALER, 0x3));
+    TC2_REGS->COUNT16.TC_WAVE = RF_VALUE(RF_REG_TC_WAVE,
+            RF(RF_TC_WAVE_WAVEGEN, 0x1));
+    TC2_REGS->COUNT16.TC_INTENSET = (1 << 0);
+
+    // Enabled but stopped; each transfer retriggers it.
+    TC2_REGS->COUNT16.TC_CTRLA |= RF_MASK(RF_TC_CTRLA_ENABLE);
+    sync_post(&TC2_REGS->COUNT16.TC_SYNCBUSY, (1 << 1));
+    sync_wait(&TC2_REGS->COUNT16.TC_SYNCBUSY, (1 << 1));
+    ow_timer_cmd(0x2); // STOP
+
+    // Released until the first transfer
+    pclk_put(PLATFORM_PCLK_TC2);
+}
+
+bool platform_ow_xfer_async(platform_ow_xfer_t *xfer) {
+    ctx_ow_t *ctx = &ctx_ow;
+
+    if (!xfer || (xfer->nr_tx > 0 && !xfer->tx) || (xfer->nr_rx > 0 && !xfer->rx))
+        return false;
+    if (ctx->xfer != NULL)
+        return false;
+
+    if (!ctx->clk_held) {
+        pclk_get(PLATFORM_PCLK_TC2);
+        ctx->clk_held = true;
+    }
+
+    xfer->state = PLATFORM_OW_XFER_BUSY;
+    ctx->stage = OW_STAGE_RESET;
+    ctx->slot = OW_SLOT_NONE;
+    ctx->bit = 0;
+    ctx->xfer = xfer;
+
+    /*
+     * TC2 is stopped here, so its handler cannot run; the first slot's
+     * phase and period are set up before the timer is restarted, and
+     * nothing else touches TC2 while ctx->xfer is set.
+     */
+    TC2_REGS->COUNT16.TC_INTFLAG = (1 << 0);
+    ow_slot_begin(ctx, ow_advance(ctx));
+    while ((TC2_REGS->COUNT16.TC_SYNCBUSY & (1 << 6)) != 0)
+        asm("nop");
+    ow_timer_cmd(0x1); // RETRIGGER
+    return true;
+}
+
+bool platform_ow_busy(void) {
+    return ctx_ow.xfer != NULL;
+}
+
+// Dallas/Maxim CRC-8 (x^8 + x^5 + x^4 + 1, reflected)
+
+uint8_t platform_ow_crc8(const uint8_t *buf, unsigned int len) {
+    uint8_t crc = 0, x;
+
+    while (len-- > 0) {
+        crc ^= *(buf++);
+        for (x = 0; x < 8; ++x)
+            crc = (crc & 1) ? (uint8_t) ((crc >> 1) ^ 0x8C) : (uint8_t) (crc >> 1);
+    }
+    return crc;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+/*
+ * DS18B20 conversion scheduling
+ *
+ * All sensors convert at once (SKIP ROM, CONVERT T); while they do, the bus
+ * is left alone and the main loop goes on. Each scratchpad is then read in
+ * turn (MATCH ROM, READ SCRATCHPAD), one transfer per loop pass at most.
+ */
+
+/// Worst-case conversion time at 12-bit resolution, in ms
+#define OW_TEMP_CONV_MS		750
+
+#define OW_TEMP_IDLE		0
+#define OW_TEMP_CONVERT		1
+#define OW_TEMP_WAIT		2
+#define OW_TEMP_READ		3
+#define OW_TEMP_SLEEP		4
+
+static struct {
+    uint8_t state;
+    platform_ow_temp_t *devs;
+    unsigned int nr_devs;
+    unsigned int idx;
+    uint32_t period_ms;
+
+    /// Start of the current round
+    platform_timespec_t ts_round;
+
+    /// Whether a transfer of ours is in flight
+    bool pending;
+
+    platform_ow_xfer_t xfer;
+    uint8_t tx[10];
+    uint8_t rx[9];
+} ow_temp;
+
+// Time elapsed since @c since, in ms
+
+static uint32_t ow_elapsed_ms(const platform_timespec_t *tick, const platform_timespec_t *since) {
+    platform_timespec_t ts_delta;
+
+    platform_tick_delta(&ts_delta, tick, since);
+    return ts_delta.nr_sec * 1000 + ts_delta.nr_nsec / 1000000;
+}
+
+static void ow_temp_tick(const platform_timespec_t *tick) {
+    platform_ow_temp_t *dev;
+
+    if (ow_temp.pending) {
+        if (ow_temp.xfer.state == PLATFORM_OW_XFER_BUSY)
+            return;
+        ow_temp.pending = false;
+        if (ow_temp.state == OW_TEMP_READ) {
+            dev = &ow_temp.devs[ow_temp.idx++];
+            if (ow_temp.xfer.state == PLATFORM_OW_XFER_DONE &&
+                    platform_ow_crc8(ow_temp.rx, 8) == ow_temp.rx[8]) {
+                dev->raw = (int16_t) (ow_temp.rx[0] | (ow_temp.rx[1] << 8));
+                dev->valid = true;
+            } else {
+                dev->valid = false;
+            }
+            if (ow_temp.idx >= ow_temp.nr_devs)
+                ow_temp.state = OW_TEMP_SLEEP;
+        } else if (ow_temp.state == OW_TEMP_CONVERT) {
+            ow_temp.state = (ow_temp.xfer.state == PLATFORM_OW_XFER_DONE) ?
+                    OW_TEMP_WAIT : OW_TEMP_SLEEP;
+        }
+    }
+
+    switch (ow_temp.state) {
+        case OW_TEMP_CONVERT:
+            ow_temp.ts_round = *tick;
+            ow_temp.tx[0] = 0xCC; // SKIP ROM
+            ow_temp.tx[1] = 0x44; // CONVERT T
+            ow_temp.xfer.nr_tx = 2;
+            ow_temp.xfer.nr_rx = 0;
+            break;
+
+        case OW_TEMP_WAIT:
+            if (ow_elapsed_ms(tick, &ow_temp.ts_round) < OW_TEMP_CONV_MS)
+                return;
+            ow_temp.idx = 0;
+            ow_temp.state = OW_TEMP_READ;
+            // fall through
+
+        case OW_TEMP_READ:
+            ow_temp.tx[0] = 0x55; // MATCH ROM
+            memcpy(&ow_temp.tx[1], ow_temp.devs[ow_temp.idx].rom, 8);
+            ow_temp.tx[9] = 0xBE; // READ SCRATCHPAD
+            ow_temp.xfer.nr_tx = 10;
+            ow_temp.xfer.nr_rx = 9;
+            break;
+
+        case OW_TEMP_SLEEP:
+            if (ow_elapsed_ms(tick, &ow_temp.ts_round) < ow_temp.period_ms)
+                return;
+            ow_temp.state = OW_TEMP_CONVERT;
+            return;
+
+        default:
+            return;
+    }
+
+    ow_temp.xfer.reset = true;
+    ow_temp.xfer.tx = ow_temp.tx;
+    ow_temp.xfer.rx = ow_temp.rx;
+    ow_temp.xfer.search_rom = NULL;
+    // If the bus is taken by the application, try again next pass.
+    ow_temp.pending = platform_ow_xfer_async(&ow_temp.xfer);
+}
+
+bool platform_ow_temp_start(platform_ow_temp_t *devs, unsigned int nr_devs,
+        uint32_t period_ms) {
+    unsigned int x;
+
+    if (!devs || nr_devs == 0 || ow_temp.pending)
+        return false;
+    for (x = 0; x < nr_devs; ++x)
+        devs[x].valid = false;
+
+    ow_temp.devs = devs;
+    ow_temp.nr_devs = nr_devs;
+    ow_temp.period_ms = (period_ms > OW_TEMP_CONV_MS) ? period_ms : OW_TEMP_CONV_MS;
+    ow_temp.state = OW_TEMP_CONVERT;
+    return true;
+}
+
+void platform_ow_temp_stop(void) {
+    // A transfer in flight still completes; its result is just not used.
+    ow_temp.state = OW_TEMP_IDLE;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+void platform_ow_tick_handler(const platform_timespec_t *tick) {
+    if (ow_temp.state != OW_TEMP_IDLE || ow_temp.pending)
+        ow_temp_tick(tick);
+
+    // TC2 only needs its clocks while a transfer runs.
+    if (ctx_ow.clk_held && ctx_ow.xfer == NULL) {
+        pclk_put(PLATFORM_PCLK_TC2);
+        ctx_ow.clk_held = false;
+    }
+}
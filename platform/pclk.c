@@ -0,0 +1,186 @@
+/**
+ * @file platform/pclk.c
+ * @brief Platform-support routines, peripheral clock gating
+ */
+
+// Common include for the XC32 compiler
+#include <xc.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "sync.h"
+#include "pclk.h"
+#include "../platform.h"
+
+/////////////////////////////////////////////////////////////////////////////
+
+// Clocks feeding one peripheral
+typedef struct pclk_desc_type {
+    /// MCLK APBxMASK register and bit
+    volatile uint32_t *apbmask;
+    uint32_t apbbit;
+
+    /// GCLK peripheral channel (from the device header), and its generator
+    uint8_t pch;
+    uint8_t gen;
+
+    /// SYNCBUSY register, which must be clear before gating (NULL if none)
+    const volatile uint32_t *syncbusy;
+
+    /**
+     * Rough active current drawn by the peripheral at its GCLK rate, in uA
+     * 
+     * NOTE: These are estimates from the typical per-MHz figures in the
+     *       datasheet's electrical characteristics, not measurements.
+     */
+    uint16_t ua;
+} pclk_desc_t;
+
+static const pclk_desc_t pclk_descs[PLATFORM_PCLK_NR] = {
+    // SERCOM3: GCLK_GEN2 (4 MHz)
+    [PLATFORM_PCLK_SERCOM3] = {
+        &MCLK_REGS->MCLK_APBCMASK, MCLK_APBCMASK_SERCOM3_Msk, SERCOM3_GCLK_ID_CORE, 2,
+        &SERCOM3_REGS->USART_INT.SERCOM_SYNCBUSY, 20
+    },
+    // TC0: GCLK_GEN0 (24 MHz)
+    [PLATFORM_PCLK_TC0] = {
+        &MCLK_REGS->MCLK_APBCMASK, MCLK_APBCMASK_TC0_Msk, TC0_GCLK_ID, 0,
+        &TC0_REGS->COUNT16.TC_SYNCBUSY, 60
+    },
+    // TC2: GCLK_GEN0 (24 MHz)
+    [PLATFORM_PCLK_TC2] = {
+        &MCLK_REGS->MCLK_APBCMASK, MCLK_APBCMASK_TC2_Msk, TC2_GCLK_ID, 0,
+        &TC2_REGS->COUNT16.TC_SYNCBUSY, 60
+    },
+    // SERCOM0: GCLK_GEN0 (24 MHz)
+    [PLATFORM_PCLK_SERCOM0] = {
+        &MCLK_REGS->MCLK_APBCMASK, MCLK_APBCMASK_SERCOM0_Msk, SERCOM0_GCLK_ID_CORE, 0,
+        &SERCOM0_REGS->SPIM.SERCOM_SYNCBUSY, 120
+    },
+    // SERCOM2: GCLK_GEN0 (24 MHz)
+    [PLATFORM_PCLK_SERCOM2] = {
+        &MCLK_REGS->MCLK_APBCMASK, MCLK_APBCMASK_SERCOM2_Msk, SERCOM2_GCLK_ID_CORE, 0,
+        &SERCOM2_REGS->SPIM.SERCOM_SYNCBUSY, 120
+    },
+    // TC1: GCLK_GEN0 (24 MHz), on the channel it shares with TC0
+    [PLATFORM_PCLK_TC1] = {
+        &MCLK_REGS->MCLK_APBCMASK, MCLK_APBCMASK_TC1_Msk, TC1_GCLK_ID, 0,
+        &TC1_REGS->COUNT16.TC_SYNCBUSY, 60
+    },
+};
+
+static uint8_t pclk_refs[PLATFORM_PCLK_NR];
+
+/// Generator currently selected per channel; starts as pclk_descs[].gen
+static uint8_t pclk_gens[PLATFORM_PCLK_NR];
+static platform_pclk_stats_t pclk_stats;
+
+/*
+ * Check whether another referenced peripheral shares this one's GCLK
+ * channel (TC0/TC1); such a channel stays on until both are released.
+ */
+static bool pclk_pch_shared(unsigned int id) {
+    unsigned int x;
+
+    for (x = 0; x < PLATFORM_PCLK_NR; ++x) {
+        if (x != id && pclk_descs[x].pch == pclk_descs[id].pch && pclk_refs[x] > 0)
+            return true;
+    }
+    return false;
+}
+
+void pclk_get(unsigned int id) {
+    const pclk_desc_t *d = &pclk_descs[id];
+
+    if (pclk_refs[id]++ > 0)
+        return;
+
+    // APB first, so that the peripheral is accessible once its clock runs.
+    *d->apbmask |= d->apbbit;
+    GCLK_REGS->GCLK_PCHCTRL[d->pch] = (1 << 6) | pclk_gens[id];
+    while ((GCLK_REGS->GCLK_PCHCTRL[d->pch] & (1 << 6)) == 0)
+        asm("nop");
+
+    pclk_stats.mask_on |= (1 << id);
+    pclk_stats.ua_reclaimed -= d->ua;
+}
+
+void pclk_put(unsigned int id) {
+    const pclk_desc_t *d = &pclk_descs[id];
+
+    if (pclk_refs[id] == 0 || --pclk_refs[id] > 0)
+        return;
+
+    /*
+     * Writes still being synchronized would be stuck until the clock came
+     * back; let them finish first. Posted ones are retired as well, so
+     * that no sync slot is left pointing at a gated peripheral.
+     */
+    if (d->syncbusy) {
+        sync_wait(d->syncbusy, 0xFFFFFFFF);
+        while (*d->syncbusy != 0)
+            asm("nop");
+    }
+
+    if (!pclk_pch_shared(id)) {
+        GCLK_REGS->GCLK_PCHCTRL[d->pch] = pclk_gens[id];
+        while ((GCLK_REGS->GCLK_PCHCTRL[d->pch] & (1 << 6)) != 0)
+            asm("nop");
+    }
+    *d->apbmask &= ~d->apbbit;
+
+    pclk_stats.mask_on &= ~(1 << id);
+    pclk_stats.ua_reclaimed += d->ua;
+    ++pclk_stats.nr_gated;
+}
+
+void pclk_set_gen(unsigned int id, uint8_t gen) {
+    const pclk_desc_t *d = &pclk_descs[id];
+
+    if (pclk_gens[id] == gen)
+        return;
+    pclk_gens[id] = gen;
+    if (pclk_refs[id] == 0)
+        return;
+
+    GCLK_REGS->GCLK_PCHCTRL[d->pch] = 0;
+    while ((GCLK_REGS->GCLK_PCHCTRL[d->pch] & (1 << 6)) != 0)
+        asm("nop");
+    GCLK_REGS->GCLK_PCHCTRL[d->pch] = (1 << 6) | gen;
+    while ((GCLK_REGS->GCLK_PCHCTRL[d->pch] & (1 << 6)) == 0)
+        asm("nop");
+}
+
+void pclk_reset_gen(unsigned int id) {
+    pclk_set_gen(id, pclk_descs[id].gen);
+}
+
+// Gate everything at startup; drivers take what they need.
+
+void platform_pclk_init(void) {
+    unsigned int x;
+
+    memset(pclk_refs, 0, sizeof (pclk_refs));
+    memset(&pclk_stats, 0, sizeof (pclk_stats));
+    for (x = 0; x < PLATFORM_PCLK_NR; ++x) {
+        pclk_gens[x] = pclk_descs[x].gen;
+        GCLK_REGS->GCLK_PCHCTRL[pclk_descs[x].pch] = pclk_descs[x].gen;
+        *pclk_descs[x].apbmask &= ~pclk_descs[x].apbbit;
+        pclk_stats.ua_reclaimed += pclk_descs[x].ua;
+    }
+
+    /*
+     * OSC16M only feeds GCLK_GEN2 (SERCOM3 and EIC) past clock setup; let
+     * it stop whenever no channel on that generator requests a clock.
+     */
+    OSCCTRL_REGS->OSCCTRL_OSC16MCTRL |= (1 << 7);
+}
+
+bool platform_pclk_is_on(unsigned int id) {
+    return id < PLATFORM_PCLK_NR && pclk_refs[id] > 0;
+}
+
+void platform_pclk_get_stats(platform_pclk_stats_t *stats) {
+    if (stats)
+        *stats = pclk_stats;
+}
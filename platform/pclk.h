@@ -0,0 +1,50 @@
+#ifndef PCLK_H
+#define PCLK_H
+
+/*
+ * Reference-counted peripheral clocks
+ * 
+ * Each peripheral's APB clock and GCLK channel are turned on by the first
+ * pclk_get() and gated again by the matching last pclk_put(). A driver
+ * holds a reference for as long as it needs the peripheral to run (or its
+ * registers to be accessible); registers keep their contents while gated.
+ * 
+ * NOTE: These are meant to be called from the main loop only, not from
+ *       interrupt handlers. The ID's are the PLATFORM_PCLK_* values in
+ *       platform.h. Peripherals sharing a GCLK channel (TC0/TC1) must be
+ *       kept on the same generator.
+ */
+
+/**
+ * Take a reference to a peripheral's clocks, enabling them if needed
+ * 
+ * @param[in]	id	Peripheral (@c PLATFORM_PCLK_*)
+ */
+void pclk_get(unsigned int id);
+
+/**
+ * Drop a reference to a peripheral's clocks, gating them on the last one
+ * 
+ * @param[in]	id	Peripheral (@c PLATFORM_PCLK_*)
+ */
+void pclk_put(unsigned int id);
+
+/**
+ * Move a peripheral's GCLK channel to another generator
+ * 
+ * If the channel is running, it is briefly stopped for the switch, as
+ * required by 17.6.3.3; it is otherwise applied on the next pclk_get().
+ * 
+ * @param[in]	id	Peripheral (@c PLATFORM_PCLK_*)
+ * @param[in]	gen	GCLK generator number
+ */
+void pclk_set_gen(unsigned int id, uint8_t gen);
+
+/**
+ * Move a peripheral's GCLK channel back to its usual generator
+ * 
+ * @param[in]	id	Peripheral (@c PLATFORM_PCLK_*)
+ */
+void pclk_reset_gen(unsigned int id);
+
+#endif // PCLK_H
@@ -0,0 +1,59 @@
+#ifndef PIO_H
+#define PIO_H
+
+/*
+ * Fast pin access
+ * 
+ * The Cortex-M23 reaches PORT through a single-cycle IOBUS alias as well as
+ * through the APB bridge, where each access takes several wait states.
+ * Run-time pin writes and reads (set/clear/toggle, direction for open-drain
+ * signalling, input) go through the alias wherever the device header
+ * provides it; pin configuration (PINCFG, PMUX) stays on the APB view.
+ * 
+ * NOTE: IOBUS accesses are CPU-only (no DMA), and must be full 32-bit
+ *       accesses, which all of the below are.
+ */
+
+/*
+ * Falling back to the APB view silently would make every hot pin access
+ * several times slower; it has to be asked for with PLATFORM_PIO_APB.
+ */
+#if defined(PORT_IOBUS_SEC_REGS)
+#define PIO_REGS	PORT_IOBUS_SEC_REGS
+#elif defined(PLATFORM_PIO_APB)
+#define PIO_REGS	PORT_SEC_REGS
+#else
+#error "No IOBUS alias of PORT in the device header; define PLATFORM_PIO_APB to use the APB view"
+#endif
+
+// Drive the pins in @c mask of @c group high
+static inline void pio_set(unsigned int group, uint32_t mask) {
+    PIO_REGS->GROUP[group].PORT_OUTSET = mask;
+}
+
+// Drive the pins in @c mask of @c group low
+static inline void pio_clr(unsigned int group, uint32_t mask) {
+    PIO_REGS->GROUP[group].PORT_OUTCLR = mask;
+}
+
+// Invert the pins in @c mask of @c group
+static inline void pio_tgl(unsigned int group, uint32_t mask) {
+    PIO_REGS->GROUP[group].PORT_OUTTGL = mask;
+}
+
+// Make the pins in @c mask of @c group outputs
+static inline void pio_dirset(unsigned int group, uint32_t mask) {
+    PIO_REGS->GROUP[group].PORT_DIRSET = mask;
+}
+
+// Make the pins in @c mask of @c group inputs
+static inline void pio_dirclr(unsigned int group, uint32_t mask) {
+    PIO_REGS->GROUP[group].PORT_DIRCLR = mask;
+}
+
+// Sample the input levels of @c group
+static inline uint32_t pio_in(unsigned int group) {
+    return PIO_REGS->GROUP[group].PORT_IN;
+}
+
+#endif // PIO_H
@@ -0,0 +1,160 @@
+#ifndef REGFIELD_H
+#define REGFIELD_H
+
+/*
+ * Compile-time register fields
+ *
+ * A field is a (register, position, width) triple, e.g.
+ *
+ *     #define RF_TC_CTRLA_PRESCALER	(RF_REG_TC_CTRLA, 8, 3)
+ *
+ * RF(field, value) pairs a field with a value, and RF_VALUE(register, ...)
+ * combines up to eight such pairs into the value for a single store:
+ *
+ *     TC0_REGS->COUNT16.TC_CTRLA = RF_VALUE(RF_REG_TC_CTRLA,
+ *             RF(RF_TC_CTRLA_PRESCSYNC, 0x1),
+ *             RF(RF_TC_CTRLA_PRESCALER, 0x7));
+ *
+ * The result is an integer constant expression, so the compiler emits the
+ * same single store as for hand-written shifts. The following are build
+ * errors:
+ *
+ * -- A value that does not fit in its field
+ * -- A field that belongs to a different register
+ * -- Two fields that overlap (e.g. the same field given twice)
+ *
+ * NOTE: Values must be constants; for run-time values, use RF_MASK() and
+ *       RF_POS() directly.
+ *
+ * Field names carry an RF_ prefix so as not to clash with the DFP's own
+ * <name>_Pos/<name>_Msk macros. Positions follow the datasheet section noted.
+ */
+
+/////////////////////////////////////////////////////////////////////////////
+
+// Build error unless c is non-zero; evaluates to zero
+#define RF_CHECK(c)	(0 * sizeof (struct { int rf_check : (c) ? 1 : -1; }))
+
+#define RF_APPLY(m, args)	m args
+#define RF_REG_(r, p, w)	r
+#define RF_POS_(r, p, w)	(p)
+#define RF_MASK_(r, p, w)	((uint32_t) (((1ULL << (w)) - 1) << (p)))
+#define RF_WIDTH_(r, p, w)	(w)
+
+#define RF_REGOF(f)	RF_APPLY(RF_REG_, f)
+#define RF_POS(f)	RF_APPLY(RF_POS_, f)
+#define RF_MASK(f)	RF_APPLY(RF_MASK_, f)
+#define RF_WIDTH(f)	RF_APPLY(RF_WIDTH_, f)
+
+/// A field/value pair: (register, mask, shifted value)
+#define RF(f, v) \
+    (RF_REGOF(f), RF_MASK(f), \
+     ((uint32_t) (v) << RF_POS(f)) + RF_CHECK(((unsigned long long) (v) >> RF_WIDTH(f)) == 0))
+
+#define RF_PR_(r, m, v)	r
+#define RF_PM_(r, m, v)	((unsigned long long) (m))
+#define RF_PV_(r, m, v)	(v)
+
+// Per-pair terms: value (checked against the register), and mask
+#define RF_TERM_V(reg, fv)	(RF_APPLY(RF_PV_, fv) + RF_CHECK(RF_APPLY(RF_PR_, fv) == (reg)))
+#define RF_TERM_M(reg, fv)	RF_APPLY(RF_PM_, fv)
+
+#define RF_NARG(...)	RF_NARG_(__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define RF_NARG_(a1, a2, a3, a4, a5, a6, a7, a8, n, ...)	n
+#define RF_CAT(a, b)	RF_CAT_(a, b)
+#define RF_CAT_(a, b)	a##b
+
+// m(x, a1) op m(x, a2) op ...
+#define RF_EACH(m, op, x, ...)	RF_CAT(RF_EACH_, RF_NARG(__VA_ARGS__))(m, op, x, __VA_ARGS__)
+#define RF_EACH_1(m, op, x, a)		m(x, a)
+#define RF_EACH_2(m, op, x, a, ...)	m(x, a) op RF_EACH_1(m, op, x, __VA_ARGS__)
+#define RF_EACH_3(m, op, x, a, ...)	m(x, a) op RF_EACH_2(m, op, x, __VA_ARGS__)
+#define RF_EACH_4(m, op, x, a, ...)	m(x, a) op RF_EACH_3(m, op, x, __VA_ARGS__)
+#define RF_EACH_5(m, op, x, a, ...)	m(x, a) op RF_EACH_4(m, op, x, __VA_ARGS__)
+#define RF_EACH_6(m, op, x, a, ...)	m(x, a) op RF_EACH_5(m, op, x, __VA_ARGS__)
+#define RF_EACH_7(m, op, x, a, ...)	m(x, a) op RF_EACH_6(m, op, x, __VA_ARGS__)
+#define RF_EACH_8(m, op, x, a, ...)	m(x, a) op RF_EACH_7(m, op, x, __VA_ARGS__)
+
+/*
+ * Combine field/value pairs for one register into a single value
+ *
+ * The fields are disjoint exactly when the sum of their masks equals
+ * their bitwise OR.
+ */
+#define RF_VALUE(reg, ...) \
+    ((uint32_t) ((RF_EACH(RF_TERM_V, |, reg, __VA_ARGS__)) + \
+     RF_CHECK((RF_EACH(RF_TERM_M, +, reg, __VA_ARGS__)) == \
+              (RF_EACH(RF_TERM_M, |, reg, __VA_ARGS__)))))
+
+/////////////////////////////////////////////////////////////////////////////
+
+// Register ID's; arbitrary, but unique
+#define RF_REG_TC_CTRLA		1
+#define RF_REG_TC_WAVE		2
+#define RF_REG_USART_CTRLA	3
+#define RF_REG_USART_CTRLB	4
+#define RF_REG_SPI_CTRLA	5
+#define RF_REG_SPI_CTRLB	6
+
+// 39.7.2.1 (TC) CTRLA
+#define RF_TC_CTRLA_SWRST	(RF_REG_TC_CTRLA, 0, 1)
+#define RF_TC_CTRLA_ENABLE	(RF_REG_TC_CTRLA, 1, 1)
+#define RF_TC_CTRLA_MODE	(RF_REG_TC_CTRLA, 2, 2)
+#define RF_TC_CTRLA_PRESCSYNC	(RF_REG_TC_CTRLA, 4, 2)
+#define RF_TC_CTRLA_RUNSTDBY	(RF_REG_TC_CTRLA, 6, 1)
+#define RF_TC_CTRLA_ONDEMAND	(RF_REG_TC_CTRLA, 7, 1)
+#define RF_TC_CTRLA_PRESCALER	(RF_REG_TC_CTRLA, 8, 3)
+
+// 39.7.2.7 (TC) WAVE
+#define RF_TC_WAVE_WAVEGEN	(RF_REG_TC_WAVE, 0, 2)
+
+// 34.7.1 (SERCOM USART) CTRLA
+#define RF_USART_CTRLA_SWRST	(RF_REG_USART_CTRLA, 0, 1)
+#define RF_USART_CTRLA_ENABLE	(RF_REG_USART_CTRLA, 1, 1)
+#define RF_USART_CTRLA_MODE	(RF_REG_USART_CTRLA, 2, 3)
+#define RF_USART_CTRLA_RUNSTDBY	(RF_REG_USART_CTRLA, 7, 1)
+#define RF_USART_CTRLA_SAMPR	(RF_REG_USART_CTRLA, 13, 3)
+#define RF_USART_CTRLA_TXPO	(RF_REG_USART_CTRLA, 16, 2)
+#define RF_USART_CTRLA_RXPO	(RF_REG_USART_CTRLA, 20, 2)
+#define RF_USART_CTRLA_SAMPA	(RF_REG_USART_CTRLA, 22, 2)
+#define RF_USART_CTRLA_FORM	(RF_REG_USART_CTRLA, 24, 4)
+#define RF_USART_CTRLA_CMODE	(RF_REG_USART_CTRLA, 28, 1)
+#define RF_USART_CTRLA_CPOL	(RF_REG_USART_CTRLA, 29, 1)
+#define RF_USART_CTRLA_DORD	(RF_REG_USART_CTRLA, 30, 1)
+
+// 34.7.2 (SERCOM USART) CTRLB
+#define RF_USART_CTRLB_CHSIZE	(RF_REG_USART_CTRLB, 0, 3)
+#define RF_USART_CTRLB_SBMODE	(RF_REG_USART_CTRLB, 6, 1)
+#define RF_USART_CTRLB_COLDEN	(RF_REG_USART_CTRLB, 8, 1)
+#define RF_USART_CTRLB_SFDE	(RF_REG_USART_CTRLB, 9, 1)
+#define RF_USART_CTRLB_ENC	(RF_REG_USART_CTRLB, 10, 1)
+#define RF_USART_CTRLB_PMODE	(RF_REG_USART_CTRLB, 13, 1)
+#define RF_USART_CTRLB_TXEN	(RF_REG_USART_CTRLB, 16, 1)
+#define RF_USART_CTRLB_RXEN	(RF_REG_USART_CTRLB, 17, 1)
+#define RF_USART_CTRLB_FIFOCLR	(RF_REG_USART_CTRLB, 22, 2)
+
+// 35.8.1 (SERCOM SPI) CTRLA
+#define RF_SPI_CTRLA_SWRST	(RF_REG_SPI_CTRLA, 0, 1)
+#define RF_SPI_CTRLA_ENABLE	(RF_REG_SPI_CTRLA, 1, 1)
+#define RF_SPI_CTRLA_MODE	(RF_REG_SPI_CTRLA, 2, 3)
+#define RF_SPI_CTRLA_DOPO	(RF_REG_SPI_CTRLA, 16, 2)
+#define RF_SPI_CTRLA_DIPO	(RF_REG_SPI_CTRLA, 20, 2)
+#define RF_SPI_CTRLA_FORM	(RF_REG_SPI_CTRLA, 24, 4)
+#define RF_SPI_CTRLA_CPHA	(RF_REG_SPI_CTRLA, 28, 1)
+#define RF_SPI_CTRLA_CPOL	(RF_REG_SPI_CTRLA, 29, 1)
+#define RF_SPI_CTRLA_DORD	(RF_REG_SPI_CTRLA, 30, 1)
+
+// 35.8.2 (SERCOM SPI) CTRLB
+#define RF_SPI_CTRLB_CHSIZE	(RF_REG_SPI_CTRLB, 0, 3)
+#define RF_SPI_CTRLB_MSSEN	(RF_REG_SPI_CTRLB, 13, 1)
+#define RF_SPI_CTRLB_RXEN	(RF_REG_SPI_CTRLB, 17, 1)
+
+// Spot checks against hand-written shifts
+_Static_assert(RF_VALUE(RF_REG_TC_CTRLA,
+        RF(RF_TC_CTRLA_PRESCSYNC, 0x1),
+        RF(RF_TC_CTRLA_PRESCALER, 0x7)) == ((0x1 << 4) | (0x7 << 8)),
+        "RF_VALUE() must match the equivalent shifts");
+_Static_assert(RF_MASK(RF_USART_CTRLA_FORM) == (0xFUL << 24),
+        "RF_MASK() must match the equivalent shifts");
+
+#endif // REGFIELD_H
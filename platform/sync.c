@@ -0,0 +1,165 @@
+/**
+ * @file platform/sync.c
+ * @brief Platform-support routines, posted writes to synchronized registers
+ */
+
+// Common include for the XC32 compiler
+#include <xc.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "sync.h"
+#include "../platform.h"
+
+/////////////////////////////////////////////////////////////////////////////
+
+/// Maximum number of SYNCBUSY registers with writes in flight
+#define NR_SYNC_SLOTS	(6)
+
+/*
+ * Worst-case number of CPU cycles a single synchronization takes
+ * 
+ * Per the datasheet, synchronization takes up to 5 GCLK cycles plus 2 APB
+ * cycles. At 24 MHz against the slowest (4 MHz) GCLK in use, that is about
+ * 32 CPU cycles; round up.
+ */
+#define SYNC_CYCLES_MAX	(40)
+
+/// SysTick reload value; see systick.c
+#define SYNC_SYSTICK_PERIOD	(SysTick->LOAD + 1)
+
+// A SYNCBUSY register with at least one write in flight
+typedef struct sync_slot_type {
+    /// SYNCBUSY register being tracked; NULL if the slot is free
+    const volatile uint32_t *syncbusy;
+
+    /// Bits of @c syncbusy for which writes have been posted
+    uint32_t pending;
+
+    /// SysTick value at the time of the latest post
+    uint32_t ts;
+
+    /// Whether SysTick was running at that time (@c ts is meaningful)
+    bool timed;
+} sync_slot_t;
+
+static sync_slot_t sync_slots[NR_SYNC_SLOTS];
+static platform_sync_stats_t sync_stats;
+
+// SysTick cycles elapsed since @c ts (SysTick counts down)
+
+static uint32_t sync_elapsed(uint32_t ts) {
+    uint32_t now = SysTick->VAL;
+
+    if (ts >= now)
+        return ts - now;
+    else
+        return ts + (SYNC_SYSTICK_PERIOD - now);
+}
+
+// Whether SysTick is running yet; before platform_systick_init(), VAL is junk
+
+static bool sync_timed(void) {
+    return (SysTick->CTRL & (1 << 0)) != 0;
+}
+
+static sync_slot_t *sync_find(const volatile uint32_t *syncbusy) {
+    unsigned int x;
+
+    for (x = 0; x < NR_SYNC_SLOTS; ++x) {
+        if (sync_slots[x].syncbusy == syncbusy)
+            return &sync_slots[x];
+    }
+    return NULL;
+}
+
+// Drop posted writes on @c bits of a slot, freeing it once none are left
+
+static void sync_forget(sync_slot_t *slot, uint32_t bits) {
+    slot->pending &= ~bits;
+    if (slot->pending == 0)
+        slot->syncbusy = NULL;
+}
+
+/*
+ * Wait for, account for, and forget posted writes on @c bits of a slot
+ * 
+ * NOTE: Only called when an access actually depends on the writes; slots
+ *       reclaimed by sync_post() are dropped without accounting.
+ */
+static void sync_retire(sync_slot_t *slot, uint32_t bits) {
+    const volatile uint32_t *syncbusy = slot->syncbusy;
+    uint32_t elapsed = (slot->timed && sync_timed()) ? sync_elapsed(slot->ts) : 0;
+
+    if ((*syncbusy & bits) != 0) {
+        /*
+         * Still synchronizing; all the work done since the post was
+         * overlapped with it.
+         */
+        ++sync_stats.nr_stalls;
+        while ((*syncbusy & bits) != 0)
+            asm("nop");
+        sync_stats.cycles_saved += elapsed;
+    } else {
+        /*
+         * Already done; the whole synchronization was hidden. Its
+         * actual length is unknown, so take the lesser of the
+         * worst case and the time since the post.
+         */
+        ++sync_stats.nr_elided;
+        sync_stats.cycles_saved +=
+                (elapsed < SYNC_CYCLES_MAX) ? elapsed : SYNC_CYCLES_MAX;
+    }
+    sync_forget(slot, bits);
+}
+
+void sync_wait(const volatile uint32_t *syncbusy, uint32_t mask) {
+    sync_slot_t *slot = sync_find(syncbusy);
+
+    if (slot == NULL || (slot->pending & mask) == 0)
+        // Nothing in flight that this access depends on
+        return;
+
+    sync_retire(slot, slot->pending & mask);
+    return;
+}
+
+void sync_post(const volatile uint32_t *syncbusy, uint32_t mask) {
+    sync_slot_t *slot = sync_find(syncbusy);
+    unsigned int x;
+
+    if (slot == NULL) {
+        /*
+         * Writes that nobody waited on (e.g. a final ENABLE) would hold
+         * on to their slots forever; reclaim the ones that are done.
+         * No wait was skipped for these, so they are not counted.
+         */
+        for (x = 0; x < NR_SYNC_SLOTS && slot == NULL; ++x) {
+            if (sync_slots[x].syncbusy != NULL &&
+                    (*sync_slots[x].syncbusy & sync_slots[x].pending) == 0)
+                sync_forget(&sync_slots[x], sync_slots[x].pending);
+            if (sync_slots[x].syncbusy == NULL)
+                slot = &sync_slots[x];
+        }
+        if (slot == NULL) {
+            // Out of slots; fall back to a blocking write.
+            while ((*syncbusy & mask) != 0)
+                asm("nop");
+            return;
+        }
+        slot->syncbusy = syncbusy;
+    }
+
+    slot->pending |= mask;
+    slot->timed = sync_timed();
+    slot->ts = slot->timed ? SysTick->VAL : 0;
+    ++sync_stats.nr_posted;
+    return;
+}
+
+// API-visible items
+
+void platform_sync_get_stats(platform_sync_stats_t *stats) {
+    if (stats)
+        *stats = sync_stats;
+}
@@ -0,0 +1,36 @@
+#ifndef SYNC_H
+#define SYNC_H
+
+/*
+ * Posted writes to synchronized registers
+ * 
+ * Registers in the GCLK domain of a peripheral (TC, SERCOM, EIC, GCLK, ...)
+ * take several peripheral clock cycles to synchronize after being written;
+ * progress is tracked via the peripheral's SYNCBUSY register. Rather than
+ * spin on SYNCBUSY after every write, a write is "posted" with
+ * sync_post(), and sync_wait() is called only right before an access that
+ * actually depends on synchronization being complete (e.g. a second write
+ * to the same register, reading COUNT after a read request, writing
+ * registers after SWRST).
+ * 
+ * NOTE: These are meant to be called from the main loop only, not from
+ *       interrupt handlers.
+ */
+
+/**
+ * Record that a write has been issued to a synchronized register
+ * 
+ * @param[in]	syncbusy	Peripheral SYNCBUSY register
+ * @param[in]	mask		SYNCBUSY bit/s that the write sets
+ */
+void sync_post(const volatile uint32_t *syncbusy, uint32_t mask);
+
+/**
+ * Wait for synchronization of earlier posted writes, but only if needed
+ * 
+ * @param[in]	syncbusy	Peripheral SYNCBUSY register
+ * @param[in]	mask		SYNCBUSY bit/s that the upcoming access depends on
+ */
+void sync_wait(const volatile uint32_t *syncbusy, uint32_t mask);
+
+#endif // SYNC_H
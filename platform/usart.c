@@ -24,6 +24,11 @@
 #include <stdbool.h>
 #include <string.h>
 
+#include "sync.h"
+#include "pclk.h"
+#include "regfield.h"
+#include "pio.h"
+#include "dma.h"
 #include "../platform.h"
 
 // Functions "exported" by this file
@@ -51,6 +56,9 @@ typedef struct ctx_usart_type {
         // Current descriptor
         volatile const char *buf;
         volatile uint16_t len;
+
+        /// The fragment just loaded is going out by DMA (synchronous mode)
+        volatile bool dma;
     } tx;
 
     /// State variables for the receiver
@@ -65,18 +73,161 @@ typedef struct ctx_usart_type {
         /// Index at which to place an incoming character
         volatile uint16_t idx;
 
+        /// Number of bytes to complete at (length modes only; 0 if not yet known)
+        volatile uint16_t expect;
+
+        /// Last character seen in line mode was CR; kept across lines
+        volatile bool after_cr;
+
     } rx;
 
+    /// Echo queue for cooked-mode reception; sent ahead of regular TX
+
+    struct {
+        volatile uint8_t buf[32];
+        volatile uint8_t head;
+        volatile uint8_t tail;
+    } echo;
+
+    /// RS-485 half-duplex state (see platform_usart_cdc_set_rs485())
+
+    struct {
+        /// Whether DE is driven at all
+        bool enabled;
+
+        /// Drop bytes received while DE is asserted
+        bool suppress_echo;
+
+        /// DE is asserted; cleared only by the TXC handler
+        volatile bool de;
+
+        /// TXC interrupt armed for the current burst
+        volatile bool txc_armed;
+
+        /// DE was released with the last echo still in RX; the tick drops it
+        volatile bool drain;
+
+        /// Tick at which DE was asserted
+        platform_timespec_t ts_de;
+
+        /// DE-to-start-bit time
+        platform_timespec_t ts_pre_guard;
+
+        /// Guard times as configured, in bit times
+        uint8_t pre_guard_bits;
+        uint8_t post_guard_bits;
+
+        /// Stop-bit-to-DE-release time, in TC1 counts (0: none)
+        uint32_t post_guard_counts;
+    } rs485;
+
     /// Configuration items
 
     struct {
         /// Idle timeout (reception only)
         platform_timespec_t ts_idle_timeout;
+
+        /// Inter-character gap limit (reception only; zero if unchecked)
+        platform_timespec_t ts_gap_timeout;
+
+        /// Timing came from platform_usart_cdc_set_timing(), not the default
+        bool timing_user;
+
+        /// Current baud rate
+        uint32_t baud;
+
+        /// Synchronous (clocked) mode; see platform_usart_cdc_set_sync()
+        bool sync;
+
+        /// Asynchronous rate to return to when synchronous mode ends
+        uint32_t async_baud;
+
+        /// Byte sent to the peer on overflow; negative if none
+        int16_t ovf_notify;
     } cfg;
 
+    /// Receive error counters
+    platform_usart_stats_t stats;
+
+    /// XON/XOFF flow control (see platform_usart_cdc_set_xonxoff())
+
+    struct {
+        bool enabled;
+
+        /// The peer sent XOFF; regular TX is held
+        volatile bool paused;
+
+        /// We sent XOFF and owe the peer an XON
+        bool throttled;
+
+        /// Control character to send next, ahead of everything; negative if none
+        int16_t ctl;
+
+        /// Room left in the RX buffer at which XOFF/XON are sent
+        uint16_t xoff_room;
+        uint16_t xon_room;
+    } flow;
+
+    /// Transaction queue; the head is the active one
+
+    struct {
+        platform_usart_xact_t *head;
+        platform_usart_xact_t *tail;
+    } xact;
+
 } ctx_usart_t;
 static ctx_usart_t ctx_uart;
 
+/// Frequency of the GCLK feeding SERCOM3 (GCLK_GEN2, OSC16M @ 4 MHz)
+#define USART_GCLK_HZ	4000000UL
+
+/*
+ * Compute SERCOM_BAUD for arithmetic mode with 16x oversampling:
+ * 
+ * BAUD = 65536 * (1 - 16 * f_baud / f_ref), rounded to nearest
+ */
+static uint16_t usart_baud_reg(uint32_t baud) {
+    return (uint16_t) (65536UL -
+            (uint32_t) (((uint64_t) 65536 * 16 * baud + (USART_GCLK_HZ / 2)) / USART_GCLK_HZ));
+}
+
+/*
+ * Idle timeout for a given baud rate
+ * 
+ * This keeps the original 937.5 us at 57600 bps (54 bit times) and scales
+ * it for other rates.
+ */
+static void usart_idle_timeout(platform_timespec_t *ts, uint32_t baud) {
+    ts->nr_sec = 0;
+    ts->nr_nsec = (uint32_t) ((54ULL * 1000000000ULL) / baud);
+}
+
+// Rescale a time from one baud rate to another, keeping its length in bits
+
+static void usart_ts_scale(platform_timespec_t *ts, uint32_t from, uint32_t to) {
+    uint64_t ns = (uint64_t) ts->nr_sec * 1000000000ULL + ts->nr_nsec;
+
+    ns = (ns * from) / to;
+    ts->nr_sec = (uint32_t) (ns / 1000000000ULL);
+    ts->nr_nsec = (uint32_t) (ns % 1000000000ULL);
+}
+
+/*
+ * Follow a rate change with the receive timing; call before cfg.baud is
+ * updated
+ * 
+ * The default idle timeout is 54 bit times at any rate. Timing set via
+ * platform_usart_cdc_set_timing() is kept as many bit times as it was.
+ */
+static void usart_timing_follow(ctx_usart_t *ctx, uint32_t baud) {
+    if (!ctx->cfg.timing_user) {
+        usart_idle_timeout(&ctx->cfg.ts_idle_timeout, baud);
+        return;
+    }
+    usart_ts_scale(&ctx->cfg.ts_idle_timeout, ctx->cfg.baud, baud);
+    usart_ts_scale(&ctx->cfg.ts_gap_timeout, ctx->cfg.baud, baud);
+}
+
 // Configure USART
 
 void platform_usart_init(void) {
@@ -90,29 +241,20 @@ void platform_usart_init(void) {
 #define UART_REGS (&(SERCOM3_REGS->USART_INT))
 
     /*
-     * Enable the APB clock for this peripheral
-     * 
-     * NOTE: The chip resets with it enabled; hence, commented-out.
-     * 
-     * WARNING: Incorrect MCLK settings can cause system lockup that can
-     *          only be rectified via a hardware reset/power-cycle.
-     */
-    //18.6
-    MCLK_REGS->MCLK_APBCMASK |= (1 << 4);
-
-    /*
-     * Enable the GCLK generator for this peripheral
+     * Enable the APB clock and GCLK channel for this peripheral
      * 
      * NOTE: GEN2 (4 MHz) is used, as GEN0 (24 MHz) is too fast for our
-     *       use case.
+     *       use case. The receiver always listens, so the reference is
+     *       never dropped.
      */
-    // 17.7.5
-    GCLK_REGS->GCLK_PCHCTRL[20] = 0x00000042;
-    while ((GCLK_REGS->GCLK_PCHCTRL[20] & 0x00000040) == 0);
+    // 18.6, 17.7.5
+    pclk_get(PLATFORM_PCLK_SERCOM3);
 
     // Initialize the peripheral's context structure
     memset(&ctx_uart, 0, sizeof (ctx_uart));
     ctx_uart.regs = UART_REGS;
+    ctx_uart.cfg.ovf_notify = -1;
+    ctx_uart.flow.ctl = -1;
 
     /*
      * This is the classic "SWRST" (software-triggered reset).
@@ -123,36 +265,34 @@ void platform_usart_init(void) {
      */
     // 34.7.1: Reset
     UART_REGS->SERCOM_CTRLA = (1 << 0);
-    while ((UART_REGS -> SERCOM_SYNCBUSY & (1 << 0)) != 0);
-    UART_REGS->SERCOM_CTRLA = (0x1 << 2); // Internally clocked
+    sync_post(&UART_REGS->SERCOM_SYNCBUSY, (1 << 0));
+    sync_wait(&UART_REGS->SERCOM_SYNCBUSY, (1 << 0));
     /*
-     * Select further settings compatible with the 16550 UART:
+     * Select further settings:
      * 
-     * - x16-bit oversampling, arithmetic mode (for noise immunity)
-     * - xLSB first
-     * - xNo parity
-     * - xTwo stop bits
-     * - x8-bit character size
-     * - xNo break detection
+     * - Internally clocked
+     * - 16x oversampling, arithmetic mode (for noise immunity)
+     * - LSB first
+     * - Even parity
+     * - One stop bit
+     * - 8-bit character size
+     * - No collision detection
      * 
-     * - xUse PAD[0] for data transmission
-     * - xUse PAD[1] for data reception
+     * - Use PAD[0] for data transmission
+     * - Use PAD[1] for data reception
      * 
-     * NOTE: If a control register is not used, comment it out.
+     * Fields at zero are still listed, for clarity; they cost nothing.
+     * CTRLB is written together with the receiver/transmitter enables
+     * below. CTRLC stays at its reset value (FIFO disabled).
      */
-    // For sake of clarity, I still added configurations where their bit position is zero.
     // 34.7.1
-    UART_REGS->SERCOM_CTRLA |= (1 << 30); // LSB First
-    UART_REGS->SERCOM_CTRLA |= (0x1 << 20); // PAD[1] Rx
-    UART_REGS->SERCOM_CTRLB |= (0 << 6); // 1 Stop Bit
-    
-    UART_REGS->SERCOM_CTRLA |= (0x1 << 24); // USART frame w/ parity
-    UART_REGS->SERCOM_CTRLB |= (0 << 13); // Even Parity
-    UART_REGS->SERCOM_CTRLA |= (0x0 << 13); // 16 bit oversampling, arithmetic
-    UART_REGS->SERCOM_CTRLA |= (0x0 << 16); // PAD[0] Tx
-    UART_REGS->SERCOM_CTRLB |= (0 << 8); // No collision detection
-    UART_REGS->SERCOM_CTRLB |= (0x0 << 0); // 8 bits
-    UART_REGS->SERCOM_CTRLC |= (0 << 27); // FIFO disabled
+    UART_REGS->SERCOM_CTRLA = RF_VALUE(RF_REG_USART_CTRLA,
+            RF(RF_USART_CTRLA_MODE, 0x1),
+            RF(RF_USART_CTRLA_SAMPR, 0x0),
+            RF(RF_USART_CTRLA_TXPO, 0x0),
+            RF(RF_USART_CTRLA_RXPO, 0x1),
+            RF(RF_USART_CTRLA_FORM, 0x1),
+            RF(RF_USART_CTRLA_DORD, 0x1));
 
 
     /*
@@ -161,6 +301,7 @@ void platform_usart_init(void) {
      */
     // SERCOM_BAUD = 65536 (1 - (16*57600)/4e6)
     UART_REGS->SERCOM_BAUD = 0xC505; // 50437
+    ctx_uart.cfg.baud = PLATFORM_USART_CDC_BAUD;
     /*
      * Configure the IDLE timeout, which should be the length of 3
      * USART characters.
@@ -181,9 +322,16 @@ void platform_usart_init(void) {
      * - Clear the FIFOs (even though they're disabled)
      */
     
-    UART_REGS->SERCOM_CTRLB |= (1 << 16) | (0x3 << 22) | (1 << 17);
-
-    while ((UART_REGS->SERCOM_SYNCBUSY & (1 << 2)) != 0);
+    // 34.7.2
+    UART_REGS->SERCOM_CTRLB = RF_VALUE(RF_REG_USART_CTRLB,
+            RF(RF_USART_CTRLB_CHSIZE, 0x0),
+            RF(RF_USART_CTRLB_SBMODE, 0x0),
+            RF(RF_USART_CTRLB_COLDEN, 0x0),
+            RF(RF_USART_CTRLB_PMODE, 0x0),
+            RF(RF_USART_CTRLB_TXEN, 0x1),
+            RF(RF_USART_CTRLB_RXEN, 0x1),
+            RF(RF_USART_CTRLB_FIFOCLR, 0x3));
+    sync_post(&UART_REGS->SERCOM_SYNCBUSY, (1 << 2));
 
     /*
      * Second-to-last: Configure the physical pins.
@@ -199,9 +347,16 @@ void platform_usart_init(void) {
     PORT_SEC_REGS -> GROUP[1].PORT_PINCFG[9] |= (0x3 << 0);
     PORT_SEC_REGS -> GROUP[1].PORT_PMUX[4] |= (0x3 << 4);
 
-    // Last: enable the peripheral, after resetting the state machine
+    /*
+     * Last: enable the peripheral, after resetting the state machine
+     * 
+     * NOTE: The CTRLB write must have been synchronized first; the pin
+     *       setup above overlaps with that. Nothing touches DATA until
+     *       INTFLAG says so, so the ENABLE write itself can be posted.
+     */
+    sync_wait(&UART_REGS->SERCOM_SYNCBUSY, (1 << 2));
     UART_REGS->SERCOM_CTRLA |= (1 << 1);
-    while ((UART_REGS -> SERCOM_SYNCBUSY & (1 << 1)) != 0);
+    sync_post(&UART_REGS->SERCOM_SYNCBUSY, (1 << 1));
     return;
 
 #undef UART_REGS
@@ -209,29 +364,300 @@ void platform_usart_init(void) {
 
 // Helper abort routine for USART reception
 
-static void usart_rx_abort_helper(ctx_usart_t *ctx) {
+static void usart_rx_abort_helper(ctx_usart_t *ctx, uint16_t flags) {
     if (ctx->rx.desc != NULL) {
-        ctx->rx.desc->compl_type = PLATFORM_USART_RX_COMPL_DATA;
+        ctx->rx.desc->compl_flags |= flags;
         ctx->rx.desc->compl_info.data_len = ctx->rx.idx;
+        ctx->rx.desc->compl_type = PLATFORM_USART_RX_COMPL_DATA;
         ctx->rx.desc = NULL;
     }
     ctx->rx.ts_idle.nr_sec = 0;
     ctx->rx.ts_idle.nr_nsec = 0;
     ctx->rx.idx = 0;
+    ctx->rx.expect = 0;
     return;
 }
 
+// Queue bytes for echoing; whatever does not fit is dropped
+
+static void usart_echo(ctx_usart_t *ctx, const char *s, uint8_t n) {
+    uint8_t next;
+
+    while (n-- > 0) {
+        next = (ctx->echo.head + 1) % sizeof (ctx->echo.buf);
+        if (next == ctx->echo.tail)
+            return;
+        ctx->echo.buf[ctx->echo.head] = *(s++);
+        ctx->echo.head = next;
+    }
+}
+
+/*
+ * Line discipline for PLATFORM_USART_RX_MODE_LINE
+ * 
+ * Return the completion flag/s to report, or zero if reception continues.
+ */
+static uint16_t usart_rx_line(ctx_usart_t *ctx, uint8_t data) {
+    volatile platform_usart_rx_async_desc_t *desc = ctx->rx.desc;
+    bool after_cr = ctx->rx.after_cr;
+
+    ctx->rx.after_cr = (data == '\r');
+    switch (data) {
+        case '\n':
+            // The second half of a CR LF pair; the CR already ended the line.
+            if (after_cr)
+                return 0;
+            // Fall through
+        case '\r':
+            usart_echo(ctx, "\r\n", 2);
+            return PLATFORM_USART_RX_FLAG_TERM;
+
+        case 0x08: // Backspace
+        case 0x7F: // DEL
+            if (ctx->rx.idx > 0) {
+                --ctx->rx.idx;
+                usart_echo(ctx, "\b \b", 3);
+            }
+            return 0;
+
+        case 0x15: // CTRL+U: line kill
+            while (ctx->rx.idx > 0) {
+                --ctx->rx.idx;
+                usart_echo(ctx, "\b \b", 3);
+            }
+            return 0;
+
+        default:
+            if (data < 0x20 || data > 0x7E)
+                return 0;
+            if (ctx->rx.idx >= desc->max_len) {
+                // No room; ring the bell instead.
+                usart_echo(ctx, "\a", 1);
+                return 0;
+            }
+            desc->buf[ctx->rx.idx++] = data;
+            usart_echo(ctx, (const char *) &data, 1);
+            return 0;
+    }
+}
+
+/*
+ * Evaluate the descriptor's completion criterion after a byte is stored
+ * 
+ * Return the completion flag/s to report, or zero if reception continues.
+ */
+static uint16_t usart_rx_check_mode(ctx_usart_t *ctx, uint8_t data) {
+    volatile platform_usart_rx_async_desc_t *desc = ctx->rx.desc;
+    uint16_t x;
+
+    switch (desc->mode) {
+        case PLATFORM_USART_RX_MODE_TERM:
+            for (x = 0; x < desc->nr_term; ++x) {
+                if ((uint8_t) desc->term[x] == data)
+                    return PLATFORM_USART_RX_FLAG_TERM;
+            }
+            break;
+
+        case PLATFORM_USART_RX_MODE_LEN:
+            if (ctx->rx.idx >= desc->len)
+                return PLATFORM_USART_RX_FLAG_LEN;
+            break;
+
+        case PLATFORM_USART_RX_MODE_LENPFX:
+            if (ctx->rx.idx == desc->len) {
+                // Prefix complete; little-endian
+                ctx->rx.expect = (uint8_t) desc->buf[0];
+                if (desc->len > 1)
+                    ctx->rx.expect |= (uint16_t) ((uint8_t) desc->buf[1]) << 8;
+                ctx->rx.expect += desc->len;
+            }
+            if (ctx->rx.idx >= desc->len && ctx->rx.idx >= ctx->rx.expect)
+                return PLATFORM_USART_RX_FLAG_LEN;
+            break;
+
+        default:
+            break;
+    }
+    return 0;
+}
+
+/*
+ * RS-485 driver-enable (DE) pin
+ * 
+ * NOTE: PB10 is free on the Curiosity Nano header; override both macros
+ *       for other transceiver wiring.
+ */
+#if !defined(PLATFORM_USART_RS485_DE_GROUP)
+#define PLATFORM_USART_RS485_DE_GROUP	1
+#endif
+#if !defined(PLATFORM_USART_RS485_DE_PIN)
+#define PLATFORM_USART_RS485_DE_PIN	10
+#endif
+
+#define USART_RS485_DE_PORT	(&PORT_SEC_REGS->GROUP[PLATFORM_USART_RS485_DE_GROUP])
+
+/*
+ * Whether the transmitter may be fed in RS-485 mode
+ * 
+ * DE is asserted as soon as anything is queued; the first byte waits for
+ * the pre-guard time to elapse, so that the transceiver is driving the
+ * bus before the start bit.
+ */
+static bool usart_rs485_tx_ready(ctx_usart_t *ctx, const platform_timespec_t *tick) {
+    platform_timespec_t ts_delta;
+
+    if (!ctx->rs485.de) {
+        if (ctx->tx.nr_desc == 0 && ctx->tx.len == 0 &&
+                ctx->echo.head == ctx->echo.tail)
+            return false;
+
+        // Forget a TXC left over from the previous burst.
+        ctx->regs->SERCOM_INTFLAG = (1 << 1);
+        pio_set(PLATFORM_USART_RS485_DE_GROUP, (1 << PLATFORM_USART_RS485_DE_PIN));
+        ctx->rs485.ts_de = *tick;
+        ctx->rs485.txc_armed = false;
+        ctx->rs485.de = true;
+    }
+    if (ctx->rs485.txc_armed)
+        return false;
+
+    platform_tick_delta(&ts_delta, tick, &ctx->rs485.ts_de);
+    return platform_timespec_compare(&ts_delta, &ctx->rs485.ts_pre_guard) >= 0;
+}
+
+/*
+ * Account for receive errors
+ * 
+ * BUFOVF (STATUS bit 2) comes with a valid character; it only means that
+ * characters before it were lost. PERR and FERR mean this one is bad.
+ */
+static void usart_rx_error(ctx_usart_t *ctx, uint16_t status) {
+    char c;
+
+    // Clear right away, so that each event is counted once even with no descriptor
+    ctx->regs->SERCOM_STATUS = (status & 0x0007);
+    if ((status & (1 << 0)) != 0)
+        ++ctx->stats.nr_perr;
+    if ((status & (1 << 1)) != 0)
+        ++ctx->stats.nr_ferr;
+    if ((status & (1 << 2)) != 0) {
+        ++ctx->stats.nr_ovf;
+        if (ctx->cfg.ovf_notify >= 0) {
+            c = (char) ctx->cfg.ovf_notify;
+            usart_echo(ctx, &c, 1);
+        }
+    }
+}
+
+/// XON/XOFF characters (DC1/DC3)
+#define USART_XON	0x11
+#define USART_XOFF	0x13
+
+/*
+ * Send XOFF/XON as room in the RX buffer crosses the watermarks
+ * 
+ * XOFF is only sent while a descriptor is being filled, so that a quiet
+ * gap between receptions does not stop the peer. Once throttled, having
+ * no descriptor counts as having no room.
+ */
+static void usart_flow_check(ctx_usart_t *ctx) {
+    volatile platform_usart_rx_async_desc_t *desc = ctx->rx.desc;
+    uint16_t room = (desc != NULL) ? (desc->max_len - ctx->rx.idx) : 0;
+
+    if (!ctx->flow.throttled) {
+        if (desc != NULL && ctx->rx.idx > 0 && room <= ctx->flow.xoff_room) {
+            ctx->flow.ctl = USART_XOFF;
+            ctx->flow.throttled = true;
+        }
+    } else if (room >= ctx->flow.xon_room) {
+        ctx->flow.ctl = USART_XON;
+        ctx->flow.throttled = false;
+    }
+}
+
+/*
+ * Record the arrival time of the byte about to be stored at rx.idx
+ * 
+ * In line mode the slot may go unused (control characters) or be reused
+ * (after a backspace); it is simply overwritten then.
+ */
+static void usart_rx_stamp(ctx_usart_t *ctx, const platform_timespec_t *tick) {
+    volatile platform_usart_rx_async_desc_t *desc = ctx->rx.desc;
+    platform_timespec_t ts_delta;
+
+    if (ctx->rx.idx >= desc->max_len)
+        return;
+    platform_tick_delta(&ts_delta, tick, (const platform_timespec_t *) &desc->ts_start);
+    desc->ts[ctx->rx.idx] = ts_delta.nr_sec * 1000000UL + ts_delta.nr_nsec / 1000;
+}
+
+/// DMAC trigger for "SERCOM3 DATA empty", from the device header
+#define USART_DMA_TRIG	SERCOM3_DMAC_ID_TX
+
+/*
+ * Whether to hand the rest of the current fragment to DMA
+ * 
+ * Only in synchronous mode, where the per-byte cost of the tick handler
+ * matters, and not with XON/XOFF, as a block cannot be paused part-way.
+ */
+static bool usart_tx_use_dma(const ctx_usart_t *ctx) {
+    return ctx->cfg.sync && !ctx->flow.enabled && ctx->tx.len > 1;
+}
+
+/*
+ * Check whether no byte of the current TX fragment has gone out yet
+ * 
+ * The fragment just loaded is the descriptor before ctx->tx.desc.
+ */
+static bool usart_tx_at_boundary(const ctx_usart_t *ctx) {
+    return ctx->tx.len == 0 || ctx->tx.buf == ctx->tx.desc[-1].buf;
+}
+
 // Tick handler for the USART
 
 static void usart_tick_handler_common(
         ctx_usart_t *ctx, const platform_timespec_t *tick) {
     uint16_t status = 0x0000;
     uint8_t data = 0x00;
-    platform_timespec_t ts_delta;
+    uint16_t compl = 0;
+    platform_timespec_t ts_delta, ts_prev;
+    bool drain = false;
 
     // TX handling
-    if ((ctx->regs->SERCOM_INTFLAG & (1 << 0)) != 0) {
-        if (ctx->tx.len > 0) {
+    if (ctx->tx.dma)
+        ctx->tx.dma = dma_busy(DMA_CH_USART);
+    if (ctx->flow.ctl >= 0 && (ctx->regs->SERCOM_INTFLAG & (1 << 0)) != 0) {
+        // Flow-control characters go first, even while paused.
+        ctx->regs->SERCOM_DATA = (uint8_t) ctx->flow.ctl;
+        ctx->flow.ctl = -1;
+    } else if (ctx->flow.paused) {
+        /*
+         * The peer sent XOFF; nothing more is written until XON. At most
+         * the two characters already in the transmitter still go out.
+         */
+    } else if (ctx->rs485.enabled && !usart_rs485_tx_ready(ctx, tick)) {
+        // Driver not yet enabled, or still within the pre-guard time
+    } else if (ctx->tx.dma) {
+        // DMA owns DATA until the fragment is out; echo waits too.
+    } else if ((ctx->regs->SERCOM_INTFLAG & (1 << 0)) != 0 &&
+            ctx->echo.head != ctx->echo.tail && usart_tx_at_boundary(ctx)) {
+        /*
+         * Echo from cooked-mode reception goes out first, right as the
+         * character is received, without a round-trip through the
+         * application; but only between fragments, so that it cannot
+         * split an escape sequence being sent.
+         */
+        ctx->regs->SERCOM_DATA = ctx->echo.buf[ctx->echo.tail];
+        ctx->echo.tail = (ctx->echo.tail + 1) % sizeof (ctx->echo.buf);
+    } else if ((ctx->regs->SERCOM_INTFLAG & (1 << 0)) != 0) {
+        if (usart_tx_use_dma(ctx) &&
+                dma_start(DMA_CH_USART, (const void *) ctx->tx.buf,
+                        &ctx->regs->SERCOM_DATA, ctx->tx.len, USART_DMA_TRIG)) {
+            // The whole fragment, one byte per DRE, without the CPU
+            ctx->tx.buf += ctx->tx.len;
+            ctx->tx.len = 0;
+            ctx->tx.dma = true;
+        } else if (ctx->tx.len > 0) {
             /*
              * There is still something to transmit in the working
              * copy of the current descriptor.
@@ -276,8 +702,24 @@ static void usart_tick_handler_common(
             }
         }
     }
+    if (ctx->rs485.de && !ctx->rs485.txc_armed &&
+            ctx->tx.nr_desc == 0 && ctx->tx.len == 0 &&
+            ctx->echo.head == ctx->echo.tail) {
+        /*
+         * The last byte is in the shift register; DE is released by the
+         * TXC handler once its stop bit is out.
+         */
+        ctx->rs485.txc_armed = true;
+        ctx->regs->SERCOM_INTENSET = (1 << 1);
+    }
 
     // RX handling
+    if (ctx->rs485.drain) {
+        // DE was released since the last pass, with the last echo pending
+        ctx->rs485.drain = false;
+        drain = true;
+        ctx->regs->SERCOM_STATUS = 0x00F7;
+    }
     if ((ctx->regs->SERCOM_INTFLAG & (1 << 2)) != 0) {
         /*
          * There are unread data
@@ -290,6 +732,30 @@ static void usart_tick_handler_common(
          */
         status = ctx->regs->SERCOM_STATUS | 0x8000;
         data = (uint8_t) (ctx->regs->SERCOM_DATA);
+        if ((ctx->rs485.de || drain) && ctx->rs485.suppress_echo) {
+            // Our own transmission, looped back by the transceiver
+            ctx->regs->SERCOM_STATUS = (status & 0x00F7);
+            status = 0x0000;
+        }
+        if ((status & 0x0007) != 0)
+            usart_rx_error(ctx, status);
+        if ((status & 0x0004) != 0 && ctx->rx.desc != NULL &&
+                (ctx->rx.desc->compl_flags & PLATFORM_USART_RX_FLAG_OVF) == 0) {
+            /*
+             * The hardware discarded whatever arrived while its buffer was
+             * full; the loss lies just before the slot the next stored
+             * byte goes to. Recorded here, as the flow-control filter
+             * below may swallow this byte.
+             */
+            ctx->rx.desc->compl_flags |= PLATFORM_USART_RX_FLAG_OVF;
+            ctx->rx.desc->ovf_idx = ctx->rx.idx;
+        }
+        if (ctx->flow.enabled && (status & 0x0003) == 0 &&
+                (data == USART_XON || data == USART_XOFF)) {
+            // Flow control from the peer; never part of the data.
+            ctx->flow.paused = (data == USART_XOFF);
+            status = 0x0000;
+        }
     }
     do {
         if (ctx->rx.desc == NULL) {
@@ -299,32 +765,81 @@ static void usart_tick_handler_common(
 
         if ((status & 0x8003) == 0x8000) {
             // No errors detected
-            ctx->rx.desc->buf[ctx->rx.idx++] = data;
+            if (ctx->rx.idx > 0 && ctx->cfg.ts_gap_timeout.nr_nsec != 0) {
+                ts_prev = ctx->rx.ts_idle;
+                platform_tick_delta(&ts_delta, tick, &ts_prev);
+                if (platform_timespec_compare(&ts_delta, &ctx->cfg.ts_gap_timeout) > 0)
+                    ctx->rx.desc->compl_flags |= PLATFORM_USART_RX_FLAG_GAP;
+            }
             ctx->rx.ts_idle = *tick;
+            if (ctx->rx.desc->ts != NULL)
+                usart_rx_stamp(ctx, tick);
+            if (ctx->rx.desc->mode == PLATFORM_USART_RX_MODE_LINE) {
+                compl = usart_rx_line(ctx, data);
+            } else {
+                ctx->rx.desc->buf[ctx->rx.idx++] = data;
+                compl = usart_rx_check_mode(ctx, data);
+            }
         }
         ctx->regs->SERCOM_STATUS |= (status & 0x00F7);
 
         // Some housekeeping
-        if (ctx->rx.idx >= ctx->rx.desc->max_len) {
+        if (ctx->rx.desc->mode == PLATFORM_USART_RX_MODE_LINE) {
+            // Lines complete only on CR/LF.
+            if (compl != 0)
+                usart_rx_abort_helper(ctx, compl);
+            break;
+        }
+        if (ctx->rx.idx >= ctx->rx.desc->max_len)
             // Buffer completely filled
-            usart_rx_abort_helper(ctx);
+            compl |= PLATFORM_USART_RX_FLAG_FULL;
+        if (compl != 0) {
+            usart_rx_abort_helper(ctx, compl);
             break;
         } else if (ctx->rx.idx > 0) {
             platform_tick_delta(&ts_delta, tick, &ctx->rx.ts_idle);
             if (platform_timespec_compare(&ts_delta, &ctx->cfg.ts_idle_timeout) >= 0) {
                 // IDLE timeout
-                usart_rx_abort_helper(ctx);
+                usart_rx_abort_helper(ctx, PLATFORM_USART_RX_FLAG_IDLE);
                 break;
             }
         }
     } while (0);
 
+    if (ctx->flow.enabled)
+        usart_flow_check(ctx);
+
     // Done
     return;
 }
 
+/// Maximum number of handler passes per tick in synchronous mode
+#define USART_SYNC_BURST	16
+
+// Whether another pass of the handler would move data right away
+
+static bool usart_tick_pending(ctx_usart_t *ctx) {
+    uint32_t flags = ctx->regs->SERCOM_INTFLAG;
+
+    return (flags & (1 << 2)) != 0 || ((flags & (1 << 0)) != 0 && !ctx->tx.dma &&
+            (ctx->tx.len > 0 || ctx->tx.nr_desc > 0));
+}
+
+static void usart_xact_tick(ctx_usart_t *ctx, const platform_timespec_t *tick);
+
 void platform_usart_tick_handler(const platform_timespec_t *tick) {
-    usart_tick_handler_common(&ctx_uart, tick);
+    unsigned int x = 1;
+
+    /*
+     * At megabit rates a character takes only a few microseconds, so one
+     * byte per main-loop pass would waste most of the link. Keep going
+     * while the peripheral is ready, within a bound.
+     */
+    do {
+        usart_tick_handler_common(&ctx_uart, tick);
+    } while (ctx_uart.cfg.sync && x++ < USART_SYNC_BURST &&
+            usart_tick_pending(&ctx_uart));
+    usart_xact_tick(&ctx_uart, tick);
 }
 
 /// Maximum number of bytes that may be sent (or received) in one transaction
@@ -336,7 +851,7 @@ void platform_usart_tick_handler(const platform_timespec_t *tick) {
 // Enqueue a buffer for transmission
 
 static bool usart_tx_busy(ctx_usart_t *ctx) {
-    return (ctx->tx.len > 0) || (ctx->tx.nr_desc > 0) ||
+    return (ctx->tx.len > 0) || (ctx->tx.nr_desc > 0) || ctx->tx.dma || ctx->rs485.de ||
             ((ctx->regs->SERCOM_INTFLAG & (1 << 0)) == 0);
 }
 
@@ -373,6 +888,10 @@ static bool usart_tx_async(ctx_usart_t *ctx,
 }
 
 static void usart_tx_abort(ctx_usart_t *ctx) {
+    if (ctx->tx.dma) {
+        dma_abort(DMA_CH_USART);
+        ctx->tx.dma = false;
+    }
     ctx->tx.nr_desc = 0;
     ctx->tx.desc = NULL;
     ctx->tx.len = 0;
@@ -408,15 +927,39 @@ static bool usart_rx_async(ctx_usart_t *ctx, platform_usart_rx_async_desc_t *des
     if (!desc || !desc->buf || desc->max_len == 0 || desc->max_len > NR_USART_CHARS_MAX)
         // Invalid descriptor
         return false;
+    switch (desc->mode) {
+        case PLATFORM_USART_RX_MODE_IDLE:
+        case PLATFORM_USART_RX_MODE_LINE:
+            break;
+        case PLATFORM_USART_RX_MODE_TERM:
+            if (!desc->term || desc->nr_term == 0)
+                return false;
+            break;
+        case PLATFORM_USART_RX_MODE_LEN:
+            if (desc->len == 0 || desc->len > desc->max_len)
+                return false;
+            break;
+        case PLATFORM_USART_RX_MODE_LENPFX:
+            if (desc->len != 1 && desc->len != 2)
+                return false;
+            break;
+        default:
+            // Unknown mode
+            return false;
+    }
 
     if ((ctx->rx.desc) != NULL)
         // Don't clobber an existing buffer
         return false;
 
     desc->compl_type = PLATFORM_USART_RX_COMPL_NONE;
+    desc->compl_flags = 0;
     desc->compl_info.data_len = 0;
+    desc->ovf_idx = 0;
     ctx->rx.idx = 0;
+    ctx->rx.expect = 0;
     platform_tick_hrcount(&ctx->rx.ts_idle);
+    desc->ts_start = ctx->rx.ts_idle;
     ctx->rx.desc = desc;
     return true;
 }
@@ -432,5 +975,719 @@ bool platform_usart_cdc_rx_busy(void) {
 }
 
 void platform_usart_cdc_rx_abort(void) {
-    usart_rx_abort_helper(&ctx_uart);
+    usart_rx_abort_helper(&ctx_uart, PLATFORM_USART_RX_FLAG_ABORT);
+}
+
+void platform_usart_cdc_get_stats(platform_usart_stats_t *stats) {
+    if (stats)
+        *stats = ctx_uart.stats;
+}
+
+void platform_usart_cdc_set_ovf_notify(int notify) {
+    ctx_uart.cfg.ovf_notify = (notify < 0) ? -1 : (int16_t) (notify & 0xFF);
+}
+
+bool platform_usart_cdc_set_xonxoff(const platform_usart_flow_cfg_t *cfg) {
+    ctx_usart_t *ctx = &ctx_uart;
+
+    if (cfg == NULL) {
+        // Release the peer if it is still held.
+        if (ctx->flow.throttled)
+            ctx->flow.ctl = USART_XON;
+        ctx->flow.enabled = false;
+        ctx->flow.paused = false;
+        ctx->flow.throttled = false;
+        return true;
+    }
+    if (ctx->rs485.enabled || cfg->xon_room <= cfg->xoff_room)
+        return false;
+
+    ctx->flow.xoff_room = cfg->xoff_room;
+    ctx->flow.xon_room = cfg->xon_room;
+    ctx->flow.paused = false;
+    ctx->flow.throttled = false;
+    ctx->flow.enabled = true;
+    return true;
+}
+
+void platform_usart_cdc_set_timing(const platform_timespec_t *idle,
+        const platform_timespec_t *gap) {
+    if (idle)
+        ctx_uart.cfg.ts_idle_timeout = *idle;
+    if (gap)
+        ctx_uart.cfg.ts_gap_timeout = *gap;
+    if (idle || gap)
+        ctx_uart.cfg.timing_user = true;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Automatic baud-rate detection
+ * 
+ * The host is asked to send 'U' (0x55). With 8E1 framing, that character
+ * produces five falling edges on RX exactly two bit times apart (start bit,
+ * then D1, D3, D5 and D7), so the span between the first and last falling
+ * edge is eight bit times.
+ * 
+ * The RX pin (PB08) is sampled via PORT IN in a tight loop, with SysTick as
+ * the timebase. At 24 MHz, one loop pass is well under a microsecond, which
+ * over eight bit times gives under 1% error up to 115200 bps. This blocks,
+ * so it is only meant for boot time or an explicit request.
+ * 
+ * NOTE: SERCOM's own auto-baud (FORM = 0x4/0x5) needs a LIN break and sync
+ *       field, which ordinary terminal programs cannot send.
+ */
+
+/// Rates that auto-baud snaps to
+static const uint32_t usart_baud_table[] = {
+    9600, 19200, 38400, 57600, 115200, 230400
+};
+
+_Static_assert(sizeof (usart_baud_table) / sizeof (usart_baud_table[0]) ==
+        PLATFORM_USART_BIST_NR_RATES, "The self-test runs once per rate");
+
+/// Acceptable mismatch between the measured and the nominal rate, in percent
+#define AUTOBAUD_TOLERANCE_PCT	5
+
+/// Maximum time between consecutive falling edges of 'U', in microseconds
+#define AUTOBAUD_EDGE_TIMEOUT_US	1000
+
+// SysTick counts per microsecond, per the platform tick setup
+
+static uint32_t usart_systick_per_us(void) {
+    return (SysTick->LOAD + 1) / PLATFORM_TICK_PERIOD_US;
+}
+
+/*
+ * Wait for a falling edge on PB08
+ * 
+ * @c budget is the timeout in SysTick counts; it is decremented by the time
+ * actually spent. Return the SysTick value at the edge, or -1 on timeout.
+ */
+static int32_t usart_autobaud_edge(uint32_t *budget) {
+    uint32_t prev = SysTick->VAL, now, d;
+    bool high = false;
+
+    for (;;) {
+        if ((pio_in(1) & (1 << 8)) != 0) {
+            high = true;
+        } else if (high) {
+            return (int32_t) SysTick->VAL;
+        }
+
+        now = SysTick->VAL;
+        d = (prev >= now) ? (prev - now) : (prev + (SysTick->LOAD + 1 - now));
+        prev = now;
+        if (d >= *budget)
+            return -1;
+        *budget -= d;
+    }
+}
+
+// Pick the nearest supported rate, or return zero if none is close enough
+
+static uint32_t usart_baud_snap(uint32_t measured) {
+    uint32_t nominal, diff;
+    unsigned int x;
+
+    for (x = 0; x < sizeof (usart_baud_table) / sizeof (usart_baud_table[0]); ++x) {
+        nominal = usart_baud_table[x];
+        diff = (measured > nominal) ? (measured - nominal) : (nominal - measured);
+        if (diff * 100 <= nominal * AUTOBAUD_TOLERANCE_PCT)
+            return nominal;
+    }
+    return 0;
+}
+
+/*
+ * Rate from the span of the four bit-pairs of 'U', in SysTick counts;
+ * zero if it is not one of the supported rates
+ */
+static uint32_t usart_autobaud_rate(uint32_t span, uint32_t per_us) {
+    if (span == 0)
+        return 0;
+    // Eight bit times over "span" SysTick counts
+    return usart_baud_snap((uint32_t) ((8ULL * 1000000ULL * per_us) / span));
+}
+
+static void usart_rs485_timing(ctx_usart_t *ctx);
+
+/*
+ * Reprogram the baud rate and RX pad; both are enable-protected, so the
+ * peripheral is disabled meanwhile.
+ * 
+ * In loopback, RX is taken from PAD[0] (the TX pad), so that the receiver
+ * sees exactly what the transmitter drives.
+ */
+static void usart_set_baud(ctx_usart_t *ctx, uint32_t baud, bool loopback) {
+    ctx->regs->SERCOM_CTRLA &= ~(1 << 1);
+    while ((ctx->regs->SERCOM_SYNCBUSY & (1 << 1)) != 0)
+        asm("nop");
+    ctx->regs->SERCOM_BAUD = usart_baud_reg(baud);
+    ctx->regs->SERCOM_CTRLA = (ctx->regs->SERCOM_CTRLA & ~RF_MASK(RF_USART_CTRLA_RXPO)) |
+            ((loopback ? 0x0 : 0x1) << RF_POS(RF_USART_CTRLA_RXPO));
+    ctx->regs->SERCOM_CTRLA |= (1 << 1);
+    while ((ctx->regs->SERCOM_SYNCBUSY & (1 << 1)) != 0)
+        asm("nop");
+
+    usart_timing_follow(ctx, baud);
+    ctx->cfg.baud = baud;
+    if (ctx->rs485.enabled)
+        usart_rs485_timing(ctx);
+
+    // Drop whatever was received at the wrong rate.
+    while ((ctx->regs->SERCOM_INTFLAG & (1 << 2)) != 0) {
+        (void) ctx->regs->SERCOM_DATA;
+        asm("nop");
+    }
+    ctx->regs->SERCOM_STATUS = 0x00F7;
+}
+
+uint32_t platform_usart_cdc_autobaud(uint32_t timeout_ms) {
+    uint32_t per_us = usart_systick_per_us();
+    uint32_t budget = timeout_ms * 1000 * per_us;
+    uint32_t span = 0, baud;
+    int32_t first, prev, edge;
+    unsigned int x;
+
+    // PB08 carries the bit clock in synchronous mode.
+    if (ctx_uart.cfg.sync)
+        return 0;
+
+    first = usart_autobaud_edge(&budget);
+    prev = first;
+    for (x = 0; first >= 0 && x < 4; ++x) {
+        budget = AUTOBAUD_EDGE_TIMEOUT_US * per_us;
+        if ((edge = usart_autobaud_edge(&budget)) < 0)
+            break;
+        // SysTick counts down; account for at most one wrap.
+        span += (prev >= edge) ? (uint32_t) (prev - edge) :
+                (uint32_t) prev + (SysTick->LOAD + 1 - (uint32_t) edge);
+        prev = edge;
+    }
+
+    baud = (first >= 0 && x == 4) ? usart_autobaud_rate(span, per_us) : 0;
+
+    usart_set_baud(&ctx_uart, (baud != 0) ? baud : PLATFORM_USART_CDC_BAUD, false);
+    return baud;
+}
+
+uint32_t platform_usart_cdc_get_baud(void) {
+    return ctx_uart.cfg.baud;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Loopback self-test
+ * 
+ * For each rate in usart_baud_table[], SERCOM3 is switched to internal
+ * loopback and a PRBS-15 pattern is pushed through the regular TX and RX
+ * paths (usart_tx_async(), usart_rx_async() and the tick handler), exactly
+ * as the application would use them.
+ * 
+ * NOTE: Loopback goes through the TX pad, so the pattern also appears on
+ *       PB09 and thus on the host's terminal.
+ */
+
+/// Number of bytes sent per rate
+#define USART_BIST_LEN		64
+
+/// Extra time allowed per rate beyond the nominal transfer time, in ns
+#define USART_BIST_SLACK_NS	5000000UL
+
+// PRBS-15 (x^15 + x^14 + 1), eight bits at a time
+
+static uint8_t usart_prbs15(uint16_t *lfsr) {
+    uint8_t out = 0;
+    unsigned int x;
+
+    for (x = 0; x < 8; ++x) {
+        uint16_t bit = ((*lfsr >> 14) ^ (*lfsr >> 13)) & 1;
+
+        *lfsr = ((*lfsr << 1) | bit) & 0x7FFF;
+        out = (out << 1) | bit;
+    }
+    return out;
+}
+
+static void usart_bist_one(ctx_usart_t *ctx, platform_usart_bist_result_t *res) {
+    char tx[USART_BIST_LEN], rx[USART_BIST_LEN];
+    platform_usart_tx_bufdesc_t txd = {tx, sizeof (tx)};
+    platform_usart_rx_async_desc_t rxd;
+    platform_timespec_t t0, now, delta, limit;
+    uint16_t lfsr = 0x7FFF, n, x;
+
+    for (x = 0; x < sizeof (tx); ++x)
+        tx[x] = (char) usart_prbs15(&lfsr);
+
+    memset(&rxd, 0, sizeof (rxd));
+    rxd.buf = rx;
+    rxd.max_len = sizeof (rx);
+    rxd.mode = PLATFORM_USART_RX_MODE_LEN;
+    rxd.len = sizeof (rx);
+
+    // Twice the nominal time on the wire, plus some slack
+    limit.nr_sec = 0;
+    limit.nr_nsec = (uint32_t) ((2ULL * sizeof (tx) * PLATFORM_USART_CDC_CHAR_BITS *
+            1000000000ULL) / res->baud) + USART_BIST_SLACK_NS;
+
+    usart_set_baud(ctx, res->baud, true);
+    usart_rx_async(ctx, &rxd);
+    usart_tx_async(ctx, &txd, 1);
+
+    platform_tick_hrcount(&t0);
+    for (;;) {
+        platform_tick_hrcount(&now);
+        usart_tick_handler_common(ctx, &now);
+        if (rxd.compl_type != PLATFORM_USART_RX_COMPL_NONE)
+            break;
+
+        platform_tick_delta(&delta, &now, &t0);
+        if (platform_timespec_compare(&delta, &limit) > 0) {
+            usart_tx_abort(ctx);
+            usart_rx_abort_helper(ctx, PLATFORM_USART_RX_FLAG_ABORT);
+            break;
+        }
+        asm("nop");
+    }
+    platform_tick_delta(&delta, &now, &t0);
+
+    // Lost bytes count as errors, as do mismatches.
+    n = rxd.compl_info.data_len;
+    res->nr_err = sizeof (tx) - n;
+    for (x = 0; x < n; ++x) {
+        if (rx[x] != tx[x])
+            ++res->nr_err;
+    }
+
+    res->nr_bytes = n;
+    res->bytes_per_sec = 0;
+    if (delta.nr_sec == 0 && delta.nr_nsec > 0)
+        res->bytes_per_sec = (uint32_t) ((1000000000ULL * n) / delta.nr_nsec);
+}
+
+unsigned int platform_usart_cdc_bist(platform_usart_bist_result_t *res,
+        unsigned int nr_res) {
+    uint32_t baud = ctx_uart.cfg.baud;
+    platform_timespec_t idle = ctx_uart.cfg.ts_idle_timeout;
+    platform_timespec_t gap = ctx_uart.cfg.ts_gap_timeout;
+    unsigned int x;
+
+    if (!res || usart_tx_busy(&ctx_uart) || usart_rx_busy(&ctx_uart) ||
+            ctx_uart.cfg.sync || ctx_uart.flow.enabled)
+        return 0;
+
+    for (x = 0; x < nr_res &&
+            x < sizeof (usart_baud_table) / sizeof (usart_baud_table[0]); ++x) {
+        memset(&res[x], 0, sizeof (res[x]));
+        res[x].baud = usart_baud_table[x];
+        usart_bist_one(&ctx_uart, &res[x]);
+    }
+
+    // Back to normal operation
+    usart_set_baud(&ctx_uart, baud, false);
+    ctx_uart.cfg.ts_idle_timeout = idle;
+    ctx_uart.cfg.ts_gap_timeout = gap;
+    return x;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+/*
+ * RS-485 half-duplex mode
+ * 
+ * DE is released from the TXC (transmit complete) interrupt, which fires
+ * once the stop bit of the last byte has left the shift register, instead
+ * of from the main loop; otherwise the bus would stay driven for up to a
+ * whole loop pass after each frame, which caps the polling rate of the
+ * bus master. A post-guard is timed by TC1 rather than waited out in the
+ * handler.
+ * 
+ * NOTE: SERCOM can drive DE from PAD[2] itself (TXPO = 0x3), but PAD[2]
+ *       of SERCOM3 is not routed to a usable pin on this board.
+ */
+
+/// TC1 rate for the post-guard: GCLK_GEN0 (24 MHz) / 16
+#define USART_RS485_TC_HZ	1500000UL
+
+/// Longest post-guard TC1 can time, in its counts (CC0 + 1)
+#define USART_RS485_TC_MAX	0x10000UL
+
+// Post-guard in TC1 counts for the given rate
+
+static uint32_t usart_rs485_post_counts(uint32_t baud, uint8_t bits) {
+    return (uint32_t) (((uint64_t) bits * USART_RS485_TC_HZ) / baud);
+}
+
+/*
+ * Derive the guard times from the bit times and the current rate
+ * 
+ * Called again on each rate change. A post-guard that no longer fits TC1
+ * is cut to the longest one it can time.
+ */
+static void usart_rs485_timing(ctx_usart_t *ctx) {
+    uint32_t counts;
+
+    ctx->rs485.ts_pre_guard.nr_sec = 0;
+    ctx->rs485.ts_pre_guard.nr_nsec = (uint32_t) (1000000000UL / ctx->cfg.baud) *
+            ctx->rs485.pre_guard_bits;
+
+    counts = usart_rs485_post_counts(ctx->cfg.baud, ctx->rs485.post_guard_bits);
+    if (counts > USART_RS485_TC_MAX)
+        counts = USART_RS485_TC_MAX;
+    ctx->rs485.post_guard_counts = counts;
+    if (counts > 0) {
+        while ((TC1_REGS->COUNT16.TC_SYNCBUSY & (1 << 6)) != 0)
+            asm("nop");
+        TC1_REGS->COUNT16.TC_CC[0] = (uint16_t) (counts - 1);
+    }
+}
+
+/*
+ * Release DE, once the post-guard (if any) is over
+ * 
+ * Runs in interrupt context. The echo of the last byte may have landed
+ * after the final tick; it is left for the next tick to drop, so that DATA
+ * and STATUS are only ever accessed from the tick handler.
+ */
+static void usart_rs485_release(ctx_usart_t *ctx) {
+    pio_clr(PLATFORM_USART_RS485_DE_GROUP, (1 << PLATFORM_USART_RS485_DE_PIN));
+
+    ctx->rs485.drain = ctx->rs485.suppress_echo &&
+            (ctx->regs->SERCOM_INTFLAG & (1 << 2)) != 0;
+    ctx->rs485.txc_armed = false;
+    ctx->rs485.de = false;
+}
+
+/*
+ * SERCOM3 interrupt 1 is TXC (34.8.6); DRE, RXC and the rest go to the
+ * other vectors, which stay disabled.
+ * 
+ * With a post-guard, TC1 is started in one-shot mode instead of waiting
+ * here; its overflow releases DE.
+ */
+void __attribute__((used, interrupt())) SERCOM3_1_Handler(void) {
+    ctx_usart_t *ctx = &ctx_uart;
+
+    ctx->regs->SERCOM_INTENCLR = (1 << 1);
+    ctx->regs->SERCOM_INTFLAG = (1 << 1);
+    if (ctx->rs485.post_guard_counts == 0) {
+        usart_rs485_release(ctx);
+        return;
+    }
+
+    while ((TC1_REGS->COUNT16.TC_SYNCBUSY & (1 << 2)) != 0)
+        asm("nop");
+    TC1_REGS->COUNT16.TC_CTRLBSET = (0x1 << 5); // RETRIGGER
+}
+
+// TC1 overflow: end of the post-guard
+
+void __attribute__((used, interrupt())) TC1_Handler(void) {
+    TC1_REGS->COUNT16.TC_INTFLAG = (1 << 0);
+    usart_rs485_release(&ctx_uart);
+}
+
+// One-shot, stopped, overflow interrupt; CC0 is set by usart_rs485_timing()
+
+static void usart_rs485_timer_init(void) {
+    pclk_get(PLATFORM_PCLK_TC1);
+    TC1_REGS->COUNT16.TC_CTRLA = RF_VALUE(RF_REG_TC_CTRLA,
+            RF(RF_TC_CTRLA_SWRST, 0x1));
+    sync_post(&TC1_REGS->COUNT16.TC_SYNCBUSY, (1 << 0));
+    sync_wait(&TC1_REGS->COUNT16.TC_SYNCBUSY, (1 << 0));
+
+    // 16-bit, GCLK/16, MFRQ (CC0 is the period)
+    TC1_REGS->COUNT16.TC_CTRLA = RF_VALUE(RF_REG_TC_CTRLA,
+            RF(RF_TC_CTRLA_MODE, 0x0),
+            RF(RF_TC_CTRLA_PRESCSYNC, 0x1),
+            RF(RF_TC_CTRLA_PRESCALER, 0x4));
+    TC1_REGS->COUNT16.TC_WAVE = RF_VALUE(RF_REG_TC_WAVE,
+            RF(RF_TC_WAVE_WAVEGEN, 0x1));
+    TC1_REGS->COUNT16.TC_CTRLBSET = (1 << 2); // ONESHOT
+    sync_post(&TC1_REGS->COUNT16.TC_SYNCBUSY, (1 << 2));
+
+    TC1_REGS->COUNT16.TC_CTRLA |= RF_MASK(RF_TC_CTRLA_ENABLE);
+    sync_post(&TC1_REGS->COUNT16.TC_SYNCBUSY, (1 << 1));
+    sync_wait(&TC1_REGS->COUNT16.TC_SYNCBUSY, (1 << 1) | (1 << 2));
+    TC1_REGS->COUNT16.TC_CTRLBSET = (0x2 << 5); // STOP
+    sync_post(&TC1_REGS->COUNT16.TC_SYNCBUSY, (1 << 2));
+    sync_wait(&TC1_REGS->COUNT16.TC_SYNCBUSY, (1 << 2));
+
+    // Enabling starts a first, unwanted count.
+    TC1_REGS->COUNT16.TC_INTFLAG = (1 << 0);
+    TC1_REGS->COUNT16.TC_INTENSET = (1 << 0);
+}
+
+bool platform_usart_cdc_set_rs485(const platform_usart_rs485_cfg_t *cfg) {
+    ctx_usart_t *ctx = &ctx_uart;
+
+    if (usart_tx_busy(ctx) || (cfg != NULL && ctx->flow.enabled))
+        return false;
+
+    if (cfg == NULL) {
+        if (ctx->rs485.enabled) {
+            TC1_REGS->COUNT16.TC_INTENCLR = (1 << 0);
+            pclk_put(PLATFORM_PCLK_TC1);
+        }
+        ctx->rs485.enabled = false;
+        USART_RS485_DE_PORT->PORT_OUTCLR = (1 << PLATFORM_USART_RS485_DE_PIN);
+        return true;
+    }
+    if (usart_rs485_post_counts(ctx->cfg.baud, cfg->post_guard_bits) > USART_RS485_TC_MAX)
+        return false;
+
+    // DE idles low (receive), as a plain push-pull output
+    USART_RS485_DE_PORT->PORT_OUTCLR = (1 << PLATFORM_USART_RS485_DE_PIN);
+    USART_RS485_DE_PORT->PORT_DIRSET = (1 << PLATFORM_USART_RS485_DE_PIN);
+
+    if (!ctx->rs485.enabled)
+        usart_rs485_timer_init();
+    ctx->rs485.pre_guard_bits = cfg->pre_guard_bits;
+    ctx->rs485.post_guard_bits = cfg->post_guard_bits;
+    usart_rs485_timing(ctx);
+    ctx->rs485.suppress_echo = cfg->suppress_echo;
+    ctx->rs485.de = false;
+    ctx->rs485.txc_armed = false;
+    ctx->rs485.drain = false;
+    ctx->rs485.enabled = true;
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Synchronous (clocked) mode
+ * 
+ * For board-to-board links, SERCOM3 can run as a synchronous USART: the
+ * bit clock is carried on XCK (PAD[1], PB08), and no oversampling takes
+ * place, so that f_baud = f_ref / (2 * (BAUD + 1)) (34.6.2.3). As master,
+ * GCLK_GEN0 (24 MHz) is used for a ceiling of 12 Mbps; as slave, the
+ * clock comes from the other end and the GCLK only runs the registers.
+ * 
+ * Frames are 8N1 (ten bits per byte), with TxD on PAD[0] (PB09) as usual
+ * and RxD moved to PAD[3], as PAD[1] now carries the clock.
+ * 
+ * Transmission goes by DMA: each fragment of more than one byte is one
+ * block on DMA_CH_USART, paced by DRE, so that the tick handler only
+ * starts it and notices its end. Reception stays with the tick handler,
+ * as every byte passes through it for time stamps, line editing,
+ * terminators, XON/XOFF and the idle timeout, none of which a DMA block
+ * could apply.
+ * 
+ * Throughput model: the wire carries rate / 10 bytes per second. Received
+ * data is moved by the tick handler, at most USART_SYNC_BURST bytes per
+ * main-loop pass, so sustained reception is around
+ * 
+ *     min(rate / 10, USART_SYNC_BURST / t_pass)
+ * 
+ * An otherwise idle pass (roughly 2 us at 24 MHz) gives 8 MB/s, beyond
+ * even the 1.2 MB/s of the 12 Mbps ceiling. The CPU only becomes the limit
+ * once the rest of the loop stretches t_pass past about 13 us. Transmission
+ * runs at rate / 10 within a fragment, whatever t_pass, with up to one
+ * pass lost between fragments.
+ */
+
+/// Synchronous-mode RxD pin: SERCOM3 PAD[3], as mapped by the device header
+#if !defined(PLATFORM_USART_SYNC_RX_GROUP)
+#define PLATFORM_USART_SYNC_RX_GROUP	(PIN_PB11D_SERCOM3_PAD3 >> 5)
+#endif
+#if !defined(PLATFORM_USART_SYNC_RX_PIN)
+#define PLATFORM_USART_SYNC_RX_PIN	(PIN_PB11D_SERCOM3_PAD3 & 0x1F)
+#endif
+#if !defined(PLATFORM_USART_SYNC_RX_PMUX)
+#define PLATFORM_USART_SYNC_RX_PMUX	MUX_PB11D_SERCOM3_PAD3
+#endif
+
+/// Reference clock for synchronous master mode (GCLK_GEN0)
+#define USART_SYNC_GCLK_HZ	24000000UL
+
+/// Shortest idle timeout in synchronous mode, in ns
+#define USART_SYNC_IDLE_MIN_NS	50000UL
+
+bool platform_usart_cdc_set_sync(const platform_usart_sync_cfg_t *cfg) {
+    ctx_usart_t *ctx = &ctx_uart;
+    volatile port_group_registers_t *rx = &PORT_SEC_REGS->GROUP[PLATFORM_USART_SYNC_RX_GROUP];
+    uint32_t div = 0, rate;
+
+    if (usart_tx_busy(ctx) || usart_rx_busy(ctx) || ctx->rs485.enabled)
+        return false;
+    if (cfg != NULL && cfg->master) {
+        if (cfg->rate == 0 || cfg->rate > USART_SYNC_GCLK_HZ / 2)
+            return false;
+        // Round to the nearest achievable rate
+        div = (USART_SYNC_GCLK_HZ + cfg->rate) / (2 * cfg->rate);
+        if (div > 65536)
+            return false;
+    }
+
+    ctx->regs->SERCOM_CTRLA &= ~(1 << 1);
+    while ((ctx->regs->SERCOM_SYNCBUSY & (1 << 1)) != 0)
+        asm("nop");
+
+    if (cfg == NULL) {
+        // Back to the asynchronous CDC link of platform_usart_init()
+        pclk_reset_gen(PLATFORM_PCLK_SERCOM3);
+        ctx->regs->SERCOM_CTRLA = RF_VALUE(RF_REG_USART_CTRLA,
+                RF(RF_USART_CTRLA_MODE, 0x1),
+                RF(RF_USART_CTRLA_RXPO, 0x1),
+                RF(RF_USART_CTRLA_FORM, 0x1),
+                RF(RF_USART_CTRLA_DORD, 0x1));
+        rx->PORT_PINCFG[PLATFORM_USART_SYNC_RX_PIN] &= ~(0x3 << 0);
+        if (ctx->cfg.sync) {
+            ctx->cfg.sync = false;
+            usart_set_baud(ctx, ctx->cfg.async_baud, false);
+        } else {
+            usart_set_baud(ctx, ctx->cfg.baud, false);
+        }
+        return true;
+    }
+    if (!ctx->cfg.sync)
+        ctx->cfg.async_baud = ctx->cfg.baud;
+
+    /*
+     * As slave, XCK is an input and BAUD is unused; the rate given is only
+     * used for the idle timeout.
+     */
+    if (cfg->master) {
+        pclk_set_gen(PLATFORM_PCLK_SERCOM3, 0);
+        ctx->regs->SERCOM_CTRLA = RF_VALUE(RF_REG_USART_CTRLA,
+                RF(RF_USART_CTRLA_MODE, 0x1),
+                RF(RF_USART_CTRLA_RXPO, 0x3),
+                RF(RF_USART_CTRLA_FORM, 0x0),
+                RF(RF_USART_CTRLA_CMODE, 0x1),
+                RF(RF_USART_CTRLA_DORD, 0x1));
+        ctx->regs->SERCOM_BAUD = (uint16_t) (div - 1);
+        rate = USART_SYNC_GCLK_HZ / (2 * div);
+    } else {
+        ctx->regs->SERCOM_CTRLA = RF_VALUE(RF_REG_USART_CTRLA,
+                RF(RF_USART_CTRLA_MODE, 0x0),
+                RF(RF_USART_CTRLA_RXPO, 0x3),
+                RF(RF_USART_CTRLA_FORM, 0x0),
+                RF(RF_USART_CTRLA_CMODE, 0x1),
+                RF(RF_USART_CTRLA_DORD, 0x1));
+        rate = (cfg->rate != 0) ? cfg->rate : PLATFORM_USART_CDC_BAUD;
+    }
+
+    // RxD on PAD[3]; XCK shares PB08's existing function-D mux setting.
+    rx->PORT_PINCFG[PLATFORM_USART_SYNC_RX_PIN] |= (0x3 << 0);
+    rx->PORT_PMUX[PLATFORM_USART_SYNC_RX_PIN >> 1] =
+            (rx->PORT_PMUX[PLATFORM_USART_SYNC_RX_PIN >> 1] &
+             ~(0xF << (4 * (PLATFORM_USART_SYNC_RX_PIN & 1)))) |
+            (PLATFORM_USART_SYNC_RX_PMUX << (4 * (PLATFORM_USART_SYNC_RX_PIN & 1)));
+
+    ctx->regs->SERCOM_CTRLA |= (1 << 1);
+    while ((ctx->regs->SERCOM_SYNCBUSY & (1 << 1)) != 0)
+        asm("nop");
+
+    usart_timing_follow(ctx, rate);
+    ctx->cfg.baud = rate;
+    ctx->cfg.sync = true;
+    if (ctx->cfg.ts_idle_timeout.nr_nsec < USART_SYNC_IDLE_MIN_NS)
+        ctx->cfg.ts_idle_timeout.nr_nsec = USART_SYNC_IDLE_MIN_NS;
+
+    while ((ctx->regs->SERCOM_INTFLAG & (1 << 2)) != 0)
+        (void) ctx->regs->SERCOM_DATA;
+    ctx->regs->SERCOM_STATUS = 0x00F7;
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Request/response transactions
+ * 
+ * The queue is advanced from the main loop, right after the regular tick
+ * handling, so that a reply completed in this pass lets the next request
+ * start in the same pass. Everything runs in main-loop context; nothing
+ * here is touched by interrupt handlers.
+ */
+
+// Finish the head transaction and start on the next one
+
+static void usart_xact_pop(ctx_usart_t *ctx, uint16_t state) {
+    platform_usart_xact_t *x = ctx->xact.head;
+
+    ctx->xact.head = x->next;
+    if (ctx->xact.head == NULL)
+        ctx->xact.tail = NULL;
+    x->next = NULL;
+    x->state = state;
+}
+
+static void usart_xact_tick(ctx_usart_t *ctx, const platform_timespec_t *tick) {
+    platform_usart_xact_t *x;
+    platform_timespec_t ts_delta, ts_limit;
+
+    while ((x = ctx->xact.head) != NULL) {
+        if (x->state == PLATFORM_USART_XACT_QUEUED) {
+            // Wait for the link to be free.
+            if (usart_tx_busy(ctx) || usart_rx_busy(ctx))
+                return;
+
+            // Listen first, so that not even a fast reply is missed.
+            if (!usart_rx_async(ctx, &x->rx)) {
+                usart_xact_pop(ctx, PLATFORM_USART_XACT_FAILED);
+                continue;
+            }
+            if (!usart_tx_async(ctx, x->tx, x->nr_tx)) {
+                usart_rx_abort_helper(ctx, PLATFORM_USART_RX_FLAG_ABORT);
+                usart_xact_pop(ctx, PLATFORM_USART_XACT_FAILED);
+                continue;
+            }
+            x->ts_start = *tick;
+            x->state = PLATFORM_USART_XACT_ACTIVE;
+            return;
+        }
+
+        if (x->rx.compl_type != PLATFORM_USART_RX_COMPL_NONE) {
+            if (x->match == NULL ||
+                    x->match(x->rx.buf, x->rx.compl_info.data_len, x->arg)) {
+                usart_xact_pop(ctx, PLATFORM_USART_XACT_DONE);
+                continue;
+            }
+            // Not our reply; keep listening.
+            usart_rx_async(ctx, &x->rx);
+        }
+
+        ts_limit.nr_sec = x->timeout_ms / 1000;
+        ts_limit.nr_nsec = (x->timeout_ms % 1000) * 1000000UL;
+        platform_tick_delta(&ts_delta, tick, &x->ts_start);
+        if (platform_timespec_compare(&ts_delta, &ts_limit) < 0)
+            return;
+
+        usart_tx_abort(ctx);
+        usart_rx_abort_helper(ctx, PLATFORM_USART_RX_FLAG_ABORT);
+        usart_xact_pop(ctx, PLATFORM_USART_XACT_TIMEOUT);
+    }
+}
+
+bool platform_usart_cdc_xact_submit(platform_usart_xact_t *xact) {
+    const platform_usart_xact_t *x;
+
+    if (!xact || !xact->tx || xact->nr_tx == 0 || xact->timeout_ms == 0)
+        return false;
+    // Line mode echoes, which would collide with the request on the wire.
+    if (xact->rx.mode == PLATFORM_USART_RX_MODE_LINE)
+        return false;
+    // Linking it in a second time would close the list into a loop.
+    for (x = ctx_uart.xact.head; x != NULL; x = x->next) {
+        if (x == xact)
+            return false;
+    }
+
+    xact->state = PLATFORM_USART_XACT_QUEUED;
+    xact->next = NULL;
+    if (ctx_uart.xact.tail != NULL)
+        ctx_uart.xact.tail->next = xact;
+    else
+        ctx_uart.xact.head = xact;
+    ctx_uart.xact.tail = xact;
+    return true;
+}
+
+bool platform_usart_cdc_xact_busy(void) {
+    return ctx_uart.xact.head != NULL;
 }
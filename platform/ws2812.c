@@ -0,0 +1,321 @@
+/**
+ * @file platform/ws2812.c
+ * @brief Platform-support routines, WS2812 LED strip via SPI and DMA
+ */
+
+/*
+ * HW configuration:
+ * -- Data: SERCOM2 as SPI host, GCLK_GEN0 (24 MHz); MOSI (PAD0) on PA12 by
+ *    default, peripheral function C. SCK is not routed to a pin.
+ * -- The strip wants 5-V logic levels; use a level shifter, or run its first
+ *    LED at a lower supply.
+ *
+ * Each WS2812 bit is 1.25 us, high for a short or long part of it. At a
+ * 2.4-MHz SPI clock, three SPI bits make one WS2812 bit:
+ *
+ *     0 -> 100 (0.42 us high)
+ *     1 -> 110 (0.83 us high)
+ *
+ * so each 8-bit color component becomes 24 SPI bits, or three bytes. Every
+ * pattern ends low, so the line stays low after the last byte, which is
+ * what the strip takes as the latch (reset) signal once it lasts long
+ * enough.
+ *
+ * Frames are encoded into one of two buffers while DMA sends the other, so
+ * that the next frame can be computed while the previous one goes out.
+ */
+
+// Common include for the XC32 compiler
+#include <xc.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "blink_settings.h"
+#include "sync.h"
+#include "pclk.h"
+#include "regfield.h"
+#include "dma.h"
+#include "../platform.h"
+
+// Functions "exported" by this file
+void platform_ws2812_init(void);
+void platform_ws2812_tick_handler(const platform_timespec_t *tick);
+
+/////////////////////////////////////////////////////////////////////////////
+
+#define WS2812_SPI_REGS	(&SERCOM2_REGS->SPIM)
+
+#if !defined(PLATFORM_WS2812_GROUP)
+#define PLATFORM_WS2812_GROUP	0
+#endif
+#if !defined(PLATFORM_WS2812_PIN)
+#define PLATFORM_WS2812_PIN	12
+#endif
+#if !defined(PLATFORM_WS2812_PMUX)
+#define PLATFORM_WS2812_PMUX	MUX_PA12C_SERCOM2_PAD0
+#endif
+
+/// Default brightness; a full-white strip draws 60 mA per LED.
+#if !defined(PLATFORM_WS2812_BRIGHTNESS)
+#define PLATFORM_WS2812_BRIGHTNESS	32
+#endif
+
+/// 24 MHz / (2 * (4 + 1)) = 2.4 MHz, three SPI bits per 1.25-us WS2812 bit
+#define WS2812_SPI_BAUD	4
+
+/// DMAC trigger for "SERCOM2 DATA empty", from the device header
+#define WS2812_DMA_TRIG	SERCOM2_DMAC_ID_TX
+
+/// Encoded bytes per LED: three colors, three SPI bytes each
+#define WS2812_LED_BYTES	9
+
+/*
+ * Minimum low time between frames, in us
+ *
+ * The original WS2812 latches after 50 us; later parts (WS2812B-V5 and
+ * the like) need 280 us.
+ */
+#define WS2812_T_LATCH_US	300
+
+/// Period of the built-in animation, in ms
+#define WS2812_ANIM_MS		20
+
+/// WS2812 bit pattern of one nibble: 12 SPI bits, MSB first
+#define WS2812_BIT(n, i)	((((n) >> (i)) & 1) ? 0x6 : 0x4)
+#define WS2812_NIBBLE(n) \
+    ((WS2812_BIT(n, 3) << 9) | (WS2812_BIT(n, 2) << 6) | \
+     (WS2812_BIT(n, 1) << 3) | WS2812_BIT(n, 0))
+
+static const uint16_t ws2812_nibble[16] = {
+    WS2812_NIBBLE(0x0), WS2812_NIBBLE(0x1), WS2812_NIBBLE(0x2), WS2812_NIBBLE(0x3),
+    WS2812_NIBBLE(0x4), WS2812_NIBBLE(0x5), WS2812_NIBBLE(0x6), WS2812_NIBBLE(0x7),
+    WS2812_NIBBLE(0x8), WS2812_NIBBLE(0x9), WS2812_NIBBLE(0xA), WS2812_NIBBLE(0xB),
+    WS2812_NIBBLE(0xC), WS2812_NIBBLE(0xD), WS2812_NIBBLE(0xE), WS2812_NIBBLE(0xF),
+};
+
+_Static_assert(WS2812_NIBBLE(0x0) == 0x924 && WS2812_NIBBLE(0xF) == 0xDB6,
+        "0 must encode as 100, and 1 as 110");
+
+/*
+ * What the strip shows for each blink setting, when driven automatically
+ *
+ * Period and duty cycle follow the on-board LED (see
+ * platform_blink_modify()): it is lit for the last duty_pct of each period.
+ * While dark, a dim dot runs once along the strip per period.
+ */
+typedef struct ws2812_mode_type {
+    uint16_t period_ms;
+    uint8_t duty_pct;
+    uint8_t rgb[3];
+} ws2812_mode_t;
+
+static const ws2812_mode_t ws2812_modes[NUM_SETTINGS] = {
+    [OFF] = {0, 0, {0x00, 0x00, 0x00}},
+    [SLOW] = {1000, 10, {0x00, 0xFF, 0x00}},
+    [MEDIUM] = {500, 20, {0xFF, 0xA0, 0x00}},
+    [FAST] = {300, 50, {0xFF, 0x00, 0x00}},
+    [ON] = {0, 100, {0xFF, 0xFF, 0xFF}},
+};
+
+typedef struct ctx_ws2812_type {
+    /// Colors for the next frame, in wire order (G, R, B)
+    uint8_t grb[PLATFORM_WS2812_NR][3];
+
+    /// Encoded frames
+    uint8_t enc[2][PLATFORM_WS2812_NR * WS2812_LED_BYTES];
+
+    /// Buffer being sent, and buffer waiting to be; -1 if none
+    int8_t sending;
+    int8_t queued;
+
+    /// When the line last went low after a frame
+    platform_timespec_t ts_latch;
+
+    uint8_t brightness;
+
+    /// Built-in animation: enabled, blink setting shown, and its start
+    bool anim;
+    int8_t anim_setting;
+    platform_timespec_t ts_anim_start;
+    platform_timespec_t ts_anim;
+
+    platform_ws2812_stats_t stats;
+} ctx_ws2812_t;
+static ctx_ws2812_t ctx_ws2812;
+
+//////////////////////////////////////////////////////////////////////////////
+
+// Time elapsed since @c since, in us
+
+static uint32_t ws2812_elapsed_us(const platform_timespec_t *tick, const platform_timespec_t *since) {
+    platform_timespec_t ts_delta;
+
+    platform_tick_delta(&ts_delta, tick, since);
+    return ts_delta.nr_sec * 1000000 + ts_delta.nr_nsec / 1000;
+}
+
+// Encode the current colors into a buffer
+
+static void ws2812_encode(ctx_ws2812_t *ctx, uint8_t *out) {
+    const uint8_t *c = &ctx->grb[0][0];
+    unsigned int n, v;
+    uint32_t x;
+
+    for (n = 0; n < PLATFORM_WS2812_NR * 3; ++n) {
+        v = (c[n] * (ctx->brightness + 1)) >> 8;
+        x = ((uint32_t) ws2812_nibble[v >> 4] << 12) | ws2812_nibble[v & 0xF];
+        *(out++) = (uint8_t) (x >> 16);
+        *(out++) = (uint8_t) (x >> 8);
+        *(out++) = (uint8_t) x;
+    }
+}
+
+// Compute the next frame of the built-in animation
+
+static void ws2812_animate(ctx_ws2812_t *ctx, const platform_timespec_t *tick) {
+    const ws2812_mode_t *m = &ws2812_modes[currentSetting];
+    uint32_t t = 0, head = PLATFORM_WS2812_NR;
+    bool lit = (m->duty_pct >= 100);
+    unsigned int x;
+
+    // Restart the pattern along with the LED, on a setting change
+    if (ctx->anim_setting != (int8_t) currentSetting) {
+        ctx->anim_setting = (int8_t) currentSetting;
+        ctx->ts_anim_start = *tick;
+    }
+    if (m->period_ms > 0) {
+        t = (ws2812_elapsed_us(tick, &ctx->ts_anim_start) / 1000) % m->period_ms;
+        lit = (t * 100 >= (uint32_t) m->period_ms * (100 - m->duty_pct));
+        head = t * PLATFORM_WS2812_NR / m->period_ms;
+    }
+
+    for (x = 0; x < PLATFORM_WS2812_NR; ++x) {
+        if (lit)
+            platform_ws2812_set(x, m->rgb[0], m->rgb[1], m->rgb[2]);
+        else if (x == head)
+            platform_ws2812_set(x, m->rgb[0] >> 2, m->rgb[1] >> 2, m->rgb[2] >> 2);
+        else
+            platform_ws2812_set(x, 0, 0, 0);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+void platform_ws2812_tick_handler(const platform_timespec_t *tick) {
+    ctx_ws2812_t *ctx = &ctx_ws2812;
+
+    if (ctx->anim && ws2812_elapsed_us(tick, &ctx->ts_anim) >= WS2812_ANIM_MS * 1000) {
+        ctx->ts_anim = *tick;
+        ws2812_animate(ctx, tick);
+        platform_ws2812_show();
+    }
+
+    if (ctx->sending >= 0) {
+        // The latch time counts from when the last bit has gone out.
+        if (dma_busy(DMA_CH_WS2812) ||
+                (WS2812_SPI_REGS->SERCOM_INTFLAG & (1 << 1)) == 0) // TXC
+            return;
+        ctx->sending = -1;
+        ctx->ts_latch = *tick;
+        ++ctx->stats.nr_frames;
+    }
+    if (ctx->queued < 0 || ws2812_elapsed_us(tick, &ctx->ts_latch) < WS2812_T_LATCH_US)
+        return;
+
+    dma_start(DMA_CH_WS2812, ctx->enc[ctx->queued], &WS2812_SPI_REGS->SERCOM_DATA,
+            sizeof (ctx->enc[0]), WS2812_DMA_TRIG);
+    ctx->sending = ctx->queued;
+    ctx->queued = -1;
+}
+
+void platform_ws2812_init(void) {
+    memset(&ctx_ws2812, 0, sizeof (ctx_ws2812));
+    ctx_ws2812.sending = -1;
+    ctx_ws2812.queued = -1;
+    ctx_ws2812.brightness = PLATFORM_WS2812_BRIGHTNESS;
+    ctx_ws2812.anim = true;
+    ctx_ws2812.anim_setting = -1;
+
+    pclk_get(PLATFORM_PCLK_SERCOM2);
+    WS2812_SPI_REGS->SERCOM_CTRLA = RF_VALUE(RF_REG_SPI_CTRLA,
+            RF(RF_SPI_CTRLA_SWRST, 0x1));
+    sync_post(&WS2812_SPI_REGS->SERCOM_SYNCBUSY, (1 << 0));
+    sync_wait(&WS2812_SPI_REGS->SERCOM_SYNCBUSY, (1 << 0));
+
+    // Host, mode 0, MSB first; DO on PAD0
+    WS2812_SPI_REGS->SERCOM_CTRLA = RF_VALUE(RF_REG_SPI_CTRLA,
+            RF(RF_SPI_CTRLA_MODE, 0x3),
+            RF(RF_SPI_CTRLA_DOPO, 0x0),
+            RF(RF_SPI_CTRLA_DIPO, 0x3),
+            RF(RF_SPI_CTRLA_FORM, 0x0),
+            RF(RF_SPI_CTRLA_CPHA, 0x0),
+            RF(RF_SPI_CTRLA_CPOL, 0x0),
+            RF(RF_SPI_CTRLA_DORD, 0x0));
+    WS2812_SPI_REGS->SERCOM_CTRLB = RF_VALUE(RF_REG_SPI_CTRLB,
+            RF(RF_SPI_CTRLB_CHSIZE, 0x0),
+            RF(RF_SPI_CTRLB_MSSEN, 0x0),
+            RF(RF_SPI_CTRLB_RXEN, 0x0));
+    sync_post(&WS2812_SPI_REGS->SERCOM_SYNCBUSY, (1 << 2));
+    WS2812_SPI_REGS->SERCOM_BAUD = WS2812_SPI_BAUD;
+
+    // Data pin: low until the SERCOM takes over
+    PORT_SEC_REGS->GROUP[PLATFORM_WS2812_GROUP].PORT_OUTCLR = (1 << PLATFORM_WS2812_PIN);
+    PORT_SEC_REGS->GROUP[PLATFORM_WS2812_GROUP].PORT_DIRSET = (1 << PLATFORM_WS2812_PIN);
+    PORT_SEC_REGS->GROUP[PLATFORM_WS2812_GROUP].PORT_PINCFG[PLATFORM_WS2812_PIN] |= (1 << 0);
+    PORT_SEC_REGS->GROUP[PLATFORM_WS2812_GROUP].PORT_PMUX[PLATFORM_WS2812_PIN >> 1] =
+            (PORT_SEC_REGS->GROUP[PLATFORM_WS2812_GROUP].PORT_PMUX[PLATFORM_WS2812_PIN >> 1] &
+            ~(0xF << ((PLATFORM_WS2812_PIN & 1) * 4))) |
+            (PLATFORM_WS2812_PMUX << ((PLATFORM_WS2812_PIN & 1) * 4));
+
+    sync_wait(&WS2812_SPI_REGS->SERCOM_SYNCBUSY, (1 << 2));
+    WS2812_SPI_REGS->SERCOM_CTRLA |= (1 << 1);
+    sync_post(&WS2812_SPI_REGS->SERCOM_SYNCBUSY, (1 << 1));
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+void platform_ws2812_set(unsigned int idx, uint8_t r, uint8_t g, uint8_t b) {
+    if (idx >= PLATFORM_WS2812_NR)
+        return;
+    ctx_ws2812.grb[idx][0] = g;
+    ctx_ws2812.grb[idx][1] = r;
+    ctx_ws2812.grb[idx][2] = b;
+}
+
+void platform_ws2812_show(void) {
+    ctx_ws2812_t *ctx = &ctx_ws2812;
+    platform_timespec_t t0, t1;
+    int8_t b;
+
+    // Never the buffer on the wire; reuse the one waiting, if any.
+    if (ctx->queued >= 0) {
+        b = ctx->queued;
+        ++ctx->stats.nr_replaced;
+    } else {
+        b = (ctx->sending == 0) ? 1 : 0;
+    }
+
+    platform_tick_hrcount(&t0);
+    ws2812_encode(ctx, ctx->enc[b]);
+    platform_tick_hrcount(&t1);
+    ctx->stats.encode_us = ws2812_elapsed_us(&t1, &t0);
+    ctx->queued = b;
+}
+
+void platform_ws2812_set_auto(bool on) {
+    ctx_ws2812.anim = on;
+    ctx_ws2812.anim_setting = -1;
+}
+
+void platform_ws2812_set_brightness(uint8_t val) {
+    ctx_ws2812.brightness = val;
+}
+
+bool platform_ws2812_busy(void) {
+    return ctx_ws2812.sending >= 0 || ctx_ws2812.queued >= 0;
+}
+
+void platform_ws2812_get_stats(platform_ws2812_stats_t *stats) {
+    if (stats)
+        *stats = ctx_ws2812.stats;
+}
@@ -0,0 +1,200 @@
+/**
+ * @file tests/host/host.c
+ * @brief Register storage and busy-wait hook for the host tests
+ */
+
+#define _GNU_SOURCE
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#include "xc.h"
+#include "test.h"
+
+/////////////////////////////////////////////////////////////////////////////
+
+host_regs_t host_regs;
+
+void (*host_poll_hook)(void);
+
+/// Spins allowed in one test before a busy-wait counts as stuck
+#define HOST_POLL_MAX	1000000UL
+
+static unsigned long host_nr_polls;
+
+static volatile sig_atomic_t host_tracing;
+static void host_trace_add(int op, uint32_t off, uint32_t old, uint32_t val);
+static void host_trace_protect(int prot);
+
+void host_poll(void) {
+    if (++host_nr_polls > HOST_POLL_MAX) {
+        host_trace_stop();
+        fprintf(stderr, "FAIL: busy-wait never ended\n");
+        exit(2);
+    }
+
+    // "Hardware" is not traced.
+    if (host_tracing) {
+        host_trace_add(HOST_TRACE_SPIN, 0, 0, 0);
+        host_trace_protect(PROT_READ | PROT_WRITE);
+    }
+    if (host_poll_hook)
+        host_poll_hook();
+    if (host_tracing)
+        host_trace_protect(PROT_NONE);
+}
+
+void host_reset(void) {
+    memset(&host_regs, 0, sizeof (host_regs));
+    host_poll_hook = NULL;
+    host_nr_polls = 0;
+    host_nvic_nr = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+host_nvic_op_t host_nvic_log[HOST_NVIC_LOG_MAX];
+unsigned int host_nvic_nr;
+
+// Operations past the end of the log are only counted.
+
+void host_nvic(int op, int irqn, uint32_t prio) {
+    if (host_nvic_nr < HOST_NVIC_LOG_MAX) {
+        host_nvic_log[host_nvic_nr].op = op;
+        host_nvic_log[host_nvic_nr].irqn = irqn;
+        host_nvic_log[host_nvic_nr].prio = prio;
+    }
+    ++host_nvic_nr;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+host_trace_t host_trace_log[HOST_TRACE_MAX];
+unsigned int host_trace_nr;
+
+/// Access being stepped over, logged once the instruction has completed
+static host_trace_t host_trace_cur;
+
+/// x86 EFLAGS.TF: trap after the next instruction
+#define HOST_EFLAGS_TF	0x100
+
+/// Page-fault error code: the access was a write
+#define HOST_PF_WRITE	0x2
+
+static void host_trace_add(int op, uint32_t off, uint32_t old, uint32_t val) {
+    if (host_trace_nr < HOST_TRACE_MAX) {
+        host_trace_log[host_trace_nr].op = op;
+        host_trace_log[host_trace_nr].off = off;
+        host_trace_log[host_trace_nr].old = old;
+        host_trace_log[host_trace_nr].val = val;
+    }
+    ++host_trace_nr;
+}
+
+static void host_trace_protect(int prot) {
+    if (mprotect(&host_regs, sizeof (host_regs), prot) != 0) {
+        perror("mprotect");
+        exit(2);
+    }
+}
+
+// Four bytes at an offset into the area, or fewer at its very end
+
+static uint32_t host_trace_peek(uint32_t off) {
+    uint32_t val = 0;
+    size_t len = sizeof (host_regs) - off;
+
+    memcpy(&val, &host_regs.page[off], len < sizeof (val) ? len : sizeof (val));
+    return val;
+}
+
+#if defined(__linux__) && defined(__x86_64__)
+
+// A traced access faulted: open the area and step over the instruction.
+
+static void host_trace_segv(int sig, siginfo_t *si, void *ctx) {
+    ucontext_t *uc = ctx;
+    uint8_t *addr = si->si_addr;
+
+    if (!host_tracing || addr < host_regs.page ||
+            addr >= host_regs.page + sizeof (host_regs)) {
+        // Not ours; crash as usual once this returns.
+        signal(SIGSEGV, SIG_DFL);
+        return;
+    }
+    host_trace_protect(PROT_READ | PROT_WRITE);
+    host_trace_cur.op = (uc->uc_mcontext.gregs[REG_ERR] & HOST_PF_WRITE) ?
+            HOST_TRACE_W : HOST_TRACE_R;
+    host_trace_cur.off = (uint32_t) (addr - host_regs.page);
+    host_trace_cur.old = host_trace_peek(host_trace_cur.off);
+    uc->uc_mcontext.gregs[REG_EFL] |= HOST_EFLAGS_TF;
+}
+
+// The instruction completed; log it and close the area again.
+
+static void host_trace_step(int sig, siginfo_t *si, void *ctx) {
+    ucontext_t *uc = ctx;
+
+    uc->uc_mcontext.gregs[REG_EFL] &= ~HOST_EFLAGS_TF;
+    host_trace_add(host_trace_cur.op, host_trace_cur.off, host_trace_cur.old,
+            host_trace_peek(host_trace_cur.off));
+    host_trace_protect(PROT_NONE);
+}
+
+int host_trace_start(void) {
+    struct sigaction sa;
+
+    if (sysconf(_SC_PAGESIZE) > HOST_PAGE)
+        return 0;
+
+    memset(&sa, 0, sizeof (sa));
+    sa.sa_flags = SA_SIGINFO;
+    sa.sa_sigaction = host_trace_segv;
+    sigaction(SIGSEGV, &sa, NULL);
+    sa.sa_sigaction = host_trace_step;
+    sigaction(SIGTRAP, &sa, NULL);
+
+    host_trace_nr = 0;
+    host_tracing = 1;
+    host_trace_protect(PROT_NONE);
+    return 1;
+}
+
+#else
+
+int host_trace_start(void) {
+    return 0;
+}
+
+#endif
+
+void host_trace_stop(void) {
+    if (!host_tracing)
+        return;
+    host_trace_protect(PROT_READ | PROT_WRITE);
+    host_tracing = 0;
+    signal(SIGSEGV, SIG_DFL);
+    signal(SIGTRAP, SIG_DFL);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+int test_nr_failed;
+
+void test_fail(const char *file, int line, const char *what) {
+    fprintf(stderr, "%s:%d: check failed: %s\n", file, line, what);
+    ++test_nr_failed;
+}
+
+int test_result(const char *name) {
+    if (test_nr_failed == 0)
+        printf("%s: ok\n", name);
+    else
+        printf("%s: %d check(s) failed\n", name, test_nr_failed);
+    return test_nr_failed ? 1 : 0;
+}
@@ -0,0 +1,33 @@
+#ifndef TEST_H
+#define TEST_H
+
+/*
+ * Minimal checks for the host tests
+ *
+ * Each test program #includes the driver source it exercises, so that its
+ * static state and helpers are reachable, and links host.c for register
+ * storage. A failed CHECK() is reported and counted; the test keeps going.
+ */
+
+/// Clear all registers and the busy-wait hook
+void host_reset(void);
+
+extern int test_nr_failed;
+void test_fail(const char *file, int line, const char *what);
+
+/// Print the outcome of a test program; returns its exit status
+int test_result(const char *name);
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) \
+            test_fail(__FILE__, __LINE__, #cond); \
+    } while (0)
+
+#define CHECK_EQ(a, b) \
+    do { \
+        if ((long long) (a) != (long long) (b)) \
+            test_fail(__FILE__, __LINE__, #a " == " #b); \
+    } while (0)
+
+#endif // TEST_H
@@ -0,0 +1,234 @@
+/**
+ * @file tests/host/test_clk.c
+ * @brief Host tests, closed-loop DFLL48M settings and lock handling
+ */
+
+#include <xc.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "test.h"
+#include "../../platform/sync.h"
+#include "../../platform/pclk.h"
+#include "../../platform/regfield.h"
+#include "../../platform.h"
+#include "../../platform/clk.h"
+
+/////////////////////////////////////////////////////////////////////////////
+
+/*
+ * DFLL48M model
+ *
+ * The output is linear in COARSE and FINE around the open-loop calibration
+ * (COARSE 32, FINE 512), which is off by model_skew. In closed-loop mode,
+ * each host_poll() is one XOSC32K period: the ratio of output to reference
+ * is compared with MUL, and COARSE (then FINE) moves by its step towards it,
+ * halving the step whenever the error changes sign. Each loop reports lock
+ * once it is within half of its own resolution.
+ *
+ * The step sizes are illustrative (a COARSE step of 1.5%, and 1024 FINE
+ * steps spanning about three COARSE steps), not datasheet figures.
+ */
+#define MODEL_COARSE_HZ	720000.0
+#define MODEL_FINE_HZ	2200.0
+
+#define STATUS_DFLLRDY	(1u << 24)
+#define STATUS_LCKF	(1u << 26)
+#define STATUS_LCKC	(1u << 27)
+
+static double model_skew;
+static bool model_crystal;	// XOSC32K populated
+static bool model_stuck;	// DFLL never settles
+static unsigned int model_xosc_polls;
+
+static int model_coarse, model_fine;
+static int model_step, model_last_sign;
+static bool model_lckc, model_lckf;
+static unsigned int model_periods;
+
+static double model_hz(void) {
+    return 48000000.0 * (1.0 + model_skew) +
+            (model_coarse - 32) * MODEL_COARSE_HZ +
+            (model_fine - 512) * MODEL_FINE_HZ;
+}
+
+// Move one loop by its step; return true once it is within half a step
+
+static bool model_adjust(int *val, int max, double err, double res_hz, int step0) {
+    int sign = (err > 0) ? 1 : -1;
+
+    if (err * DFLL_REF_HZ < res_hz / 2 && -err * DFLL_REF_HZ < res_hz / 2)
+        return true;
+    if (model_step == 0)
+        model_step = step0;
+    else if (sign != model_last_sign && model_step > 1)
+        model_step /= 2;
+    model_last_sign = sign;
+    *val += sign * model_step;
+    if (*val < 0)
+        *val = 0;
+    if (*val > max)
+        *val = max;
+    return false;
+}
+
+static void model_poll(void) {
+    uint32_t mul = OSCCTRL_REGS->OSCCTRL_DFLLMUL;
+    bool ref = ((GCLK_REGS->GCLK_PCHCTRL[0] & 0x4F) == 0x41) &&
+            ((GCLK_REGS->GCLK_GENCTRL[1] & 0x10F) == 0x104) &&
+            (OSC32KCTRL_REGS->OSC32KCTRL_STATUS & (1 << 0));
+    double err;
+
+    // XOSC32K comes up some time after being enabled, if it is there at all.
+    if ((OSC32KCTRL_REGS->OSC32KCTRL_XOSC32K & (1 << 1)) == 0) {
+        model_xosc_polls = 0;
+        OSC32KCTRL_REGS->OSC32KCTRL_STATUS = 0;
+    } else if (model_crystal && ++model_xosc_polls >= 100) {
+        OSC32KCTRL_REGS->OSC32KCTRL_STATUS = (1 << 0);
+    }
+
+    if ((OSCCTRL_REGS->OSCCTRL_DFLLCTRL & 0x6) != 0x6 || !ref || model_stuck)
+        return;
+
+    ++model_periods;
+    err = (double) (mul & 0xFFFF) - model_hz() / DFLL_REF_HZ;
+    if (!model_lckc) {
+        model_lckc = model_adjust(&model_coarse, 0x3F, err, MODEL_COARSE_HZ,
+                (int) ((mul >> 26) & 0x3F));
+        if (model_lckc)
+            model_step = 0;
+    } else if (!model_lckf) {
+        model_lckf = model_adjust(&model_fine, 0x3FF, err, MODEL_FINE_HZ,
+                (int) ((mul >> 16) & 0x3FF));
+    }
+
+    err = (double) (mul & 0xFFFF) - model_hz() / DFLL_REF_HZ;
+    OSCCTRL_REGS->OSCCTRL_DFLLVAL = ((uint32_t) (uint16_t) (int16_t) (err + ((err < 0) ? -0.5 : 0.5)) << 16) |
+            ((uint32_t) model_coarse << 10) | (uint32_t) model_fine;
+    OSCCTRL_REGS->OSCCTRL_STATUS = STATUS_DFLLRDY |
+            (model_lckc ? STATUS_LCKC : 0) | (model_lckf ? STATUS_LCKF : 0);
+}
+
+static void reset(double skew, bool crystal) {
+    host_reset();
+    host_poll_hook = model_poll;
+    dfll_closed_loop = false;
+
+    model_skew = skew;
+    model_crystal = crystal;
+    model_stuck = false;
+    model_xosc_polls = 0;
+    model_coarse = 32;
+    model_fine = 512;
+    model_step = 0;
+    model_last_sign = 0;
+    model_lckc = model_lckf = false;
+    model_periods = 0;
+
+    // DFLL running in open-loop mode, as raise_perf_level() leaves it
+    OSCCTRL_REGS->OSCCTRL_DFLLCTRL = (1 << 1);
+    OSCCTRL_REGS->OSCCTRL_DFLLVAL = (32 << 10) | 512;
+    OSCCTRL_REGS->OSCCTRL_STATUS = STATUS_DFLLRDY;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+static void test_constants(void) {
+    // 48 MHz / 32.768 kHz = 1464.84, rounded up: 48.005120 MHz
+    CHECK_EQ(DFLL_MUL, 1465);
+    CHECK_EQ(DFLL_MUL_ERR_PPM, 106);
+
+    // At most half of each step field, per the datasheet's advice
+    CHECK(DFLL_CSTEP * 2 <= 0x3F + 1);
+    CHECK(DFLL_FSTEP * 2 <= 0x3FF + 1);
+}
+
+// Lock from open-loop errors across the calibration's range
+
+static void test_lock(void) {
+    static const double skews[] = {-0.02, -0.01, 0.0, 0.005, 0.01, 0.02};
+    double hz, ppm;
+    unsigned int x;
+
+    for (x = 0; x < sizeof (skews) / sizeof (skews[0]); ++x) {
+        reset(skews[x], true);
+        CHECK(dfll_lock());
+        CHECK_EQ(OSCCTRL_REGS->OSCCTRL_DFLLMUL,
+                (16u << 26) | (256u << 16) | 1465u);
+        CHECK(OSCCTRL_REGS->OSCCTRL_DFLLCTRL & (1 << 2));
+
+        // The reference path stays up while locked.
+        CHECK_EQ(GCLK_REGS->GCLK_GENCTRL[1], 0x104);
+        CHECK_EQ(GCLK_REGS->GCLK_PCHCTRL[0], 0x41);
+
+        // Within half a FINE step of MUL x 32.768 kHz, and quickly
+        hz = model_hz();
+        ppm = (hz - 48000000.0) / 48.0;
+        CHECK(ppm > DFLL_MUL_ERR_PPM - MODEL_FINE_HZ / 96.0 - 1);
+        CHECK(ppm < DFLL_MUL_ERR_PPM + 1 + MODEL_FINE_HZ / 96.0);
+        CHECK(model_periods < 64);
+        CHECK(model_periods * 10 < DFLL_LOCK_TIMEOUT_LOOPS);
+    }
+}
+
+// DIFF to ppm, including differences whose product overflows 32 bits
+
+static void test_error_ppm(void) {
+    static const int16_t diffs[] = {0, 1, -1, 2147, 2148, -3000, 32767, -32768};
+    int32_t ppm;
+    int64_t want;
+    unsigned int x;
+
+    reset(0.0, true);
+    CHECK(!platform_clk_dfll_error_ppm(&ppm));
+    CHECK(!platform_clk_dfll_closed_loop());
+
+    dfll_closed_loop = dfll_lock();
+    CHECK(platform_clk_dfll_closed_loop());
+    CHECK(!platform_clk_dfll_error_ppm(NULL));
+    CHECK(platform_clk_dfll_error_ppm(&ppm));
+    CHECK(ppm > DFLL_MUL_ERR_PPM - 700 && ppm < DFLL_MUL_ERR_PPM + 700);
+
+    model_stuck = true;
+    for (x = 0; x < sizeof (diffs) / sizeof (diffs[0]); ++x) {
+        OSCCTRL_REGS->OSCCTRL_DFLLVAL = (uint32_t) (uint16_t) diffs[x] << 16;
+        CHECK(platform_clk_dfll_error_ppm(&ppm));
+        want = -(int64_t) diffs[x] * 1000000 / 1465 + DFLL_MUL_ERR_PPM;
+        CHECK_EQ(ppm, want);
+    }
+    CHECK_EQ(OSCCTRL_REGS->OSCCTRL_DFLLSYNC, 1 << 7);
+}
+
+// No crystal: nothing is left running
+
+static void test_no_crystal(void) {
+    reset(0.01, false);
+    CHECK(!dfll_lock());
+    CHECK_EQ(OSC32KCTRL_REGS->OSC32KCTRL_XOSC32K, 0);
+    CHECK_EQ(GCLK_REGS->GCLK_GENCTRL[1], 0);
+    CHECK_EQ(GCLK_REGS->GCLK_PCHCTRL[0], 0);
+    CHECK_EQ(OSCCTRL_REGS->OSCCTRL_DFLLMUL, 0);
+    CHECK_EQ(OSCCTRL_REGS->OSCCTRL_DFLLCTRL, 1 << 1);
+}
+
+// No lock: open-loop again, and the reference path is shut down
+
+static void test_no_lock(void) {
+    reset(0.01, true);
+    model_stuck = true;
+    CHECK(!dfll_lock());
+    CHECK_EQ(OSCCTRL_REGS->OSCCTRL_DFLLCTRL, 1 << 1);
+    CHECK_EQ(GCLK_REGS->GCLK_PCHCTRL[0], 0);
+    CHECK_EQ(GCLK_REGS->GCLK_GENCTRL[1], 0);
+    CHECK_EQ(OSC32KCTRL_REGS->OSC32KCTRL_XOSC32K, 0);
+    CHECK(!platform_clk_dfll_closed_loop());
+}
+
+int main(void) {
+    test_constants();
+    test_lock();
+    test_error_ppm();
+    test_no_crystal();
+    test_no_lock();
+    return test_result("clk");
+}
@@ -0,0 +1,374 @@
+/**
+ * @file tests/host/test_display.c
+ * @brief Host tests, display dirty-span merging and DMA updates
+ */
+
+#include <stdio.h>
+
+#include "test.h"
+#include "../../platform/dma.c"
+#include "../../platform/display.c"
+
+extern void platform_pclk_init(void);
+extern void platform_timespec_normalize(platform_timespec_t *ts);
+
+/////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Simulated panel: each DMA block is taken whole on the pass after it was
+ * started, and copied into panel RAM at the same offset it had in the
+ * framebuffer (SSD1306 pages are laid out as the framebuffer bands are).
+ * The SPI transmitter is always ready, so polled commands never wait.
+ */
+static uint8_t panel[sizeof (ctx_disp.fb)];
+
+/// DMA blocks, as framebuffer offset and length
+#define NR_XFERS_MAX	64
+static struct {
+    uint32_t ofs;
+    uint32_t len;
+} xfers[NR_XFERS_MAX];
+static unsigned int nr_xfers;
+
+static platform_timespec_t now;
+
+// DMAC leaves reset at once
+
+static void dmac_poll(void) {
+    DMAC_SEC_REGS->DMAC_CTRL &= ~(1u << 0);
+}
+
+static void reset(void) {
+    host_reset();
+    platform_pclk_init();
+    host_poll_hook = dmac_poll;
+    platform_dma_init();
+    host_poll_hook = NULL;
+    SERCOM0_REGS->SPIM.SERCOM_INTFLAG = (1 << 1) | (1 << 0);
+    platform_disp_init();
+
+    memset(panel, 0xA5, sizeof (panel));
+    nr_xfers = 0;
+    now.nr_sec = 0;
+    now.nr_nsec = 0;
+}
+
+// Finish the block in flight, if any
+
+static void dma_complete(void) {
+    dmac_descriptor_registers_t *d = &dma_desc[DMA_CH_DISP];
+    uint32_t ofs;
+
+    if ((DMAC_SEC_REGS->DMAC_CHCTRLA & (1 << 1)) == 0)
+        return;
+
+    // SRCADDR is the end of the block; addresses are only 32 bits wide here.
+    ofs = d->DMAC_SRCADDR - d->DMAC_BTCNT - (uint32_t) (uintptr_t) ctx_disp.fb;
+    CHECK(ofs + d->DMAC_BTCNT <= sizeof (panel));
+    CHECK_EQ(d->DMAC_DSTADDR, (uint32_t) (uintptr_t) &SERCOM0_REGS->SPIM.SERCOM_DATA);
+    CHECK_EQ((DMAC_SEC_REGS->DMAC_CHCTRLB >> 8) & 0xFF, SERCOM0_DMAC_ID_TX);
+    if (ofs + d->DMAC_BTCNT <= sizeof (panel))
+        memcpy(&panel[ofs], &ctx_disp.fb[ofs], d->DMAC_BTCNT);
+    if (nr_xfers < NR_XFERS_MAX) {
+        xfers[nr_xfers].ofs = ofs;
+        xfers[nr_xfers].len = d->DMAC_BTCNT;
+        ++nr_xfers;
+    }
+    DMAC_SEC_REGS->DMAC_CHCTRLA = 0;
+}
+
+/// Run one main-loop pass, @c ms after the previous one
+static void tick(uint32_t ms) {
+    now.nr_nsec += ms * 1000000;
+    platform_timespec_normalize(&now);
+    platform_disp_tick_handler(&now);
+}
+
+// Run passes 1 ms apart until the panel is up to date
+
+static void run(void) {
+    unsigned int n = 1000;
+
+    while (n-- > 0 && platform_disp_busy()) {
+        tick(1);
+        dma_complete();
+    }
+    CHECK(!platform_disp_busy());
+    CHECK(memcmp(panel, ctx_disp.fb, sizeof (panel)) == 0);
+}
+
+static void bring_up(void) {
+    reset();
+    run();
+    nr_xfers = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+// The first frame is the whole panel, in one block
+
+static void test_first_frame(void) {
+    platform_disp_stats_t stats;
+    unsigned int x;
+
+    reset();
+    for (x = 0; x < DISP_NR_BANDS; ++x) {
+        CHECK_EQ(ctx_disp.dirty_x0[x], 0);
+        CHECK_EQ(ctx_disp.dirty_x1[x], PLATFORM_DISP_WIDTH - 1);
+    }
+
+    // Nothing is sent until the bring-up sequence is through.
+    for (x = 0; x < 20; ++x) {
+        tick(1);
+        CHECK(ctx_disp.state != DISP_ST_STREAM);
+    }
+    CHECK_EQ(DMAC_SEC_REGS->DMAC_CHCTRLA, 0);
+
+    run();
+    CHECK_EQ(ctx_disp.init_idx, sizeof (disp_init_seq));
+    CHECK_EQ(nr_xfers, 1);
+    CHECK_EQ(xfers[0].ofs, 0);
+    CHECK_EQ(xfers[0].len, sizeof (ctx_disp.fb));
+
+    platform_disp_get_stats(&stats);
+    CHECK_EQ(stats.nr_frames, 1);
+    CHECK_EQ(stats.nr_rects, 1);
+    CHECK_EQ(stats.nr_bytes, 1024);
+    CHECK_EQ(stats.last_frame_bytes, 1024);
+    CHECK_EQ(stats.last_frame_us, 1000);
+
+    // Up to date: further passes send nothing.
+    for (x = 0; x < 10; ++x)
+        tick(1);
+    CHECK_EQ(nr_xfers, 1);
+}
+
+// Spans widen to cover every change in a band
+
+static void test_mark(void) {
+    bring_up();
+    platform_disp_pixel(10, 20, PLATFORM_DISP_WHITE);
+    CHECK_EQ(ctx_disp.dirty_x0[2], 10);
+    CHECK_EQ(ctx_disp.dirty_x1[2], 10);
+    CHECK(ctx_disp.dirty_x0[1] > ctx_disp.dirty_x1[1]);
+    CHECK(ctx_disp.dirty_x0[3] > ctx_disp.dirty_x1[3]);
+
+    platform_disp_pixel(100, 23, PLATFORM_DISP_WHITE);
+    platform_disp_pixel(40, 16, PLATFORM_DISP_WHITE);
+    CHECK_EQ(ctx_disp.dirty_x0[2], 10);
+    CHECK_EQ(ctx_disp.dirty_x1[2], 100);
+
+    // Off the panel: no change, no mark
+    platform_disp_pixel(PLATFORM_DISP_WIDTH, 0, PLATFORM_DISP_WHITE);
+    platform_disp_pixel(0, PLATFORM_DISP_HEIGHT, PLATFORM_DISP_WHITE);
+    CHECK(ctx_disp.dirty_x0[0] > ctx_disp.dirty_x1[0]);
+    CHECK(ctx_disp.dirty_x0[7] > ctx_disp.dirty_x1[7]);
+
+    run();
+    CHECK_EQ(nr_xfers, 1);
+    CHECK_EQ(xfers[0].ofs, 2 * DISP_BAND_BYTES + 10);
+    CHECK_EQ(xfers[0].len, 91);
+    CHECK_EQ(panel[2 * DISP_BAND_BYTES + 10], 1 << 4);
+    CHECK_EQ(panel[2 * DISP_BAND_BYTES + 100], 1 << 7);
+
+    // Clipping keeps the mark on the panel too.
+    nr_xfers = 0;
+    platform_disp_fill_rect(120, 60, 50, 50, PLATFORM_DISP_WHITE);
+    CHECK_EQ(ctx_disp.dirty_x0[7], 120);
+    CHECK_EQ(ctx_disp.dirty_x1[7], 127);
+    run();
+    CHECK_EQ(nr_xfers, 1);
+    CHECK_EQ(xfers[0].len, 8);
+}
+
+// Adjacent bands with the same span make one rectangle
+
+static void test_merge(void) {
+    platform_disp_stats_t before, after;
+
+    bring_up();
+    platform_disp_get_stats(&before);
+    platform_disp_fill_rect(8, 8, 16, 24, PLATFORM_DISP_WHITE);
+    run();
+    platform_disp_get_stats(&after);
+    CHECK_EQ(after.nr_rects - before.nr_rects, 1);
+    CHECK_EQ(after.nr_frames - before.nr_frames, 1);
+    CHECK_EQ(after.last_frame_bytes, 3 * 16);
+
+    // Partial width: one block per band
+    CHECK_EQ(nr_xfers, 3);
+    CHECK_EQ(xfers[0].ofs, 1 * DISP_BAND_BYTES + 8);
+    CHECK_EQ(xfers[1].ofs, 2 * DISP_BAND_BYTES + 8);
+    CHECK_EQ(xfers[2].ofs, 3 * DISP_BAND_BYTES + 8);
+    CHECK(xfers[0].len == 16 && xfers[1].len == 16 && xfers[2].len == 16);
+
+    // Full width: the bands lie back to back, one block for all
+    nr_xfers = 0;
+    platform_disp_fill_rect(0, 16, PLATFORM_DISP_WIDTH, 24, PLATFORM_DISP_BLACK);
+    run();
+    CHECK_EQ(nr_xfers, 1);
+    CHECK_EQ(xfers[0].ofs, 2 * DISP_BAND_BYTES);
+    CHECK_EQ(xfers[0].len, 3 * DISP_BAND_BYTES);
+}
+
+// Different spans, or a clean band in between, split the rectangle
+
+static void test_split(void) {
+    platform_disp_stats_t before, after;
+
+    bring_up();
+    platform_disp_get_stats(&before);
+    platform_disp_fill_rect(0, 0, 4, 8, PLATFORM_DISP_WHITE);	// Band 0
+    platform_disp_fill_rect(0, 16, 4, 8, PLATFORM_DISP_WHITE);	// Band 2
+    platform_disp_fill_rect(0, 24, 5, 8, PLATFORM_DISP_WHITE);	// Band 3
+    run();
+    platform_disp_get_stats(&after);
+    CHECK_EQ(after.nr_rects - before.nr_rects, 3);
+    CHECK_EQ(after.nr_frames - before.nr_frames, 1);
+    CHECK_EQ(after.last_frame_bytes, 4 + 4 + 5);
+    CHECK_EQ(nr_xfers, 3);
+    CHECK_EQ(xfers[0].ofs, 0);
+    CHECK_EQ(xfers[1].ofs, 2 * DISP_BAND_BYTES);
+    CHECK_EQ(xfers[2].ofs, 3 * DISP_BAND_BYTES);
+    CHECK_EQ(xfers[2].len, 5);
+}
+
+// A band drawn into while it is being sent goes out again, in the same frame
+
+static void test_redraw(void) {
+    platform_disp_stats_t before, after;
+
+    bring_up();
+    platform_disp_get_stats(&before);
+    platform_disp_fill_rect(8, 8, 16, 16, PLATFORM_DISP_WHITE);
+    tick(1);
+    CHECK_EQ(ctx_disp.state, DISP_ST_STREAM);
+    CHECK(dma_busy(DMA_CH_DISP));
+    CHECK(ctx_disp.dirty_x0[1] > ctx_disp.dirty_x1[1]);
+
+    // The DMA block is in flight; the driver waits for it.
+    tick(1);
+    CHECK_EQ(ctx_disp.band, 2);
+    platform_disp_pixel(9, 9, PLATFORM_DISP_BLACK);
+    CHECK_EQ(ctx_disp.dirty_x0[1], 9);
+
+    run();
+    platform_disp_get_stats(&after);
+    CHECK_EQ(after.nr_frames - before.nr_frames, 1);
+    CHECK_EQ(after.nr_rects - before.nr_rects, 2);
+    CHECK_EQ(after.last_frame_bytes, 16 + 16 + 1);
+    CHECK_EQ(nr_xfers, 3);
+    CHECK_EQ(xfers[2].ofs, DISP_BAND_BYTES + 9);
+    CHECK_EQ(panel[DISP_BAND_BYTES + 9], 0xFF & ~(1 << 1));
+}
+
+// Bytes per update: a clock readout costs its cells, not the frame
+
+static void test_bytes_per_update(void) {
+    platform_disp_stats_t stats;
+    unsigned int x;
+
+    bring_up();
+    x = platform_disp_text(0, 0, "12:34", PLATFORM_DISP_WHITE, PLATFORM_DISP_BLACK);
+    CHECK_EQ(x, 5 * PLATFORM_DISP_CHAR_W);
+    run();
+    platform_disp_get_stats(&stats);
+    CHECK_EQ(stats.last_frame_bytes, 5 * PLATFORM_DISP_CHAR_W);
+    CHECK(stats.last_frame_bytes * 30 < sizeof (ctx_disp.fb));
+
+    // One changed digit: only its cell, even if the rest is redrawn later
+    x = platform_disp_text(4 * PLATFORM_DISP_CHAR_W, 0, "5",
+            PLATFORM_DISP_WHITE, PLATFORM_DISP_BLACK);
+    run();
+    platform_disp_get_stats(&stats);
+    CHECK_EQ(stats.last_frame_bytes, PLATFORM_DISP_CHAR_W);
+
+    // Text off the right edge is clipped, and so is its mark.
+    platform_disp_text(PLATFORM_DISP_WIDTH - 8, 56, "abc",
+            PLATFORM_DISP_WHITE, PLATFORM_DISP_BLACK);
+    CHECK_EQ(ctx_disp.dirty_x1[7], PLATFORM_DISP_WIDTH - 1);
+    run();
+    platform_disp_get_stats(&stats);
+    CHECK_EQ(stats.last_frame_bytes, 8);
+}
+
+/*
+ * Frame rate bound by the SPI link
+ *
+ * Each rectangle costs its window commands as well as its pixels; at the
+ * SCK rate the simulated BAUD register gives, that bounds the update rate
+ * for a whole-panel frame and for a one-cell one.
+ */
+#if PLATFORM_DISP_BPP == 1
+#define WINDOW_BYTES	(2 * (1 + 2))
+#else
+#define WINDOW_BYTES	(2 * (1 + 4) + 1)
+#endif
+
+/// Bytes the CPU writes to the SPI DATA register by polling
+static unsigned int nr_cmd_bytes(void) {
+    uint32_t off = offsetof(host_periph_t, sercom[0].SPIM.SERCOM_DATA);
+    unsigned int x, n = 0;
+
+    for (x = 0; x < host_trace_nr && x < HOST_TRACE_MAX; ++x) {
+        if (host_trace_log[x].op == HOST_TRACE_W && host_trace_log[x].off == off)
+            ++n;
+    }
+    return n;
+}
+
+// Run a frame; returns its bytes on the wire, commands included
+
+static uint32_t frame_wire_bytes(void) {
+    platform_disp_stats_t before, after;
+    unsigned int nr_rects, traced;
+
+    platform_disp_get_stats(&before);
+    traced = host_trace_start();
+    run();
+    if (traced)
+        host_trace_stop();
+    platform_disp_get_stats(&after);
+    nr_rects = after.nr_rects - before.nr_rects;
+    CHECK_EQ(after.nr_frames - before.nr_frames, 1);
+    if (traced)
+        CHECK_EQ(nr_cmd_bytes(), nr_rects * WINDOW_BYTES);
+    return after.last_frame_bytes + nr_rects * WINDOW_BYTES;
+}
+
+static void test_fps(void) {
+    uint32_t spi_hz, full, part, fps_full, fps_part;
+
+    bring_up();
+    spi_hz = 24000000 / (2 * (SERCOM0_REGS->SPIM.SERCOM_BAUD + 1));
+    CHECK(spi_hz <= PLATFORM_DISP_SPI_HZ);
+    CHECK(spi_hz * 2 > PLATFORM_DISP_SPI_HZ);
+
+    platform_disp_fill_rect(0, 0, PLATFORM_DISP_WIDTH, PLATFORM_DISP_HEIGHT, PLATFORM_DISP_WHITE);
+    full = frame_wire_bytes();
+    CHECK_EQ(full, sizeof (ctx_disp.fb) + WINDOW_BYTES);
+
+    platform_disp_text(4 * PLATFORM_DISP_CHAR_W, 0, "7", PLATFORM_DISP_BLACK, PLATFORM_DISP_WHITE);
+    part = frame_wire_bytes();
+    CHECK_EQ(part, PLATFORM_DISP_CHAR_W + WINDOW_BYTES);
+
+    fps_full = spi_hz / (8 * full);
+    fps_part = spi_hz / (8 * part);
+    CHECK(fps_full > 0);
+    CHECK(fps_part > 30 * fps_full);
+    printf("display: %lu Hz SCK; full frame %lu bytes -> %lu fps, "
+            "one cell %lu bytes -> %lu fps\n", (unsigned long) spi_hz,
+            (unsigned long) full, (unsigned long) fps_full,
+            (unsigned long) part, (unsigned long) fps_part);
+}
+
+int main(void) {
+    test_first_frame();
+    test_mark();
+    test_merge();
+    test_split();
+    test_redraw();
+    test_bytes_per_update();
+    test_fps();
+    return test_result("display");
+}
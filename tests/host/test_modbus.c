@@ -0,0 +1,267 @@
+/**
+ * @file tests/host/test_modbus.c
+ * @brief Host tests, Modbus RTU slave on the simulated CDC USART
+ */
+
+#include "test.h"
+#include "../../platform/usart.c"
+#include "../../modbus.c"
+#include "usart_sim.h"
+
+/////////////////////////////////////////////////////////////////////////////
+
+#define SLAVE	0x11
+
+static modbus_slave_t mb;
+static uint16_t coils, holding[8];
+
+static uint8_t map_read(void *ctx, uint8_t table, uint16_t addr, uint16_t *val) {
+    switch (table) {
+        case MODBUS_TABLE_COIL:
+            if (addr >= 16)
+                return MODBUS_EX_ILLEGAL_ADDRESS;
+            *val = (coils >> addr) & 1;
+            return MODBUS_EX_NONE;
+        case MODBUS_TABLE_HOLDING:
+            if (addr >= 8)
+                return MODBUS_EX_ILLEGAL_ADDRESS;
+            *val = holding[addr];
+            return MODBUS_EX_NONE;
+        default:
+            return MODBUS_EX_ILLEGAL_ADDRESS;
+    }
+}
+
+static uint8_t map_write(void *ctx, uint8_t table, uint16_t addr, uint16_t val) {
+    switch (table) {
+        case MODBUS_TABLE_COIL:
+            if (addr >= 16)
+                return MODBUS_EX_ILLEGAL_ADDRESS;
+            coils = (coils & ~(1 << addr)) | (val << addr);
+            return MODBUS_EX_NONE;
+        case MODBUS_TABLE_HOLDING:
+            if (addr >= 8)
+                return MODBUS_EX_ILLEGAL_ADDRESS;
+            if (val == 0xDEAD)
+                return MODBUS_EX_DEVICE_FAILURE;
+            holding[addr] = val;
+            return MODBUS_EX_NONE;
+        default:
+            return MODBUS_EX_ILLEGAL_ADDRESS;
+    }
+}
+
+static void reset(void) {
+    static const modbus_map_t map = {NULL, map_read, map_write};
+    unsigned int x;
+
+    sim_reset();
+    coils = 0;
+    for (x = 0; x < 8; ++x)
+        holding[x] = 0x1000 + x;
+    modbus_init(&mb, SLAVE, &map);
+}
+
+// Main-loop passes, 100 us apart
+
+static void run(unsigned int n) {
+    while (n-- > 0) {
+        sim_tick(100);
+        modbus_poll(&mb);
+    }
+}
+
+/*
+ * Send a frame, with its CRC appended, one byte per pass and with a pause
+ * of gap_us before byte gap_at; then let t3.5 and the response go by
+ */
+static void send_gap(const uint8_t *adu, uint16_t len, uint16_t gap_at, uint32_t gap_us) {
+    uint16_t crc = modbus_crc16(adu, len), x;
+    char c;
+
+    sim_nr_sent = 0;
+    for (x = 0; x < len + 2; ++x) {
+        if (x == gap_at)
+            sim_advance_us(gap_us);
+        c = (x < len) ? (char) adu[x] : (char) (crc >> (8 * (x - len)));
+        sim_peer_send(&c, 1);
+        run(1);
+    }
+    run(40);
+}
+
+#define SEND(...) \
+    do { \
+        static const uint8_t adu_[] = {__VA_ARGS__}; \
+        send_gap(adu_, sizeof (adu_), 0xFFFF, 0); \
+    } while (0)
+
+// Check the response: its CRC, then its contents
+
+static void expect(const uint8_t *rsp, uint16_t len) {
+    uint16_t crc = modbus_crc16(rsp, len);
+
+    CHECK_EQ(sim_nr_sent, len + 2);
+    CHECK(memcmp(sim_sent, rsp, len) == 0);
+    CHECK_EQ(sim_sent[len], crc & 0xFF);
+    CHECK_EQ(sim_sent[len + 1], crc >> 8);
+}
+
+#define EXPECT(...) \
+    do { \
+        static const uint8_t rsp_[] = {__VA_ARGS__}; \
+        expect(rsp_, sizeof (rsp_)); \
+    } while (0)
+
+/////////////////////////////////////////////////////////////////////////////
+
+static void test_crc(void) {
+    static const uint8_t req[] = {0x01, 0x03, 0x00, 0x00, 0x00, 0x0A};
+
+    // The specification's example, and the CRC catalogue's check value
+    CHECK_EQ(modbus_crc16(req, sizeof (req)), 0xCDC5);
+    CHECK_EQ(modbus_crc16((const uint8_t *) "123456789", 9), 0x4B37);
+    CHECK_EQ(modbus_crc16(req, 0), 0xFFFF);
+}
+
+static void test_functions(void) {
+    reset();
+
+    SEND(SLAVE, 0x03, 0x00, 0x01, 0x00, 0x02);
+    EXPECT(SLAVE, 0x03, 0x04, 0x10, 0x01, 0x10, 0x02);
+
+    SEND(SLAVE, 0x06, 0x00, 0x07, 0xAB, 0xCD);
+    EXPECT(SLAVE, 0x06, 0x00, 0x07, 0xAB, 0xCD);
+    CHECK_EQ(holding[7], 0xABCD);
+
+    SEND(SLAVE, 0x10, 0x00, 0x02, 0x00, 0x02, 0x04, 0x12, 0x34, 0x56, 0x78);
+    EXPECT(SLAVE, 0x10, 0x00, 0x02, 0x00, 0x02);
+    CHECK_EQ(holding[2], 0x1234);
+    CHECK_EQ(holding[3], 0x5678);
+
+    SEND(SLAVE, 0x0F, 0x00, 0x03, 0x00, 0x0A, 0x02, 0xCD, 0x01);
+    EXPECT(SLAVE, 0x0F, 0x00, 0x03, 0x00, 0x0A);
+    CHECK_EQ(coils, 0x1CD << 3);
+
+    SEND(SLAVE, 0x05, 0x00, 0x03, 0x00, 0x00);
+    EXPECT(SLAVE, 0x05, 0x00, 0x03, 0x00, 0x00);
+    SEND(SLAVE, 0x01, 0x00, 0x03, 0x00, 0x0A);
+    EXPECT(SLAVE, 0x01, 0x02, 0xCC, 0x01);
+
+    CHECK_EQ(mb.stats.nr_frames, 6);
+    CHECK_EQ(mb.stats.nr_slave_msgs, 6);
+    CHECK_EQ(mb.stats.nr_exceptions, 0);
+}
+
+static void test_exceptions(void) {
+    reset();
+
+    SEND(SLAVE, 0x2B, 0x0E, 0x01, 0x00);
+    EXPECT(SLAVE, 0xAB, MODBUS_EX_ILLEGAL_FUNCTION);
+    SEND(SLAVE, 0x03, 0x00, 0x00, 0x00, 0x00);
+    EXPECT(SLAVE, 0x83, MODBUS_EX_ILLEGAL_VALUE);
+    SEND(SLAVE, 0x03, 0x00, 0x00, 0x00, 0x7E);
+    EXPECT(SLAVE, 0x83, MODBUS_EX_ILLEGAL_VALUE);
+    SEND(SLAVE, 0x03, 0x00, 0x07, 0x00, 0x02);
+    EXPECT(SLAVE, 0x83, MODBUS_EX_ILLEGAL_ADDRESS);
+    SEND(SLAVE, 0x03, 0xFF, 0xFF, 0x00, 0x02);
+    EXPECT(SLAVE, 0x83, MODBUS_EX_ILLEGAL_ADDRESS);
+    SEND(SLAVE, 0x05, 0x00, 0x00, 0x12, 0x34);
+    EXPECT(SLAVE, 0x85, MODBUS_EX_ILLEGAL_VALUE);
+    SEND(SLAVE, 0x06, 0x00, 0x00, 0xDE, 0xAD);
+    EXPECT(SLAVE, 0x86, MODBUS_EX_DEVICE_FAILURE);
+
+    // Byte count disagreeing with the quantity, and a short PDU
+    SEND(SLAVE, 0x10, 0x00, 0x00, 0x00, 0x02, 0x02, 0x12, 0x34);
+    EXPECT(SLAVE, 0x90, MODBUS_EX_ILLEGAL_VALUE);
+    SEND(SLAVE, 0x03, 0x00);
+    EXPECT(SLAVE, 0x83, MODBUS_EX_ILLEGAL_VALUE);
+
+    CHECK_EQ(mb.stats.nr_exceptions, 9);
+    CHECK_EQ(holding[0], 0x1000);
+}
+
+static void test_framing(void) {
+    static const uint8_t req[] = {SLAVE, 0x06, 0x00, 0x01, 0x00, 0x55};
+    uint8_t bad[sizeof (req) + 2];
+    uint16_t crc;
+
+    reset();
+
+    // Bad CRC: dropped silently
+    crc = modbus_crc16(req, sizeof (req)) ^ 0x0100;
+    memcpy(bad, req, sizeof (req));
+    bad[sizeof (req)] = (uint8_t) crc;
+    bad[sizeof (req) + 1] = (uint8_t) (crc >> 8);
+    sim_nr_sent = 0;
+    sim_peer_send((const char *) bad, sizeof (bad));
+    run(40);
+    CHECK_EQ(sim_nr_sent, 0);
+    CHECK_EQ(mb.stats.nr_crc_err, 1);
+    CHECK_EQ(holding[1], 0x1001);
+
+    // A gap beyond t1.5 (750 us at 57600 bps) inside the frame: dropped
+    send_gap(req, sizeof (req), 3, 800);
+    CHECK_EQ(sim_nr_sent, 0);
+    CHECK_EQ(mb.stats.nr_crc_err, 2);
+    CHECK_EQ(holding[1], 0x1001);
+
+    // Within t1.5: fine
+    send_gap(req, sizeof (req), 3, 500);
+    EXPECT(SLAVE, 0x06, 0x00, 0x01, 0x00, 0x55);
+
+    // Two frames t3.5 apart are two requests.
+    SEND(SLAVE, 0x06, 0x00, 0x01, 0x00, 0x66);
+    EXPECT(SLAVE, 0x06, 0x00, 0x01, 0x00, 0x66);
+
+    // Other slaves' frames are ignored; broadcasts are applied silently.
+    SEND(SLAVE + 1, 0x06, 0x00, 0x01, 0x00, 0x77);
+    CHECK_EQ(sim_nr_sent, 0);
+    SEND(0x00, 0x06, 0x00, 0x01, 0x00, 0x88);
+    CHECK_EQ(sim_nr_sent, 0);
+    CHECK_EQ(holding[1], 0x88);
+    CHECK_EQ(mb.stats.nr_no_resp, 1);
+
+    // Too short to hold a CRC
+    sim_peer_send("\x11\x03\x00", 3);
+    run(40);
+    CHECK_EQ(sim_nr_sent, 0);
+    CHECK_EQ(mb.stats.nr_crc_err, 3);
+    CHECK_EQ(mb.stats.nr_frames, 7);
+}
+
+// t1.5/t3.5 follow the rate the link actually runs at
+
+static void test_timing(void) {
+    reset();
+    CHECK_EQ(mb.baud, 57600);
+    CHECK_EQ(ctx_uart.cfg.ts_idle_timeout.nr_nsec, 1750000);
+    CHECK_EQ(ctx_uart.cfg.ts_gap_timeout.nr_nsec, 750000);
+
+    // As after autobaud: picked up on the next poll
+    usart_set_baud(&ctx_uart, 9600, false);
+    run(1);
+    CHECK_EQ(mb.baud, 9600);
+    CHECK_EQ(ctx_uart.cfg.ts_idle_timeout.nr_nsec, MODBUS_T35_NS(9600));
+    CHECK_EQ(ctx_uart.cfg.ts_gap_timeout.nr_nsec, MODBUS_T15_NS(9600));
+    CHECK(MODBUS_T35_NS(9600) > 4000000);
+
+    usart_set_baud(&ctx_uart, 9600, false);
+    platform_usart_cdc_rx_abort();
+    modbus_init(&mb, SLAVE, &mb.map);
+    CHECK_EQ(ctx_uart.cfg.ts_idle_timeout.nr_nsec, MODBUS_T35_NS(9600));
+
+    usart_set_baud(&ctx_uart, 115200, false);
+    run(1);
+    CHECK_EQ(ctx_uart.cfg.ts_idle_timeout.nr_nsec, 1750000);
+    CHECK_EQ(ctx_uart.cfg.ts_gap_timeout.nr_nsec, 750000);
+}
+
+int main(void) {
+    test_crc();
+    test_functions();
+    test_exceptions();
+    test_framing();
+    test_timing();
+    return test_result("modbus");
+}
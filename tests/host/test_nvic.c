@@ -0,0 +1,96 @@
+/**
+ * @file tests/host/test_nvic.c
+ * @brief Host tests, NVIC priority plan and the order it is applied in
+ */
+
+#include "test.h"
+#include "../../platform/gpio.c"
+
+/////////////////////////////////////////////////////////////////////////////
+
+BlinkSetting currentSetting;
+
+/// The plan, restated: vector and level
+static const struct {
+    int irqn;
+    uint32_t prio;
+} want[] = {
+    {SysTick_IRQn, 1},
+    {TC2_IRQn, 1},
+    {SERCOM3_1_IRQn, 2},
+    {TC1_IRQn, 2},
+    {EIC_EXTINT_2_IRQn, 3},
+};
+#define NR_WANT	(sizeof (want) / sizeof (want[0]))
+
+static const host_nvic_op_t *find(int op, int irqn) {
+    unsigned int x;
+
+    for (x = 0; x < host_nvic_nr; ++x) {
+        if (host_nvic_log[x].op == op && host_nvic_log[x].irqn == irqn)
+            return &host_nvic_log[x];
+    }
+    return NULL;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+static void test_plan(void) {
+    const host_nvic_op_t *op;
+    unsigned int x, nr_prio = 0, nr_enable = 0;
+
+    host_reset();
+    NVIC_init();
+    CHECK_EQ(NVIC_PLAN_NR, NR_WANT);
+
+    for (x = 0; x < NR_WANT; ++x) {
+        op = find(HOST_NVIC_PRIO, want[x].irqn);
+        CHECK(op != NULL);
+        if (op != NULL)
+            CHECK_EQ(op->prio, want[x].prio);
+
+        // Core exceptions have no NVIC enable bit.
+        op = find(HOST_NVIC_ENABLE, want[x].irqn);
+        CHECK((op != NULL) == (want[x].irqn >= 0));
+    }
+
+    for (x = 0; x < host_nvic_nr; ++x) {
+        nr_prio += (host_nvic_log[x].op == HOST_NVIC_PRIO);
+        nr_enable += (host_nvic_log[x].op == HOST_NVIC_ENABLE);
+        CHECK(host_nvic_log[x].op != HOST_NVIC_DISABLE);
+    }
+    CHECK_EQ(nr_prio, NR_WANT);
+    CHECK_EQ(nr_enable, NR_WANT - 1);
+}
+
+/*
+ * PRIMASK is set first and released last; every priority is in place
+ * before any vector is enabled, and the barrier comes before the release.
+ */
+static void test_order(void) {
+    unsigned int x, last_prio = 0, first_enable = ~0u;
+
+    host_reset();
+    NVIC_init();
+    CHECK(host_nvic_nr >= 2 && host_nvic_nr <= HOST_NVIC_LOG_MAX);
+    CHECK_EQ(host_nvic_log[0].op, HOST_NVIC_IRQ_OFF);
+    CHECK_EQ(host_nvic_log[host_nvic_nr - 1].op, HOST_NVIC_IRQ_ON);
+    CHECK_EQ(host_nvic_log[host_nvic_nr - 2].op, HOST_NVIC_DMB);
+
+    for (x = 1; x + 1 < host_nvic_nr; ++x) {
+        CHECK(host_nvic_log[x].op != HOST_NVIC_IRQ_OFF);
+        CHECK(host_nvic_log[x].op != HOST_NVIC_IRQ_ON);
+        if (host_nvic_log[x].op == HOST_NVIC_PRIO)
+            last_prio = x;
+        if (host_nvic_log[x].op == HOST_NVIC_ENABLE && first_enable == ~0u)
+            first_enable = x;
+    }
+    CHECK(last_prio > 0);
+    CHECK(last_prio < first_enable);
+}
+
+int main(void) {
+    test_plan();
+    test_order();
+    return test_result("nvic");
+}
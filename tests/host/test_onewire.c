@@ -0,0 +1,422 @@
+/**
+ * @file tests/host/test_onewire.c
+ * @brief Host tests, 1-Wire master against a simulated multi-device bus
+ */
+
+#include "test.h"
+#include "../../platform/onewire.c"
+
+// Linked from the rest of the platform code
+extern void platform_pclk_init(void);
+extern void platform_timespec_normalize(platform_timespec_t *ts);
+
+/////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Bus model
+ *
+ * The master's line control is recovered from its DIRSET/DIRCLR writes,
+ * and time from the TC2 period programmed for each phase: every call of
+ * TC2_Handler() is one overflow, (CC0 + 1) / OW_COUNTS_PER_US after the
+ * previous one. A write-1 or read slot shows up as both writes in the
+ * same call; its low pulse is OW_T_SHORT_LOW long.
+ *
+ * Devices react to edges as real ones do: a reset is a low of 480 us or
+ * more, and the length of a master low tells a 1 (under 15 us) from a 0.
+ * A device sending a 0 holds the line for only 15 us past the falling
+ * edge, the minimum allowed, so that a late sample reads as 1.
+ */
+
+#define OW_MASK		(1 << PLATFORM_OW_PIN)
+#define OW_PORT		(&PORT_IOBUS_SEC_REGS->GROUP[PLATFORM_OW_GROUP])
+#define NR_DEVS_MAX	8
+
+/// Device protocol states
+#define DEV_IDLE	0	// Waiting for a reset
+#define DEV_CMD		1	// Receiving a ROM command
+#define DEV_SEARCH	2	// SEARCH ROM
+#define DEV_MATCH	3	// Receiving the ROM of MATCH ROM
+#define DEV_FUNC	4	// Receiving a function command
+#define DEV_SEND	5	// Sending bits to the master
+
+typedef struct {
+    uint8_t rom[8];
+    uint8_t scratch[9];
+
+    uint8_t state;
+    uint16_t bit;
+
+    /// SEARCH ROM: 0 sends the bit, 1 its complement, 2 takes the direction
+    uint8_t step;
+
+    /// Bits received in the current state
+    uint8_t in[8];
+
+    /// What DEV_SEND sends
+    const uint8_t *out;
+    uint16_t nr_out;
+
+    /// The slot now running carries a bit to this device
+    bool rx_slot;
+
+    /// When this device pulls the line low
+    uint32_t low_from, low_until;
+
+    unsigned int nr_convert;
+} ow_dev_t;
+
+static ow_dev_t devs[NR_DEVS_MAX];
+static unsigned int nr_devs;
+
+static uint32_t bus_t;
+static bool bus_low;
+static uint32_t bus_fall_t, bus_rise_t;
+static unsigned int bus_nr_resets;
+
+static uint8_t rom_bit(const uint8_t *buf, unsigned int n) {
+    return (buf[n >> 3] >> (n & 7)) & 1;
+}
+
+static void dev_enter(ow_dev_t *d, uint8_t state) {
+    d->state = state;
+    d->bit = 0;
+    d->step = 0;
+    memset(d->in, 0, sizeof (d->in));
+}
+
+static void dev_send(ow_dev_t *d, const uint8_t *buf, uint16_t nr_bits) {
+    dev_enter(d, DEV_SEND);
+    d->out = buf;
+    d->nr_out = nr_bits;
+}
+
+// Whether the device sends in the slot just opened, and what
+
+static bool dev_sends(const ow_dev_t *d, uint8_t *b) {
+    if (d->state == DEV_SEARCH && d->step < 2) {
+        *b = rom_bit(d->rom, d->bit) ^ d->step;
+        return true;
+    }
+    if (d->state == DEV_SEND) {
+        *b = rom_bit(d->out, d->bit);
+        return true;
+    }
+    return false;
+}
+
+static void dev_recv(ow_dev_t *d, uint8_t b) {
+    switch (d->state) {
+        case DEV_CMD:
+        case DEV_FUNC:
+            d->in[0] |= (b << d->bit);
+            if (++d->bit < 8)
+                return;
+            if (d->state == DEV_FUNC) {
+                if (d->in[0] == 0x44)
+                    ++d->nr_convert;
+                if (d->in[0] == 0xBE)
+                    dev_send(d, d->scratch, 72);
+                else
+                    dev_enter(d, DEV_IDLE);
+            } else if (d->in[0] == 0xF0) {
+                dev_enter(d, DEV_SEARCH);
+            } else if (d->in[0] == 0x33) {
+                dev_send(d, d->rom, 64);
+            } else if (d->in[0] == 0x55) {
+                dev_enter(d, DEV_MATCH);
+            } else if (d->in[0] == 0xCC) {
+                dev_enter(d, DEV_FUNC);
+            } else {
+                dev_enter(d, DEV_IDLE);
+            }
+            break;
+
+        case DEV_MATCH:
+            d->in[d->bit >> 3] |= (b << (d->bit & 7));
+            if (++d->bit < 64)
+                return;
+            dev_enter(d, (memcmp(d->in, d->rom, 8) == 0) ? DEV_FUNC : DEV_IDLE);
+            break;
+
+        case DEV_SEARCH:
+            // Step 2: the master's direction; off the bus if it is not ours
+            if (b != rom_bit(d->rom, d->bit) || ++d->bit == 64)
+                dev_enter(d, DEV_IDLE);
+            else
+                d->step = 0;
+            break;
+
+        default:
+            break;
+    }
+}
+
+static void bus_fall(uint32_t t) {
+    unsigned int x;
+    uint8_t b;
+
+    // Slot length and recovery time, against the standard-speed minimums
+    if (bus_fall_t != 0 || bus_rise_t != 0) {
+        CHECK(t - bus_fall_t >= 60);
+        CHECK(t - bus_rise_t >= 1);
+    }
+    bus_fall_t = t;
+    bus_low = true;
+
+    for (x = 0; x < nr_devs; ++x) {
+        ow_dev_t *d = &devs[x];
+
+        d->rx_slot = false;
+        if (dev_sends(d, &b)) {
+            if (b == 0) {
+                d->low_from = t;
+                d->low_until = t + 15;
+            }
+            if (d->state == DEV_SEARCH)
+                ++d->step;
+            else if (++d->bit == d->nr_out)
+                dev_enter(d, DEV_IDLE);
+        } else {
+            d->rx_slot = (d->state != DEV_IDLE);
+        }
+    }
+}
+
+static void bus_rise(uint32_t t) {
+    uint32_t dur = t - bus_fall_t;
+    unsigned int x;
+
+    if (!bus_low)
+        return;
+    bus_low = false;
+    bus_rise_t = t;
+
+    if (dur >= 480) {
+        ++bus_nr_resets;
+        for (x = 0; x < nr_devs; ++x) {
+            // Presence: wait 15-60 us, then pull low for 60-240 us
+            dev_enter(&devs[x], DEV_CMD);
+            devs[x].rx_slot = false;
+            devs[x].low_from = t + 30;
+            devs[x].low_until = t + 150;
+        }
+        return;
+    }
+    for (x = 0; x < nr_devs; ++x) {
+        if (devs[x].rx_slot)
+            dev_recv(&devs[x], dur < 15);
+        devs[x].rx_slot = false;
+    }
+}
+
+static uint32_t bus_level(uint32_t t) {
+    unsigned int x;
+
+    if (bus_low)
+        return 0;
+    for (x = 0; x < nr_devs; ++x) {
+        if (t >= devs[x].low_from && t < devs[x].low_until)
+            return 0;
+    }
+    return 1;
+}
+
+// Turn the master's pin writes since the last look into edges
+
+static void bus_edges(void) {
+    bool set = (OW_PORT->PORT_DIRSET & OW_MASK) != 0;
+    bool clr = (OW_PORT->PORT_DIRCLR & OW_MASK) != 0;
+
+    OW_PORT->PORT_DIRSET = 0;
+    OW_PORT->PORT_DIRCLR = 0;
+    if (set)
+        bus_fall(bus_t);
+    if (set && clr)
+        bus_rise(bus_t + OW_T_SHORT_LOW);
+    else if (clr)
+        bus_rise(bus_t);
+}
+
+// Let TC2 overflow until the transfer is over
+
+static void bus_run(void) {
+    unsigned int n = 0;
+
+    // Some idle time since the previous transfer
+    bus_t += 100;
+    bus_edges();
+    while (ctx_ow.xfer != NULL && n++ < 100000) {
+        bus_t += (TC2_REGS->COUNT16.TC_CC[0] + 1) / OW_COUNTS_PER_US;
+        OW_PORT->PORT_IN = bus_level(bus_t) << PLATFORM_OW_PIN;
+        TC2_Handler();
+        bus_edges();
+    }
+    CHECK(ctx_ow.xfer == NULL);
+    CHECK_EQ(TC2_REGS->COUNT16.TC_CTRLBSET, 0x2 << 5);
+}
+
+static void bus_add(const uint8_t *serial, int16_t raw) {
+    ow_dev_t *d = &devs[nr_devs++];
+
+    memset(d, 0, sizeof (*d));
+    d->rom[0] = 0x28; // DS18B20
+    memcpy(&d->rom[1], serial, 6);
+    d->rom[7] = platform_ow_crc8(d->rom, 7);
+    d->scratch[0] = (uint8_t) raw;
+    d->scratch[1] = (uint8_t) (raw >> 8);
+    d->scratch[4] = 0x7F;
+    d->scratch[8] = platform_ow_crc8(d->scratch, 8);
+}
+
+static void reset(void) {
+    host_reset();
+    platform_pclk_init();
+    platform_ow_init();
+
+    // SysTick stopped at LOAD 0: the inline 2 us low does not spin.
+    SysTick->LOAD = 0;
+
+    nr_devs = 0;
+    bus_t = 1000;
+    bus_low = false;
+    bus_fall_t = bus_rise_t = 0;
+    bus_nr_resets = 0;
+    OW_PORT->PORT_DIRSET = 0;
+    OW_PORT->PORT_DIRCLR = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+static void test_no_presence(void) {
+    static const uint8_t cmd[] = {0xCC};
+    platform_ow_xfer_t x = {.reset = true, .tx = cmd, .nr_tx = 1};
+
+    reset();
+    CHECK(platform_ow_xfer_async(&x));
+    CHECK(platform_ow_busy());
+    CHECK(!platform_ow_xfer_async(&x));
+    bus_run();
+    CHECK_EQ(x.state, PLATFORM_OW_XFER_NO_PRESENCE);
+    CHECK_EQ(bus_nr_resets, 1);
+}
+
+static void test_read_rom(void) {
+    static const uint8_t cmd[] = {0x33};
+    uint8_t rom[8];
+    platform_ow_xfer_t x = {.reset = true, .tx = cmd, .nr_tx = 1, .rx = rom, .nr_rx = 8};
+
+    reset();
+    bus_add((const uint8_t *) "\x12\x34\x56\x78\x9A\xBC", 0);
+    CHECK(platform_ow_xfer_async(&x));
+    bus_run();
+    CHECK_EQ(x.state, PLATFORM_OW_XFER_DONE);
+    CHECK(memcmp(rom, devs[0].rom, 8) == 0);
+    CHECK_EQ(platform_ow_crc8(rom, 8), 0);
+}
+
+// Search passes until every device on the bus has been found once
+
+static unsigned int search_all(uint8_t found[][8], unsigned int nr_max) {
+    static const uint8_t cmd[] = {0xF0};
+    platform_ow_xfer_t x = {.reset = true, .tx = cmd, .nr_tx = 1};
+    uint8_t rom[8] = {0};
+    unsigned int n = 0;
+
+    x.search_rom = rom;
+    x.search_last = 0;
+    do {
+        CHECK(platform_ow_xfer_async(&x));
+        bus_run();
+        if (x.state != PLATFORM_OW_XFER_DONE)
+            break;
+        memcpy(found[n++], rom, 8);
+    } while (x.search_last != 0 && n < nr_max);
+    return n;
+}
+
+static void test_search(void) {
+    // Serials sharing prefixes, so that the search forks at several depths
+    static const char *serials[] = {
+        "\x01\x00\x00\x00\x00\x00", "\x03\x00\x00\x00\x00\x00",
+        "\x01\x80\x00\x00\x00\x00", "\xFF\xFF\xFF\xFF\xFF\x7F",
+        "\x01\x00\x00\x00\x00\x80", "\x55\xAA\x55\xAA\x55\xAA",
+    };
+    uint8_t found[NR_DEVS_MAX + 1][8];
+    unsigned int n, nr, x, y, hits;
+
+    for (n = 1; n <= 6; ++n) {
+        reset();
+        for (x = 0; x < n; ++x)
+            bus_add((const uint8_t *) serials[x], 0);
+
+        nr = search_all(found, NR_DEVS_MAX + 1);
+        CHECK_EQ(nr, n);
+        CHECK_EQ(bus_nr_resets, n);
+        for (x = 0; x < n; ++x) {
+            for (y = 0, hits = 0; y < nr; ++y)
+                hits += (memcmp(found[y], devs[x].rom, 8) == 0);
+            CHECK_EQ(hits, 1);
+        }
+        for (y = 0; y < nr; ++y)
+            CHECK_EQ(platform_ow_crc8(found[y], 8), 0);
+    }
+
+    // An empty bus fails the very first pass.
+    reset();
+    CHECK_EQ(search_all(found, 1), 0);
+}
+
+// Conversion on all sensors at once, then one scratchpad read per sensor
+
+static void test_temp(void) {
+    static const int16_t raw[] = {0x0191, -0x005E, 0x07D0};
+    platform_ow_temp_t temps[4];
+    platform_timespec_t tick = {0, 0};
+    unsigned int x, nr_xfers = 0, nr_xfers_waiting = 0;
+
+    reset();
+    bus_add((const uint8_t *) "\x10\x00\x00\x00\x00\x01", raw[0]);
+    bus_add((const uint8_t *) "\x20\x00\x00\x00\x00\x02", raw[1]);
+    bus_add((const uint8_t *) "\x30\x00\x00\x00\x00\x03", raw[2]);
+    for (x = 0; x < 3; ++x)
+        memcpy(temps[x].rom, devs[x].rom, 8);
+
+    // The fourth sensor is on the list but not on the bus.
+    memcpy(temps[3].rom, devs[0].rom, 8);
+    temps[3].rom[1] ^= 0xFF;
+
+    CHECK(platform_ow_temp_start(temps, 4, 2000));
+    while (tick.nr_sec < 1) {
+        platform_ow_tick_handler(&tick);
+        if (ctx_ow.xfer != NULL) {
+            // The bus is left alone while the sensors convert.
+            if (tick.nr_nsec > 0 && tick.nr_nsec < OW_TEMP_CONV_MS * 1000000UL)
+                ++nr_xfers_waiting;
+            ++nr_xfers;
+            bus_run();
+        }
+        tick.nr_nsec += 5000000;
+        platform_timespec_normalize(&tick);
+    }
+
+    CHECK_EQ(nr_xfers, 1 + 4);
+    CHECK_EQ(nr_xfers_waiting, 0);
+    for (x = 0; x < 3; ++x) {
+        CHECK_EQ(devs[x].nr_convert, 1);
+        CHECK(temps[x].valid);
+        CHECK_EQ(temps[x].raw, raw[x]);
+    }
+    CHECK(!temps[3].valid);
+
+    // TC2 is released between transfers.
+    CHECK(!platform_pclk_is_on(PLATFORM_PCLK_TC2));
+    platform_ow_temp_stop();
+}
+
+int main(void) {
+    test_no_presence();
+    test_read_rom();
+    test_search();
+    test_temp();
+    return test_result("onewire");
+}
@@ -0,0 +1,164 @@
+/**
+ * @file tests/host/test_pclk.c
+ * @brief Host tests, peripheral clock reference counting
+ */
+
+#include <string.h>
+
+#include "test.h"
+#include "../../platform/sync.c"
+#include "../../platform/pclk.c"
+
+/////////////////////////////////////////////////////////////////////////////
+
+#define PCH_TC		TC0_GCLK_ID	// Shared by TC0 and TC1
+#define CHEN		(1 << 6)
+
+static void reset(void) {
+    host_reset();
+    memset(sync_slots, 0, sizeof (sync_slots));
+    memset(&sync_stats, 0, sizeof (sync_stats));
+
+    // Everything on out of reset, as far as this module is concerned
+    MCLK_REGS->MCLK_APBCMASK = 0xFFFFFFFF;
+    platform_pclk_init();
+}
+
+static uint32_t ua_total(void) {
+    uint32_t ua = 0;
+    unsigned int x;
+
+    for (x = 0; x < PLATFORM_PCLK_NR; ++x)
+        ua += pclk_descs[x].ua;
+    return ua;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+static void test_init(void) {
+    platform_pclk_stats_t stats;
+
+    reset();
+    CHECK_EQ(MCLK_REGS->MCLK_APBCMASK & MCLK_APBCMASK_SERCOM3_Msk, 0);
+    CHECK_EQ(MCLK_REGS->MCLK_APBCMASK & MCLK_APBCMASK_TC1_Msk, 0);
+    CHECK_EQ(GCLK_REGS->GCLK_PCHCTRL[SERCOM3_GCLK_ID_CORE], 2);
+    CHECK_EQ(GCLK_REGS->GCLK_PCHCTRL[PCH_TC], 0);
+    CHECK(OSCCTRL_REGS->OSCCTRL_OSC16MCTRL & (1 << 7));
+
+    platform_pclk_get_stats(&stats);
+    CHECK_EQ(stats.mask_on, 0);
+    CHECK_EQ(stats.nr_gated, 0);
+    CHECK_EQ(stats.ua_reclaimed, ua_total());
+}
+
+static void test_refcount(void) {
+    platform_pclk_stats_t stats;
+
+    reset();
+    pclk_get(PLATFORM_PCLK_SERCOM3);
+    CHECK(MCLK_REGS->MCLK_APBCMASK & MCLK_APBCMASK_SERCOM3_Msk);
+    CHECK_EQ(GCLK_REGS->GCLK_PCHCTRL[SERCOM3_GCLK_ID_CORE], CHEN | 2);
+    CHECK(platform_pclk_is_on(PLATFORM_PCLK_SERCOM3));
+
+    pclk_get(PLATFORM_PCLK_SERCOM3);
+    pclk_put(PLATFORM_PCLK_SERCOM3);
+    CHECK(platform_pclk_is_on(PLATFORM_PCLK_SERCOM3));
+    CHECK(MCLK_REGS->MCLK_APBCMASK & MCLK_APBCMASK_SERCOM3_Msk);
+    platform_pclk_get_stats(&stats);
+    CHECK_EQ(stats.mask_on, 1 << PLATFORM_PCLK_SERCOM3);
+    CHECK_EQ(stats.ua_reclaimed, ua_total() - pclk_descs[PLATFORM_PCLK_SERCOM3].ua);
+
+    pclk_put(PLATFORM_PCLK_SERCOM3);
+    CHECK(!platform_pclk_is_on(PLATFORM_PCLK_SERCOM3));
+    CHECK_EQ(MCLK_REGS->MCLK_APBCMASK & MCLK_APBCMASK_SERCOM3_Msk, 0);
+    CHECK_EQ(GCLK_REGS->GCLK_PCHCTRL[SERCOM3_GCLK_ID_CORE], 2);
+    platform_pclk_get_stats(&stats);
+    CHECK_EQ(stats.mask_on, 0);
+    CHECK_EQ(stats.nr_gated, 1);
+    CHECK_EQ(stats.ua_reclaimed, ua_total());
+
+    // Unbalanced puts are ignored
+    pclk_put(PLATFORM_PCLK_SERCOM3);
+    platform_pclk_get_stats(&stats);
+    CHECK_EQ(stats.nr_gated, 1);
+    CHECK_EQ(pclk_refs[PLATFORM_PCLK_SERCOM3], 0);
+    CHECK(!platform_pclk_is_on(PLATFORM_PCLK_NR));
+}
+
+// TC0 and TC1 share one GCLK channel, which must outlive either user
+
+static void test_shared(void) {
+    reset();
+    pclk_get(PLATFORM_PCLK_TC0);
+    pclk_get(PLATFORM_PCLK_TC1);
+    CHECK_EQ(GCLK_REGS->GCLK_PCHCTRL[PCH_TC], CHEN);
+
+    pclk_put(PLATFORM_PCLK_TC0);
+    CHECK_EQ(GCLK_REGS->GCLK_PCHCTRL[PCH_TC], CHEN);
+    CHECK_EQ(MCLK_REGS->MCLK_APBCMASK & MCLK_APBCMASK_TC0_Msk, 0);
+    CHECK(MCLK_REGS->MCLK_APBCMASK & MCLK_APBCMASK_TC1_Msk);
+
+    pclk_put(PLATFORM_PCLK_TC1);
+    CHECK_EQ(GCLK_REGS->GCLK_PCHCTRL[PCH_TC], 0);
+    CHECK_EQ(MCLK_REGS->MCLK_APBCMASK & (MCLK_APBCMASK_TC0_Msk | MCLK_APBCMASK_TC1_Msk), 0);
+
+    // Same the other way around
+    pclk_get(PLATFORM_PCLK_TC1);
+    pclk_get(PLATFORM_PCLK_TC0);
+    pclk_put(PLATFORM_PCLK_TC1);
+    CHECK_EQ(GCLK_REGS->GCLK_PCHCTRL[PCH_TC], CHEN);
+    pclk_put(PLATFORM_PCLK_TC0);
+    CHECK_EQ(GCLK_REGS->GCLK_PCHCTRL[PCH_TC], 0);
+}
+
+// Gating waits for, and retires, writes still in flight
+
+static unsigned int gate_polls;
+
+static void gate_poll(void) {
+    if (++gate_polls == 2)
+        HOST_SET(TC2_REGS->COUNT16.TC_SYNCBUSY, 0);
+}
+
+static void test_put_sync(void) {
+    reset();
+    pclk_get(PLATFORM_PCLK_TC2);
+    HOST_SET(TC2_REGS->COUNT16.TC_SYNCBUSY, 1 << 1);
+    sync_post(&TC2_REGS->COUNT16.TC_SYNCBUSY, 1 << 1);
+
+    gate_polls = 0;
+    host_poll_hook = gate_poll;
+    pclk_put(PLATFORM_PCLK_TC2);
+    CHECK_EQ(gate_polls, 2);
+    CHECK(sync_find(&TC2_REGS->COUNT16.TC_SYNCBUSY) == NULL);
+    CHECK_EQ(sync_stats.nr_stalls, 1);
+    CHECK_EQ(GCLK_REGS->GCLK_PCHCTRL[TC2_GCLK_ID], 0);
+}
+
+static void test_gen(void) {
+    reset();
+
+    // While gated, only remembered
+    pclk_set_gen(PLATFORM_PCLK_SERCOM3, 0);
+    CHECK_EQ(GCLK_REGS->GCLK_PCHCTRL[SERCOM3_GCLK_ID_CORE], 2);
+    pclk_get(PLATFORM_PCLK_SERCOM3);
+    CHECK_EQ(GCLK_REGS->GCLK_PCHCTRL[SERCOM3_GCLK_ID_CORE], CHEN | 0);
+
+    // While running, switched right away
+    pclk_set_gen(PLATFORM_PCLK_SERCOM3, 1);
+    CHECK_EQ(GCLK_REGS->GCLK_PCHCTRL[SERCOM3_GCLK_ID_CORE], CHEN | 1);
+    pclk_reset_gen(PLATFORM_PCLK_SERCOM3);
+    CHECK_EQ(GCLK_REGS->GCLK_PCHCTRL[SERCOM3_GCLK_ID_CORE], CHEN | 2);
+
+    pclk_put(PLATFORM_PCLK_SERCOM3);
+    CHECK_EQ(GCLK_REGS->GCLK_PCHCTRL[SERCOM3_GCLK_ID_CORE], 2);
+}
+
+int main(void) {
+    test_init();
+    test_refcount();
+    test_shared();
+    test_put_sync();
+    test_gen();
+    return test_result("pclk");
+}
@@ -0,0 +1,84 @@
+/**
+ * @file tests/host/test_pio.c
+ * @brief Host tests, pin access through the IOBUS alias of PORT
+ */
+
+#include <xc.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "test.h"
+#include "../../platform/pio.h"
+
+/////////////////////////////////////////////////////////////////////////////
+
+#define IOBUS_OFS(g, reg)	offsetof(host_periph_t, port_iobus.GROUP[g].reg)
+
+/// Whether an access falls within the APB view of PORT
+static bool in_apb(uint32_t off) {
+    return off >= offsetof(host_periph_t, port) &&
+            off < offsetof(host_periph_t, port) + sizeof (port_registers_t);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+// The two views are distinct, so that an access can only land in one.
+
+static void test_views(void) {
+    CHECK(PIO_REGS == PORT_IOBUS_SEC_REGS);
+    CHECK((void *) PORT_IOBUS_SEC_REGS != (void *) PORT_SEC_REGS);
+    CHECK(!in_apb(offsetof(host_periph_t, port_iobus)));
+}
+
+// Each call is one 32-bit access to its register in the alias, and only that.
+
+static void test_access(void) {
+    static const struct {
+        int op;
+        uint32_t off;
+        uint32_t val;
+    } want[] = {
+        {HOST_TRACE_W, IOBUS_OFS(1, PORT_OUTSET), 1u << 10},
+        {HOST_TRACE_W, IOBUS_OFS(1, PORT_OUTCLR), 1u << 10},
+        {HOST_TRACE_W, IOBUS_OFS(0, PORT_OUTTGL), 1u << 19},
+        {HOST_TRACE_W, IOBUS_OFS(0, PORT_DIRSET), 1u << 3},
+        {HOST_TRACE_W, IOBUS_OFS(0, PORT_DIRCLR), 1u << 3},
+        {HOST_TRACE_R, IOBUS_OFS(1, PORT_IN), 0x00000A05},
+    };
+    unsigned int x;
+    uint32_t in;
+
+    host_reset();
+    PORT_IOBUS_SEC_REGS->GROUP[1].PORT_IN = 0x00000A05;
+    PORT_SEC_REGS->GROUP[1].PORT_IN = 0xFFFFFFFF;
+    if (!host_trace_start()) {
+        // No tracer here: the values still show which view was used.
+        pio_set(1, 1u << 10);
+        CHECK_EQ(PORT_IOBUS_SEC_REGS->GROUP[1].PORT_OUTSET, 1u << 10);
+        CHECK_EQ(PORT_SEC_REGS->GROUP[1].PORT_OUTSET, 0);
+        CHECK_EQ(pio_in(1), 0x00000A05);
+        return;
+    }
+    pio_set(1, 1u << 10);
+    pio_clr(1, 1u << 10);
+    pio_tgl(0, 1u << 19);
+    pio_dirset(0, 1u << 3);
+    pio_dirclr(0, 1u << 3);
+    in = pio_in(1);
+    host_trace_stop();
+
+    CHECK_EQ(in, 0x00000A05);
+    CHECK_EQ(host_trace_nr, sizeof (want) / sizeof (want[0]));
+    for (x = 0; x < host_trace_nr && x < sizeof (want) / sizeof (want[0]); ++x) {
+        CHECK_EQ(host_trace_log[x].op, want[x].op);
+        CHECK_EQ(host_trace_log[x].off, want[x].off);
+        CHECK_EQ(host_trace_log[x].val, want[x].val);
+        CHECK(!in_apb(host_trace_log[x].off));
+    }
+}
+
+int main(void) {
+    test_views();
+    test_access();
+    return test_result("pio");
+}
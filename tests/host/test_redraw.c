@@ -0,0 +1,174 @@
+/**
+ * @file tests/host/test_redraw.c
+ * @brief Host tests, status-line redraw coalescing in main.c
+ */
+
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/// Blank Data Flash: no stored behaviour program
+static uint8_t flash[512];
+#define VM_FLASH_ADDR	((uintptr_t) flash)
+
+#include "test.h"
+#include "../../platform/usart.c"
+#include "../../vm.c"
+#define main prog_main
+#include "../../main.c"
+#undef main
+#include "usart_sim.h"
+
+/////////////////////////////////////////////////////////////////////////////
+
+/*
+ * The board side of main.c: the USART is usart_sim.h's, one main-loop pass
+ * is PASS_US (about a character time at 57600 bps), and SysTick fires every
+ * PLATFORM_TICK_PERIOD_US of that. Buttons and the display are stubbed.
+ */
+extern void SysTick_Handler(void);
+
+#define PASS_US		200
+
+static uint32_t pass_us;
+static uint16_t pb_events;
+
+/// Everything sent, in order
+static char out[16384];
+static unsigned int nr_out;
+
+void platform_init(void) {
+}
+
+void platform_do_loop_one(void) {
+    unsigned int x;
+
+    sim_tick(PASS_US);
+    pass_us += PASS_US;
+    if (pass_us >= PLATFORM_TICK_PERIOD_US) {
+        pass_us -= PLATFORM_TICK_PERIOD_US;
+        SysTick_Handler();
+    }
+    for (x = 0; x < sim_nr_sent && nr_out < sizeof (out); ++x)
+        out[nr_out++] = (char) sim_sent[x];
+    sim_nr_sent = 0;
+}
+
+void platform_blink_modify(void) {
+}
+
+void platform_blink_restart(void) {
+}
+
+uint16_t platform_pb_get_event(void) {
+    uint16_t ev = pb_events;
+
+    pb_events = 0;
+    return ev;
+}
+
+unsigned int platform_disp_text(unsigned int x, unsigned int y,
+        const char *s, uint16_t fg, uint16_t bg) {
+    return x + 8 * strlen(s);
+}
+
+static prog_state_t ps;
+
+static void reset(void) {
+    sim_reset();
+    pass_us = 0;
+    pb_events = 0;
+    nr_out = 0;
+    memset(flash, 0xFF, sizeof (flash));
+    prog_setup(&ps);
+    currentSetting = OFF;
+    init = 1;	// No banner
+}
+
+static void run_ms(unsigned int ms) {
+    unsigned int n = ms * 1000 / PASS_US;
+
+    while (n-- > 0)
+        prog_loop_one(&ps);
+}
+
+// Bytes one region takes to draw; sent per update before coalescing
+
+#define BUTTON_BYTES	(sizeof (ESC_SEQ_BUTTON_POS) - 1 + sizeof (BUTTON_PRESSED) - 1)
+#define BLINK_BYTES	(sizeof (CHANGE_MODE) - 1 + strlen(blinkSettingStrings[OFF]))
+
+/// Whether the last copy of line in the output is the expected one
+static bool last_drawn(const char *pos, const char *want) {
+    const char *p, *last = NULL;
+
+    for (p = out; (p = memmem(p, out + nr_out - p, pos, strlen(pos))) != NULL; ++p)
+        last = p + strlen(pos);
+    return last != NULL && (size_t) (out + nr_out - last) >= strlen(want) &&
+            memcmp(last, want, strlen(want)) == 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+// A single change is drawn on the next idle pass, whole.
+
+static void test_single(void) {
+    reset();
+    sim_peer_send("d", 1);
+    run_ms(20);
+    CHECK_EQ(currentSetting, SLOW);
+    CHECK_EQ(ps.nr_redraws, 1);
+    CHECK_EQ(ps.nr_redraw_merged, 0);
+    CHECK_EQ(ps.nr_redraw_bytes, BLINK_BYTES);
+    CHECK_EQ(nr_out, BLINK_BYTES);
+    CHECK(last_drawn(CHANGE_MODE, blinkSettingStrings[SLOW]));
+}
+
+/*
+ * A key held down (auto-repeat every 35 ms) and a bouncing button (an
+ * edge every 5 ms), for one second
+ *
+ * Uncoalesced, every update is its own redraw of its region; coalesced,
+ * redraws are capped at PROG_REDRAW_MAX_HZ and each draws the final state.
+ */
+static void test_burst(void) {
+    unsigned int ms, nr_keys = 0, nr_edges = 0, before, after;
+
+    reset();
+    for (ms = 0; ms < 1000; ms += 5) {
+        if (ms % 35 == 0) {
+            sim_peer_send((ms < 500) ? "d" : "a", 1);
+            ++nr_keys;
+        }
+        pb_events = (nr_edges++ % 2 == 0) ?
+                PLATFORM_PB_ONBOARD_PRESS : PLATFORM_PB_ONBOARD_RELEASE;
+        run_ms(5);
+    }
+    run_ms(200);
+
+    // Every key was acted on, even while the link was busy.
+    CHECK_EQ(currentSetting, OFF);
+
+    before = nr_keys * BLINK_BYTES + nr_edges * BUTTON_BYTES;
+    after = ps.nr_redraw_bytes;
+    CHECK_EQ(after, nr_out);
+    CHECK(ps.nr_redraws <= PROG_REDRAW_MAX_HZ * 1200 / 1000 + 1);
+    CHECK(ps.nr_redraws >= PROG_REDRAW_MAX_HZ / 2);
+    CHECK(after * 4 < before);
+
+    // The screen ends up showing the final state.
+    CHECK(last_drawn(CHANGE_MODE, blinkSettingStrings[OFF]));
+    CHECK(last_drawn(ESC_SEQ_BUTTON_POS, ps.pb_pressed ? BUTTON_PRESSED : BUTTON_RELEASED));
+
+    printf("redraw: %u updates in 1 s -> %lu redraws; %u bytes uncoalesced, %u sent "
+            "(%u per update, %lu per redraw)\n", nr_keys + nr_edges,
+            (unsigned long) ps.nr_redraws, before, after,
+            before / (nr_keys + nr_edges), (unsigned long) (after / ps.nr_redraws));
+}
+
+int main(void) {
+    test_single();
+    test_burst();
+    return test_result("redraw");
+}
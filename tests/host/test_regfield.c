@@ -0,0 +1,162 @@
+/**
+ * @file tests/host/test_regfield.c
+ * @brief Host tests, RF_VALUE() stores against the equivalent shifts
+ *
+ * Every RF_VALUE() store in the drivers is restated here next to the
+ * hand-written shifts it stands for. Built as usual, this compares the
+ * values the two store. Built with -DRF_SIDE=1 or 2 (see the Makefile), it
+ * holds only one side's store functions, so that the two assembly listings
+ * can be compared as a whole. Built with -DRF_BAD=n, it holds the n-th
+ * misuse, which must not compile.
+ */
+
+#include <stdint.h>
+
+#include "../../platform/regfield.h"
+
+/////////////////////////////////////////////////////////////////////////////
+
+// X(name, RF_VALUE() form, shift form), one per distinct store
+
+#define STORES(X) \
+    X(tc_swrst, RF_VALUE(RF_REG_TC_CTRLA, \
+            RF(RF_TC_CTRLA_SWRST, 0x1)), \
+        (0x1 << 0)) \
+    X(tc0_ctrla, RF_VALUE(RF_REG_TC_CTRLA, \
+            RF(RF_TC_CTRLA_MODE, 0x0), \
+            RF(RF_TC_CTRLA_PRESCSYNC, 0x1), \
+            RF(RF_TC_CTRLA_PRESCALER, 0x7)), \
+        (0x0 << 2) | (0x1 << 4) | (0x7 << 8)) \
+    X(tc1_ctrla, RF_VALUE(RF_REG_TC_CTRLA, \
+            RF(RF_TC_CTRLA_MODE, 0x0), \
+            RF(RF_TC_CTRLA_PRESCSYNC, 0x1), \
+            RF(RF_TC_CTRLA_PRESCALER, 0x4)), \
+        (0x0 << 2) | (0x1 << 4) | (0x4 << 8)) \
+    X(tc2_ctrla, RF_VALUE(RF_REG_TC_CTRLA, \
+            RF(RF_TC_CTRLA_MODE, 0x0), \
+            RF(RF_TC_CTRLA_PRESCSYNC, 0x1), \
+            RF(RF_TC_CTRLA_PRESCALER, 0x3)), \
+        (0x0 << 2) | (0x1 << 4) | (0x3 << 8)) \
+    X(tc_wave, RF_VALUE(RF_REG_TC_WAVE, \
+            RF(RF_TC_WAVE_WAVEGEN, 0x1)), \
+        (0x1 << 0)) \
+    X(usart_ctrla, RF_VALUE(RF_REG_USART_CTRLA, \
+            RF(RF_USART_CTRLA_MODE, 0x1), \
+            RF(RF_USART_CTRLA_SAMPR, 0x0), \
+            RF(RF_USART_CTRLA_TXPO, 0x0), \
+            RF(RF_USART_CTRLA_RXPO, 0x1), \
+            RF(RF_USART_CTRLA_FORM, 0x1), \
+            RF(RF_USART_CTRLA_DORD, 0x1)), \
+        (0x1 << 2) | (0x0 << 13) | (0x0 << 16) | (0x1 << 20) | (0x1 << 24) | (1u << 30)) \
+    X(usart_ctrlb, RF_VALUE(RF_REG_USART_CTRLB, \
+            RF(RF_USART_CTRLB_CHSIZE, 0x0), \
+            RF(RF_USART_CTRLB_SBMODE, 0x0), \
+            RF(RF_USART_CTRLB_COLDEN, 0x0), \
+            RF(RF_USART_CTRLB_PMODE, 0x0), \
+            RF(RF_USART_CTRLB_TXEN, 0x1), \
+            RF(RF_USART_CTRLB_RXEN, 0x1), \
+            RF(RF_USART_CTRLB_FIFOCLR, 0x3)), \
+        (0x0 << 0) | (0 << 6) | (0 << 8) | (0 << 13) | (1 << 16) | (1 << 17) | (0x3 << 22)) \
+    X(usart_async, RF_VALUE(RF_REG_USART_CTRLA, \
+            RF(RF_USART_CTRLA_MODE, 0x1), \
+            RF(RF_USART_CTRLA_RXPO, 0x1), \
+            RF(RF_USART_CTRLA_FORM, 0x1), \
+            RF(RF_USART_CTRLA_DORD, 0x1)), \
+        (0x1 << 2) | (0x1 << 20) | (0x1 << 24) | (1u << 30)) \
+    X(usart_sync_master, RF_VALUE(RF_REG_USART_CTRLA, \
+            RF(RF_USART_CTRLA_MODE, 0x1), \
+            RF(RF_USART_CTRLA_RXPO, 0x3), \
+            RF(RF_USART_CTRLA_FORM, 0x0), \
+            RF(RF_USART_CTRLA_CMODE, 0x1), \
+            RF(RF_USART_CTRLA_DORD, 0x1)), \
+        (0x1 << 2) | (0x3 << 20) | (0x0 << 24) | (1 << 28) | (1u << 30)) \
+    X(usart_sync_slave, RF_VALUE(RF_REG_USART_CTRLA, \
+            RF(RF_USART_CTRLA_MODE, 0x0), \
+            RF(RF_USART_CTRLA_RXPO, 0x3), \
+            RF(RF_USART_CTRLA_FORM, 0x0), \
+            RF(RF_USART_CTRLA_CMODE, 0x1), \
+            RF(RF_USART_CTRLA_DORD, 0x1)), \
+        (0x0 << 2) | (0x3 << 20) | (0x0 << 24) | (1 << 28) | (1u << 30)) \
+    X(spi_swrst, RF_VALUE(RF_REG_SPI_CTRLA, \
+            RF(RF_SPI_CTRLA_SWRST, 0x1)), \
+        (0x1 << 0)) \
+    X(spi_ctrla, RF_VALUE(RF_REG_SPI_CTRLA, \
+            RF(RF_SPI_CTRLA_MODE, 0x3), \
+            RF(RF_SPI_CTRLA_DOPO, 0x0), \
+            RF(RF_SPI_CTRLA_DIPO, 0x3), \
+            RF(RF_SPI_CTRLA_FORM, 0x0), \
+            RF(RF_SPI_CTRLA_CPHA, 0x0), \
+            RF(RF_SPI_CTRLA_CPOL, 0x0), \
+            RF(RF_SPI_CTRLA_DORD, 0x0)), \
+        (0x3 << 2) | (0x0 << 16) | (0x3 << 20) | (0x0 << 24) | (0 << 28) | (0 << 29) | (0 << 30)) \
+    X(spi_ctrlb, RF_VALUE(RF_REG_SPI_CTRLB, \
+            RF(RF_SPI_CTRLB_CHSIZE, 0x0), \
+            RF(RF_SPI_CTRLB_MSSEN, 0x0), \
+            RF(RF_SPI_CTRLB_RXEN, 0x0)), \
+        (0x0 << 0) | (0 << 13) | (0 << 17))
+
+/////////////////////////////////////////////////////////////////////////////
+
+#if defined(RF_BAD)
+
+// Misuse; each must be rejected by regfield.h itself
+
+volatile uint32_t reg;
+
+void bad(void) {
+#if RF_BAD == 1
+    // Too wide: PRESCALER is 3 bits
+    reg = RF_VALUE(RF_REG_TC_CTRLA, RF(RF_TC_CTRLA_PRESCALER, 0x8));
+#elif RF_BAD == 2
+    // Foreign register: WAVEGEN is in TC WAVE, not TC CTRLA
+    reg = RF_VALUE(RF_REG_TC_CTRLA, RF(RF_TC_WAVE_WAVEGEN, 0x1));
+#elif RF_BAD == 3
+    // Overlap: the same field twice
+    reg = RF_VALUE(RF_REG_TC_CTRLA,
+            RF(RF_TC_CTRLA_PRESCALER, 0x1),
+            RF(RF_TC_CTRLA_PRESCALER, 0x2));
+#endif
+}
+
+#elif defined(RF_SIDE)
+
+// One side only, under the same names; the listings must be identical
+
+#if RF_SIDE == 1
+#define STORE_FN(name, rf, shift) \
+    void store_##name(volatile uint32_t *reg) { *reg = (rf); }
+#else
+#define STORE_FN(name, rf, shift) \
+    void store_##name(volatile uint32_t *reg) { *reg = (uint32_t) (shift); }
+#endif
+STORES(STORE_FN)
+
+#else
+
+#include <stdio.h>
+
+#include "test.h"
+
+#define CHECK_STORE(name, rf, shift) \
+    do { \
+        uint32_t a = (rf), b = (uint32_t) (shift); \
+        if (a != b) \
+            printf("regfield: %s: RF_VALUE() 0x%08lX, shifts 0x%08lX\n", \
+                    #name, (unsigned long) a, (unsigned long) b); \
+        CHECK_EQ(a, b); \
+        ++nr; \
+    } while (0);
+
+static void test_values(void) {
+    unsigned int nr = 0;
+
+    STORES(CHECK_STORE)
+    CHECK_EQ(nr, 13);
+}
+
+int main(void) {
+    test_values();
+    return test_result("regfield");
+}
+
+#endif
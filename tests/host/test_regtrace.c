@@ -0,0 +1,494 @@
+/**
+ * @file tests/host/test_regtrace.c
+ * @brief Host tests, register accesses of platform_init() and a main-loop pass
+ *
+ * Every register load and store made by platform_init(), and by one pass of
+ * the platform's share of the main loop, is recorded (see host_trace_start())
+ * and compared against the traces kept in tools/golden, so that a change to
+ * what init or the loop touch shows up in review as a diff of those files.
+ * After a deliberate change, accept the new traces with
+ *
+ *     make -C tests/host test_regtrace && (cd tests/host && ./test_regtrace -u)
+ *
+ * Each line is one access, in program order:
+ *
+ *     R     load, with the value read
+ *     W     store, with the value written
+ *     RMW   load then store of the same register, old -> new
+ *     spin  passes through a busy-wait
+ *
+ * Accesses that cost cycles for nothing are flagged, and counted in the
+ * header:
+ *
+ *     rmw-w1    read-modify-write of a write-one register (SET/CLR/TGL,
+ *               INTFLAG, STATUS, INTENSET/INTENCLR); the read is wasted,
+ *               and on flag registers it acknowledges every pending flag
+ *     noop-rmw  read-modify-write that leaves the register as it was
+ *
+ * Registers are plain RAM here; values are what the drivers wrote, and what
+ * the ready model below presets, not what the silicon would hold.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/// NVM calibration word, COARSE = 0x1F
+static uint32_t calib = 0x1Fu << 25;
+#define DFLL_CALIB_ADDR	((uintptr_t) &calib)
+
+#include "test.h"
+#include "../../platform/gpio.c"
+
+/////////////////////////////////////////////////////////////////////////////
+
+BlinkSetting currentSetting = OFF;
+
+#define GOLDEN	"../../tools/golden/"
+
+/*
+ * Oscillators and regulators report ready at once; software resets and
+ * enables complete within one spin.
+ */
+static void ready_preset(void) {
+    OSCCTRL_REGS->OSCCTRL_STATUS = (1 << 24);
+    SUPC_REGS->SUPC_STATUS = (1 << 18);
+}
+
+static void ready_poll(void) {
+    unsigned int x;
+
+    for (x = 0; x < 3; ++x)
+        host_regs.p.tc[x].COUNT16.TC_CTRLA &= ~(1u << 0);
+    for (x = 0; x < 4; ++x)
+        host_regs.p.sercom[x].USART_INT.SERCOM_CTRLA &= ~(1u << 0);
+    DMAC_SEC_REGS->DMAC_CTRL &= ~(1u << 0);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+// Register names
+
+typedef struct {
+    const char *name;
+    uint16_t off;
+    uint16_t size;	// Of one register
+    uint16_t n;		// Registers in the array; 1 if not an array
+} reg_field_t;
+
+#define F(type, f)	{#f, offsetof(type, f), sizeof (((type *) 0)->f), 1}
+#define A(type, f, n)	{#f, offsetof(type, f), sizeof (((type *) 0)->f[0]), n}
+
+static const reg_field_t oscctrl_fields[] = {
+    F(oscctrl_registers_t, OSCCTRL_EVCTRL), F(oscctrl_registers_t, OSCCTRL_INTENCLR),
+    F(oscctrl_registers_t, OSCCTRL_INTENSET), F(oscctrl_registers_t, OSCCTRL_INTFLAG),
+    F(oscctrl_registers_t, OSCCTRL_STATUS), F(oscctrl_registers_t, OSCCTRL_XOSCCTRL),
+    F(oscctrl_registers_t, OSCCTRL_CFDPRESC), F(oscctrl_registers_t, OSCCTRL_OSC16MCTRL),
+    F(oscctrl_registers_t, OSCCTRL_DFLLULPCTRL), F(oscctrl_registers_t, OSCCTRL_DFLLULPDITHER),
+    F(oscctrl_registers_t, OSCCTRL_DFLLULPRREQ), F(oscctrl_registers_t, OSCCTRL_DFLLCTRL),
+    F(oscctrl_registers_t, OSCCTRL_DFLLVAL), F(oscctrl_registers_t, OSCCTRL_DFLLMUL),
+    F(oscctrl_registers_t, OSCCTRL_DFLLSYNC),
+};
+
+static const reg_field_t osc32kctrl_fields[] = {
+    F(osc32kctrl_registers_t, OSC32KCTRL_INTENCLR), F(osc32kctrl_registers_t, OSC32KCTRL_INTENSET),
+    F(osc32kctrl_registers_t, OSC32KCTRL_INTFLAG), F(osc32kctrl_registers_t, OSC32KCTRL_STATUS),
+    F(osc32kctrl_registers_t, OSC32KCTRL_RTCCTRL), F(osc32kctrl_registers_t, OSC32KCTRL_XOSC32K),
+    F(osc32kctrl_registers_t, OSC32KCTRL_CFDCTRL), F(osc32kctrl_registers_t, OSC32KCTRL_EVCTRL),
+    F(osc32kctrl_registers_t, OSC32KCTRL_OSCULP32K),
+};
+
+static const reg_field_t pm_fields[] = {
+    F(pm_registers_t, PM_SLEEPCFG), F(pm_registers_t, PM_PLCFG), F(pm_registers_t, PM_PWCFG),
+    F(pm_registers_t, PM_INTENCLR), F(pm_registers_t, PM_INTENSET), F(pm_registers_t, PM_INTFLAG),
+    F(pm_registers_t, PM_STDBYCFG),
+};
+
+static const reg_field_t supc_fields[] = {
+    F(supc_registers_t, SUPC_INTENCLR), F(supc_registers_t, SUPC_INTENSET),
+    F(supc_registers_t, SUPC_INTFLAG), F(supc_registers_t, SUPC_STATUS),
+    F(supc_registers_t, SUPC_BOD33), F(supc_registers_t, SUPC_BOD12), F(supc_registers_t, SUPC_VREG),
+    F(supc_registers_t, SUPC_VREF), F(supc_registers_t, SUPC_VREGPLL),
+};
+
+static const reg_field_t nvmctrl_fields[] = {
+    F(nvmctrl_registers_t, NVMCTRL_CTRLA), F(nvmctrl_registers_t, NVMCTRL_CTRLB),
+    F(nvmctrl_registers_t, NVMCTRL_CTRLC), F(nvmctrl_registers_t, NVMCTRL_EVCTRL),
+    F(nvmctrl_registers_t, NVMCTRL_INTENCLR), F(nvmctrl_registers_t, NVMCTRL_INTENSET),
+    F(nvmctrl_registers_t, NVMCTRL_INTFLAG), F(nvmctrl_registers_t, NVMCTRL_STATUS),
+    F(nvmctrl_registers_t, NVMCTRL_ADDR),
+};
+
+static const reg_field_t gclk_fields[] = {
+    F(gclk_registers_t, GCLK_CTRLA), F(gclk_registers_t, GCLK_SYNCBUSY),
+    A(gclk_registers_t, GCLK_GENCTRL, 5), A(gclk_registers_t, GCLK_PCHCTRL, 41),
+};
+
+static const reg_field_t mclk_fields[] = {
+    F(mclk_registers_t, MCLK_CTRLA), F(mclk_registers_t, MCLK_INTENCLR),
+    F(mclk_registers_t, MCLK_INTENSET), F(mclk_registers_t, MCLK_INTFLAG),
+    F(mclk_registers_t, MCLK_CPUDIV), F(mclk_registers_t, MCLK_AHBMASK),
+    F(mclk_registers_t, MCLK_APBAMASK), F(mclk_registers_t, MCLK_APBBMASK),
+    F(mclk_registers_t, MCLK_APBCMASK),
+};
+
+static const reg_field_t tc_fields[] = {
+    F(tc_count16_registers_t, TC_CTRLA), F(tc_count16_registers_t, TC_CTRLBCLR),
+    F(tc_count16_registers_t, TC_CTRLBSET), F(tc_count16_registers_t, TC_EVCTRL),
+    F(tc_count16_registers_t, TC_INTENCLR), F(tc_count16_registers_t, TC_INTENSET),
+    F(tc_count16_registers_t, TC_INTFLAG), F(tc_count16_registers_t, TC_STATUS),
+    F(tc_count16_registers_t, TC_WAVE), F(tc_count16_registers_t, TC_DRVCTRL),
+    F(tc_count16_registers_t, TC_DBGCTRL), F(tc_count16_registers_t, TC_SYNCBUSY),
+    F(tc_count16_registers_t, TC_COUNT), A(tc_count16_registers_t, TC_CC, 2),
+    A(tc_count16_registers_t, TC_CCBUF, 2),
+};
+
+static const reg_field_t port_fields[] = {
+    F(port_group_registers_t, PORT_DIR), F(port_group_registers_t, PORT_DIRCLR),
+    F(port_group_registers_t, PORT_DIRSET), F(port_group_registers_t, PORT_DIRTGL),
+    F(port_group_registers_t, PORT_OUT), F(port_group_registers_t, PORT_OUTCLR),
+    F(port_group_registers_t, PORT_OUTSET), F(port_group_registers_t, PORT_OUTTGL),
+    F(port_group_registers_t, PORT_IN), F(port_group_registers_t, PORT_CTRL),
+    F(port_group_registers_t, PORT_WRCONFIG), F(port_group_registers_t, PORT_EVCTRL),
+    A(port_group_registers_t, PORT_PMUX, 16), A(port_group_registers_t, PORT_PINCFG, 32),
+};
+
+static const reg_field_t usart_fields[] = {
+    F(sercom_usart_int_registers_t, SERCOM_CTRLA), F(sercom_usart_int_registers_t, SERCOM_CTRLB),
+    F(sercom_usart_int_registers_t, SERCOM_CTRLC), F(sercom_usart_int_registers_t, SERCOM_BAUD),
+    F(sercom_usart_int_registers_t, SERCOM_RXPL), F(sercom_usart_int_registers_t, SERCOM_INTENCLR),
+    F(sercom_usart_int_registers_t, SERCOM_INTENSET), F(sercom_usart_int_registers_t, SERCOM_INTFLAG),
+    F(sercom_usart_int_registers_t, SERCOM_STATUS), F(sercom_usart_int_registers_t, SERCOM_SYNCBUSY),
+    F(sercom_usart_int_registers_t, SERCOM_RXERRCNT), F(sercom_usart_int_registers_t, SERCOM_DATA),
+    F(sercom_usart_int_registers_t, SERCOM_DBGCTRL),
+};
+
+static const reg_field_t spim_fields[] = {
+    F(sercom_spim_registers_t, SERCOM_CTRLA), F(sercom_spim_registers_t, SERCOM_CTRLB),
+    F(sercom_spim_registers_t, SERCOM_CTRLC), F(sercom_spim_registers_t, SERCOM_BAUD),
+    F(sercom_spim_registers_t, SERCOM_INTENCLR), F(sercom_spim_registers_t, SERCOM_INTENSET),
+    F(sercom_spim_registers_t, SERCOM_INTFLAG), F(sercom_spim_registers_t, SERCOM_STATUS),
+    F(sercom_spim_registers_t, SERCOM_SYNCBUSY), F(sercom_spim_registers_t, SERCOM_ADDR),
+    F(sercom_spim_registers_t, SERCOM_DATA), F(sercom_spim_registers_t, SERCOM_DBGCTRL),
+};
+
+static const reg_field_t dmac_fields[] = {
+    F(dmac_registers_t, DMAC_CTRL), F(dmac_registers_t, DMAC_BASEADDR),
+    F(dmac_registers_t, DMAC_WRBADDR), F(dmac_registers_t, DMAC_CHID),
+    F(dmac_registers_t, DMAC_CHCTRLA), F(dmac_registers_t, DMAC_CHCTRLB),
+    F(dmac_registers_t, DMAC_CHINTENCLR), F(dmac_registers_t, DMAC_CHINTENSET),
+    F(dmac_registers_t, DMAC_CHINTFLAG), F(dmac_registers_t, DMAC_CHSTATUS),
+};
+
+static const reg_field_t eic_fields[] = {
+    F(eic_registers_t, EIC_CTRLA), F(eic_registers_t, EIC_NMICTRL), F(eic_registers_t, EIC_NMIFLAG),
+    F(eic_registers_t, EIC_SYNCBUSY), F(eic_registers_t, EIC_EVCTRL),
+    F(eic_registers_t, EIC_INTENCLR), F(eic_registers_t, EIC_INTENSET),
+    F(eic_registers_t, EIC_INTFLAG), F(eic_registers_t, EIC_ASYNCH), F(eic_registers_t, EIC_CONFIG0),
+    F(eic_registers_t, EIC_DEBOUNCEN), F(eic_registers_t, EIC_DPRESCALER),
+    F(eic_registers_t, EIC_PINSTATE),
+};
+
+static const reg_field_t evsys_fields[] = {
+    F(evsys_registers_t, EVSYS_CTRLA), F(evsys_registers_t, EVSYS_SWEVT),
+    F(evsys_registers_t, EVSYS_PRICTRL), F(evsys_registers_t, EVSYS_INTPEND),
+    F(evsys_registers_t, EVSYS_INTSTATUS), F(evsys_registers_t, EVSYS_BUSYCH),
+    F(evsys_registers_t, EVSYS_READYUSR),
+};
+
+static const reg_field_t systick_fields[] = {
+    F(SysTick_Type, CTRL), F(SysTick_Type, LOAD), F(SysTick_Type, VAL), F(SysTick_Type, CALIB),
+};
+
+#undef F
+#undef A
+
+typedef struct {
+    const char *name;
+    size_t off;
+    const reg_field_t *fields;
+    unsigned int nr_fields;
+} reg_block_t;
+
+#define B(name, member, fields) \
+    {name, offsetof(host_periph_t, member), fields, sizeof (fields) / sizeof (fields[0])}
+
+// SERCOM0/2 drive SPI; SERCOM1 is unused.
+static const reg_block_t blocks[] = {
+    B("OSCCTRL", oscctrl, oscctrl_fields),
+    B("OSC32KCTRL", osc32kctrl, osc32kctrl_fields),
+    B("PM", pm, pm_fields),
+    B("SUPC", supc, supc_fields),
+    B("NVMCTRL", nvmctrl, nvmctrl_fields),
+    B("GCLK", gclk, gclk_fields),
+    B("MCLK", mclk, mclk_fields),
+    B("TC0", tc[0], tc_fields),
+    B("TC1", tc[1], tc_fields),
+    B("TC2", tc[2], tc_fields),
+    B("PORT.GROUP[0]", port.GROUP[0], port_fields),
+    B("PORT.GROUP[1]", port.GROUP[1], port_fields),
+    B("PORT_IOBUS.GROUP[0]", port_iobus.GROUP[0], port_fields),
+    B("PORT_IOBUS.GROUP[1]", port_iobus.GROUP[1], port_fields),
+    B("SERCOM0", sercom[0], spim_fields),
+    B("SERCOM1", sercom[1], spim_fields),
+    B("SERCOM2", sercom[2], spim_fields),
+    B("SERCOM3", sercom[3], usart_fields),
+    B("DMAC", dmac, dmac_fields),
+    B("EIC", eic, eic_fields),
+    B("EVSYS", evsys, evsys_fields),
+    B("SysTick", systick, systick_fields),
+};
+
+#undef B
+
+#define NR_BLOCKS	(sizeof (blocks) / sizeof (blocks[0]))
+
+/// A traced offset, resolved
+typedef struct {
+    char name[64];
+    unsigned int size;
+    bool w1;		// Write-one register
+    bool addr;		// Holds an address, which differs from run to run
+} reg_info_t;
+
+static void reg_lookup(uint32_t off, reg_info_t *info) {
+    const reg_field_t *f;
+    unsigned int x, y, idx;
+    size_t rel;
+
+    info->size = 4;
+    info->w1 = info->addr = false;
+    for (x = 0; x < NR_BLOCKS; ++x) {
+        for (y = 0; y < blocks[x].nr_fields; ++y) {
+            f = &blocks[x].fields[y];
+            if (off < blocks[x].off + f->off)
+                continue;
+            rel = off - blocks[x].off - f->off;
+            if (rel >= (size_t) f->size * f->n)
+                continue;
+
+            idx = rel / f->size;
+            if (f->n > 1)
+                snprintf(info->name, sizeof (info->name), "%s.%s[%u]",
+                        blocks[x].name, f->name, idx);
+            else
+                snprintf(info->name, sizeof (info->name), "%s.%s",
+                        blocks[x].name, f->name);
+            if (rel % f->size != 0) {
+                snprintf(info->name + strlen(info->name),
+                        sizeof (info->name) - strlen(info->name),
+                        "+%u", (unsigned int) (rel % f->size));
+            }
+            info->size = f->size - rel % f->size;
+            info->w1 = (strstr(f->name, "SET") || strstr(f->name, "CLR") ||
+                    strstr(f->name, "TGL") || strstr(f->name, "INTFLAG") ||
+                    strstr(f->name, "STATUS"));
+            info->addr = (strcmp(f->name, "DMAC_BASEADDR") == 0 ||
+                    strcmp(f->name, "DMAC_WRBADDR") == 0);
+            return;
+        }
+    }
+    snprintf(info->name, sizeof (info->name), "+0x%04x", (unsigned int) off);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+// Listing
+
+typedef struct {
+    unsigned int nr_r, nr_w, nr_rmw, nr_spin;
+    unsigned int nr_rmw_w1, nr_noop_rmw;
+} trace_counts_t;
+
+static void print_val(FILE *f, const reg_info_t *info, uint32_t val) {
+    if (info->addr)
+        fprintf(f, "(address)");
+    else if (info->size >= 4)
+        fprintf(f, "0x%08x", (unsigned int) val);
+    else if (info->size == 2)
+        fprintf(f, "0x%04x", (unsigned int) (val & 0xFFFF));
+    else
+        fprintf(f, "0x%02x", (unsigned int) (val & 0xFF));
+}
+
+// Body of the listing; counts are filled in along the way
+
+static void list_trace(FILE *f, trace_counts_t *cnt) {
+    const host_trace_t *t, *next;
+    reg_info_t info;
+    unsigned int x, n, seq = 0;
+
+    memset(cnt, 0, sizeof (*cnt));
+    for (x = 0; x < host_trace_nr && x < HOST_TRACE_MAX; ++x) {
+        t = &host_trace_log[x];
+        if (t->op == HOST_TRACE_SPIN) {
+            for (n = 1; x + 1 < host_trace_nr && x + 1 < HOST_TRACE_MAX &&
+                    host_trace_log[x + 1].op == HOST_TRACE_SPIN; ++x)
+                ++n;
+            fprintf(f, "     spin x%u\n", n);
+            cnt->nr_spin += n;
+            continue;
+        }
+
+        reg_lookup(t->off, &info);
+        next = (x + 1 < host_trace_nr && x + 1 < HOST_TRACE_MAX) ?
+                &host_trace_log[x + 1] : NULL;
+        fprintf(f, "%04u ", seq++);
+        if (t->op == HOST_TRACE_R && next && next->op == HOST_TRACE_W &&
+                next->off == t->off) {
+            fprintf(f, "RMW  %-36s ", info.name);
+            print_val(f, &info, t->val);
+            fprintf(f, " -> ");
+            print_val(f, &info, next->val);
+            ++cnt->nr_rmw;
+            if (info.w1) {
+                fprintf(f, "  rmw-w1");
+                ++cnt->nr_rmw_w1;
+            } else if (next->val == t->val) {
+                fprintf(f, "  noop-rmw");
+                ++cnt->nr_noop_rmw;
+            }
+            ++x;
+        } else {
+            fprintf(f, "%-4s %-36s ", (t->op == HOST_TRACE_R) ? "R" : "W", info.name);
+            print_val(f, &info, t->val);
+            if (t->op == HOST_TRACE_R)
+                ++cnt->nr_r;
+            else
+                ++cnt->nr_w;
+        }
+        fprintf(f, "\n");
+    }
+}
+
+/*
+ * Compare the trace just taken against its golden copy, or replace the
+ * latter if update is set
+ */
+static void check_trace(const char *tag, const char *what, bool update) {
+    char path[128], *live = NULL, *body = NULL, gold[65536];
+    size_t live_len = 0, body_len = 0, gold_len, len;
+    const char *l, *g;
+    trace_counts_t cnt;
+    unsigned int line;
+    FILE *f;
+
+    CHECK(host_trace_nr <= HOST_TRACE_MAX);
+    f = open_memstream(&body, &body_len);
+    list_trace(f, &cnt);
+    fclose(f);
+    f = open_memstream(&live, &live_len);
+    fprintf(f, "# %s: R=%u W=%u RMW=%u spins=%u; rmw-w1=%u noop-rmw=%u\n", what,
+            cnt.nr_r, cnt.nr_w, cnt.nr_rmw, cnt.nr_spin, cnt.nr_rmw_w1, cnt.nr_noop_rmw);
+    fputs(body, f);
+    fclose(f);
+    printf("regtrace: %.*s\n", (int) strcspn(live + 2, "\n"), live + 2);
+    free(body);
+
+    snprintf(path, sizeof (path), GOLDEN "%s.trace", tag);
+    if (update) {
+        f = fopen(path, "w");
+        CHECK(f != NULL);
+        if (f != NULL) {
+            fputs(live, f);
+            fclose(f);
+        }
+        free(live);
+        return;
+    }
+
+    f = fopen(path, "r");
+    CHECK(f != NULL);
+    if (f == NULL) {
+        free(live);
+        return;
+    }
+    gold_len = fread(gold, 1, sizeof (gold) - 1, f);
+    gold[gold_len] = '\0';
+    fclose(f);
+
+    // Report the first access that differs; the header only if none does.
+    if (strcmp(live, gold) != 0) {
+        l = strchr(live, '\n');
+        g = strchr(gold, '\n');
+        for (line = 2; l != NULL && g != NULL; ++line) {
+            ++l;
+            ++g;
+            len = strcspn(l, "\n");
+            if (len != strcspn(g, "\n") || memcmp(l, g, len) != 0)
+                break;
+            l = strchr(l, '\n');
+            g = strchr(g, '\n');
+        }
+        if (l == NULL || g == NULL) {
+            line = 1;
+            l = live;
+            g = gold;
+        }
+        fprintf(stderr, "regtrace: %s: line %u differs from %s (./test_regtrace -u to accept)\n"
+                "  golden: %.*s\n  live:   %.*s\n", what, line, path,
+                (int) strcspn(g, "\n"), g, (int) strcspn(l, "\n"), l);
+        test_fail(__FILE__, __LINE__, tag);
+    }
+    free(live);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+// The recorder itself: order, values, read-modify-writes and spins
+
+static void test_recorder(void) {
+    host_reset();
+    if (!host_trace_start())
+        return;
+    PM_REGS->PM_PLCFG = 0x02;
+    PORT_SEC_REGS->GROUP[0].PORT_PINCFG[19] |= (1 << 1);
+    asm("nop");
+    asm("nop");
+    (void) GCLK_REGS->GCLK_PCHCTRL[4];
+    host_trace_stop();
+
+    CHECK_EQ(host_trace_nr, 6);
+    CHECK_EQ(host_trace_log[0].op, HOST_TRACE_W);
+    CHECK_EQ(host_trace_log[0].off, offsetof(host_periph_t, pm.PM_PLCFG));
+    CHECK_EQ(host_trace_log[0].val, 0x02);
+    CHECK_EQ(host_trace_log[1].op, HOST_TRACE_R);
+    CHECK_EQ(host_trace_log[2].op, HOST_TRACE_W);
+    CHECK_EQ(host_trace_log[2].off, offsetof(host_periph_t, port.GROUP[0].PORT_PINCFG[19]));
+    CHECK_EQ(host_trace_log[2].val & 0xFF, 0x02);
+    CHECK_EQ(host_trace_log[3].op, HOST_TRACE_SPIN);
+    CHECK_EQ(host_trace_log[4].op, HOST_TRACE_SPIN);
+    CHECK_EQ(host_trace_log[5].op, HOST_TRACE_R);
+    CHECK_EQ(host_trace_log[5].off, offsetof(host_periph_t, gclk.GCLK_PCHCTRL[4]));
+
+    // Untraced accesses are not logged.
+    PM_REGS->PM_PLCFG = 0x00;
+    CHECK_EQ(host_trace_nr, 6);
+}
+
+int main(int argc, char **argv) {
+    bool update = (argc > 1 && strcmp(argv[1], "-u") == 0);
+
+    test_recorder();
+
+    host_reset();
+    ready_preset();
+    host_poll_hook = ready_poll;
+    if (!host_trace_start()) {
+        printf("regtrace: no access tracing on this host; skipped\n");
+        return test_result("regtrace");
+    }
+    platform_init();
+    host_trace_stop();
+    check_trace("init", "platform_init()", update);
+
+    // The platform's share of one pass of the main loop in main.c
+    host_trace_start();
+    platform_do_loop_one();
+    platform_blink_modify();
+    host_trace_stop();
+    check_trace("loop", "platform_do_loop_one() + platform_blink_modify()", update);
+
+    return test_result("regtrace");
+}
@@ -0,0 +1,212 @@
+/**
+ * @file tests/host/test_sync.c
+ * @brief Host tests, posted-write slot bookkeeping
+ */
+
+#include <string.h>
+
+#include "test.h"
+#include "../../platform/sync.c"
+
+/////////////////////////////////////////////////////////////////////////////
+
+/// Stand-ins for the SYNCBUSY registers of several peripherals
+static volatile uint32_t busy[NR_SYNC_SLOTS + 1];
+
+static void reset(void) {
+    host_reset();
+    memset((void *) busy, 0, sizeof (busy));
+    memset(sync_slots, 0, sizeof (sync_slots));
+    memset(&sync_stats, 0, sizeof (sync_stats));
+
+    // SysTick running as set up by platform_systick_init()
+    SysTick->LOAD = 59999;
+    SysTick->VAL = 1000;
+    SysTick->CTRL = 0x7;
+}
+
+static unsigned int nr_used(void) {
+    unsigned int x, n = 0;
+
+    for (x = 0; x < NR_SYNC_SLOTS; ++x) {
+        if (sync_slots[x].syncbusy != NULL)
+            ++n;
+    }
+    return n;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+// Synchronization already over by the time of the wait
+
+static void test_elided(void) {
+    reset();
+    sync_post(&busy[0], 1 << 1);
+    CHECK_EQ(sync_stats.nr_posted, 1);
+    CHECK_EQ(nr_used(), 1);
+
+    SysTick->VAL = 990;
+    sync_wait(&busy[0], 1 << 1);
+    CHECK_EQ(sync_stats.nr_elided, 1);
+    CHECK_EQ(sync_stats.nr_stalls, 0);
+    CHECK_EQ(sync_stats.cycles_saved, 10);
+    CHECK_EQ(nr_used(), 0);
+
+    // Credit is capped at the worst-case synchronization time
+    sync_post(&busy[0], 1 << 1);
+    SysTick->VAL = 100;
+    sync_wait(&busy[0], 1 << 1);
+    CHECK_EQ(sync_stats.nr_elided, 2);
+    CHECK_EQ(sync_stats.cycles_saved, 10 + SYNC_CYCLES_MAX);
+}
+
+// SysTick wrapping around between post and wait
+
+static void test_wrap(void) {
+    reset();
+    SysTick->VAL = 5;
+    sync_post(&busy[0], 1 << 0);
+    SysTick->VAL = 59990;
+    sync_wait(&busy[0], 1 << 0);
+    CHECK_EQ(sync_stats.cycles_saved, 15);
+}
+
+// No cycles are credited for posts made before SysTick was started
+
+static void test_untimed(void) {
+    reset();
+    SysTick->CTRL = 0;
+    sync_post(&busy[0], 1 << 0);
+    CHECK(!sync_slots[0].timed);
+
+    SysTick->CTRL = 0x7;
+    SysTick->VAL = 500;
+    sync_wait(&busy[0], 1 << 0);
+    CHECK_EQ(sync_stats.nr_elided, 1);
+    CHECK_EQ(sync_stats.cycles_saved, 0);
+}
+
+// Waiting on bits or registers with nothing posted is free
+
+static void test_unposted(void) {
+    reset();
+    sync_post(&busy[0], 1 << 1);
+    busy[0] = 1 << 1;
+
+    sync_wait(&busy[0], 1 << 2);
+    sync_wait(&busy[1], 1 << 1);
+    CHECK_EQ(sync_stats.nr_elided, 0);
+    CHECK_EQ(sync_stats.nr_stalls, 0);
+    CHECK_EQ(sync_slots[0].pending, 1 << 1);
+
+    // Only the bits waited on are retired
+    sync_post(&busy[0], 1 << 2);
+    CHECK_EQ(nr_used(), 1);
+    CHECK_EQ(sync_slots[0].pending, (1 << 1) | (1 << 2));
+    sync_wait(&busy[0], 1 << 2);
+    CHECK_EQ(sync_stats.nr_elided, 1);
+    CHECK_EQ(sync_slots[0].pending, 1 << 1);
+    CHECK(sync_slots[0].syncbusy == &busy[0]);
+}
+
+// Still synchronizing at the time of the wait
+
+static unsigned int stall_polls;
+
+static void stall_poll(void) {
+    if (++stall_polls == 3)
+        busy[0] = 0;
+}
+
+static void test_stall(void) {
+    reset();
+    busy[0] = 1 << 0;
+    sync_post(&busy[0], 1 << 0);
+
+    SysTick->VAL = 900;
+    stall_polls = 0;
+    host_poll_hook = stall_poll;
+    sync_wait(&busy[0], 1 << 0);
+    CHECK_EQ(stall_polls, 3);
+    CHECK_EQ(sync_stats.nr_stalls, 1);
+    CHECK_EQ(sync_stats.nr_elided, 0);
+    CHECK_EQ(sync_stats.cycles_saved, 100);
+    CHECK_EQ(nr_used(), 0);
+}
+
+// All slots in flight: the next post blocks instead, and is not counted
+
+static unsigned int full_polls;
+
+static void full_poll(void) {
+    if (++full_polls == 2)
+        busy[NR_SYNC_SLOTS] = 0;
+}
+
+static void test_full(void) {
+    unsigned int x;
+
+    reset();
+    for (x = 0; x < NR_SYNC_SLOTS; ++x) {
+        busy[x] = 1 << 0;
+        sync_post(&busy[x], 1 << 0);
+    }
+    CHECK_EQ(nr_used(), NR_SYNC_SLOTS);
+    CHECK_EQ(sync_stats.nr_posted, NR_SYNC_SLOTS);
+
+    busy[NR_SYNC_SLOTS] = 1 << 0;
+    full_polls = 0;
+    host_poll_hook = full_poll;
+    sync_post(&busy[NR_SYNC_SLOTS], 1 << 0);
+    CHECK_EQ(full_polls, 2);
+    CHECK_EQ(sync_stats.nr_posted, NR_SYNC_SLOTS);
+    CHECK(sync_find(&busy[NR_SYNC_SLOTS]) == NULL);
+
+    sync_wait(&busy[NR_SYNC_SLOTS], 1 << 0);
+    CHECK_EQ(sync_stats.nr_elided, 0);
+    CHECK_EQ(sync_stats.nr_stalls, 0);
+}
+
+// Finished writes nobody waited on give up their slots, uncounted
+
+static void test_reclaim(void) {
+    unsigned int x;
+
+    reset();
+    for (x = 0; x < NR_SYNC_SLOTS; ++x) {
+        busy[x] = 1 << 0;
+        sync_post(&busy[x], 1 << 0);
+    }
+    busy[3] = 0;
+
+    sync_post(&busy[NR_SYNC_SLOTS], 1 << 0);
+    CHECK_EQ(sync_stats.nr_posted, NR_SYNC_SLOTS + 1);
+    CHECK_EQ(sync_stats.nr_elided, 0);
+    CHECK(sync_find(&busy[3]) == NULL);
+    CHECK(sync_find(&busy[NR_SYNC_SLOTS]) != NULL);
+    CHECK_EQ(nr_used(), NR_SYNC_SLOTS);
+}
+
+static void test_get_stats(void) {
+    platform_sync_stats_t stats;
+
+    reset();
+    sync_post(&busy[0], 1 << 0);
+    sync_wait(&busy[0], 1 << 0);
+    platform_sync_get_stats(&stats);
+    CHECK_EQ(stats.nr_posted, 1);
+    CHECK_EQ(stats.nr_elided, 1);
+    platform_sync_get_stats(NULL);
+}
+
+int main(void) {
+    test_elided();
+    test_wrap();
+    test_untimed();
+    test_unposted();
+    test_stall();
+    test_full();
+    test_reclaim();
+    test_get_stats();
+    return test_result("sync");
+}
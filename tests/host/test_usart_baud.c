@@ -0,0 +1,103 @@
+/**
+ * @file tests/host/test_usart_baud.c
+ * @brief Host tests, auto-baud rate computation and rate changes
+ */
+
+#include "test.h"
+#include "../../platform/usart.c"
+
+// Linked from the rest of the platform code
+extern void platform_pclk_init(void);
+extern void platform_systick_init(void);
+
+/////////////////////////////////////////////////////////////////////////////
+
+#define NR_RATES	(sizeof (usart_baud_table) / sizeof (usart_baud_table[0]))
+
+/// SysTick counts per microsecond, as set up by platform_systick_init()
+#define PER_US		12
+
+// SysTick counts over eight bit times at a given (actual) rate
+
+static uint32_t span_at(double baud) {
+    return (uint32_t) (8.0 * 1000000.0 * PER_US / baud + 0.5);
+}
+
+static void reset(void) {
+    host_reset();
+    platform_pclk_init();
+    platform_systick_init();
+    platform_usart_init();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+static void test_snap(void) {
+    unsigned int x;
+    uint32_t nominal;
+
+    for (x = 0; x < NR_RATES; ++x) {
+        nominal = usart_baud_table[x];
+        CHECK_EQ(usart_baud_snap(nominal), nominal);
+        CHECK_EQ(usart_baud_snap(nominal + nominal / 25), nominal);
+        CHECK_EQ(usart_baud_snap(nominal - nominal / 25), nominal);
+        CHECK_EQ(usart_baud_snap(nominal + nominal / 10), 0);
+        CHECK_EQ(usart_baud_snap(nominal - nominal / 10), 0);
+    }
+    CHECK_EQ(usart_baud_snap(0), 0);
+    CHECK_EQ(usart_baud_snap(4800), 0);
+    CHECK_EQ(usart_baud_snap(460800), 0);
+}
+
+// From the measured edge span, across the whole table and host clock error
+
+static void test_measure(void) {
+    static const double skew[] = {1.0, 0.98, 1.02, 0.96, 1.04};
+    unsigned int x, y;
+    uint32_t nominal;
+
+    for (x = 0; x < NR_RATES; ++x) {
+        nominal = usart_baud_table[x];
+        for (y = 0; y < sizeof (skew) / sizeof (skew[0]); ++y)
+            CHECK_EQ(usart_autobaud_rate(span_at(nominal * skew[y]), PER_US), nominal);
+        CHECK_EQ(usart_autobaud_rate(span_at(nominal * 1.08), PER_US), 0);
+        CHECK_EQ(usart_autobaud_rate(span_at(nominal * 0.92), PER_US), 0);
+    }
+    CHECK_EQ(usart_autobaud_rate(0, PER_US), 0);
+    CHECK_EQ(usart_autobaud_rate(0xFFFFFFFF, PER_US), 0);
+}
+
+// Locking in a rate programs SERCOM_BAUD and rescales the receive timing
+
+static void test_set_baud(void) {
+    platform_timespec_t gap = {0, 1000000};
+    unsigned int x;
+
+    reset();
+    CHECK_EQ(usart_systick_per_us(), PER_US);
+    CHECK_EQ(usart_baud_reg(PLATFORM_USART_CDC_BAUD), 0xC505);
+    for (x = 0; x < NR_RATES; ++x) {
+        usart_set_baud(&ctx_uart, usart_baud_table[x], false);
+        CHECK_EQ(platform_usart_cdc_get_baud(), usart_baud_table[x]);
+        CHECK_EQ(ctx_uart.regs->SERCOM_BAUD, usart_baud_reg(usart_baud_table[x]));
+        CHECK_EQ(ctx_uart.cfg.ts_idle_timeout.nr_nsec,
+                54000000000ULL / usart_baud_table[x]);
+        CHECK(ctx_uart.regs->SERCOM_CTRLA & (1 << 1));
+    }
+
+    // User timing stays the same number of bit times.
+    usart_set_baud(&ctx_uart, 57600, false);
+    platform_usart_cdc_set_timing(NULL, &gap);
+    usart_set_baud(&ctx_uart, 115200, false);
+    CHECK_EQ(ctx_uart.cfg.ts_gap_timeout.nr_nsec, 500000);
+    CHECK_EQ(ctx_uart.cfg.ts_idle_timeout.nr_nsec, 937500 / 2);
+    usart_set_baud(&ctx_uart, 9600, false);
+    CHECK_EQ(ctx_uart.cfg.ts_gap_timeout.nr_nsec, 6000000);
+}
+
+int main(void) {
+    test_snap();
+    test_measure();
+    test_set_baud();
+    return test_result("usart_baud");
+}
@@ -0,0 +1,211 @@
+/**
+ * @file tests/host/test_usart_bist.c
+ * @brief Host tests, PRBS-15 pattern and loopback self-test
+ */
+
+#include "test.h"
+#include "../../platform/usart.c"
+#include "usart_sim.h"
+
+/////////////////////////////////////////////////////////////////////////////
+
+/*
+ * SERCOM3 in internal loopback, and SysTick
+ *
+ * Each host_poll() is one pass of the self-test's loop, LOOP_NS long. A
+ * byte written to DATA is shifted out for a character time, then looped
+ * back to RX, but only while CTRLA.RXPO selects loopback (PAD[0]). As in
+ * usart_sim.h, a pass shows either RXC or DRE, never both.
+ */
+extern void SysTick_Handler(void);
+
+#define LOOP_NS		2000UL
+#define SYSTICK_NS	(PLATFORM_TICK_PERIOD_US * 1000UL)
+
+static uint32_t lb_ns;			// Time within the current SysTick period
+static bool lb_shifting;
+static uint32_t lb_shift_ns;		// Shift time left for the byte in flight
+static uint8_t lb_byte;
+static bool lb_rx;			// Byte waiting in RX
+
+/// Loopback bytes to corrupt or drop, counted from the start of the run
+static unsigned int lb_nr_bytes;
+static unsigned int lb_flip_at, lb_drop_at;
+
+static void lb_poll(void) {
+    sercom_usart_int_registers_t *regs = &SERCOM3_REGS->USART_INT;
+    uint32_t baud = ctx_uart.cfg.baud;
+
+    // Time
+    lb_ns += LOOP_NS;
+    if (lb_ns >= SYSTICK_NS) {
+        lb_ns -= SYSTICK_NS;
+        SysTick_Handler();
+    }
+    SysTick->VAL = SysTick->LOAD - (lb_ns * 12) / 1000;
+
+    // What the last pass did with DATA
+    if ((regs->SERCOM_INTFLAG & (1 << 2)) != 0)
+        lb_rx = false;
+    else if ((regs->SERCOM_INTFLAG & (1 << 0)) != 0 && regs->SERCOM_DATA != 0x1FF) {
+        lb_byte = (uint8_t) regs->SERCOM_DATA;
+        lb_shifting = true;
+        lb_shift_ns = (uint32_t) ((PLATFORM_USART_CDC_CHAR_BITS * 1000000000ULL) / baud);
+    }
+
+    if (lb_shifting && !lb_rx) {
+        if (lb_shift_ns > LOOP_NS) {
+            lb_shift_ns -= LOOP_NS;
+        } else {
+            lb_shifting = false;
+            if ((regs->SERCOM_CTRLA & RF_MASK(RF_USART_CTRLA_RXPO)) == 0) {
+                if (lb_nr_bytes == lb_flip_at)
+                    lb_byte ^= 0x10;
+                lb_rx = (lb_nr_bytes != lb_drop_at);
+            }
+            ++lb_nr_bytes;
+        }
+    }
+
+    if (lb_rx) {
+        regs->SERCOM_INTFLAG = (1 << 2);
+        regs->SERCOM_DATA = 0x100 | lb_byte;
+    } else {
+        regs->SERCOM_INTFLAG = lb_shifting ? 0 : (1 << 0);
+        regs->SERCOM_DATA = 0x1FF;
+    }
+    regs->SERCOM_STATUS = 0;
+}
+
+static void lb_reset(void) {
+    sim_reset();
+    SERCOM3_REGS->USART_INT.SERCOM_DATA = 0x1FF;
+    host_poll_hook = lb_poll;
+    SysTick->VAL = SysTick->LOAD;
+    lb_ns = 0;
+    lb_shifting = lb_rx = false;
+    lb_nr_bytes = 0;
+    lb_flip_at = lb_drop_at = ~0u;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+// Reference PRBS-15, one bit at a time, MSB first within each byte
+
+static uint8_t ref_prbs15(uint16_t *lfsr) {
+    uint8_t out = 0;
+    unsigned int x;
+
+    for (x = 0; x < 8; ++x) {
+        uint16_t bit = ((*lfsr >> 14) ^ (*lfsr >> 13)) & 1;
+
+        *lfsr = (uint16_t) (((*lfsr << 1) | bit) & 0x7FFF);
+        out = (uint8_t) ((out << 1) | bit);
+    }
+    return out;
+}
+
+static void test_prbs(void) {
+    uint16_t lfsr = 0x7FFF, ref = 0x7FFF, first = 0;
+    unsigned long ones = 0, k, period = 0, nr_diff = 0;
+    uint8_t b;
+
+    /*
+     * 32767 is odd, so the byte sequence repeats when the bit sequence
+     * does: the state is back only after 32767 bytes, never before.
+     */
+    for (k = 1; k <= 2 * 32767UL; ++k) {
+        b = usart_prbs15(&lfsr);
+        if (b != ref_prbs15(&ref))
+            ++nr_diff;
+        if (k == 1)
+            first = b;
+        if (k <= 32767) {
+            for (; b != 0; b &= b - 1)
+                ++ones;
+        }
+        if (lfsr == 0x7FFF && period == 0)
+            period = k;
+    }
+    CHECK_EQ(nr_diff, 0);
+    CHECK_EQ(period, 32767);
+    CHECK_EQ(lfsr, 0x7FFF);
+
+    // A maximal-length sequence has one more 1 than 0s per period (x 8).
+    CHECK_EQ(ones, 8UL * 16384);
+    CHECK_EQ(first, usart_prbs15(&lfsr));
+}
+
+static void test_bist(void) {
+    platform_usart_bist_result_t res[PLATFORM_USART_BIST_NR_RATES + 1];
+    unsigned int x;
+
+    lb_reset();
+    CHECK_EQ(platform_usart_cdc_bist(res, PLATFORM_USART_BIST_NR_RATES + 1),
+            PLATFORM_USART_BIST_NR_RATES);
+    for (x = 0; x < PLATFORM_USART_BIST_NR_RATES; ++x) {
+        CHECK_EQ(res[x].baud, usart_baud_table[x]);
+        CHECK_EQ(res[x].nr_bytes, USART_BIST_LEN);
+        CHECK_EQ(res[x].nr_err, 0);
+
+        // One byte at a time through the model: close to baud / 11
+        CHECK(res[x].bytes_per_sec * 12 > res[x].baud * 10 / 11);
+        CHECK(res[x].bytes_per_sec * PLATFORM_USART_CDC_CHAR_BITS <= res[x].baud);
+    }
+    CHECK_EQ(lb_nr_bytes, PLATFORM_USART_BIST_NR_RATES * USART_BIST_LEN);
+
+    // Back to the pins and the original rate
+    CHECK_EQ(ctx_uart.cfg.baud, PLATFORM_USART_CDC_BAUD);
+    CHECK_EQ(SERCOM3_REGS->USART_INT.SERCOM_CTRLA & RF_MASK(RF_USART_CTRLA_RXPO),
+            0x1u << RF_POS(RF_USART_CTRLA_RXPO));
+    CHECK_EQ(SERCOM3_REGS->USART_INT.SERCOM_BAUD, usart_baud_reg(PLATFORM_USART_CDC_BAUD));
+}
+
+// Corruption and loss are reported against the rate they happened at.
+
+static void test_errors(void) {
+    platform_usart_bist_result_t res[PLATFORM_USART_BIST_NR_RATES];
+    platform_usart_rx_async_desc_t rxd;
+    char buf[4];
+    unsigned int x;
+
+    lb_reset();
+    lb_flip_at = 2 * USART_BIST_LEN + 17;
+    CHECK_EQ(platform_usart_cdc_bist(res, PLATFORM_USART_BIST_NR_RATES),
+            PLATFORM_USART_BIST_NR_RATES);
+    for (x = 0; x < PLATFORM_USART_BIST_NR_RATES; ++x) {
+        CHECK_EQ(res[x].nr_bytes, USART_BIST_LEN);
+        CHECK_EQ(res[x].nr_err, (x == 2) ? 1 : 0);
+    }
+
+    // A lost byte: the rate times out one short, and everything after slips.
+    lb_reset();
+    lb_drop_at = 4 * USART_BIST_LEN + 60;
+    CHECK_EQ(platform_usart_cdc_bist(res, PLATFORM_USART_BIST_NR_RATES),
+            PLATFORM_USART_BIST_NR_RATES);
+    for (x = 0; x < PLATFORM_USART_BIST_NR_RATES; ++x) {
+        CHECK_EQ(res[x].nr_bytes, (x == 4) ? USART_BIST_LEN - 1 : USART_BIST_LEN);
+        if (x == 4)
+            CHECK(res[x].nr_err >= 1);
+        else
+            CHECK_EQ(res[x].nr_err, 0);
+    }
+    CHECK(!platform_usart_cdc_rx_busy());
+    CHECK(!platform_usart_cdc_tx_busy());
+
+    // Refused while busy, or with nowhere to put results
+    CHECK_EQ(platform_usart_cdc_bist(NULL, 1), 0);
+    memset(&rxd, 0, sizeof (rxd));
+    rxd.buf = buf;
+    rxd.max_len = sizeof (buf);
+    CHECK(platform_usart_cdc_rx_async(&rxd));
+    CHECK_EQ(platform_usart_cdc_bist(res, 1), 0);
+    CHECK_EQ(ctx_uart.cfg.baud, PLATFORM_USART_CDC_BAUD);
+}
+
+int main(void) {
+    test_prbs();
+    test_bist();
+    test_errors();
+    return test_result("usart_bist");
+}
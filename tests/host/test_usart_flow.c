@@ -0,0 +1,180 @@
+/**
+ * @file tests/host/test_usart_flow.c
+ * @brief Host tests, XON/XOFF flow control
+ */
+
+#include "test.h"
+#include "../../platform/usart.c"
+#include "usart_sim.h"
+
+/////////////////////////////////////////////////////////////////////////////
+
+static const platform_usart_flow_cfg_t flow = {.xoff_room = 4, .xon_room = 10};
+
+static char buf[16];
+static platform_usart_rx_async_desc_t rx;
+
+static void reset(void) {
+    sim_reset();
+    CHECK(platform_usart_cdc_set_xonxoff(&flow));
+    memset(&rx, 0, sizeof (rx));
+    rx.buf = buf;
+    rx.max_len = sizeof (buf);
+}
+
+// Number of times a byte was sent so far
+
+static unsigned int nr_sent(uint8_t c) {
+    unsigned int x, n = 0;
+
+    for (x = 0; x < sim_nr_sent; ++x) {
+        if (sim_sent[x] == c)
+            ++n;
+    }
+    return n;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+static void test_cfg(void) {
+    platform_usart_flow_cfg_t cfg = {.xoff_room = 8, .xon_room = 8};
+
+    sim_reset();
+    CHECK(!platform_usart_cdc_set_xonxoff(&cfg));
+    cfg.xon_room = 9;
+    CHECK(platform_usart_cdc_set_xonxoff(&cfg));
+    CHECK(platform_usart_cdc_set_xonxoff(NULL));
+    CHECK(!ctx_uart.flow.enabled);
+}
+
+// XOFF once room drops to the low watermark, XON once back at the high one
+
+static void test_watermarks(void) {
+    unsigned int x;
+
+    reset();
+    CHECK(platform_usart_cdc_rx_async(&rx));
+    for (x = 0; x < 11; ++x) {
+        sim_peer_send("x", 1);
+        sim_tick(200);
+    }
+    CHECK_EQ(nr_sent(USART_XOFF), 0);
+
+    // The 12th byte leaves 4 free; XOFF goes out on the next pass.
+    sim_peer_send("x", 1);
+    sim_tick(200);
+    CHECK(ctx_uart.flow.throttled);
+    sim_tick(200);
+    CHECK_EQ(sim_nr_sent, 1);
+    CHECK_EQ(sim_sent[0], USART_XOFF);
+
+    // The peer's bytes in flight still fit; the buffer fills up.
+    sim_peer_send("yyyy", 4);
+    for (x = 0; x < 4; ++x)
+        sim_tick(200);
+    CHECK_EQ(rx.compl_type, PLATFORM_USART_RX_COMPL_DATA);
+    CHECK_EQ(rx.compl_flags, PLATFORM_USART_RX_FLAG_FULL);
+    CHECK_EQ(rx.compl_info.data_len, 16);
+
+    // No descriptor counts as no room: still throttled.
+    sim_tick(200);
+    sim_tick(200);
+    CHECK_EQ(nr_sent(USART_XON), 0);
+    CHECK_EQ(nr_sent(USART_XOFF), 1);
+
+    CHECK(platform_usart_cdc_rx_async(&rx));
+    sim_tick(200);
+    sim_tick(200);
+    CHECK_EQ(nr_sent(USART_XON), 1);
+    CHECK(!ctx_uart.flow.throttled);
+}
+
+// No XOFF between receptions, nor on an empty buffer
+
+static void test_idle(void) {
+    unsigned int x;
+
+    reset();
+    sim_peer_send("abcdefgh", 8);
+    for (x = 0; x < 10; ++x)
+        sim_tick(200);
+    CHECK_EQ(sim_nr_sent, 0);
+
+    rx.max_len = 4;
+    CHECK(platform_usart_cdc_rx_async(&rx));
+    sim_tick(200);
+    CHECK_EQ(sim_nr_sent, 0);
+}
+
+// XOFF from the peer holds TX from the very next pass; XON resumes it
+
+static void test_pause(void) {
+    static const platform_usart_tx_bufdesc_t msg[] = {{"0123456789", 10}};
+    unsigned int before, x;
+
+    reset();
+    CHECK(platform_usart_cdc_rx_async(&rx));
+    CHECK(platform_usart_cdc_tx_async(msg, 1));
+    for (x = 0; x < 4; ++x)
+        sim_tick(200);
+
+    sim_peer_send("\x13", 1);
+    sim_tick(200);
+    CHECK(ctx_uart.flow.paused);
+    before = sim_nr_sent;
+    for (x = 0; x < 10; ++x)
+        sim_tick(200);
+    CHECK_EQ(sim_nr_sent, before);
+
+    // Flow-control characters still go out while paused.
+    platform_usart_cdc_set_xonxoff(NULL);
+    CHECK(platform_usart_cdc_set_xonxoff(&flow));
+    CHECK(ctx_uart.flow.ctl < 0);
+    ctx_uart.flow.paused = true;
+    ctx_uart.flow.ctl = USART_XON;
+    sim_tick(200);
+    CHECK_EQ(sim_nr_sent, before + 1);
+    CHECK_EQ(sim_sent[before], USART_XON);
+
+    sim_peer_send("\x11", 1);
+    for (x = 0; x < 20; ++x)
+        sim_tick(200);
+    CHECK(!ctx_uart.flow.paused);
+    CHECK_EQ(sim_nr_sent, 10 + 1);
+    CHECK(!platform_usart_cdc_tx_busy());
+
+    // Neither control character made it into the data.
+    CHECK_EQ(ctx_uart.rx.idx, 0);
+}
+
+// Turning flow control off releases a throttled peer
+
+static void test_disable(void) {
+    unsigned int x;
+
+    reset();
+    CHECK(platform_usart_cdc_rx_async(&rx));
+    sim_peer_send("xxxxxxxxxxxx", 12);
+    for (x = 0; x < 13; ++x)
+        sim_tick(200);
+    CHECK_EQ(nr_sent(USART_XOFF), 1);
+
+    CHECK(platform_usart_cdc_set_xonxoff(NULL));
+    sim_tick(200);
+    CHECK_EQ(nr_sent(USART_XON), 1);
+
+    // Control characters are plain data again.
+    sim_peer_send("\x13", 1);
+    sim_tick(200);
+    CHECK_EQ(ctx_uart.rx.idx, 13);
+    CHECK_EQ(buf[12], USART_XOFF);
+}
+
+int main(void) {
+    test_cfg();
+    test_watermarks();
+    test_idle();
+    test_pause();
+    test_disable();
+    return test_result("usart_flow");
+}
@@ -0,0 +1,213 @@
+/**
+ * @file tests/host/test_usart_line.c
+ * @brief Host tests, cooked (line) mode reception and its echo
+ */
+
+#include <stdio.h>
+
+#include "test.h"
+#include "../../platform/usart.c"
+#include "usart_sim.h"
+
+/////////////////////////////////////////////////////////////////////////////
+
+static char buf[16];
+static platform_usart_rx_async_desc_t rx;
+
+/// Sim time at which each byte in sim_sent[] went out, in us
+static uint32_t sent_us[256];
+
+static uint32_t now_us(void) {
+    return sim_now.nr_sec * 1000000UL + sim_now.nr_nsec / 1000;
+}
+
+static void line_start(uint16_t max_len) {
+    memset(buf, 0, sizeof (buf));
+    memset(&rx, 0, sizeof (rx));
+    rx.buf = buf;
+    rx.max_len = max_len;
+    rx.mode = PLATFORM_USART_RX_MODE_LINE;
+    CHECK(platform_usart_cdc_rx_async(&rx));
+}
+
+// Main-loop passes, 100 us apart
+
+static void run(unsigned int n) {
+    unsigned int x;
+
+    while (n-- > 0) {
+        x = sim_nr_sent;
+        sim_tick(100);
+        if (sim_nr_sent > x)
+            sent_us[x] = now_us();
+    }
+}
+
+// Type bytes, each followed by enough passes for its echo to go out
+
+static void type(const char *s) {
+    while (*s != '\0') {
+        sim_peer_send(s++, 1);
+        run(8);
+    }
+}
+
+static bool echoed(const char *s) {
+    return sim_nr_sent == strlen(s) && memcmp(sim_sent, s, sim_nr_sent) == 0;
+}
+
+static bool line_is(const char *s) {
+    return rx.compl_type == PLATFORM_USART_RX_COMPL_DATA &&
+            rx.compl_flags == PLATFORM_USART_RX_FLAG_TERM &&
+            rx.compl_info.data_len == strlen(s) &&
+            memcmp(buf, s, rx.compl_info.data_len) == 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+static void test_edit(void) {
+    sim_reset();
+    line_start(sizeof (buf));
+    type("ab\bc");
+    CHECK(echoed("ab\b \bc"));
+    CHECK(platform_usart_cdc_rx_busy());
+    type("\r");
+    CHECK(line_is("ac"));
+    CHECK(echoed("ab\b \bc\r\n"));
+
+    // DEL too; neither erases past the start of the line.
+    sim_reset();
+    line_start(sizeof (buf));
+    type("\x7F" "x\x7F\x7F" "y\r");
+    CHECK(line_is("y"));
+    CHECK(echoed("x\b \by\r\n"));
+
+    // Line kill
+    sim_reset();
+    line_start(sizeof (buf));
+    type("abc\x15" "d\r");
+    CHECK(line_is("d"));
+    CHECK(echoed("abc\b \b\b \b\b \bd\r\n"));
+
+    // Other control characters are neither stored nor echoed.
+    sim_reset();
+    line_start(sizeof (buf));
+    type("a\x01\x1B" "b\t\r");
+    CHECK(line_is("ab"));
+    CHECK(echoed("ab\r\n"));
+}
+
+// CR LF counts once, CR CR twice, and a lone LF ends a line too
+
+static void test_crlf(void) {
+    sim_reset();
+    line_start(sizeof (buf));
+    type("x\r");
+    CHECK(line_is("x"));
+    line_start(sizeof (buf));
+    type("\n");
+    CHECK(platform_usart_cdc_rx_busy());
+    type("y\n");
+    CHECK(line_is("y"));
+
+    line_start(sizeof (buf));
+    type("\r");
+    CHECK(line_is(""));
+    line_start(sizeof (buf));
+    type("\r");
+    CHECK(line_is(""));
+
+    // Only one LF is swallowed after CR.
+    line_start(sizeof (buf));
+    type("\n\n");
+    CHECK(line_is(""));
+    CHECK(echoed("x\r\ny\r\n\r\n\r\n\r\n"));
+}
+
+// A full buffer rings the bell; only CR/LF ends the line.
+
+static void test_full(void) {
+    sim_reset();
+    line_start(3);
+    type("abcd");
+    CHECK(platform_usart_cdc_rx_busy());
+    type("\be");
+    sim_tick(1000000);
+    CHECK(platform_usart_cdc_rx_busy());
+    type("\r");
+    CHECK(line_is("abe"));
+    CHECK(echoed("abc\a\b \be\r\n"));
+}
+
+/*
+ * Echo latency, from the pass that reads a byte to the one that writes its
+ * echo, in passes of the main loop
+ *
+ * The echo only waits for a fragment boundary, so behind application
+ * output it is as late as the rest of the fragment.
+ */
+static void test_latency(void) {
+    static platform_usart_tx_bufdesc_t tx[2];
+    static const char msg[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+    uint32_t typed, idle, busy_min, busy_max;
+    unsigned int x, at;
+
+    sim_reset();
+    line_start(sizeof (buf));
+    sim_peer_send("k", 1);
+    run(1);
+    typed = now_us();
+    run(4);
+    CHECK(echoed("k"));
+    idle = (sent_us[0] - typed) / 100;
+    CHECK_EQ(idle, 1);
+
+    // Type while two fragments are going out.
+    tx[0].buf = msg;
+    tx[0].len = 18;
+    tx[1].buf = msg + 18;
+    tx[1].len = 18;
+    sim_nr_sent = 0;
+    CHECK(platform_usart_cdc_tx_async(tx, 2));
+    busy_min = UINT32_MAX;
+    busy_max = 0;
+    for (x = 0; x < 6; ++x) {
+        run(x + 1);
+        at = sim_nr_sent;
+        sim_peer_send("#", 1);
+        run(1);
+        typed = now_us();
+        while (sim_nr_sent < sizeof (sim_sent) &&
+                memchr(&sim_sent[at], '#', sim_nr_sent - at) == NULL)
+            run(1);
+        at = (uint8_t *) memchr(&sim_sent[at], '#', sim_nr_sent - at) - sim_sent;
+        if ((sent_us[at] - typed) / 100 < busy_min)
+            busy_min = (sent_us[at] - typed) / 100;
+        if ((sent_us[at] - typed) / 100 > busy_max)
+            busy_max = (sent_us[at] - typed) / 100;
+    }
+    run(40);
+    CHECK_EQ(sim_nr_sent, 36 + 6);
+    CHECK(busy_max <= 18);
+    CHECK(busy_min >= 1);
+
+    // The fragments themselves went out whole, the echo only between them.
+    for (x = 0, at = 0; x < sim_nr_sent; ++x) {
+        if (sim_sent[x] == '#')
+            CHECK_EQ(at % 18, 0);
+        else
+            CHECK_EQ(sim_sent[x], msg[at++]);
+    }
+    CHECK_EQ(at, 36);
+
+    printf("usart_line: echo after %lu pass(es) idle, %lu to %lu behind 18-byte fragments\n",
+            (unsigned long) idle, (unsigned long) busy_min, (unsigned long) busy_max);
+}
+
+int main(void) {
+    test_edit();
+    test_crlf();
+    test_full();
+    test_latency();
+    return test_result("usart_line");
+}
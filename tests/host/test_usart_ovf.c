@@ -0,0 +1,161 @@
+/**
+ * @file tests/host/test_usart_ovf.c
+ * @brief Host tests, receiver overflow reporting and notification
+ */
+
+#include "test.h"
+#include "../../platform/usart.c"
+#include "usart_sim.h"
+
+/////////////////////////////////////////////////////////////////////////////
+
+#define BUFOVF	(1 << 2)
+
+static char buf[8];
+static platform_usart_rx_async_desc_t rx;
+
+static void rx_start(uint16_t len) {
+    memset(buf, '.', sizeof (buf));
+    memset(&rx, 0, sizeof (rx));
+    rx.buf = buf;
+    rx.max_len = sizeof (buf);
+    rx.mode = PLATFORM_USART_RX_MODE_LEN;
+    rx.len = len;
+    CHECK(platform_usart_cdc_rx_async(&rx));
+}
+
+// Feed bytes one pass each; with feed_ovf(), the first carries BUFOVF
+
+static void feed(const char *s, unsigned int n) {
+    sim_peer_send(s, n);
+    while (n-- > 0)
+        sim_tick(100);
+}
+
+static void feed_ovf(const char *s, unsigned int n) {
+    sim_rx_status = BUFOVF;
+    feed(s, n);
+}
+
+static uint32_t nr_ovf(void) {
+    platform_usart_stats_t stats;
+
+    platform_usart_cdc_get_stats(&stats);
+    return stats.nr_ovf;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+// BUFOVF comes with the first byte after the loss, which is kept.
+
+static void test_flag(void) {
+    sim_reset();
+    rx_start(8);
+    feed("ab", 2);
+    CHECK_EQ(rx.compl_flags & PLATFORM_USART_RX_FLAG_OVF, 0);
+    feed_ovf("c", 1);
+    CHECK(rx.compl_flags & PLATFORM_USART_RX_FLAG_OVF);
+    CHECK_EQ(rx.ovf_idx, 2);
+    CHECK_EQ(rx.compl_type, PLATFORM_USART_RX_COMPL_NONE);
+
+    // Only the first overflow is located.
+    feed("de", 2);
+    feed_ovf("f", 1);
+    feed("gh", 2);
+    CHECK_EQ(rx.compl_type, PLATFORM_USART_RX_COMPL_DATA);
+    CHECK(rx.compl_flags & PLATFORM_USART_RX_FLAG_LEN);
+    CHECK(rx.compl_flags & PLATFORM_USART_RX_FLAG_OVF);
+    CHECK_EQ(rx.ovf_idx, 2);
+    CHECK_EQ(rx.compl_info.data_len, 8);
+    CHECK(memcmp(buf, "abcdefgh", 8) == 0);
+
+    // A fresh descriptor starts clean.
+    rx_start(2);
+    feed("ij", 2);
+    CHECK_EQ(rx.compl_flags & PLATFORM_USART_RX_FLAG_OVF, 0);
+    CHECK_EQ(rx.ovf_idx, 0);
+}
+
+// Each overflow is counted, with or without a descriptor
+
+static void test_count(void) {
+    uint32_t before;
+
+    sim_reset();
+    before = nr_ovf();
+    feed_ovf("a", 1);
+    CHECK_EQ(nr_ovf(), before + 1);
+    rx_start(8);
+    feed_ovf("b", 1);
+    feed("c", 1);
+    feed_ovf("d", 1);
+    feed_ovf("e", 1);
+    CHECK_EQ(nr_ovf(), before + 4);
+    CHECK_EQ(rx.ovf_idx, 0);
+    CHECK_EQ(ctx_uart.rx.idx, 4);
+}
+
+// The byte that carries BUFOVF is XON/XOFF: swallowed, but the loss stands.
+
+static void test_flow(void) {
+    sim_reset();
+    CHECK(platform_usart_cdc_set_xonxoff(&(platform_usart_flow_cfg_t) {4, 16}));
+    rx_start(8);
+    feed("ab", 2);
+    feed_ovf("\x13", 1);
+    CHECK(ctx_uart.flow.paused);
+    CHECK_EQ(ctx_uart.rx.idx, 2);
+    CHECK(rx.compl_flags & PLATFORM_USART_RX_FLAG_OVF);
+    CHECK_EQ(rx.ovf_idx, 2);
+    CHECK_EQ(nr_ovf(), 1);
+
+    feed_ovf("\x11", 1);
+    CHECK(!ctx_uart.flow.paused);
+    CHECK_EQ(nr_ovf(), 2);
+    feed("c", 1);
+    CHECK_EQ(buf[2], 'c');
+    CHECK_EQ(rx.ovf_idx, 2);
+}
+
+// The notification goes out before queued fragments, never inside one
+
+static void test_notify(void) {
+    static const platform_usart_tx_bufdesc_t tx[] = {{"HELLO", 5}, {"WORLD", 5}};
+    unsigned int x;
+
+    sim_reset();
+    platform_usart_cdc_set_ovf_notify('!');
+    rx_start(8);
+    CHECK(platform_usart_cdc_tx_async(tx, 2));
+    feed_ovf("a", 1);
+    for (x = 0; x < 20; ++x)
+        sim_tick(100);
+    CHECK_EQ(sim_nr_sent, 11);
+    CHECK(memcmp(sim_sent, "!HELLOWORLD", 11) == 0);
+
+    // Part-way through a fragment: right after it
+    sim_nr_sent = 0;
+    CHECK(platform_usart_cdc_tx_async(tx, 2));
+    sim_tick(100);
+    sim_tick(100);
+    feed_ovf("b", 1);
+    for (x = 0; x < 20; ++x)
+        sim_tick(100);
+    CHECK_EQ(sim_nr_sent, 11);
+    CHECK(memcmp(sim_sent, "HELLO!WORLD", 11) == 0);
+
+    // Off again
+    sim_nr_sent = 0;
+    platform_usart_cdc_set_ovf_notify(-1);
+    feed_ovf("c", 1);
+    sim_tick(100);
+    CHECK_EQ(sim_nr_sent, 0);
+}
+
+int main(void) {
+    test_flag();
+    test_count();
+    test_flow();
+    test_notify();
+    return test_result("usart_ovf");
+}
@@ -0,0 +1,244 @@
+/**
+ * @file tests/host/test_usart_rs485.c
+ * @brief Host tests, RS-485 driver-enable sequencing
+ */
+
+#include <stddef.h>
+
+#include "test.h"
+#include "../../platform/usart.c"
+#include "usart_sim.h"
+
+/////////////////////////////////////////////////////////////////////////////
+
+#define TC1	(&TC1_REGS->COUNT16)
+
+static const platform_usart_rs485_cfg_t cfg_guarded = {
+    .pre_guard_bits = 2, .post_guard_bits = 3, .suppress_echo = true
+};
+
+static const platform_usart_tx_bufdesc_t frame[] = {{"AB", 2}};
+
+// Queue a frame and run ticks until its last byte has been written
+
+static unsigned int send_frame(uint32_t us) {
+    unsigned int nr_ticks = 0;
+
+    CHECK(platform_usart_cdc_tx_async(frame, 1));
+    do {
+        sim_tick(us);
+        ++nr_ticks;
+    } while (!ctx_uart.rs485.txc_armed && nr_ticks < 100);
+    return nr_ticks;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+static void test_setup(void) {
+    platform_usart_rs485_cfg_t cfg = cfg_guarded;
+
+    sim_reset();
+    CHECK(platform_usart_cdc_set_rs485(&cfg));
+    CHECK(platform_pclk_is_on(PLATFORM_PCLK_TC1));
+    CHECK(PORT_SEC_REGS->GROUP[1].PORT_DIRSET & SIM_DE_MASK);
+    CHECK_EQ(TC1->TC_WAVE, 0x1);
+    CHECK_EQ(TC1->TC_INTENSET, 1 << 0);
+
+    // 3 bits at 57600 bps, in 1.5 MHz counts: 78
+    CHECK_EQ(ctx_uart.rs485.post_guard_counts, 78);
+    CHECK_EQ(TC1->TC_CC[0], 77);
+    CHECK_EQ(ctx_uart.rs485.ts_pre_guard.nr_nsec, 2 * (1000000000UL / 57600));
+
+    // Guards follow rate changes.
+    usart_set_baud(&ctx_uart, 9600, false);
+    CHECK_EQ(TC1->TC_CC[0], 467);
+    CHECK_EQ(ctx_uart.rs485.ts_pre_guard.nr_nsec, 2 * (1000000000UL / 9600));
+
+    // Longer than TC1 can time at this rate
+    usart_set_baud(&ctx_uart, 1200, false);
+    cfg.post_guard_bits = 60;
+    CHECK(!platform_usart_cdc_set_rs485(&cfg));
+    cfg.post_guard_bits = 50;
+    CHECK(platform_usart_cdc_set_rs485(&cfg));
+    CHECK_EQ(TC1->TC_CC[0], 62499);
+
+    // Not together with XON/XOFF
+    CHECK(platform_usart_cdc_set_rs485(NULL));
+    CHECK(!platform_pclk_is_on(PLATFORM_PCLK_TC1));
+    CHECK_EQ(TC1->TC_INTENCLR, 1 << 0);
+    CHECK(platform_usart_cdc_set_xonxoff(&(platform_usart_flow_cfg_t) {4, 16}));
+    CHECK(!platform_usart_cdc_set_rs485(&cfg_guarded));
+}
+
+// DE up, pre-guard, data, TXC, post-guard on TC1, DE down
+
+static void test_sequence(void) {
+    platform_usart_rx_async_desc_t rx = {0};
+    char buf[8];
+    unsigned int x;
+
+    sim_reset();
+    CHECK(platform_usart_cdc_set_rs485(&cfg_guarded));
+    rx.buf = buf;
+    rx.max_len = sizeof (buf);
+    CHECK(platform_usart_cdc_rx_async(&rx));
+
+    // Nothing to send: DE stays down.
+    sim_tick(5);
+    CHECK(!sim_de);
+
+    CHECK(platform_usart_cdc_tx_async(frame, 1));
+    CHECK(platform_usart_cdc_tx_busy());
+    sim_tick(5);
+    CHECK(sim_de);
+    CHECK_EQ(sim_nr_sent, 0);
+
+    // The pre-guard (34.7 us) holds the first byte back.
+    sim_tick(20);
+    CHECK_EQ(sim_nr_sent, 0);
+    for (x = 0; x < 10 && sim_nr_sent < 2; ++x)
+        sim_tick(20);
+    CHECK_EQ(sim_nr_sent, 2);
+    CHECK(memcmp(sim_sent, "AB", 2) == 0);
+    CHECK(sim_de);
+
+    // Wait for TXC once the last byte is in the shifter.
+    sim_tick(200);
+    CHECK(ctx_uart.rs485.txc_armed);
+    CHECK_EQ(ctx_uart.regs->SERCOM_INTENSET, 1 << 1);
+    CHECK(platform_usart_cdc_tx_busy());
+
+    // Our own bytes coming back are dropped while DE is up.
+    sim_peer_send("AB", 2);
+    sim_tick(5);
+    sim_tick(5);
+    CHECK_EQ(ctx_uart.rx.idx, 0);
+
+    // TXC: DE stays up, TC1 is started for the post-guard.
+    sim_irq(SERCOM3_1_Handler);
+    CHECK(sim_de);
+    CHECK_EQ(ctx_uart.regs->SERCOM_INTENCLR, 1 << 1);
+    CHECK_EQ(TC1->TC_CTRLBSET, 0x1 << 5);
+
+    // TC1 overflow: DE is released.
+    sim_irq(TC1_Handler);
+    CHECK(!sim_de);
+    CHECK_EQ(TC1->TC_INTFLAG, 1 << 0);
+    CHECK_EQ(PORT_IOBUS_SEC_REGS->GROUP[1].PORT_OUTSET, 0);
+    CHECK(!ctx_uart.rs485.de);
+    CHECK(!platform_usart_cdc_tx_busy());
+
+    // With DE down, the peer is heard again.
+    sim_peer_send("Z", 1);
+    sim_tick(5);
+    CHECK_EQ(ctx_uart.rx.idx, 1);
+    CHECK_EQ(buf[0], 'Z');
+    CHECK(!sim_de);
+}
+
+// Without a post-guard, TXC releases DE right away
+
+static void test_no_post_guard(void) {
+    platform_usart_rs485_cfg_t cfg = {.pre_guard_bits = 0, .post_guard_bits = 0};
+
+    sim_reset();
+    CHECK(platform_usart_cdc_set_rs485(&cfg));
+    CHECK_EQ(ctx_uart.rs485.post_guard_counts, 0);
+
+    TC1->TC_CTRLBSET = 0;
+    CHECK(send_frame(5) <= 4);
+    CHECK_EQ(sim_nr_sent, 2);
+    CHECK(sim_de);
+
+    sim_irq(SERCOM3_1_Handler);
+    CHECK(!sim_de);
+    CHECK_EQ(TC1->TC_CTRLBSET, 0);
+    CHECK(!platform_usart_cdc_tx_busy());
+
+    // A new burst raises DE again.
+    sim_nr_sent = 0;
+    send_frame(5);
+    CHECK(sim_de);
+    CHECK_EQ(sim_nr_sent, 2);
+}
+
+/// Whether the trace holds an access to the given SERCOM3 register
+#define TRACED(op, reg) \
+    traced(op, offsetof(host_periph_t, sercom[3].USART_INT.reg))
+
+static bool traced(int op, uint32_t off) {
+    unsigned int x;
+
+    for (x = 0; x < host_trace_nr && x < HOST_TRACE_MAX; ++x) {
+        if (host_trace_log[x].op == op && host_trace_log[x].off == off)
+            return true;
+    }
+    return false;
+}
+
+/*
+ * The echo of the last byte, and a framing error from the turnaround, are
+ * pending when TXC fires. Neither handler touches DATA or STATUS; the next
+ * tick drops the echo and clears STATUS.
+ */
+static void test_echo_at_txc(void) {
+    sercom_usart_int_registers_t *regs = &SERCOM3_REGS->USART_INT;
+    platform_usart_rx_async_desc_t rx = {0};
+    bool trace;
+    char buf[8];
+
+    sim_reset();
+    CHECK(platform_usart_cdc_set_rs485(&cfg_guarded));
+    rx.buf = buf;
+    rx.max_len = sizeof (buf);
+    CHECK(platform_usart_cdc_rx_async(&rx));
+    send_frame(20);
+    CHECK_EQ(sim_nr_sent, 2);
+
+    regs->SERCOM_INTFLAG = (1 << 2) | (1 << 1);
+    regs->SERCOM_DATA = 0x100 | 'B';
+    regs->SERCOM_STATUS = (1 << 1);
+    trace = host_trace_start();
+    SERCOM3_1_Handler();
+    regs->SERCOM_INTFLAG = (1 << 2);	// Write-one-to-clear: RXC stays up
+    TC1_Handler();
+    host_trace_stop();
+    sim_de_fold();
+    CHECK(!sim_de);
+    CHECK(ctx_uart.rs485.drain);
+    CHECK_EQ(regs->SERCOM_DATA, 0x100 | 'B');
+    CHECK_EQ(regs->SERCOM_STATUS, 1 << 1);
+    if (trace) {
+        CHECK(!TRACED(HOST_TRACE_R, SERCOM_DATA));
+        CHECK(!TRACED(HOST_TRACE_W, SERCOM_DATA));
+        CHECK(!TRACED(HOST_TRACE_R, SERCOM_STATUS));
+        CHECK(!TRACED(HOST_TRACE_W, SERCOM_STATUS));
+    }
+
+    // The next pass: the echo is still there, and dropped.
+    regs->SERCOM_INTFLAG = (1 << 0);
+    sim_peer_send("B", 1);
+    trace = host_trace_start();
+    sim_tick(5);
+    host_trace_stop();
+    CHECK(!ctx_uart.rs485.drain);
+    CHECK_EQ(ctx_uart.rx.idx, 0);
+    CHECK_EQ(rx.compl_type, PLATFORM_USART_RX_COMPL_NONE);
+    CHECK_EQ(ctx_uart.stats.nr_ferr, 0);
+    if (trace)
+        CHECK(TRACED(HOST_TRACE_W, SERCOM_STATUS));
+
+    // Only that one byte
+    sim_peer_send("Z", 1);
+    sim_tick(5);
+    CHECK_EQ(ctx_uart.rx.idx, 1);
+    CHECK_EQ(buf[0], 'Z');
+}
+
+int main(void) {
+    test_setup();
+    test_sequence();
+    test_no_post_guard();
+    test_echo_at_txc();
+    return test_result("usart_rs485");
+}
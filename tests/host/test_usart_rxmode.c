@@ -0,0 +1,257 @@
+/**
+ * @file tests/host/test_usart_rxmode.c
+ * @brief Host tests, terminator and length-based RX completion
+ */
+
+#include <stdio.h>
+#include <time.h>
+
+#include "test.h"
+#include "../../platform/usart.c"
+#include "usart_sim.h"
+
+/////////////////////////////////////////////////////////////////////////////
+
+static char buf[8];
+static platform_usart_rx_async_desc_t rx;
+
+static void rx_start(uint16_t mode, uint16_t max_len, uint16_t len) {
+    memset(buf, '.', sizeof (buf));
+    memset(&rx, 0, sizeof (rx));
+    rx.buf = buf;
+    rx.max_len = max_len;
+    rx.mode = mode;
+    rx.len = len;
+    rx.term = "\r\n";
+    rx.nr_term = 2;
+    CHECK(platform_usart_cdc_rx_async(&rx));
+}
+
+// Feed bytes one pass each, 100 us apart (well within the idle timeout)
+
+static void feed(const char *s, unsigned int n) {
+    sim_peer_send(s, n);
+    while (n-- > 0)
+        sim_tick(100);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+static void test_validate(void) {
+    sim_reset();
+    rx_start(PLATFORM_USART_RX_MODE_IDLE, 8, 0);
+    platform_usart_cdc_rx_abort();
+
+    memset(&rx, 0, sizeof (rx));
+    rx.buf = buf;
+    rx.max_len = 8;
+    rx.mode = PLATFORM_USART_RX_MODE_TERM;
+    CHECK(!platform_usart_cdc_rx_async(&rx));
+    rx.mode = PLATFORM_USART_RX_MODE_LEN;
+    rx.len = 9;
+    CHECK(!platform_usart_cdc_rx_async(&rx));
+    rx.len = 0;
+    CHECK(!platform_usart_cdc_rx_async(&rx));
+    rx.mode = PLATFORM_USART_RX_MODE_LENPFX;
+    rx.len = 3;
+    CHECK(!platform_usart_cdc_rx_async(&rx));
+    rx.mode = 0x7F;
+    CHECK(!platform_usart_cdc_rx_async(&rx));
+    CHECK(!platform_usart_cdc_rx_busy());
+}
+
+// Complete on the terminator, on the same pass, and keep it in the data
+
+static void test_term(void) {
+    sim_reset();
+    rx_start(PLATFORM_USART_RX_MODE_TERM, 8, 0);
+    feed("ab", 2);
+    CHECK(platform_usart_cdc_rx_busy());
+    feed("\n", 1);
+    CHECK(!platform_usart_cdc_rx_busy());
+    CHECK_EQ(rx.compl_type, PLATFORM_USART_RX_COMPL_DATA);
+    CHECK_EQ(rx.compl_flags, PLATFORM_USART_RX_FLAG_TERM);
+    CHECK_EQ(rx.compl_info.data_len, 3);
+    CHECK(memcmp(buf, "ab\n", 3) == 0);
+
+    // A terminator as the last byte that fits reports both.
+    rx_start(PLATFORM_USART_RX_MODE_TERM, 4, 0);
+    feed("abc\r", 4);
+    CHECK_EQ(rx.compl_flags, PLATFORM_USART_RX_FLAG_TERM | PLATFORM_USART_RX_FLAG_FULL);
+    CHECK_EQ(rx.compl_info.data_len, 4);
+    CHECK_EQ(buf[3], '\r');
+
+    // One byte short: full, but not terminated
+    rx_start(PLATFORM_USART_RX_MODE_TERM, 4, 0);
+    feed("abcd", 4);
+    CHECK_EQ(rx.compl_flags, PLATFORM_USART_RX_FLAG_FULL);
+}
+
+static void test_len(void) {
+    sim_reset();
+    rx_start(PLATFORM_USART_RX_MODE_LEN, 8, 3);
+    feed("xy", 2);
+    CHECK(platform_usart_cdc_rx_busy());
+    feed("z", 1);
+    CHECK(!platform_usart_cdc_rx_busy());
+    CHECK_EQ(rx.compl_flags, PLATFORM_USART_RX_FLAG_LEN);
+    CHECK_EQ(rx.compl_info.data_len, 3);
+
+    // Exactly max_len
+    rx_start(PLATFORM_USART_RX_MODE_LEN, 4, 4);
+    feed("1234", 4);
+    CHECK_EQ(rx.compl_flags, PLATFORM_USART_RX_FLAG_LEN | PLATFORM_USART_RX_FLAG_FULL);
+    CHECK_EQ(rx.compl_info.data_len, 4);
+}
+
+static void test_lenpfx(void) {
+    sim_reset();
+
+    // One-byte prefix
+    rx_start(PLATFORM_USART_RX_MODE_LENPFX, 8, 1);
+    feed("\x03" "ab", 3);
+    CHECK(platform_usart_cdc_rx_busy());
+    feed("c", 1);
+    CHECK_EQ(rx.compl_flags, PLATFORM_USART_RX_FLAG_LEN);
+    CHECK_EQ(rx.compl_info.data_len, 4);
+
+    // A prefix of zero completes with the prefix alone.
+    rx_start(PLATFORM_USART_RX_MODE_LENPFX, 8, 1);
+    feed("\x00", 1);
+    CHECK(!platform_usart_cdc_rx_busy());
+    CHECK_EQ(rx.compl_flags, PLATFORM_USART_RX_FLAG_LEN);
+    CHECK_EQ(rx.compl_info.data_len, 1);
+
+    rx_start(PLATFORM_USART_RX_MODE_LENPFX, 8, 2);
+    feed("\x00\x00", 2);
+    CHECK_EQ(rx.compl_flags, PLATFORM_USART_RX_FLAG_LEN);
+    CHECK_EQ(rx.compl_info.data_len, 2);
+
+    // Two-byte prefix, little-endian: 0x0004
+    rx_start(PLATFORM_USART_RX_MODE_LENPFX, 8, 2);
+    feed("\x04\x00" "abc", 5);
+    CHECK(platform_usart_cdc_rx_busy());
+    feed("d", 1);
+    CHECK_EQ(rx.compl_flags, PLATFORM_USART_RX_FLAG_LEN);
+    CHECK_EQ(rx.compl_info.data_len, 6);
+
+    // A prefix beyond max_len: the buffer fills, and that is all it says.
+    rx_start(PLATFORM_USART_RX_MODE_LENPFX, 8, 2);
+    feed("\x00\x01" "abcdef", 8);
+    CHECK(!platform_usart_cdc_rx_busy());
+    CHECK_EQ(rx.compl_flags, PLATFORM_USART_RX_FLAG_FULL);
+    CHECK_EQ(rx.compl_info.data_len, 8);
+}
+
+// Bytes after completion never land in the completed buffer
+
+static void test_after(void) {
+    sim_reset();
+    rx_start(PLATFORM_USART_RX_MODE_LEN, 8, 2);
+    feed("ABCD", 4);
+    CHECK_EQ(rx.compl_info.data_len, 2);
+    CHECK(memcmp(buf, "AB......", 8) == 0);
+    CHECK_EQ(ctx_uart.rx.idx, 0);
+
+    // Nor in the next one: they were dropped while no descriptor was queued.
+    rx_start(PLATFORM_USART_RX_MODE_TERM, 8, 0);
+    feed("e\r", 2);
+    CHECK_EQ(rx.compl_info.data_len, 2);
+    CHECK(memcmp(buf, "e\r", 2) == 0);
+
+    // The idle timeout still applies in every mode.
+    rx_start(PLATFORM_USART_RX_MODE_LENPFX, 8, 1);
+    feed("\x05" "a", 2);
+    sim_tick(1000000);
+    CHECK_EQ(rx.compl_flags, PLATFORM_USART_RX_FLAG_IDLE);
+    CHECK_EQ(rx.compl_info.data_len, 2);
+}
+
+/*
+ * Per-byte arrival times
+ *
+ * SysTick is set so that the driver's ts_start coincides with the sim's
+ * time zero; each stamp is then the sim time of the pass that took the
+ * byte.
+ */
+static void test_stamps(void) {
+    static const uint32_t gap_us[] = {100, 37, 250, 5, 880, 1, 420, 64};
+    uint32_t ts[8], want[8], at = 0;
+    unsigned int x;
+
+    sim_reset();
+    SysTick->VAL = SysTick->LOAD;
+    rx_start(PLATFORM_USART_RX_MODE_LEN, 8, 8);
+    memset(ts, 0xFF, sizeof (ts));
+    rx.ts = ts;
+    for (x = 0; x < 8; ++x) {
+        sim_peer_send(&"stamped!"[x], 1);
+        sim_tick(gap_us[x]);
+        at += gap_us[x];
+        want[x] = at;
+    }
+    CHECK_EQ(rx.compl_info.data_len, 8);
+    for (x = 0; x < 8; ++x) {
+        CHECK_EQ(ts[x], want[x]);
+        if (x > 0)
+            CHECK(ts[x] > ts[x - 1]);
+    }
+
+    // Passes with no time between them give equal stamps, never earlier ones.
+    rx_start(PLATFORM_USART_RX_MODE_LEN, 8, 4);
+    rx.ts = ts;
+    sim_peer_send("abcd", 4);
+    for (x = 0; x < 4; ++x)
+        sim_tick(0);
+    for (x = 1; x < 4; ++x)
+        CHECK(ts[x] >= ts[x - 1]);
+}
+
+/*
+ * Host cost per received byte through the tick handler (and the model),
+ * with and without stamps; only the difference between the two means much.
+ */
+static double rx_ns_per_byte(bool stamped) {
+    static char big[1024];
+    static uint32_t big_ts[1024];
+    struct timespec t0, t1;
+    unsigned int round, x;
+
+    sim_reset();
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (round = 0; round < 100; ++round) {
+        memset(&rx, 0, sizeof (rx));
+        rx.buf = big;
+        rx.max_len = sizeof (big);
+        rx.mode = PLATFORM_USART_RX_MODE_LEN;
+        rx.len = sizeof (big);
+        rx.ts = stamped ? big_ts : NULL;
+        CHECK(platform_usart_cdc_rx_async(&rx));
+        for (x = 0; x < sizeof (big); ++x) {
+            sim_peer_send("x", 1);
+            sim_tick(20);
+        }
+        CHECK_EQ(rx.compl_info.data_len, sizeof (big));
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    return ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) /
+            (100.0 * sizeof (big));
+}
+
+static void test_stamp_cost(void) {
+    double off = rx_ns_per_byte(false), on = rx_ns_per_byte(true);
+
+    printf("usart_rxmode: %.1f ns per byte with stamps, %.1f without (host, incl. model)\n",
+            on, off);
+}
+
+int main(void) {
+    test_validate();
+    test_term();
+    test_len();
+    test_lenpfx();
+    test_after();
+    test_stamps();
+    test_stamp_cost();
+    return test_result("usart_rxmode");
+}
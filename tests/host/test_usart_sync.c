@@ -0,0 +1,244 @@
+/**
+ * @file tests/host/test_usart_sync.c
+ * @brief Host tests, synchronous USART configuration and DMA transmission
+ */
+
+#include <stdio.h>
+
+#include "test.h"
+#include "../../platform/dma.c"
+#include "../../platform/usart.c"
+#include "usart_sim.h"
+
+/////////////////////////////////////////////////////////////////////////////
+
+#define CTRLA_FIELD(f) \
+    ((SERCOM3_REGS->USART_INT.SERCOM_CTRLA & RF_MASK(f)) >> RF_POS(f))
+
+#define SYNC_RX_PORT	(&PORT_SEC_REGS->GROUP[PLATFORM_USART_SYNC_RX_GROUP])
+
+/// Generator feeding SERCOM3
+#define SERCOM3_GEN	(GCLK_REGS->GCLK_PCHCTRL[SERCOM3_GCLK_ID_CORE] & 0xF)
+
+// DMAC leaves reset at once
+
+static void dmac_poll(void) {
+    DMAC_SEC_REGS->DMAC_CTRL &= ~(1u << 0);
+}
+
+static void reset(void) {
+    sim_reset();
+    host_poll_hook = dmac_poll;
+    platform_dma_init();
+    host_poll_hook = NULL;
+}
+
+static void check_sync_ctrla(unsigned int mode) {
+    CHECK_EQ(CTRLA_FIELD(RF_USART_CTRLA_MODE), mode);
+    CHECK_EQ(CTRLA_FIELD(RF_USART_CTRLA_CMODE), 1);
+    CHECK_EQ(CTRLA_FIELD(RF_USART_CTRLA_RXPO), 3);
+    CHECK_EQ(CTRLA_FIELD(RF_USART_CTRLA_TXPO), 0);
+    CHECK_EQ(CTRLA_FIELD(RF_USART_CTRLA_FORM), 0);
+    CHECK_EQ(CTRLA_FIELD(RF_USART_CTRLA_DORD), 1);
+    CHECK_EQ(CTRLA_FIELD(RF_USART_CTRLA_ENABLE), 1);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+static void test_master(void) {
+    platform_usart_sync_cfg_t cfg = {.master = true, .rate = 1000000};
+    unsigned int shift = 4 * (PLATFORM_USART_SYNC_RX_PIN & 1);
+
+    reset();
+    CHECK_EQ(SERCOM3_GEN, 2);
+    CHECK(platform_usart_cdc_set_sync(&cfg));
+    check_sync_ctrla(0x1);
+    CHECK_EQ(SERCOM3_REGS->USART_INT.SERCOM_BAUD, 11);
+    CHECK_EQ(platform_usart_cdc_get_baud(), 1000000);
+    CHECK_EQ(SERCOM3_GEN, 0);
+
+    // RxD: PB11, SERCOM3 PAD[3] on function D
+    CHECK_EQ(PLATFORM_USART_SYNC_RX_GROUP, 1);
+    CHECK_EQ(PLATFORM_USART_SYNC_RX_PIN, 11);
+    CHECK_EQ(SYNC_RX_PORT->PORT_PINCFG[PLATFORM_USART_SYNC_RX_PIN] & 0x3, 0x3);
+    CHECK_EQ((SYNC_RX_PORT->PORT_PMUX[PLATFORM_USART_SYNC_RX_PIN >> 1] >> shift) & 0xF,
+            MUX_PB11D_SERCOM3_PAD3);
+
+    // Rounded to the nearest 12 MHz / n
+    cfg.rate = 7000000;
+    CHECK(platform_usart_cdc_set_sync(&cfg));
+    CHECK_EQ(SERCOM3_REGS->USART_INT.SERCOM_BAUD, 1);
+    CHECK_EQ(platform_usart_cdc_get_baud(), 6000000);
+    cfg.rate = 12000000;
+    CHECK(platform_usart_cdc_set_sync(&cfg));
+    CHECK_EQ(SERCOM3_REGS->USART_INT.SERCOM_BAUD, 0);
+    CHECK_EQ(platform_usart_cdc_get_baud(), 12000000);
+
+    // Out of range, and left as it was
+    cfg.rate = 12000001;
+    CHECK(!platform_usart_cdc_set_sync(&cfg));
+    cfg.rate = 0;
+    CHECK(!platform_usart_cdc_set_sync(&cfg));
+    cfg.rate = 150;
+    CHECK(!platform_usart_cdc_set_sync(&cfg));
+    CHECK_EQ(platform_usart_cdc_get_baud(), 12000000);
+    check_sync_ctrla(0x1);
+}
+
+// As slave, XCK is an input: BAUD and the generator are left alone.
+
+static void test_slave(void) {
+    platform_usart_sync_cfg_t cfg = {.master = false, .rate = 2000000};
+    uint32_t baud;
+
+    reset();
+    baud = SERCOM3_REGS->USART_INT.SERCOM_BAUD;
+    CHECK(platform_usart_cdc_set_sync(&cfg));
+    check_sync_ctrla(0x0);
+    CHECK_EQ(SERCOM3_REGS->USART_INT.SERCOM_BAUD, baud);
+    CHECK_EQ(SERCOM3_GEN, 2);
+    CHECK_EQ(platform_usart_cdc_get_baud(), 2000000);
+
+    cfg.rate = 0;
+    CHECK(platform_usart_cdc_set_sync(&cfg));
+    CHECK_EQ(platform_usart_cdc_get_baud(), PLATFORM_USART_CDC_BAUD);
+}
+
+// Back to the asynchronous link, at the rate it had
+
+static void test_async(void) {
+    platform_usart_sync_cfg_t cfg = {.master = true, .rate = 4000000};
+
+    reset();
+    usart_set_baud(&ctx_uart, 115200, false);
+    CHECK(platform_usart_cdc_set_sync(&cfg));
+    CHECK(platform_usart_cdc_set_sync(NULL));
+    CHECK_EQ(CTRLA_FIELD(RF_USART_CTRLA_MODE), 0x1);
+    CHECK_EQ(CTRLA_FIELD(RF_USART_CTRLA_CMODE), 0);
+    CHECK_EQ(CTRLA_FIELD(RF_USART_CTRLA_RXPO), 1);
+    CHECK_EQ(CTRLA_FIELD(RF_USART_CTRLA_TXPO), 0);
+    CHECK_EQ(CTRLA_FIELD(RF_USART_CTRLA_FORM), 1);
+    CHECK_EQ(CTRLA_FIELD(RF_USART_CTRLA_ENABLE), 1);
+    CHECK_EQ(SERCOM3_REGS->USART_INT.SERCOM_BAUD, usart_baud_reg(115200));
+    CHECK_EQ(platform_usart_cdc_get_baud(), 115200);
+    CHECK_EQ(SYNC_RX_PORT->PORT_PINCFG[PLATFORM_USART_SYNC_RX_PIN] & 0x3, 0);
+    CHECK_EQ(SERCOM3_GEN, 2);
+
+    // Not in RS-485 mode
+    CHECK(platform_usart_cdc_set_rs485(&(platform_usart_rs485_cfg_t) {0}));
+    CHECK(!platform_usart_cdc_set_sync(&cfg));
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+/*
+ * DMA transmission at 12 Mbps
+ *
+ * Main-loop passes are PASS_NS apart. A block, once started, is sent at
+ * the wire rate and appended to sim_sent[], in order with the bytes the
+ * tick handler writes itself.
+ */
+#define PASS_NS		2000UL
+
+static const char msg[] = "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ!?";
+static uint32_t dma_ns;		// Time left on the block in flight
+static unsigned int nr_blocks;
+
+static void dma_pass(void) {
+    dmac_descriptor_registers_t *d = &dma_desc[DMA_CH_USART];
+    uint32_t ofs;
+
+    if ((DMAC_SEC_REGS->DMAC_CHCTRLA & (1 << 1)) == 0)
+        return;
+    if (dma_ns == 0) {
+        CHECK_EQ(DMAC_SEC_REGS->DMAC_CHID, DMA_CH_USART);
+        CHECK_EQ((DMAC_SEC_REGS->DMAC_CHCTRLB >> 8) & 0xFF, SERCOM3_DMAC_ID_TX);
+        CHECK_EQ(d->DMAC_DSTADDR,
+                (uint32_t) (uintptr_t) &SERCOM3_REGS->USART_INT.SERCOM_DATA);
+        dma_ns = (uint32_t) (d->DMAC_BTCNT * 10ULL * 1000000000ULL / ctx_uart.cfg.baud);
+    }
+    if (dma_ns > PASS_NS) {
+        dma_ns -= PASS_NS;
+        return;
+    }
+
+    // SRCADDR is the end of the block; addresses are only 32 bits wide here.
+    ofs = d->DMAC_SRCADDR - d->DMAC_BTCNT - (uint32_t) (uintptr_t) msg;
+    CHECK(ofs + d->DMAC_BTCNT <= sizeof (msg));
+    if (ofs + d->DMAC_BTCNT <= sizeof (msg) &&
+            sim_nr_sent + d->DMAC_BTCNT <= sizeof (sim_sent)) {
+        memcpy(&sim_sent[sim_nr_sent], &msg[ofs], d->DMAC_BTCNT);
+        sim_nr_sent += d->DMAC_BTCNT;
+    }
+    ++nr_blocks;
+    dma_ns = 0;
+    DMAC_SEC_REGS->DMAC_CHCTRLA = 0;
+}
+
+static void pass(void) {
+    sim_tick(PASS_NS / 1000);
+    dma_pass();
+}
+
+static void test_dma(void) {
+    static const platform_usart_tx_bufdesc_t frags[] = {
+        {msg, 32}, {msg + 32, 1}, {msg + 33, 31},
+    };
+    platform_usart_sync_cfg_t cfg = {.master = true, .rate = 12000000};
+    unsigned int nr_passes = 0, nr_cpu = 0, x, n;
+
+    reset();
+    dma_ns = 0;
+    nr_blocks = 0;
+    CHECK(platform_usart_cdc_set_sync(&cfg));
+    CHECK(platform_usart_cdc_tx_async(frags, 3));
+    CHECK(!platform_usart_cdc_set_sync(NULL));
+
+    while (platform_usart_cdc_tx_busy() && nr_passes < 1000) {
+        n = sim_nr_sent;
+        sim_tick(PASS_NS / 1000);
+        ++nr_passes;
+
+        // The handler writes DATA only while no block is in flight.
+        if (ctx_uart.tx.dma && dma_ns > 0)
+            CHECK_EQ(sim_nr_sent, n);
+        nr_cpu += sim_nr_sent - n;
+        dma_pass();
+    }
+    CHECK_EQ(sim_nr_sent, 64);
+    CHECK(memcmp(sim_sent, msg, 64) == 0);
+    CHECK_EQ(nr_blocks, 2);
+    CHECK_EQ(nr_cpu, 1);
+
+    // 64 bytes at 1.2 MB/s: about 53 us, plus a pass or two per fragment
+    CHECK(nr_passes * PASS_NS <= 64 * 10 * 1000000000ULL / 12000000 + 6 * PASS_NS);
+    printf("usart_sync: 64 bytes in 3 fragments at 12 Mbps: %u passes (%lu us), "
+            "%u by CPU\n", nr_passes, (unsigned long) (nr_passes * PASS_NS / 1000), nr_cpu);
+
+    // Aborted part-way, the channel is stopped.
+    sim_nr_sent = 0;
+    CHECK(platform_usart_cdc_tx_async(frags, 1));
+    pass();
+    CHECK(ctx_uart.tx.dma);
+    platform_usart_cdc_tx_abort();
+    CHECK(!ctx_uart.tx.dma);
+    CHECK(!dma_busy(DMA_CH_USART));
+    CHECK(!platform_usart_cdc_tx_busy());
+
+    // No DMA in asynchronous mode
+    CHECK(platform_usart_cdc_set_sync(NULL));
+    CHECK(platform_usart_cdc_tx_async(frags, 1));
+    for (x = 0; x < 200 && platform_usart_cdc_tx_busy(); ++x) {
+        pass();
+        CHECK(!ctx_uart.tx.dma);
+    }
+    CHECK_EQ(sim_nr_sent, 32);
+}
+
+int main(void) {
+    test_master();
+    test_slave();
+    test_async();
+    test_dma();
+    return test_result("usart_sync");
+}
@@ -0,0 +1,282 @@
+/**
+ * @file tests/host/test_usart_xact.c
+ * @brief Host tests, request/response transaction queue
+ */
+
+#include "test.h"
+#include "../../platform/usart.c"
+#include "usart_sim.h"
+
+/////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Simulated device: a request "Q<d>\r" is answered with "A<d>\r" after a
+ * latency that depends on the digit, in microseconds (0: never).
+ */
+static uint32_t dev_latency_us[10];
+
+/// Unsolicited line sent ahead of the next reply, if not NULL
+static const char *dev_noise;
+
+static unsigned int dev_parsed;
+static char dev_cmd[8];
+static unsigned int dev_cmd_len;
+
+static bool dev_pending;
+static char dev_reply[4];
+static platform_timespec_t dev_due;
+
+/// Sim time of each request's first byte and each reply's completion, in us
+static uint32_t dev_ts_req[8], dev_ts_done[8];
+static unsigned int dev_nr_req;
+
+static uint32_t now_us(void) {
+    return sim_now.nr_sec * 1000000UL + sim_now.nr_nsec / 1000;
+}
+
+static void dev_reset(void) {
+    memset(dev_latency_us, 0, sizeof (dev_latency_us));
+    dev_noise = NULL;
+    dev_parsed = 0;
+    dev_cmd_len = 0;
+    dev_pending = false;
+    dev_nr_req = 0;
+}
+
+// Look at what the board sent since the last pass, and answer when due
+
+static void dev_step(void) {
+    uint32_t lat;
+    char c;
+
+    for (; dev_parsed < sim_nr_sent; ++dev_parsed) {
+        c = (char) sim_sent[dev_parsed];
+        if (dev_cmd_len == 0 && dev_nr_req < 8)
+            dev_ts_req[dev_nr_req++] = now_us();
+        if (dev_cmd_len < sizeof (dev_cmd))
+            dev_cmd[dev_cmd_len++] = c;
+        if (c != '\r')
+            continue;
+
+        lat = dev_latency_us[(dev_cmd[1] - '0') % 10];
+        if (dev_cmd_len == 3 && dev_cmd[0] == 'Q' && lat != 0) {
+            dev_reply[0] = 'A';
+            dev_reply[1] = dev_cmd[1];
+            dev_reply[2] = '\r';
+            dev_due = sim_now;
+            dev_due.nr_nsec += lat * 1000;
+            platform_timespec_normalize(&dev_due);
+            dev_pending = true;
+        }
+        dev_cmd_len = 0;
+    }
+
+    if (dev_pending && platform_timespec_compare(&sim_now, &dev_due) >= 0) {
+        if (dev_noise)
+            sim_peer_send(dev_noise, strlen(dev_noise));
+        dev_noise = NULL;
+        sim_peer_send(dev_reply, 3);
+        dev_pending = false;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+typedef struct {
+    platform_usart_xact_t x;
+    platform_usart_tx_bufdesc_t frag;
+    char req[4];
+    char buf[16];
+} req_t;
+
+static const char term_cr[] = "\r";
+
+static void req_init(req_t *r, char digit, uint32_t timeout_ms) {
+    memset(r, 0, sizeof (*r));
+    r->req[0] = 'Q';
+    r->req[1] = digit;
+    r->req[2] = '\r';
+    r->frag.buf = r->req;
+    r->frag.len = 3;
+    r->x.tx = &r->frag;
+    r->x.nr_tx = 1;
+    r->x.rx.buf = r->buf;
+    r->x.rx.max_len = sizeof (r->buf);
+    r->x.rx.mode = PLATFORM_USART_RX_MODE_TERM;
+    r->x.rx.term = term_cr;
+    r->x.rx.nr_term = 1;
+    r->x.timeout_ms = timeout_ms;
+}
+
+static bool is_reply(const char *buf, uint16_t len, void *arg) {
+    (void) arg;
+    return len >= 1 && buf[0] == 'A';
+}
+
+// Run passes 100 us apart until the queue drains, for at most @c ms
+
+static void run(uint32_t ms) {
+    uint32_t n = ms * 10;
+
+    while (n-- > 0 && platform_usart_cdc_xact_busy()) {
+        sim_tick(100);
+        dev_step();
+    }
+}
+
+static void reset(void) {
+    sim_reset();
+    // Start SysTick at the top of its period, so hrcount agrees with sim_now.
+    SysTick->VAL = SysTick->LOAD;
+    dev_reset();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+static void test_submit(void) {
+    req_t r;
+
+    reset();
+    req_init(&r, '1', 0);
+    CHECK(!platform_usart_cdc_xact_submit(&r.x));
+    req_init(&r, '1', 10);
+    r.x.nr_tx = 0;
+    CHECK(!platform_usart_cdc_xact_submit(&r.x));
+    req_init(&r, '1', 10);
+    r.x.rx.mode = PLATFORM_USART_RX_MODE_LINE;
+    CHECK(!platform_usart_cdc_xact_submit(&r.x));
+    CHECK(!platform_usart_cdc_xact_submit(NULL));
+    CHECK(!platform_usart_cdc_xact_busy());
+
+    req_init(&r, '1', 10);
+    CHECK(platform_usart_cdc_xact_submit(&r.x));
+    CHECK(!platform_usart_cdc_xact_submit(&r.x));
+    CHECK_EQ(r.x.state, PLATFORM_USART_XACT_QUEUED);
+    CHECK(ctx_uart.xact.head == &r.x && ctx_uart.xact.tail == &r.x);
+    CHECK(r.x.next == NULL);
+}
+
+// Replies of varying latency, each request going out as the previous ends
+
+static void test_pipeline(void) {
+    static const char digits[] = "3170";
+    req_t r[4];
+    unsigned int x;
+
+    reset();
+    dev_latency_us[0] = 400;
+    dev_latency_us[1] = 1000;
+    dev_latency_us[3] = 3000;
+    dev_latency_us[7] = 7000;
+    for (x = 0; x < 4; ++x) {
+        req_init(&r[x], digits[x], 20);
+        CHECK(platform_usart_cdc_xact_submit(&r[x].x));
+    }
+
+    sim_tick(100);
+    CHECK_EQ(r[0].x.state, PLATFORM_USART_XACT_ACTIVE);
+    CHECK_EQ(r[1].x.state, PLATFORM_USART_XACT_QUEUED);
+
+    while (platform_usart_cdc_xact_busy() && now_us() < 50000) {
+        sim_tick(100);
+        dev_step();
+        for (x = 0; x < 4; ++x) {
+            if (r[x].x.state == PLATFORM_USART_XACT_DONE && dev_ts_done[x] == 0)
+                dev_ts_done[x] = now_us();
+        }
+    }
+
+    CHECK_EQ(dev_nr_req, 4);
+    for (x = 0; x < 4; ++x) {
+        CHECK_EQ(r[x].x.state, PLATFORM_USART_XACT_DONE);
+        CHECK_EQ(r[x].x.rx.compl_flags, PLATFORM_USART_RX_FLAG_TERM);
+        CHECK_EQ(r[x].x.rx.compl_info.data_len, 3);
+        CHECK(r[x].buf[0] == 'A' && r[x].buf[1] == digits[x]);
+        CHECK(r[x].x.next == NULL);
+    }
+
+    /*
+     * The link never waits on the application: each request leaves within
+     * three passes of the previous reply (the model's transmitter is busy
+     * on the pass that takes the last byte, the next pass starts the
+     * transaction, and the one after that loads the fragment).
+     */
+    for (x = 1; x < 4; ++x) {
+        CHECK(dev_ts_req[x] > dev_ts_done[x - 1]);
+        CHECK(dev_ts_req[x] - dev_ts_done[x - 1] <= 300);
+    }
+    CHECK(ctx_uart.xact.head == NULL && ctx_uart.xact.tail == NULL);
+    CHECK(!platform_usart_cdc_rx_busy());
+}
+
+// A silent device times out; the queue moves on
+
+static void test_timeout(void) {
+    req_t r[2];
+
+    reset();
+    dev_latency_us[2] = 0;
+    dev_latency_us[5] = 500;
+    req_init(&r[0], '2', 5);
+    req_init(&r[1], '5', 5);
+    CHECK(platform_usart_cdc_xact_submit(&r[0].x));
+    CHECK(platform_usart_cdc_xact_submit(&r[1].x));
+
+    run(4);
+    CHECK_EQ(r[0].x.state, PLATFORM_USART_XACT_ACTIVE);
+    run(2);
+    CHECK_EQ(r[0].x.state, PLATFORM_USART_XACT_TIMEOUT);
+    CHECK(r[0].x.rx.compl_flags & PLATFORM_USART_RX_FLAG_ABORT);
+
+    run(10);
+    CHECK_EQ(r[1].x.state, PLATFORM_USART_XACT_DONE);
+    CHECK_EQ(dev_nr_req, 2);
+}
+
+// A reply the caller does not recognize is skipped, not accepted
+
+static void test_match(void) {
+    req_t r;
+
+    reset();
+    dev_latency_us[4] = 800;
+    dev_noise = "RING\r";
+    req_init(&r, '4', 10);
+    r.x.match = is_reply;
+    CHECK(platform_usart_cdc_xact_submit(&r.x));
+
+    run(10);
+    CHECK_EQ(r.x.state, PLATFORM_USART_XACT_DONE);
+    CHECK_EQ(r.x.rx.compl_info.data_len, 3);
+    CHECK(memcmp(r.buf, "A4\r", 3) == 0);
+}
+
+// A bad reply descriptor fails that transaction alone
+
+static void test_failed(void) {
+    req_t r[2];
+
+    reset();
+    dev_latency_us[6] = 300;
+    req_init(&r[0], '6', 10);
+    r[0].x.rx.max_len = 0;
+    req_init(&r[1], '6', 10);
+    CHECK(platform_usart_cdc_xact_submit(&r[0].x));
+    CHECK(platform_usart_cdc_xact_submit(&r[1].x));
+
+    sim_tick(100);
+    CHECK_EQ(r[0].x.state, PLATFORM_USART_XACT_FAILED);
+    CHECK_EQ(r[1].x.state, PLATFORM_USART_XACT_ACTIVE);
+    run(10);
+    CHECK_EQ(r[1].x.state, PLATFORM_USART_XACT_DONE);
+    CHECK_EQ(dev_nr_req, 1);
+}
+
+int main(void) {
+    test_submit();
+    test_pipeline();
+    test_timeout();
+    test_match();
+    test_failed();
+    return test_result("usart_xact");
+}
@@ -0,0 +1,197 @@
+/**
+ * @file tests/host/test_vm.c
+ * @brief Host tests, bytecode interpreter faults and throughput
+ */
+
+#include <stdio.h>
+#include <time.h>
+
+#include "test.h"
+#include "../../vm.c"
+
+/////////////////////////////////////////////////////////////////////////////
+
+static uint8_t img[VM_PROG_MAX];
+static vm_t vm;
+
+// Wrap code in an image header and load it
+
+static bool load(const uint8_t *code, uint16_t len) {
+    uint16_t sum = 0, x;
+
+    img[0] = 'B';
+    img[1] = 'V';
+    img[2] = 1;
+    img[3] = 0;
+    img[4] = len & 0xFF;
+    img[5] = len >> 8;
+    for (x = 0; x < len; ++x)
+        sum += code[x];
+    img[6] = sum & 0xFF;
+    img[7] = sum >> 8;
+    memcpy(&img[VM_HDR_SIZE], code, len);
+
+    memset(&vm, 0, sizeof (vm));
+    return vm_load(&vm, img, VM_HDR_SIZE + len);
+}
+
+#define LOAD(...) \
+    do { \
+        static const uint8_t code_[] = {__VA_ARGS__}; \
+        CHECK(load(code_, sizeof (code_))); \
+    } while (0)
+
+/*
+ * Run a program that must fault at pc, after n good instructions, with sp
+ * items on the stack
+ */
+static void expect_fault(uint16_t pc, unsigned int n, uint8_t sp) {
+    CHECK_EQ(vm_run(&vm, VM_BUDGET), n);
+    CHECK_EQ(vm.state, VM_STATE_FAULT);
+    CHECK_EQ(vm.pc, pc);
+    CHECK_EQ(vm.sp, sp);
+    CHECK_EQ(vm.nr_insns, n);
+
+    // A faulted program stays put.
+    CHECK_EQ(vm_run(&vm, VM_BUDGET), 0);
+    CHECK_EQ(vm.pc, pc);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+static void test_load(void) {
+    static const uint8_t code[] = {VM_OP_HALT};
+
+    CHECK(load(code, 1));
+    img[VM_HDR_SIZE] = VM_OP_NOP;
+    CHECK(!vm_load(&vm, img, VM_HDR_SIZE + 1));
+    CHECK(!load(code, 0));
+    CHECK(!vm_load(&vm, img, VM_HDR_SIZE - 1));
+    CHECK(!vm_load(&vm, NULL, VM_HDR_SIZE + 1));
+}
+
+static void test_run(void) {
+    LOAD(VM_OP_PUSH8, 0xFE, VM_OP_PUSH16, 0x34, 0x12, VM_OP_ADD,
+            VM_OP_DUP, VM_OP_STORE, 7, VM_OP_HALT);
+    CHECK_EQ(vm_run(&vm, VM_BUDGET), 6);
+    CHECK_EQ(vm.state, VM_STATE_HALT);
+    CHECK_EQ(vm.vars[7], 0x1232);
+    CHECK_EQ(vm.sp, 1);
+
+    // The budget is honoured exactly.
+    LOAD(VM_OP_NOP, VM_OP_NOP, VM_OP_NOP, VM_OP_JMP, 0, 0);
+    CHECK_EQ(vm_run(&vm, 10), 10);
+    CHECK_EQ(vm.pc, 2);
+    CHECK_EQ(vm.state, VM_STATE_RUN);
+}
+
+static void test_stack(void) {
+    unsigned int x;
+
+    // Underflow, by one and two operands
+    LOAD(VM_OP_DROP);
+    expect_fault(0, 0, 0);
+    LOAD(VM_OP_PUSH8, 1, VM_OP_ADD);
+    expect_fault(2, 1, 1);
+    LOAD(VM_OP_PUSH8, 1, VM_OP_SWAP);
+    expect_fault(2, 1, 1);
+    LOAD(VM_OP_STORE, 0);
+    expect_fault(0, 0, 0);
+    LOAD(VM_OP_PUTC);
+    expect_fault(0, 0, 0);
+    LOAD(VM_OP_PUSH8, 1, VM_OP_DROP, VM_OP_JZ, 0, 0);
+    expect_fault(3, 2, 0);
+    LOAD(VM_OP_JNZ, 0, 0);
+    expect_fault(0, 0, 0);
+
+    // Overflow: the stack holds exactly VM_STACK_DEPTH items.
+    LOAD(VM_OP_PUSH8, 5, VM_OP_JMP, 0, 0);
+    expect_fault(0, 2 * VM_STACK_DEPTH, VM_STACK_DEPTH);
+    for (x = 0; x < VM_STACK_DEPTH; ++x)
+        CHECK_EQ(vm.stack[x], 5);
+    LOAD(VM_OP_PUSH8, 5, VM_OP_DUP, VM_OP_JMP, 2, 0);
+    expect_fault(2, 2 * VM_STACK_DEPTH - 1, VM_STACK_DEPTH);
+    LOAD(VM_OP_LOAD, 0, VM_OP_JMP, 0, 0);
+    expect_fault(0, 2 * VM_STACK_DEPTH, VM_STACK_DEPTH);
+}
+
+static void test_jump(void) {
+    // Targets must fall inside the code.
+    LOAD(VM_OP_NOP, VM_OP_JMP, 4, 0);
+    expect_fault(1, 1, 0);
+    LOAD(VM_OP_JMP, 3, 0, VM_OP_HALT);
+    CHECK_EQ(vm_run(&vm, VM_BUDGET), 2);
+    CHECK_EQ(vm.state, VM_STATE_HALT);
+    LOAD(VM_OP_PUSH8, 0, VM_OP_JZ, 0xFF, 0xFF);
+    expect_fault(2, 1, 1);
+
+    // An untaken branch is still checked.
+    LOAD(VM_OP_PUSH8, 1, VM_OP_JZ, 0x00, 0x01, VM_OP_HALT);
+    expect_fault(2, 1, 1);
+
+    // Running off the end without HALT
+    LOAD(VM_OP_NOP, VM_OP_NOP);
+    expect_fault(2, 2, 0);
+}
+
+static void test_truncated(void) {
+    LOAD(VM_OP_PUSH8);
+    expect_fault(0, 0, 0);
+    LOAD(VM_OP_NOP, VM_OP_PUSH16, 0x12);
+    expect_fault(1, 1, 0);
+    LOAD(VM_OP_JMP, 0);
+    expect_fault(0, 0, 0);
+    LOAD(VM_OP_PUSH8, 1, VM_OP_JNZ, 0);
+    expect_fault(2, 1, 1);
+    LOAD(VM_OP_LOAD);
+    expect_fault(0, 0, 0);
+    LOAD(VM_OP_PUSH8, 1, VM_OP_STORE);
+    expect_fault(2, 1, 1);
+
+    // Bad variable slot and bad opcode
+    LOAD(VM_OP_LOAD, VM_NR_VARS);
+    expect_fault(0, 0, 0);
+    LOAD(VM_OP_NOP, 0xFF);
+    expect_fault(1, 1, 0);
+}
+
+/*
+ * Throughput of the dispatch loop, on the host
+ *
+ * A counting loop (LOAD, PUSH8, ADD, STORE, JMP) run in VM_BUDGET slices,
+ * as the main loop does. This only compares builds of the interpreter; the
+ * target's figure scales with its clock and compiler.
+ */
+static void test_speed(void) {
+    struct timespec t0, t1;
+    unsigned long n = 0, slices = 0;
+    double s;
+
+    LOAD(VM_OP_LOAD, 0, VM_OP_PUSH8, 1, VM_OP_ADD, VM_OP_STORE, 0,
+            VM_OP_JMP, 0, 0);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    do {
+        n += vm_run(&vm, VM_BUDGET);
+        ++slices;
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        s = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    } while (s < 0.2);
+
+    CHECK_EQ(vm.state, VM_STATE_RUN);
+    CHECK_EQ(n, slices * VM_BUDGET);
+    CHECK_EQ(vm.nr_insns, n);
+    // Five instructions per count, the fourth of which stores it
+    CHECK_EQ((uint16_t) vm.vars[0], (uint16_t) ((n + 1) / 5));
+    printf("vm: %.1f M insns/s on the host, %u per slice\n",
+            n / s / 1e6, VM_BUDGET);
+}
+
+int main(void) {
+    test_load();
+    test_run();
+    test_stack();
+    test_jump();
+    test_truncated();
+    test_speed();
+    return test_result("vm");
+}
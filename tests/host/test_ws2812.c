@@ -0,0 +1,312 @@
+/**
+ * @file tests/host/test_ws2812.c
+ * @brief Host tests, WS2812 bit encoding and frame timing
+ */
+
+#include "test.h"
+#include "../../platform/dma.c"
+#include "../../platform/ws2812.c"
+
+extern void platform_pclk_init(void);
+extern void platform_timespec_normalize(platform_timespec_t *ts);
+
+BlinkSetting currentSetting = OFF;
+
+/////////////////////////////////////////////////////////////////////////////
+
+#define FRAME_BYTES	(PLATFORM_WS2812_NR * WS2812_LED_BYTES)
+
+/// Time a DMA block takes on the wire at 2.4 MHz, in us
+#define FRAME_US	(FRAME_BYTES * 8 * 10 / 24)
+
+/*
+ * Simulated link: a DMA block leaves at the SPI rate from the pass that
+ * started it, and TXC comes up once its last bit is out.
+ */
+static platform_timespec_t now;
+static uint32_t now_us;
+
+static bool link_busy;
+static uint32_t link_start_us, link_end_us;
+static const uint8_t *link_src;
+
+/// Frames seen on the wire: start time, gap since the previous, and buffer
+#define NR_FRAMES_MAX	16
+static struct {
+    uint32_t start_us;
+    uint32_t gap_us;
+    const uint8_t *src;
+} frames[NR_FRAMES_MAX];
+static unsigned int nr_frames;
+
+static void dmac_poll(void) {
+    DMAC_SEC_REGS->DMAC_CTRL &= ~(1u << 0);
+}
+
+static void reset(void) {
+    host_reset();
+    platform_pclk_init();
+    host_poll_hook = dmac_poll;
+    platform_dma_init();
+    host_poll_hook = NULL;
+    platform_ws2812_init();
+    platform_ws2812_set_auto(false);
+    WS2812_SPI_REGS->SERCOM_INTFLAG = (1 << 1) | (1 << 0);
+
+    currentSetting = OFF;
+    now.nr_sec = 0;
+    now.nr_nsec = 0;
+    now_us = 0;
+    link_busy = false;
+    link_end_us = 0;
+    nr_frames = 0;
+}
+
+static void link_step(void) {
+    dmac_descriptor_registers_t *d = &dma_desc[DMA_CH_WS2812];
+
+    if (!link_busy && (DMAC_SEC_REGS->DMAC_CHCTRLA & (1 << 1)) != 0) {
+        CHECK_EQ(d->DMAC_BTCNT, FRAME_BYTES);
+        CHECK_EQ(d->DMAC_DSTADDR, (uint32_t) (uintptr_t) &WS2812_SPI_REGS->SERCOM_DATA);
+        CHECK_EQ((DMAC_SEC_REGS->DMAC_CHCTRLB >> 8) & 0xFF, SERCOM2_DMAC_ID_TX);
+        link_src = (d->DMAC_SRCADDR - d->DMAC_BTCNT ==
+                (uint32_t) (uintptr_t) ctx_ws2812.enc[1]) ? ctx_ws2812.enc[1] : ctx_ws2812.enc[0];
+        if (nr_frames < NR_FRAMES_MAX) {
+            frames[nr_frames].start_us = now_us;
+            frames[nr_frames].gap_us = now_us - link_end_us;
+            frames[nr_frames].src = link_src;
+            ++nr_frames;
+        }
+        link_busy = true;
+        link_start_us = now_us;
+        WS2812_SPI_REGS->SERCOM_INTFLAG = (1 << 0);
+    }
+    if (link_busy && now_us - link_start_us >= FRAME_US) {
+        link_busy = false;
+        link_end_us = now_us;
+        DMAC_SEC_REGS->DMAC_CHCTRLA = 0;
+        WS2812_SPI_REGS->SERCOM_INTFLAG = (1 << 1) | (1 << 0);
+    }
+}
+
+/// Run one main-loop pass, @c us after the previous one
+static void tick(uint32_t us) {
+    now_us += us;
+    now.nr_nsec += us * 1000;
+    platform_timespec_normalize(&now);
+    link_step();
+    platform_ws2812_tick_handler(&now);
+    link_step();
+}
+
+// Run passes 20 us apart until @c n frames have started
+
+static void run_frames(unsigned int n) {
+    unsigned int x;
+
+    for (x = 0; x < 1000 && nr_frames < n; ++x)
+        tick(20);
+    CHECK_EQ(nr_frames, n);
+}
+
+/*
+ * Decode a frame as the strip would: each WS2812 bit is three SPI bits,
+ * 100 for 0 and 110 for 1. Returns false on any other pattern.
+ */
+static bool decode(const uint8_t *enc, uint8_t *out, unsigned int nr) {
+    unsigned int x, i, pat;
+    uint32_t w;
+
+    for (x = 0; x < nr; ++x, enc += 3) {
+        w = ((uint32_t) enc[0] << 16) | ((uint32_t) enc[1] << 8) | enc[2];
+        out[x] = 0;
+        for (i = 0; i < 8; ++i) {
+            pat = (w >> (21 - 3 * i)) & 0x7;
+            if (pat != 0x4 && pat != 0x6)
+                return false;
+            out[x] = (uint8_t) ((out[x] << 1) | (pat == 0x6));
+        }
+    }
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+static void test_init(void) {
+    reset();
+    CHECK(platform_pclk_is_on(PLATFORM_PCLK_SERCOM2));
+    CHECK_EQ(WS2812_SPI_REGS->SERCOM_BAUD, WS2812_SPI_BAUD);
+    CHECK_EQ(24000000 / (2 * (WS2812_SPI_BAUD + 1)), 2400000);
+    CHECK(!platform_ws2812_busy());
+}
+
+// Every component value comes back intact at full brightness
+
+static void test_encode(void) {
+    static const uint8_t zero[3] = {0x92, 0x49, 0x24}, ones[3] = {0xDB, 0x6D, 0xB6};
+    uint8_t enc[FRAME_BYTES], dec[PLATFORM_WS2812_NR * 3];
+    uint8_t *c = &ctx_ws2812.grb[0][0];
+    unsigned int v, x;
+    bool ok = true;
+
+    reset();
+    platform_ws2812_set_brightness(255);
+    for (v = 0; v < 256; v += PLATFORM_WS2812_NR * 3) {
+        for (x = 0; x < PLATFORM_WS2812_NR * 3; ++x)
+            c[x] = (uint8_t) ((v + x) & 0xFF);
+        ws2812_encode(&ctx_ws2812, enc);
+        CHECK(decode(enc, dec, PLATFORM_WS2812_NR * 3));
+        for (x = 0; x < PLATFORM_WS2812_NR * 3; ++x)
+            ok = ok && (dec[x] == ((v + x) & 0xFF));
+    }
+    CHECK(ok);
+
+    // Each pattern ends low, so the line idles low after the frame.
+    memset(ctx_ws2812.grb, 0, sizeof (ctx_ws2812.grb));
+    ws2812_encode(&ctx_ws2812, enc);
+    CHECK(memcmp(enc, zero, 3) == 0);
+    memset(ctx_ws2812.grb, 0xFF, sizeof (ctx_ws2812.grb));
+    ws2812_encode(&ctx_ws2812, enc);
+    CHECK(memcmp(enc, ones, 3) == 0);
+    CHECK_EQ(enc[FRAME_BYTES - 1] & 1, 0);
+}
+
+// Colors go out green first, then red, then blue
+
+static void test_order(void) {
+    uint8_t enc[FRAME_BYTES], dec[PLATFORM_WS2812_NR * 3];
+
+    reset();
+    platform_ws2812_set_brightness(255);
+    platform_ws2812_set(0, 0x12, 0x34, 0x56);
+    platform_ws2812_set(PLATFORM_WS2812_NR - 1, 0xAB, 0xCD, 0xEF);
+    platform_ws2812_set(PLATFORM_WS2812_NR, 0xFF, 0xFF, 0xFF);
+    ws2812_encode(&ctx_ws2812, enc);
+    CHECK(decode(enc, dec, PLATFORM_WS2812_NR * 3));
+    CHECK(dec[0] == 0x34 && dec[1] == 0x12 && dec[2] == 0x56);
+    CHECK(dec[3] == 0 && dec[4] == 0 && dec[5] == 0);
+    CHECK(dec[3 * PLATFORM_WS2812_NR - 3] == 0xCD);
+    CHECK(dec[3 * PLATFORM_WS2812_NR - 2] == 0xAB);
+    CHECK(dec[3 * PLATFORM_WS2812_NR - 1] == 0xEF);
+}
+
+// Brightness scales each component by (brightness + 1) / 256
+
+static void test_brightness(void) {
+    uint8_t enc[FRAME_BYTES], dec[PLATFORM_WS2812_NR * 3];
+    unsigned int b, prev;
+    bool ok = true;
+
+    reset();
+    CHECK_EQ(ctx_ws2812.brightness, PLATFORM_WS2812_BRIGHTNESS);
+    platform_ws2812_set(0, 0xFF, 0x80, 0x01);
+    for (b = 0, prev = 0; b < 256; ++b) {
+        platform_ws2812_set_brightness((uint8_t) b);
+        ws2812_encode(&ctx_ws2812, enc);
+        CHECK(decode(enc, dec, 3));
+        ok = ok && dec[1] == ((0xFF * (b + 1)) >> 8) && dec[1] >= prev;
+        ok = ok && dec[0] == ((0x80 * (b + 1)) >> 8);
+        ok = ok && dec[2] == ((b == 255) ? 1 : 0);
+        prev = dec[1];
+    }
+    CHECK(ok);
+
+    platform_ws2812_set_brightness(0);
+    ws2812_encode(&ctx_ws2812, enc);
+    CHECK(decode(enc, dec, 3));
+    CHECK(dec[0] == 0 && dec[1] == 0 && dec[2] == 0);
+}
+
+// Frames leave by DMA, at least the latch time apart
+
+static void test_timing(void) {
+    platform_ws2812_stats_t stats;
+    uint8_t dec[PLATFORM_WS2812_NR * 3];
+    unsigned int x;
+
+    reset();
+    platform_ws2812_set_brightness(255);
+    platform_ws2812_set(0, 1, 0, 0);
+    platform_ws2812_show();
+    CHECK(platform_ws2812_busy());
+
+    // Out of reset, the line counts as having been low since time zero.
+    run_frames(1);
+    CHECK_EQ(frames[0].start_us, WS2812_T_LATCH_US);
+    CHECK(frames[0].src == ctx_ws2812.enc[0]);
+
+    // While one frame is on the wire, the next is encoded into the other buffer.
+    platform_ws2812_set(0, 2, 0, 0);
+    platform_ws2812_show();
+    CHECK_EQ(ctx_ws2812.queued, 1);
+    platform_ws2812_set(0, 3, 0, 0);
+    platform_ws2812_show();
+    CHECK_EQ(ctx_ws2812.queued, 1);
+    platform_ws2812_get_stats(&stats);
+    CHECK_EQ(stats.nr_replaced, 1);
+
+    for (x = 0; x < 100 && platform_ws2812_busy(); ++x)
+        tick(20);
+    CHECK(!platform_ws2812_busy());
+    CHECK_EQ(nr_frames, 2);
+    CHECK(frames[1].src == ctx_ws2812.enc[1]);
+    CHECK(decode(ctx_ws2812.enc[1], dec, 3));
+    CHECK_EQ(dec[1], 3);
+
+    // 144 bytes at 2.4 MHz is 480 us, then the latch time
+    CHECK_EQ(FRAME_US, 480);
+    CHECK(frames[1].gap_us >= WS2812_T_LATCH_US);
+    CHECK(frames[1].gap_us <= WS2812_T_LATCH_US + 40);
+    CHECK(frames[1].start_us - frames[0].start_us >= FRAME_US + WS2812_T_LATCH_US);
+
+    platform_ws2812_get_stats(&stats);
+    CHECK_EQ(stats.nr_frames, 2);
+
+    // DMA done is not enough: the last byte must have left the shifter too.
+    platform_ws2812_show();
+    run_frames(3);
+    DMAC_SEC_REGS->DMAC_CHCTRLA = 0;
+    link_busy = false;
+    for (x = 0; x < 10; ++x)
+        platform_ws2812_tick_handler(&now);
+    CHECK(ctx_ws2812.sending >= 0);
+    WS2812_SPI_REGS->SERCOM_INTFLAG = (1 << 1) | (1 << 0);
+    platform_ws2812_tick_handler(&now);
+    CHECK(ctx_ws2812.sending < 0);
+}
+
+// The built-in animation follows the blink setting
+
+static void test_anim(void) {
+    uint8_t dec[PLATFORM_WS2812_NR * 3];
+    unsigned int x;
+    bool ok = true;
+
+    reset();
+    platform_ws2812_set_auto(true);
+    currentSetting = ON;
+    tick(WS2812_ANIM_MS * 1000);
+    CHECK_EQ(nr_frames, 1);
+    CHECK(decode(frames[0].src, dec, PLATFORM_WS2812_NR * 3));
+    for (x = 0; x < PLATFORM_WS2812_NR * 3; ++x)
+        ok = ok && dec[x] == ((0xFF * (PLATFORM_WS2812_BRIGHTNESS + 1)) >> 8);
+    CHECK(ok);
+
+    // Dark part of SLOW: a dim green dot at the head of the strip
+    currentSetting = SLOW;
+    tick(WS2812_ANIM_MS * 1000);
+    run_frames(2);
+    CHECK(decode(frames[1].src, dec, PLATFORM_WS2812_NR * 3));
+    CHECK_EQ(dec[0], ((0xFF >> 2) * (PLATFORM_WS2812_BRIGHTNESS + 1)) >> 8);
+    CHECK(dec[1] == 0 && dec[2] == 0 && dec[3] == 0);
+}
+
+int main(void) {
+    test_init();
+    test_encode();
+    test_order();
+    test_brightness();
+    test_timing();
+    test_anim();
+    return test_result("ws2812");
+}
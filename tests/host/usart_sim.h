@@ -0,0 +1,117 @@
+#ifndef USART_SIM_H
+#define USART_SIM_H
+
+/*
+ * Host model of the SERCOM3 USART and its peer, for tests that #include
+ * platform/usart.c
+ *
+ * Each sim_tick() is one main-loop pass: either one byte from the peer is
+ * pending (RXC), or the transmitter is ready (DRE) and whatever the driver
+ * writes to DATA is logged as sent. RAM has a single DATA for both
+ * directions, hence never both in one pass. DATA holds 0x100 | byte while
+ * a byte is pending (0x1FF otherwise), so that a write is always told apart.
+ * STATUS reads as zero on each pass, except that the next byte received
+ * carries sim_rx_status (e.g. BUFOVF) once set.
+ *
+ * The RS-485 DE pin is folded from OUTSET/OUTCLR writes on either view of
+ * PORT into sim_de.
+ */
+
+#include <string.h>
+
+extern void platform_pclk_init(void);
+extern void platform_systick_init(void);
+extern void platform_timespec_normalize(platform_timespec_t *ts);
+
+#define SIM_DE_MASK	(1 << PLATFORM_USART_RS485_DE_PIN)
+
+/// Bytes written to DATA, in order
+static uint8_t sim_sent[256];
+static unsigned int sim_nr_sent;
+
+/// Bytes queued by the peer, taken one per tick
+static uint8_t sim_rx[256];
+static unsigned int sim_rx_head, sim_rx_tail;
+
+/// STATUS shown with the next byte received, then cleared
+static uint16_t sim_rx_status;
+
+/// Level of the DE pin
+static bool sim_de;
+
+/// Current tick
+static platform_timespec_t sim_now;
+
+static void sim_de_fold(void) {
+    port_group_registers_t *views[] = {
+        &PORT_SEC_REGS->GROUP[PLATFORM_USART_RS485_DE_GROUP],
+        &PORT_IOBUS_SEC_REGS->GROUP[PLATFORM_USART_RS485_DE_GROUP],
+    };
+    unsigned int x;
+
+    for (x = 0; x < 2; ++x) {
+        if (views[x]->PORT_OUTSET & SIM_DE_MASK)
+            sim_de = true;
+        if (views[x]->PORT_OUTCLR & SIM_DE_MASK)
+            sim_de = false;
+        views[x]->PORT_OUTSET = 0;
+        views[x]->PORT_OUTCLR = 0;
+    }
+}
+
+static void sim_reset(void) {
+    host_reset();
+    platform_pclk_init();
+    platform_systick_init();
+    platform_usart_init();
+    SERCOM3_REGS->USART_INT.SERCOM_INTFLAG = (1 << 0);
+    sim_nr_sent = 0;
+    sim_rx_head = sim_rx_tail = 0;
+    sim_rx_status = 0;
+    sim_de = false;
+    sim_now.nr_sec = 0;
+    sim_now.nr_nsec = 0;
+}
+
+static void sim_peer_send(const char *s, unsigned int n) {
+    while (n-- > 0)
+        sim_rx[sim_rx_head++ % sizeof (sim_rx)] = (uint8_t) *(s++);
+}
+
+static void sim_advance_us(uint32_t us) {
+    sim_now.nr_nsec += us * 1000;
+    platform_timespec_normalize(&sim_now);
+}
+
+/// Run one main-loop pass, @c us after the previous one
+static void sim_tick(uint32_t us) {
+    sercom_usart_int_registers_t *regs = &SERCOM3_REGS->USART_INT;
+    bool rx = (sim_rx_tail != sim_rx_head);
+    uint32_t idle = rx ? (0x100 | sim_rx[sim_rx_tail % sizeof (sim_rx)]) : 0x1FF;
+
+    sim_advance_us(us);
+    regs->SERCOM_INTFLAG = rx ? (1 << 2) : (1 << 0);
+    regs->SERCOM_DATA = idle;
+    regs->SERCOM_STATUS = rx ? sim_rx_status : 0;
+    platform_usart_tick_handler(&sim_now);
+
+    if (rx) {
+        ++sim_rx_tail;
+        sim_rx_status = 0;
+    }
+    if (regs->SERCOM_DATA != idle && sim_nr_sent < sizeof (sim_sent))
+        sim_sent[sim_nr_sent++] = (uint8_t) regs->SERCOM_DATA;
+    regs->SERCOM_INTFLAG = (1 << 0);
+    regs->SERCOM_DATA = 0x1FF;
+    sim_de_fold();
+}
+
+/// Take an interrupt; INTFLAG and STATUS are write-one-to-clear, which RAM is not
+static void sim_irq(void (*handler)(void)) {
+    handler();
+    SERCOM3_REGS->USART_INT.SERCOM_INTFLAG = (1 << 0);
+    SERCOM3_REGS->USART_INT.SERCOM_STATUS = 0;
+    sim_de_fold();
+}
+
+#endif // USART_SIM_H
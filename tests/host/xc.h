@@ -0,0 +1,336 @@
+/**
+ * @file tests/host/xc.h
+ * @brief Host stand-in for the XC32 device header
+ *
+ * Only what the drivers under test touch is declared, with the names and
+ * qualifiers of the PIC32CM LS00 DFP. Each peripheral instance is a plain
+ * structure in RAM (see host.c), so that a test can preset inputs such as
+ * INTFLAG or PORT IN, and inspect whatever the driver wrote.
+ *
+ * Write-one registers (OUTSET, INTENCLR, ...) simply keep the last value
+ * written; tests clear them before the step they check.
+ */
+#ifndef HOST_XC_H
+#define HOST_XC_H
+
+#include <stdint.h>
+
+#define __I	volatile const
+#define __O	volatile
+#define __IO	volatile
+
+/////////////////////////////////////////////////////////////////////////////
+
+typedef struct {
+    __IO uint32_t OSCCTRL_EVCTRL, OSCCTRL_INTENCLR, OSCCTRL_INTENSET,
+            OSCCTRL_INTFLAG, OSCCTRL_STATUS, OSCCTRL_XOSCCTRL,
+            OSCCTRL_CFDPRESC, OSCCTRL_OSC16MCTRL, OSCCTRL_DFLLULPCTRL,
+            OSCCTRL_DFLLULPDITHER, OSCCTRL_DFLLULPRREQ, OSCCTRL_DFLLCTRL,
+            OSCCTRL_DFLLVAL, OSCCTRL_DFLLMUL, OSCCTRL_DFLLSYNC;
+} oscctrl_registers_t;
+
+typedef struct {
+    __IO uint32_t OSC32KCTRL_INTENCLR, OSC32KCTRL_INTENSET,
+            OSC32KCTRL_INTFLAG, OSC32KCTRL_STATUS, OSC32KCTRL_RTCCTRL,
+            OSC32KCTRL_XOSC32K, OSC32KCTRL_CFDCTRL, OSC32KCTRL_EVCTRL,
+            OSC32KCTRL_OSCULP32K;
+} osc32kctrl_registers_t;
+
+typedef struct {
+    __IO uint32_t PM_SLEEPCFG, PM_PLCFG, PM_PWCFG, PM_INTENCLR,
+            PM_INTENSET, PM_INTFLAG, PM_STDBYCFG;
+} pm_registers_t;
+
+typedef struct {
+    __IO uint32_t SUPC_INTENCLR, SUPC_INTENSET, SUPC_INTFLAG, SUPC_STATUS,
+            SUPC_BOD33, SUPC_BOD12, SUPC_VREG, SUPC_VREF, SUPC_VREGPLL;
+} supc_registers_t;
+
+typedef struct {
+    __IO uint32_t NVMCTRL_CTRLA, NVMCTRL_CTRLB, NVMCTRL_CTRLC,
+            NVMCTRL_EVCTRL, NVMCTRL_INTENCLR, NVMCTRL_INTENSET,
+            NVMCTRL_INTFLAG, NVMCTRL_STATUS, NVMCTRL_ADDR;
+} nvmctrl_registers_t;
+
+typedef struct {
+    __IO uint32_t GCLK_CTRLA;
+    __I uint32_t GCLK_SYNCBUSY;
+    __IO uint32_t GCLK_GENCTRL[5];
+    __IO uint32_t GCLK_PCHCTRL[41];
+} gclk_registers_t;
+
+typedef struct {
+    __IO uint32_t MCLK_CTRLA, MCLK_INTENCLR, MCLK_INTENSET, MCLK_INTFLAG,
+            MCLK_CPUDIV, MCLK_AHBMASK, MCLK_APBAMASK, MCLK_APBBMASK,
+            MCLK_APBCMASK;
+} mclk_registers_t;
+
+typedef struct {
+    __IO uint32_t TC_CTRLA, TC_CTRLBCLR, TC_CTRLBSET, TC_EVCTRL,
+            TC_INTENCLR, TC_INTENSET, TC_INTFLAG, TC_STATUS, TC_WAVE,
+            TC_DRVCTRL, TC_DBGCTRL;
+    __I uint32_t TC_SYNCBUSY;
+    __IO uint32_t TC_COUNT, TC_CC[2], TC_CCBUF[2];
+} tc_count16_registers_t;
+
+typedef union {
+    tc_count16_registers_t COUNT16;
+} tc_registers_t;
+
+typedef struct {
+    __IO uint32_t PORT_DIR, PORT_DIRCLR, PORT_DIRSET, PORT_DIRTGL,
+            PORT_OUT, PORT_OUTCLR, PORT_OUTSET, PORT_OUTTGL, PORT_IN,
+            PORT_CTRL, PORT_WRCONFIG, PORT_EVCTRL;
+    __IO uint8_t PORT_PMUX[16];
+    __IO uint8_t PORT_PINCFG[32];
+} port_group_registers_t;
+
+typedef struct {
+    port_group_registers_t GROUP[2];
+} port_registers_t;
+
+typedef struct {
+    __IO uint32_t SERCOM_CTRLA, SERCOM_CTRLB, SERCOM_CTRLC, SERCOM_BAUD,
+            SERCOM_RXPL, SERCOM_INTENCLR, SERCOM_INTENSET, SERCOM_INTFLAG,
+            SERCOM_STATUS;
+    __I uint32_t SERCOM_SYNCBUSY;
+    __IO uint32_t SERCOM_RXERRCNT, SERCOM_DATA, SERCOM_DBGCTRL;
+} sercom_usart_int_registers_t;
+
+typedef struct {
+    __IO uint32_t SERCOM_CTRLA, SERCOM_CTRLB, SERCOM_CTRLC, SERCOM_BAUD,
+            SERCOM_INTENCLR, SERCOM_INTENSET, SERCOM_INTFLAG, SERCOM_STATUS;
+    __I uint32_t SERCOM_SYNCBUSY;
+    __IO uint32_t SERCOM_ADDR, SERCOM_DATA, SERCOM_DBGCTRL;
+} sercom_spim_registers_t;
+
+typedef union {
+    sercom_usart_int_registers_t USART_INT;
+    sercom_spim_registers_t SPIM;
+} sercom_registers_t;
+
+typedef struct {
+    __IO uint32_t EIC_CTRLA, EIC_NMICTRL, EIC_NMIFLAG;
+    __I uint32_t EIC_SYNCBUSY;
+    __IO uint32_t EIC_EVCTRL, EIC_INTENCLR, EIC_INTENSET, EIC_INTFLAG,
+            EIC_ASYNCH, EIC_CONFIG0, EIC_DEBOUNCEN, EIC_DPRESCALER,
+            EIC_PINSTATE;
+} eic_registers_t;
+
+typedef struct {
+    __IO uint32_t EVSYS_CTRLA, EVSYS_SWEVT, EVSYS_PRICTRL, EVSYS_INTPEND,
+            EVSYS_INTSTATUS, EVSYS_BUSYCH, EVSYS_READYUSR;
+} evsys_registers_t;
+
+typedef struct {
+    __IO uint32_t DMAC_CTRL, DMAC_BASEADDR, DMAC_WRBADDR, DMAC_CHID,
+            DMAC_CHCTRLA, DMAC_CHCTRLB, DMAC_CHINTENCLR, DMAC_CHINTENSET,
+            DMAC_CHINTFLAG, DMAC_CHSTATUS;
+} dmac_registers_t;
+
+typedef struct {
+    __IO uint16_t DMAC_BTCTRL;
+    __IO uint16_t DMAC_BTCNT;
+    __IO uint32_t DMAC_SRCADDR;
+    __IO uint32_t DMAC_DSTADDR;
+    __IO uint32_t DMAC_DESCADDR;
+} dmac_descriptor_registers_t;
+
+typedef struct {
+    __IO uint32_t CTRL, LOAD, VAL;
+    __I uint32_t CALIB;
+} SysTick_Type;
+
+/////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Peripheral instances; see host.c
+ *
+ * All of them share one page-aligned area, padded to whole pages, so that a
+ * test can trace every access to them (see host_trace_start()).
+ */
+#define HOST_PAGE	4096
+
+typedef struct {
+    oscctrl_registers_t oscctrl;
+    osc32kctrl_registers_t osc32kctrl;
+    pm_registers_t pm;
+    supc_registers_t supc;
+    nvmctrl_registers_t nvmctrl;
+    gclk_registers_t gclk;
+    mclk_registers_t mclk;
+    tc_registers_t tc[3];
+    port_registers_t port;
+    port_registers_t port_iobus;
+    sercom_registers_t sercom[4];
+    dmac_registers_t dmac;
+    eic_registers_t eic;
+    evsys_registers_t evsys;
+    SysTick_Type systick;
+} host_periph_t;
+
+typedef union {
+    host_periph_t p;
+    uint8_t page[(sizeof (host_periph_t) + HOST_PAGE - 1) / HOST_PAGE * HOST_PAGE];
+} __attribute__((aligned(HOST_PAGE))) host_regs_t;
+
+extern host_regs_t host_regs;
+
+#define OSCCTRL_REGS		(&host_regs.p.oscctrl)
+#define OSC32KCTRL_REGS		(&host_regs.p.osc32kctrl)
+#define PM_REGS			(&host_regs.p.pm)
+#define SUPC_REGS		(&host_regs.p.supc)
+#define NVMCTRL_SEC_REGS	(&host_regs.p.nvmctrl)
+#define GCLK_REGS		(&host_regs.p.gclk)
+#define MCLK_REGS		(&host_regs.p.mclk)
+#define TC0_REGS		(&host_regs.p.tc[0])
+#define TC1_REGS		(&host_regs.p.tc[1])
+#define TC2_REGS		(&host_regs.p.tc[2])
+#define PORT_SEC_REGS		(&host_regs.p.port)
+#define PORT_IOBUS_SEC_REGS	(&host_regs.p.port_iobus)
+#define SERCOM0_REGS		(&host_regs.p.sercom[0])
+#define SERCOM2_REGS		(&host_regs.p.sercom[2])
+#define SERCOM3_REGS		(&host_regs.p.sercom[3])
+#define DMAC_SEC_REGS		(&host_regs.p.dmac)
+#define EIC_SEC_REGS		(&host_regs.p.eic)
+#define EVSYS_SEC_REGS		(&host_regs.p.evsys)
+#define SysTick			(&host_regs.p.systick)
+
+#define MCLK_APBCMASK_SERCOM0_Msk	(1u << 1)
+#define MCLK_APBCMASK_SERCOM2_Msk	(1u << 3)
+#define MCLK_APBCMASK_SERCOM3_Msk	(1u << 4)
+#define MCLK_APBCMASK_TC0_Msk		(1u << 7)
+#define MCLK_APBCMASK_TC1_Msk		(1u << 8)
+#define MCLK_APBCMASK_TC2_Msk		(1u << 9)
+
+#define SERCOM0_GCLK_ID_CORE	17
+#define SERCOM2_GCLK_ID_CORE	19
+#define SERCOM3_GCLK_ID_CORE	20
+#define TC0_GCLK_ID		23
+#define TC1_GCLK_ID		23
+#define TC2_GCLK_ID		24
+
+#define SERCOM0_DMAC_ID_TX	5
+#define SERCOM2_DMAC_ID_TX	9
+#define SERCOM3_DMAC_ID_TX	11
+
+#define MUX_PA04D_SERCOM0_PAD0	3u
+#define MUX_PA05D_SERCOM0_PAD1	3u
+#define MUX_PA12C_SERCOM2_PAD0	2u
+#define PIN_PB11D_SERCOM3_PAD3	43u
+#define MUX_PB11D_SERCOM3_PAD3	3u
+
+// Memory map; nothing here is dereferenced on the host
+#define FLASH_ADDR		0x00000000u
+#define FLASH_SIZE		0x00080000u
+#define DATAFLASH_ADDR		0x00400000u
+#define DATAFLASH_SIZE		0x00004000u
+#define HSRAM_ADDR		0x20000000u
+#define HSRAM_SIZE		0x00010000u
+
+/////////////////////////////////////////////////////////////////////////////
+
+// Core
+
+typedef enum {
+    SysTick_IRQn = -1,
+    EIC_EXTINT_2_IRQn = 14,
+    TC0_IRQn = 43,
+    TC1_IRQn = 44,
+    TC2_IRQn = 45,
+    SERCOM3_0_IRQn = 52,
+    SERCOM3_1_IRQn = 53,
+    SERCOM3_2_IRQn = 54,
+    SERCOM3_OTHER_IRQn = 55,
+} IRQn_Type;
+
+#define __NVIC_PRIO_BITS	2
+
+/*
+ * NVIC and PRIMASK operations since host_reset() are logged in order (see
+ * host.c), so that a test can check what was configured before interrupts
+ * were let in.
+ */
+#define HOST_NVIC_IRQ_OFF	1	// __disable_irq()
+#define HOST_NVIC_IRQ_ON	2	// __enable_irq()
+#define HOST_NVIC_PRIO		3	// NVIC_SetPriority()
+#define HOST_NVIC_ENABLE	4	// NVIC_EnableIRQ()
+#define HOST_NVIC_DISABLE	5	// NVIC_DisableIRQ()
+#define HOST_NVIC_DMB		6	// __DMB()
+
+typedef struct {
+    int op;
+    int irqn;
+    uint32_t prio;
+} host_nvic_op_t;
+
+#define HOST_NVIC_LOG_MAX	64
+extern host_nvic_op_t host_nvic_log[HOST_NVIC_LOG_MAX];
+extern unsigned int host_nvic_nr;
+void host_nvic(int op, int irqn, uint32_t prio);
+
+static inline void NVIC_SetPriority(IRQn_Type irqn, uint32_t prio) {
+    host_nvic(HOST_NVIC_PRIO, irqn, prio);
+}
+static inline void NVIC_EnableIRQ(IRQn_Type irqn) {
+    host_nvic(HOST_NVIC_ENABLE, irqn, 0);
+}
+static inline void NVIC_DisableIRQ(IRQn_Type irqn) {
+    host_nvic(HOST_NVIC_DISABLE, irqn, 0);
+}
+static inline void __disable_irq(void) {
+    host_nvic(HOST_NVIC_IRQ_OFF, 0, 0);
+}
+static inline void __enable_irq(void) {
+    host_nvic(HOST_NVIC_IRQ_ON, 0, 0);
+}
+static inline void __DMB(void) {
+    host_nvic(HOST_NVIC_DMB, 0, 0);
+}
+
+/*
+ * Every busy-wait in the drivers spins on asm("nop"); on the host, each
+ * spin calls host_poll(), through which a test lets "hardware" progress
+ * (e.g. SYNCBUSY clearing). A wait that never ends aborts the test.
+ */
+void host_poll(void);
+#define asm(x)	host_poll()
+
+/// Called from host_poll(); NULL if nothing changes while spinning
+extern void (*host_poll_hook)(void);
+
+/// Store into a read-only register, as the hardware would
+#define HOST_SET(reg, val)	(*(volatile uint32_t *) &(reg) = (val))
+
+/*
+ * Register access trace
+ *
+ * Between host_trace_start() and host_trace_stop(), every load and store
+ * that touches the register area is logged in order, and so is every spin
+ * of a busy-wait. The poll hook runs untraced. Only supported on x86-64
+ * Linux, where accesses are caught by protecting the area and stepping
+ * over each faulting instruction; host_trace_start() fails elsewhere.
+ *
+ * An instruction that touches the area more than once (e.g. memcpy) is
+ * logged once, at the first address it touched.
+ */
+#define HOST_TRACE_R	1	// Load
+#define HOST_TRACE_W	2	// Store, or read-modify-write in one instruction
+#define HOST_TRACE_SPIN	3	// host_poll()
+
+typedef struct {
+    int op;
+    uint32_t off;	// Offset of the access into host_regs
+    uint32_t old;	// Four bytes at off, before the access ...
+    uint32_t val;	// ... and after
+} host_trace_t;
+
+#define HOST_TRACE_MAX	4096
+extern host_trace_t host_trace_log[HOST_TRACE_MAX];
+extern unsigned int host_trace_nr;
+
+/// Clear the log and start tracing; zero if tracing is unsupported
+int host_trace_start(void);
+void host_trace_stop(void);
+
+#endif // HOST_XC_H
@@ -0,0 +1,297 @@
+#!/usr/bin/env python3
+"""
+Capture sampled board memory into memory-mapped, column-oriented files
+
+    capture.py record /dev/ttyACM0 run1 0x20000100:4 ticks:4 --seconds 60
+    capture.py record /dev/ttyACM0 run1 ticks:4 --raw run1.raw --map app.map
+    capture.py replay run1.raw run2 0x20000100:4 ticks:4
+    capture.py bench run1.raw 0x20000100:4 ticks:4 --repeat 20
+    capture.py dump run1 --from 1.5 --to 2.0
+
+"record" polls the memory-access service (see memsvc.h and memclient.py)
+for the given address:length items and appends one row per sample. With
+--raw, each response frame is also logged as received, prefixed by its
+host timestamp; "replay" decodes such a log into a new capture, and
+"bench" does so repeatedly at full speed, reporting the decode/append rate
+against the link rate.
+
+On-disk layout, one directory per capture:
+
+    meta.json       column names and widths, number of rows
+    t.col           u64 host timestamp (ns since the start of the capture)
+    c<N>.col        raw little-endian bytes of item N, fixed width per row
+    index.bin       (t:u64, row:u64) every INDEX_EVERY rows, for seeking
+
+Column files are grown in large steps and written through mmap, so that a
+row costs a few slice stores; they are trimmed to size on close.
+
+Requires pyserial (record only).
+"""
+
+import argparse
+import bisect
+import json
+import mmap
+import os
+import struct
+import sys
+import tempfile
+import time
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+
+BAUD = 57600                # PLATFORM_USART_CDC_BAUD
+CHAR_BITS = 11              # PLATFORM_USART_CDC_CHAR_BITS
+RSP_SYNC = 0x10             # MEMSVC_RSP_SYNC
+
+GROW_ROWS = 1 << 16         # Rows added to a column file at a time
+INDEX_EVERY = 1024          # Rows per index entry
+RAW_HDR = struct.Struct('<QBH')     # t_ns, sync, length
+
+
+class Column:
+    def __init__(self, path, width, rows=0):
+        self.width = width
+        self.f = open(path, 'r+b' if os.path.exists(path) else 'w+b')
+        self.cap = 0
+        self.mm = None
+        self._grow(max(rows, 1))
+
+    def _grow(self, rows):
+        cap = ((rows + GROW_ROWS - 1) // GROW_ROWS) * GROW_ROWS
+        if self.mm is not None:
+            self.mm.close()
+        self.f.truncate(cap * self.width)
+        self.mm = mmap.mmap(self.f.fileno(), cap * self.width)
+        self.cap = cap
+
+    def put(self, row, data):
+        if row >= self.cap:
+            self._grow(row + 1)
+        o = row * self.width
+        self.mm[o:o + self.width] = data
+
+    def close(self, rows):
+        self.mm.flush()
+        self.mm.close()
+        self.f.truncate(rows * self.width)
+        self.f.close()
+
+
+class Store:
+    """Append-only columnar capture directory."""
+
+    def __init__(self, path, widths):
+        os.makedirs(path, exist_ok=True)
+        self.path = path
+        self.widths = widths
+        self.rows = 0
+        self.t = Column(os.path.join(path, 't.col'), 8)
+        self.cols = [Column(os.path.join(path, 'c%d.col' % n), w) for n, w in enumerate(widths)]
+        self.index = open(os.path.join(path, 'index.bin'), 'wb')
+
+    def append(self, t_ns, values):
+        row = self.rows
+        if row % INDEX_EVERY == 0:
+            self.index.write(struct.pack('<QQ', t_ns, row))
+        self.t.put(row, struct.pack('<Q', t_ns))
+        for c, v in zip(self.cols, values):
+            c.put(row, v)
+        self.rows = row + 1
+
+    def close(self):
+        self.t.close(self.rows)
+        for c in self.cols:
+            c.close(self.rows)
+        self.index.close()
+        with open(os.path.join(self.path, 'meta.json'), 'w') as f:
+            json.dump({'widths': self.widths, 'rows': self.rows,
+                       'index_every': INDEX_EVERY}, f)
+
+
+class Reader:
+    def __init__(self, path):
+        with open(os.path.join(path, 'meta.json')) as f:
+            self.meta = json.load(f)
+        self.rows = self.meta['rows']
+        self.maps = []
+        for name, w in [('t', 8)] + [('c%d' % n, w) for n, w in enumerate(self.meta['widths'])]:
+            with open(os.path.join(path, name + '.col'), 'rb') as f:
+                mm = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ) if self.rows else b''
+            self.maps.append((mm, w))
+        with open(os.path.join(path, 'index.bin'), 'rb') as f:
+            raw = f.read()
+        self.index = [struct.unpack_from('<QQ', raw, o) for o in range(0, len(raw), 16)]
+
+    def t(self, row):
+        return struct.unpack_from('<Q', self.maps[0][0], row * 8)[0]
+
+    def seek(self, t_ns):
+        """First row with a timestamp >= t_ns."""
+        i = bisect.bisect_right([e[0] for e in self.index], t_ns) - 1
+        lo = self.index[i][1] if i >= 0 else 0
+        hi = min(self.rows, lo + self.meta['index_every'] + 1) if i >= 0 else self.rows
+        while lo < hi:
+            mid = (lo + hi) // 2
+            if self.t(mid) < t_ns:
+                lo = mid + 1
+            else:
+                hi = mid
+        return lo
+
+    def row(self, n):
+        out = []
+        for mm, w in self.maps[1:]:
+            out.append(int.from_bytes(mm[n * w:(n + 1) * w], 'little'))
+        return self.t(n), out
+
+
+class Decoder:
+    """Split a raw log into memsvc response frames and sample values."""
+
+    def __init__(self, widths):
+        self.widths = widths
+
+    def frames(self, buf):
+        o, n = 0, len(buf)
+        while o + RAW_HDR.size <= n:
+            t_ns, sync, ln = RAW_HDR.unpack_from(buf, o)
+            o += RAW_HDR.size
+            if sync != RSP_SYNC or o + ln > n:
+                break
+            yield t_ns, buf[o:o + ln]
+            o += ln
+
+    def values(self, payload):
+        """payload: seq, then (status, data) per item; None if malformed."""
+        out, i = [], 1
+        for w in self.widths:
+            if i >= len(payload) or payload[i] != 0:
+                return None
+            out.append(payload[i + 1:i + 1 + w])
+            i += 1 + w
+        return out
+
+
+def parse_items(specs, syms):
+    items = []
+    for it in specs:
+        name, _, n = it.partition(':')
+        items.append((syms[name] if name in syms else int(name, 0), int(n or '4', 0)))
+    return items
+
+
+def replay(raw, path, widths):
+    dec, store, bad = Decoder(widths), Store(path, widths), 0
+    for t_ns, payload in dec.frames(raw):
+        vals = dec.values(payload)
+        if vals is None:
+            bad += 1
+            continue
+        store.append(t_ns, vals)
+    store.close()
+    return store.rows, bad
+
+
+def cmd_record(a, items):
+    from memclient import Session
+    widths = [n for _, n in items]
+    ops = [('R', addr, n) for addr, n in items]
+    store = Store(a.out, widths)
+    raw = open(a.raw, 'wb') if a.raw else None
+    s = Session(a.port, a.timeout)
+    n, t0 = 0, time.monotonic_ns()
+    try:
+        while time.monotonic_ns() - t0 < a.seconds * 1e9:
+            vals = s.batch(ops)
+            t_ns = time.monotonic_ns() - t0
+            store.append(t_ns, vals)
+            if raw:
+                raw.write(RAW_HDR.pack(t_ns, RSP_SYNC, len(s.last)) + s.last)
+            n += 1
+    finally:
+        s.close()
+        store.close()
+        if raw:
+            raw.close()
+    el = (time.monotonic_ns() - t0) / 1e9
+    print('%d rows in %.2f s: %.1f rows/s' % (n, el, n / el), file=sys.stderr)
+
+
+def cmd_bench(a, widths):
+    with open(a.raw, 'rb') as f:
+        raw = f.read()
+    link = BAUD / CHAR_BITS
+    with tempfile.TemporaryDirectory() as tmp:
+        best = None
+        for r in range(a.repeat):
+            t0 = time.perf_counter()
+            rows, _ = replay(raw, os.path.join(tmp, str(r)), widths)
+            el = time.perf_counter() - t0
+            best = el if best is None else min(best, el)
+    print('%d frames, %d bytes; best of %d: %.3f s' % (rows, len(raw), a.repeat, best))
+    print('%.0f frames/s, %.2f MB/s (%.0fx the %d-bps link)' % (
+        rows / best, len(raw) / best / 1e6, len(raw) / best / link, BAUD))
+
+
+def cmd_dump(a):
+    r = Reader(a.out)
+    start = r.seek(int(a.t_from * 1e9)) if a.t_from is not None else 0
+    end = r.seek(int(a.t_to * 1e9)) if a.t_to is not None else r.rows
+    for n in range(start, end):
+        t_ns, vals = r.row(n)
+        print('%.6f,%s' % (t_ns / 1e9, ','.join('0x%X' % v for v in vals)))
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__,
+                                 formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = ap.add_subparsers(dest='cmd', required=True)
+
+    p = sub.add_parser('record')
+    p.add_argument('port')
+    p.add_argument('out')
+    p.add_argument('items', nargs='+')
+    p.add_argument('--raw', help='also log the response frames here')
+    p.add_argument('--map', help='linker map file, for symbol names')
+    p.add_argument('--seconds', type=float, default=10.0)
+    p.add_argument('--timeout', type=float, default=0.5)
+
+    p = sub.add_parser('replay')
+    p.add_argument('raw')
+    p.add_argument('out')
+    p.add_argument('items', nargs='+')
+    p.add_argument('--map')
+
+    p = sub.add_parser('bench')
+    p.add_argument('raw')
+    p.add_argument('items', nargs='+')
+    p.add_argument('--map')
+    p.add_argument('--repeat', type=int, default=5)
+
+    p = sub.add_parser('dump')
+    p.add_argument('out')
+    p.add_argument('--from', dest='t_from', type=float, help='seconds')
+    p.add_argument('--to', dest='t_to', type=float, help='seconds')
+
+    a = ap.parse_args()
+    if a.cmd == 'dump':
+        cmd_dump(a)
+        return
+
+    syms = {}
+    if a.map:
+        from memclient import load_map
+        syms = load_map(a.map)
+    items = parse_items(a.items, syms)
+    if a.cmd == 'record':
+        cmd_record(a, items)
+    elif a.cmd == 'replay':
+        rows, bad = replay(open(a.raw, 'rb').read(), a.out, [n for _, n in items])
+        print('%d rows, %d malformed frames' % (rows, bad), file=sys.stderr)
+    else:
+        cmd_bench(a, [n for _, n in items])
+
+
+if __name__ == '__main__':
+    main()
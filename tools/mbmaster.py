@@ -0,0 +1,111 @@
+#!/usr/bin/env python3
+"""
+Minimal Modbus RTU master, for exercising the board's Modbus slave
+
+Build the firmware with PROG_MODBUS_ADDR set (e.g. -DPROG_MODBUS_ADDR=1),
+then:
+
+    mbmaster.py /dev/ttyACM0 read-holding 0 1
+    mbmaster.py /dev/ttyACM0 write-holding 0 3
+    mbmaster.py /dev/ttyACM0 read-input 0 6
+    mbmaster.py /dev/ttyACM0 bench --seconds 10
+
+"bench" issues back-to-back Read Input Registers requests and reports
+transactions per second and round-trip latency.
+
+Requires pyserial.
+"""
+
+import argparse
+import struct
+import sys
+import time
+
+import serial
+
+BAUD = 57600        # PLATFORM_USART_CDC_BAUD
+T35 = 0.00175       # t3.5 above 19200 bps
+
+
+def crc16(data):
+    crc = 0xFFFF
+    for b in data:
+        crc ^= b
+        for _ in range(8):
+            crc = (crc >> 1) ^ 0xA001 if crc & 1 else crc >> 1
+    return crc
+
+
+def frame(addr, pdu):
+    adu = bytes([addr]) + pdu
+    return adu + struct.pack('<H', crc16(adu))
+
+
+class Master:
+    def __init__(self, port, addr, timeout):
+        self.ser = serial.Serial(port, BAUD, parity=serial.PARITY_EVEN,
+                                 stopbits=serial.STOPBITS_ONE, timeout=timeout)
+        self.addr = addr
+
+    def transact(self, pdu, rsp_len):
+        """Send a request; return the response PDU. rsp_len excludes address and CRC."""
+        self.ser.reset_input_buffer()
+        self.ser.write(frame(self.addr, pdu))
+        hdr = self.ser.read(2)
+        if len(hdr) < 2:
+            raise TimeoutError('no response')
+        if hdr[1] & 0x80:
+            rest = self.ser.read(3)
+            raise RuntimeError('exception 0x%02X' % rest[0])
+        rest = self.ser.read(rsp_len - 1 + 2)
+        adu = hdr + rest
+        if len(adu) != rsp_len + 3 or crc16(adu[:-2]) != struct.unpack('<H', adu[-2:])[0]:
+            raise RuntimeError('bad response: %s' % adu.hex())
+        time.sleep(T35)
+        return adu[1:-2]
+
+    def read_regs(self, fn, start, qty):
+        rsp = self.transact(struct.pack('>BHH', fn, start, qty), 2 + 2 * qty)
+        return list(struct.unpack('>%dH' % qty, rsp[2:]))
+
+    def write_reg(self, start, val):
+        self.transact(struct.pack('>BHH', 0x06, start, val), 5)
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__,
+                                 formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument('port')
+    ap.add_argument('cmd', choices=['read-holding', 'read-input', 'write-holding', 'bench'])
+    ap.add_argument('args', nargs='*', type=lambda v: int(v, 0))
+    ap.add_argument('--addr', type=int, default=1)
+    ap.add_argument('--timeout', type=float, default=0.1)
+    ap.add_argument('--seconds', type=float, default=5.0)
+    a = ap.parse_args()
+
+    m = Master(a.port, a.addr, a.timeout)
+    if a.cmd == 'read-holding':
+        print(m.read_regs(0x03, *a.args))
+    elif a.cmd == 'read-input':
+        print(m.read_regs(0x04, *a.args))
+    elif a.cmd == 'write-holding':
+        m.write_reg(*a.args)
+    else:
+        n, errors, worst = 0, 0, 0.0
+        t_end = time.monotonic() + a.seconds
+        t_start = time.monotonic()
+        while time.monotonic() < t_end:
+            t0 = time.monotonic()
+            try:
+                m.read_regs(0x04, 0, 6)
+                n += 1
+            except (TimeoutError, RuntimeError):
+                errors += 1
+            worst = max(worst, time.monotonic() - t0)
+        elapsed = time.monotonic() - t_start
+        print('%d transactions, %d errors, %.1f/s, worst round trip %.2f ms'
+              % (n, errors, n / elapsed, worst * 1000), file=sys.stderr)
+
+
+if __name__ == '__main__':
+    main()
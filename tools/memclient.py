@@ -0,0 +1,139 @@
+#!/usr/bin/env python3
+"""
+Host client for the board's memory/register access service (see memsvc.h)
+
+    memclient.py /dev/ttyACM0 read 0x20000100 16
+    memclient.py /dev/ttyACM0 write 0x20000100 01020304
+    memclient.py /dev/ttyACM0 sample 0x20000100:4 0x20000200:2 --rate 200
+
+"sample" reads all the given address:length pairs in one batched request
+per sample, and prints them as CSV (time, then one hex column per item);
+the achieved sample rate is reported at the end. Symbol names may be used
+instead of addresses if --map points to the linker map file.
+
+Requires pyserial.
+"""
+
+import argparse
+import re
+import struct
+import sys
+import time
+
+import serial
+
+BAUD = 57600        # PLATFORM_USART_CDC_BAUD
+CTRL_P = 0x10       # Starts a session on the board
+RSP_SYNC = 0x10     # MEMSVC_RSP_SYNC
+
+
+class Session:
+    def __init__(self, port, timeout):
+        self.ser = serial.Serial(port, BAUD, parity=serial.PARITY_EVEN,
+                                 stopbits=serial.STOPBITS_ONE, timeout=timeout)
+        self.seq = 0
+        self.last = b''     # Payload of the latest response frame, as received
+        self.ser.reset_input_buffer()
+        self.ser.write(bytes([CTRL_P]))
+        self._response()    # Empty acknowledgement
+
+    def close(self):
+        self.ser.write(struct.pack('<H', 0))
+        self.ser.close()
+
+    def _response(self):
+        # Skip anything the console was still sending.
+        while True:
+            b = self.ser.read(1)
+            if not b:
+                raise TimeoutError('no response')
+            if b[0] == RSP_SYNC:
+                break
+        n = struct.unpack('<H', self.ser.read(2))[0]
+        payload = self.ser.read(n)
+        if len(payload) != n:
+            raise TimeoutError('short response')
+        self.last = payload
+        return payload
+
+    def batch(self, ops):
+        """ops: list of ('R', addr, len) or ('W', addr, data); returns list of results."""
+        self.seq = (self.seq + 1) & 0xFF
+        req = bytes([self.seq])
+        for op in ops:
+            if op[0] == 'R':
+                req += struct.pack('<cIH', b'R', op[1], op[2])
+            else:
+                req += struct.pack('<cIH', b'W', op[1], len(op[2])) + op[2]
+        self.ser.write(struct.pack('<H', len(req)) + req)
+
+        rsp = self._response()
+        if not rsp or rsp[0] != self.seq:
+            raise RuntimeError('sequence mismatch')
+        out, i = [], 1
+        for op in ops:
+            st = rsp[i]
+            i += 1
+            if st != 0:
+                raise RuntimeError('operation at 0x%08X failed with status %d' % (op[1], st))
+            if op[0] == 'R':
+                out.append(rsp[i:i + op[2]])
+                i += op[2]
+            else:
+                out.append(None)
+        return out
+
+
+def load_map(path):
+    syms = {}
+    with open(path) as f:
+        for line in f:
+            m = re.match(r'^\s+0x([0-9a-fA-F]+)\s+([A-Za-z_]\w*)\s*$', line)
+            if m:
+                syms[m.group(2)] = int(m.group(1), 16)
+    return syms
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__,
+                                 formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument('port')
+    ap.add_argument('cmd', choices=['read', 'write', 'sample'])
+    ap.add_argument('args', nargs='+')
+    ap.add_argument('--map', help='linker map file, for symbol names')
+    ap.add_argument('--rate', type=float, default=0, help='samples/s; 0 = as fast as possible')
+    ap.add_argument('--seconds', type=float, default=5.0)
+    ap.add_argument('--timeout', type=float, default=0.5)
+    a = ap.parse_args()
+
+    syms = load_map(a.map) if a.map else {}
+    addr = lambda v: syms[v] if v in syms else int(v, 0)
+
+    s = Session(a.port, a.timeout)
+    try:
+        if a.cmd == 'read':
+            print(s.batch([('R', addr(a.args[0]), int(a.args[1], 0))])[0].hex())
+        elif a.cmd == 'write':
+            s.batch([('W', addr(a.args[0]), bytes.fromhex(a.args[1]))])
+        else:
+            items = []
+            for it in a.args:
+                name, _, n = it.partition(':')
+                items.append(('R', addr(name), int(n or '4', 0)))
+            n, t0 = 0, time.monotonic()
+            t_end = t0 + a.seconds
+            while time.monotonic() < t_end:
+                vals = s.batch(items)
+                print('%.6f,%s' % (time.monotonic() - t0, ','.join(v.hex() for v in vals)))
+                n += 1
+                if a.rate:
+                    time.sleep(max(0.0, t0 + n / a.rate - time.monotonic()))
+            elapsed = time.monotonic() - t0
+            print('%d samples in %.2f s: %.1f samples/s' % (n, elapsed, n / elapsed),
+                  file=sys.stderr)
+    finally:
+        s.close()
+
+
+if __name__ == '__main__':
+    main()
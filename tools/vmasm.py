@@ -0,0 +1,138 @@
+#!/usr/bin/env python3
+"""
+Assembler for the behaviour bytecode interpreter (see vm.h)
+
+Source syntax, one instruction per line:
+
+    ; comment
+    label:
+        push 3          ; push8 or push16 is picked from the value
+        blink
+        jmp label
+
+Values may be decimal, 0x-hex, 'c' character literals, or labels.
+
+Usage:
+    vmasm.py prog.s -o prog.bin            # raw program image
+    vmasm.py prog.s -o prog.up --frame     # length + image, for uploading
+
+To upload, press Ctrl-U in the terminal, wait for "Program: [Waiting]",
+then send the framed file as-is (e.g. as a raw file transfer).
+"""
+
+import argparse
+import re
+import struct
+import sys
+
+# Must match the VM_OP_* values in vm.h: name -> (opcode, operand bytes)
+OPS = {
+    'nop': (0x00, 0), 'halt': (0x01, 0), 'yield': (0x02, 0),
+    'push8': (0x03, 1), 'push16': (0x04, 2),
+    'dup': (0x05, 0), 'drop': (0x06, 0), 'swap': (0x07, 0),
+    'load': (0x08, 1), 'store': (0x09, 1),
+    'add': (0x10, 0), 'sub': (0x11, 0), 'mul': (0x12, 0),
+    'and': (0x13, 0), 'or': (0x14, 0), 'xor': (0x15, 0), 'not': (0x16, 0),
+    'shl': (0x17, 0), 'shr': (0x18, 0),
+    'eq': (0x19, 0), 'lt': (0x1A, 0), 'gt': (0x1B, 0),
+    'jmp': (0x20, 2), 'jz': (0x21, 2), 'jnz': (0x22, 2),
+    'blink': (0x30, 0), 'getblink': (0x31, 0), 'tick': (0x32, 0),
+    'pb': (0x33, 0), 'key': (0x34, 0), 'putc': (0x35, 0),
+}
+
+HDR_SIZE = 8
+PROG_MAX = 512
+
+
+def parse_value(tok, labels):
+    if len(tok) == 3 and tok[0] == tok[2] == "'":
+        return ord(tok[1])
+    if tok in labels:
+        return labels[tok]
+    return int(tok, 0)
+
+
+# Character literals first, so that ';', ':' and ' ' can be quoted
+TOKEN = re.compile(r"\s*(?:('.')|(;)|(:)|([^\s;:']+)|(\S))")
+
+
+def tokenize(line, nr):
+    """Split a line into (labels, words), dropping any comment"""
+    labels, words = [], []
+    for m in TOKEN.finditer(line.rstrip()):
+        lit, semi, colon, word, bad = m.groups()
+        if semi:
+            break
+        if bad:
+            raise SyntaxError('line %d: stray %r' % (nr, bad))
+        if colon:
+            if len(words) != 1 or words[0].startswith("'"):
+                raise SyntaxError('line %d: misplaced label' % nr)
+            labels.append(words.pop())
+            continue
+        words.append(lit or word)
+    return labels, words
+
+
+def assemble(lines):
+    # Pass 1: sizes and labels
+    stmts, labels, pc = [], {}, 0
+    for nr, line in enumerate(lines, 1):
+        names, parts = tokenize(line, nr)
+        for name in names:
+            labels[name] = pc
+        if not parts:
+            continue
+        op = parts[0].lower()
+        if op == 'push':
+            try:
+                v = parse_value(parts[1], {})
+                op = 'push8' if -128 <= v <= 127 else 'push16'
+            except ValueError:
+                op = 'push16'   # Label; resolved in pass 2
+        if op not in OPS:
+            raise SyntaxError('line %d: unknown instruction %r' % (nr, parts[0]))
+        if len(parts) - 1 != (1 if OPS[op][1] else 0):
+            raise SyntaxError('line %d: wrong number of operands' % nr)
+        stmts.append((nr, op, parts[1:]))
+        pc += 1 + OPS[op][1]
+
+    # Pass 2: encoding
+    code = bytearray()
+    for nr, op, args in stmts:
+        opcode, width = OPS[op]
+        code.append(opcode)
+        if width:
+            v = parse_value(args[0], labels)
+            code += struct.pack('<b' if op == 'push8' else '<B' if width == 1 else '<H',
+                                v if op == 'push8' else v & (0xFF if width == 1 else 0xFFFF))
+    return bytes(code)
+
+
+def image(code):
+    img = struct.pack('<2sBBHH', b'BV', 1, 0, len(code), sum(code) & 0xFFFF) + code
+    if len(img) > PROG_MAX:
+        raise ValueError('program too large: %d > %d bytes' % (len(img), PROG_MAX))
+    return img
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__,
+                                 formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument('src')
+    ap.add_argument('-o', '--output', required=True)
+    ap.add_argument('--frame', action='store_true',
+                    help='prepend the 2-byte upload length prefix')
+    args = ap.parse_args()
+
+    with open(args.src) as f:
+        img = image(assemble(f.readlines()))
+    if args.frame:
+        img = struct.pack('<H', len(img)) + img
+    with open(args.output, 'wb') as f:
+        f.write(img)
+    print('%s: %d bytes' % (args.output, len(img)), file=sys.stderr)
+
+
+if __name__ == '__main__':
+    main()
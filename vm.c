@@ -0,0 +1,332 @@
+/**
+ * @file vm.c
+ * @brief Behaviour bytecode interpreter
+ *
+ * The interpreter is deterministic: given the same program and the same
+ * sequence of events, it executes the same instructions. It never runs more
+ * than the given budget per call, so a misbehaving program cannot stall the
+ * main loop; it can only fault or halt.
+ */
+
+// Common include for the XC32 compiler
+#include <xc.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "vm.h"
+#include "platform.h"
+
+/////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Program images are kept at the start of the Data Flash, which can be
+ * written while code keeps executing from the main array.
+ */
+#if !defined(VM_FLASH_ADDR)
+#define VM_FLASH_ADDR	0x00400000UL
+#endif
+
+/// Data Flash row (erase unit) and page (write unit) sizes, in bytes
+#define VM_FLASH_ROW	256
+#define VM_FLASH_PAGE	64
+
+/// NVMCTRL commands, with the CMDEX key
+#define VM_NVM_CMD_ER	(0xA500 | 0x02)	// Erase row
+#define VM_NVM_CMD_WP	(0xA500 | 0x04)	// Write page
+
+static uint16_t vm_rd16(const uint8_t *p) {
+    return (uint16_t) p[0] | ((uint16_t) p[1] << 8);
+}
+
+// Sum of all code bytes, used to reject corrupted images
+
+static uint16_t vm_checksum(const uint8_t *code, uint16_t len) {
+    uint16_t sum = 0;
+
+    while (len-- > 0)
+        sum += *(code++);
+    return sum;
+}
+
+// Validate an image; return the code length, or zero if invalid
+
+static uint16_t vm_check(const uint8_t *img, uint16_t len) {
+    uint16_t code_len;
+
+    if (!img || len < VM_HDR_SIZE || len > VM_PROG_MAX)
+        return 0;
+    if (img[0] != 'B' || img[1] != 'V' || img[2] != 1)
+        return 0;
+
+    code_len = vm_rd16(&img[4]);
+    if (code_len == 0 || code_len > (len - VM_HDR_SIZE))
+        return 0;
+    if (vm_checksum(&img[VM_HDR_SIZE], code_len) != vm_rd16(&img[6]))
+        return 0;
+    return code_len;
+}
+
+bool vm_load(vm_t *vm, const uint8_t *img, uint16_t len) {
+    uint16_t code_len = vm_check(img, len);
+
+    if (code_len == 0)
+        return false;
+
+    vm->code = &img[VM_HDR_SIZE];
+    vm->len = code_len;
+    vm->pc = 0;
+    vm->sp = 0;
+    memset(vm->vars, 0, sizeof (vm->vars));
+    vm->pb_events = 0;
+    vm->key = -1;
+    vm->nr_out = 0;
+    vm->state = VM_STATE_RUN;
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+// Execution
+
+unsigned int vm_run(vm_t *vm, unsigned int budget) {
+    unsigned int n = 0;
+    platform_timespec_t t;
+    uint16_t pc, tgt;
+    int16_t a, b;
+    uint8_t op;
+
+    /*
+     * Operand checks; the instruction's width and stack effects are
+     * verified before anything is modified, so a fault leaves the state
+     * as it was just before the faulting instruction.
+     */
+#define NEED_BYTES(k)	do { if ((uint16_t) (pc + 1 + (k)) > vm->len) goto fault; } while (0)
+#define NEED_POP(k)	do { if (vm->sp < (k)) goto fault; } while (0)
+#define NEED_PUSH(k)	do { if (vm->sp + (k) > VM_STACK_DEPTH) goto fault; } while (0)
+#define POP()		(vm->stack[--vm->sp])
+#define PUSH(v)		(vm->stack[vm->sp++] = (int16_t) (v))
+
+    while (n < budget && vm->state == VM_STATE_RUN) {
+        pc = vm->pc;
+        if (pc >= vm->len)
+            goto fault;
+        op = vm->code[pc];
+
+        switch (op) {
+            case VM_OP_NOP:
+                break;
+            case VM_OP_HALT:
+                vm->state = VM_STATE_HALT;
+                break;
+            case VM_OP_YIELD:
+                vm->pc = pc + 1;
+                ++n;
+                goto done;
+
+            case VM_OP_PUSH8:
+                NEED_BYTES(1);
+                NEED_PUSH(1);
+                PUSH((int8_t) vm->code[pc + 1]);
+                vm->pc = pc + 2;
+                ++n;
+                continue;
+            case VM_OP_PUSH16:
+                NEED_BYTES(2);
+                NEED_PUSH(1);
+                PUSH(vm_rd16(&vm->code[pc + 1]));
+                vm->pc = pc + 3;
+                ++n;
+                continue;
+            case VM_OP_DUP:
+                NEED_POP(1);
+                NEED_PUSH(1);
+                a = vm->stack[vm->sp - 1];
+                PUSH(a);
+                break;
+            case VM_OP_DROP:
+                NEED_POP(1);
+                --vm->sp;
+                break;
+            case VM_OP_SWAP:
+                NEED_POP(2);
+                a = vm->stack[vm->sp - 1];
+                vm->stack[vm->sp - 1] = vm->stack[vm->sp - 2];
+                vm->stack[vm->sp - 2] = a;
+                break;
+            case VM_OP_LOAD:
+            case VM_OP_STORE:
+                NEED_BYTES(1);
+                if (vm->code[pc + 1] >= VM_NR_VARS)
+                    goto fault;
+                if (op == VM_OP_LOAD) {
+                    NEED_PUSH(1);
+                    PUSH(vm->vars[vm->code[pc + 1]]);
+                } else {
+                    NEED_POP(1);
+                    vm->vars[vm->code[pc + 1]] = POP();
+                }
+                vm->pc = pc + 2;
+                ++n;
+                continue;
+
+            case VM_OP_NOT:
+                NEED_POP(1);
+                vm->stack[vm->sp - 1] = ~vm->stack[vm->sp - 1];
+                break;
+            case VM_OP_ADD:
+            case VM_OP_SUB:
+            case VM_OP_MUL:
+            case VM_OP_AND:
+            case VM_OP_OR:
+            case VM_OP_XOR:
+            case VM_OP_SHL:
+            case VM_OP_SHR:
+            case VM_OP_EQ:
+            case VM_OP_LT:
+            case VM_OP_GT:
+                NEED_POP(2);
+                b = POP();
+                a = POP();
+                switch (op) {
+                    case VM_OP_ADD: PUSH(a + b); break;
+                    case VM_OP_SUB: PUSH(a - b); break;
+                    case VM_OP_MUL: PUSH(a * b); break;
+                    case VM_OP_AND: PUSH(a & b); break;
+                    case VM_OP_OR:  PUSH(a | b); break;
+                    case VM_OP_XOR: PUSH(a ^ b); break;
+                    case VM_OP_SHL: PUSH((uint16_t) a << (b & 0x0F)); break;
+                    case VM_OP_SHR: PUSH((uint16_t) a >> (b & 0x0F)); break;
+                    case VM_OP_EQ:  PUSH(a == b); break;
+                    case VM_OP_LT:  PUSH(a < b); break;
+                    default:        PUSH(a > b); break;
+                }
+                break;
+
+            case VM_OP_JMP:
+            case VM_OP_JZ:
+            case VM_OP_JNZ:
+                NEED_BYTES(2);
+                tgt = vm_rd16(&vm->code[pc + 1]);
+                if (tgt >= vm->len)
+                    goto fault;
+                if (op != VM_OP_JMP)
+                    NEED_POP(1);
+                vm->pc = pc + 3;
+                if (op == VM_OP_JMP) {
+                    vm->pc = tgt;
+                } else {
+                    a = POP();
+                    if ((op == VM_OP_JZ) == (a == 0))
+                        vm->pc = tgt;
+                }
+                ++n;
+                continue;
+
+            case VM_OP_BLINK:
+                NEED_POP(1);
+                a = POP();
+                if (vm->ops.set_blink)
+                    vm->ops.set_blink(vm->ops.ctx, a);
+                break;
+            case VM_OP_GETBLINK:
+                NEED_PUSH(1);
+                PUSH(vm->ops.get_blink ? vm->ops.get_blink(vm->ops.ctx) : 0);
+                break;
+            case VM_OP_TICK:
+                NEED_PUSH(1);
+                platform_tick_count(&t);
+                PUSH(((t.nr_sec * 1000) + (t.nr_nsec / 1000000)) & 0x7FFF);
+                break;
+            case VM_OP_PB:
+                NEED_PUSH(1);
+                PUSH(vm->pb_events);
+                vm->pb_events = 0;
+                break;
+            case VM_OP_KEY:
+                NEED_PUSH(1);
+                PUSH(vm->key);
+                vm->key = -1;
+                break;
+            case VM_OP_PUTC:
+                NEED_POP(1);
+                if (vm->nr_out >= VM_OUT_SIZE)
+                    // Output full; retry this instruction next time.
+                    goto done;
+                vm->out[vm->nr_out++] = (char) POP();
+                break;
+
+            default:
+                goto fault;
+        }
+
+        // Single-byte instructions
+        if (vm->state == VM_STATE_RUN)
+            vm->pc = pc + 1;
+        ++n;
+    }
+
+done:
+    vm->nr_insns += n;
+    return n;
+
+fault:
+    vm->state = VM_STATE_FAULT;
+    goto done;
+
+#undef NEED_BYTES
+#undef NEED_POP
+#undef NEED_PUSH
+#undef POP
+#undef PUSH
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+// Program storage
+
+static void vm_nvm_cmd(uint32_t addr, uint32_t cmd) {
+    NVMCTRL_SEC_REGS->NVMCTRL_ADDR = addr;
+    NVMCTRL_SEC_REGS->NVMCTRL_CTRLA = cmd;
+    while ((NVMCTRL_SEC_REGS->NVMCTRL_STATUS & (1 << 2)) == 0)
+        asm("nop");
+}
+
+bool vm_load_stored(vm_t *vm) {
+    const uint8_t *img = (const uint8_t *) VM_FLASH_ADDR;
+
+    return vm_load(vm, img, VM_PROG_MAX);
+}
+
+bool vm_store(vm_t *vm, const uint8_t *img, uint16_t len) {
+    volatile uint32_t *dst = (volatile uint32_t *) VM_FLASH_ADDR;
+    uint32_t ctrlb = NVMCTRL_SEC_REGS->NVMCTRL_CTRLB;
+    uint32_t word;
+    uint16_t x, y;
+
+    if (vm_check(img, len) == 0)
+        return false;
+
+    // Stop the old program first; it may live in the rows being erased.
+    vm->state = VM_STATE_IDLE;
+    vm->code = NULL;
+
+    for (x = 0; x < VM_PROG_MAX; x += VM_FLASH_ROW)
+        vm_nvm_cmd(VM_FLASH_ADDR + x, VM_NVM_CMD_ER);
+
+    /*
+     * Manual page writes (CTRLB.MANW), so that a partial last page is
+     * committed too. Page-buffer writes must be 32 bits wide.
+     */
+    NVMCTRL_SEC_REGS->NVMCTRL_CTRLB = ctrlb | (1 << 7);
+    for (x = 0; x < len; x += VM_FLASH_PAGE) {
+        for (y = x; y < len && y < (x + VM_FLASH_PAGE); y += 4) {
+            word = 0xFFFFFFFF;
+            memcpy(&word, &img[y], ((len - y) < 4) ? (len - y) : 4);
+            dst[y / 4] = word;
+        }
+        vm_nvm_cmd(VM_FLASH_ADDR + x, VM_NVM_CMD_WP);
+    }
+    NVMCTRL_SEC_REGS->NVMCTRL_CTRLB = ctrlb;
+
+    return vm_load_stored(vm);
+}
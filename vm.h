@@ -0,0 +1,163 @@
+/**
+ * @file  vm.h
+ * @brief Declarations for the behaviour bytecode interpreter
+ *
+ * Programs are small stack-machine images, uploaded over the USART and kept
+ * in the Data Flash, that are run a few instructions at a time from the main
+ * loop. See tools/vmasm.py for the assembler and the instruction set.
+ */
+
+#if !defined(EEE158_VM_H_)
+#define EEE158_VM_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /// Maximum program image size (header included), in bytes
+#define VM_PROG_MAX	512
+
+    /// Size of the program image header, in bytes
+#define VM_HDR_SIZE	8
+
+    /// Number of instructions executed per main-loop iteration
+#define VM_BUDGET	64
+
+    /// Depth of the operand stack
+#define VM_STACK_DEPTH	16
+
+    /// Number of variable slots
+#define VM_NR_VARS	8
+
+    /// Size of the output buffer for @c PUTC
+#define VM_OUT_SIZE	32
+
+    /**
+     * Opcodes
+     * 
+     * Operands are 16-bit signed integers. Immediates and jump targets
+     * follow the opcode, little-endian; jump targets are offsets from the
+     * start of the code (i.e. just after the header).
+     */
+#define VM_OP_NOP	0x00
+#define VM_OP_HALT	0x01	// Stop the program
+#define VM_OP_YIELD	0x02	// End this main-loop slice
+#define VM_OP_PUSH8	0x03	// imm8 (sign-extended)
+#define VM_OP_PUSH16	0x04	// imm16
+#define VM_OP_DUP	0x05
+#define VM_OP_DROP	0x06
+#define VM_OP_SWAP	0x07
+#define VM_OP_LOAD	0x08	// imm8: variable slot
+#define VM_OP_STORE	0x09	// imm8: variable slot
+#define VM_OP_ADD	0x10
+#define VM_OP_SUB	0x11
+#define VM_OP_MUL	0x12
+#define VM_OP_AND	0x13
+#define VM_OP_OR	0x14
+#define VM_OP_XOR	0x15
+#define VM_OP_NOT	0x16	// Bitwise
+#define VM_OP_SHL	0x17
+#define VM_OP_SHR	0x18	// Logical
+#define VM_OP_EQ	0x19
+#define VM_OP_LT	0x1A
+#define VM_OP_GT	0x1B
+#define VM_OP_JMP	0x20	// imm16
+#define VM_OP_JZ	0x21	// imm16; pops the condition
+#define VM_OP_JNZ	0x22	// imm16; pops the condition
+#define VM_OP_BLINK	0x30	// Pop a blink setting and apply it
+#define VM_OP_GETBLINK	0x31	// Push the current blink setting
+#define VM_OP_TICK	0x32	// Push milliseconds since reset, modulo 32768
+#define VM_OP_PB	0x33	// Push (and clear) pending PLATFORM_PB_* events
+#define VM_OP_KEY	0x34	// Push (and clear) the last key, or -1 if none
+#define VM_OP_PUTC	0x35	// Pop a character and queue it for output
+
+    /// Hooks into the application/platform
+
+    typedef struct vm_ops_type {
+        /// Opaque pointer passed to every hook
+        void *ctx;
+
+        /// Change the blink setting
+        void (*set_blink)(void *ctx, int16_t val);
+
+        /// Get the blink setting
+        int16_t (*get_blink)(void *ctx);
+    } vm_ops_t;
+
+    /// Interpreter state
+
+    typedef struct vm_type {
+        /// Code, just past the header; NULL if no program is loaded
+        const uint8_t *code;
+
+        /// Length of @c code
+        uint16_t len;
+
+        /// Program counter
+        uint16_t pc;
+
+        /// Operand stack and stack pointer (number of items)
+        int16_t stack[VM_STACK_DEPTH];
+        uint8_t sp;
+
+        /// Variable slots; cleared on load
+        int16_t vars[VM_NR_VARS];
+
+        /// Execution state
+        uint8_t state;
+#define VM_STATE_IDLE	0	// No program loaded
+#define VM_STATE_RUN	1	// Running
+#define VM_STATE_HALT	2	// Program executed HALT
+#define VM_STATE_FAULT	3	// Bad opcode, stack error, or jump out of range
+
+        /// Pending pushbutton events, for @c VM_OP_PB
+        uint16_t pb_events;
+
+        /// Last key received, for @c VM_OP_KEY; -1 if none
+        int16_t key;
+
+        /// Output queued by @c VM_OP_PUTC, drained by the application
+        char out[VM_OUT_SIZE];
+        uint8_t nr_out;
+
+        /// Total number of instructions executed
+        uint32_t nr_insns;
+
+        /// Application hooks
+        vm_ops_t ops;
+    } vm_t;
+
+    /**
+     * Check a program image and start running it
+     * 
+     * @note
+     * The image must remain valid for as long as it is loaded.
+     * 
+     * @return	@c true if the image is valid, @c false otherwise
+     */
+    bool vm_load(vm_t *vm, const uint8_t *img, uint16_t len);
+
+    /**
+     * Run up to @c budget instructions
+     * 
+     * @return	Number of instructions actually executed
+     */
+    unsigned int vm_run(vm_t *vm, unsigned int budget);
+
+    /// Load the program image stored in flash, if any
+    bool vm_load_stored(vm_t *vm);
+
+    /**
+     * Store a program image in flash and load it
+     * 
+     * @return	@c true if the image is valid and was stored
+     */
+    bool vm_store(vm_t *vm, const uint8_t *img, uint16_t len);
+
+#ifdef __cplusplus
+}
+#endif	// __cplusplus
+#endif	// !defined(EEE158_VM_H_)